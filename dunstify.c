@@ -1,3 +1,4 @@
+#include <gio/gio.h>
 #include <glib.h>
 #include <libnotify/notify.h>
 #include <locale.h>
@@ -22,6 +23,10 @@ static gboolean printid = false;
 static guint32 replace_id = 0;
 static guint32 close_id = 0;
 static gboolean block = false;
+static gchar *peer_socket = NULL;
+
+static GDBusConnection *peer = NULL;
+static guint32 peer_id = 0;
 
 static GOptionEntry entries[] =
 {
@@ -38,6 +43,7 @@ static GOptionEntry entries[] =
     { "replace",      'r', 0, G_OPTION_ARG_INT,          &replace_id,     "Set id of this notification.", "ID"},
     { "close",        'C', 0, G_OPTION_ARG_INT,          &close_id,       "Close the notification with the specified ID", "ID"},
     { "block",        'b', 0, G_OPTION_ARG_NONE,         &block,          "Block until notification is closed and print close reason", NULL},
+    { "peer",         'P', 0, G_OPTION_ARG_STRING,       &peer_socket,    "Send the notification to dunst's peer_socket instead of the session bus", "SOCKET"},
     { NULL }
 };
 
@@ -233,55 +239,247 @@ void closed(NotifyNotification *n, gpointer foo)
     die(0);
 }
 
-void add_action(NotifyNotification *n, char *str)
+/*
+ * Split an "action,label" string in place.
+ * Returns the label or NULL, if the string is malformed.
+ */
+char *split_action(char *str)
 {
-    char *action = str;
     char *label = strchr(str, ',');
 
     if (!label || *(label+1) == '\0') {
         g_printerr("Malformed action. Expected \"action,label\", got \"%s\"", str);
-        return;
+        return NULL;
     }
 
     *label = '\0';
-    label++;
+    return label + 1;
+}
 
-    notify_notification_add_action(n, action, label, actioned, NULL, NULL);
+void add_action(NotifyNotification *n, char *str)
+{
+    char *label = split_action(str);
+    if (label)
+        notify_notification_add_action(n, str, label, actioned, NULL, NULL);
 }
 
-void add_hint(NotifyNotification *n, char *str)
+/*
+ * Parse a "type:name:value" string in place.
+ * Returns the floating value of the hint and stores its name in hint_name,
+ * returns NULL if the string is malformed.
+ */
+GVariant *parse_hint(char *str, char **hint_name)
 {
     char *type = str;
     char *name = strchr(str, ':');
     if (!name || *(name+1) == '\0') {
         g_printerr("Malformed hint. Expected \"type:name:value\", got \"%s\"", str);
-        return;
+        return NULL;
     }
     *name = '\0';
     name++;
     char *value = strchr(name, ':');
     if (!value || *(value+1) == '\0') {
         g_printerr("Malformed hint. Expected \"type:name:value\", got \"%s\"", str);
-        return;
+        return NULL;
     }
     *value = '\0';
     value++;
 
+    *hint_name = name;
     if (strcmp(type, "int") == 0)
-        notify_notification_set_hint_int32(n, name, atoi(value));
+        return g_variant_new_int32(atoi(value));
     else if (strcmp(type, "double") == 0)
-        notify_notification_set_hint_double(n, name, atof(value));
+        return g_variant_new_double(atof(value));
     else if (strcmp(type, "string") == 0)
-        notify_notification_set_hint_string(n, name, value);
+        return g_variant_new_string(value);
     else if (strcmp(type, "byte") == 0) {
         gint h_byte = g_ascii_strtoull(value, NULL, 10);
-        if (h_byte < 0 || h_byte > 0xFF)
+        if (h_byte < 0 || h_byte > 0xFF) {
             g_printerr("Not a byte: \"%s\"", value);
-        else
-            notify_notification_set_hint_byte(n, name, (guchar) h_byte);
-    } else
-        g_printerr("Malformed hint. Expected a type of int, double, string or byte, got %s\n", type);
+            return NULL;
+        }
+        return g_variant_new_byte((guchar) h_byte);
+    }
+
+    g_printerr("Malformed hint. Expected a type of int, double, string or byte, got %s\n", type);
+    return NULL;
+}
+
+void add_hint(NotifyNotification *n, char *str)
+{
+    char *name;
+    GVariant *value = parse_hint(str, &name);
+    if (value)
+        notify_notification_set_hint(n, name, value);
+}
 
+/* Convert the pixbuf to the image-data hint of the notification spec */
+GVariant *pixbuf_to_variant(GdkPixbuf *pixbuf)
+{
+    GVariant *data = g_variant_new_from_data(G_VARIANT_TYPE("ay"),
+                                             gdk_pixbuf_get_pixels(pixbuf),
+                                             gdk_pixbuf_get_byte_length(pixbuf),
+                                             TRUE,
+                                             g_object_unref,
+                                             g_object_ref(pixbuf));
+
+    return g_variant_new("(iiibii@ay)",
+                         gdk_pixbuf_get_width(pixbuf),
+                         gdk_pixbuf_get_height(pixbuf),
+                         gdk_pixbuf_get_rowstride(pixbuf),
+                         gdk_pixbuf_get_has_alpha(pixbuf),
+                         gdk_pixbuf_get_bits_per_sample(pixbuf),
+                         gdk_pixbuf_get_n_channels(pixbuf),
+                         data);
+}
+
+GVariant *peer_call(const char *method, GVariant *params, const GVariantType *reply_type)
+{
+    GError *err = NULL;
+    GVariant *reply = g_dbus_connection_call_sync(peer,
+                                                  NULL,
+                                                  "/org/freedesktop/Notifications",
+                                                  "org.freedesktop.Notifications",
+                                                  method,
+                                                  params,
+                                                  reply_type,
+                                                  G_DBUS_CALL_FLAGS_NONE,
+                                                  -1,
+                                                  NULL,
+                                                  &err);
+    if (err) {
+        g_printerr("Unable to call %s on the peer socket: %s\n", method, err->message);
+        die(1);
+    }
+
+    return reply;
+}
+
+void peer_signal(GDBusConnection *connection,
+                 const gchar *sender_name,
+                 const gchar *object_path,
+                 const gchar *interface_name,
+                 const gchar *signal_name,
+                 GVariant *parameters,
+                 gpointer user_data)
+{
+    guint32 id;
+
+    if (strcmp(signal_name, "ActionInvoked") == 0) {
+        const char *action;
+        g_variant_get(parameters, "(u&s)", &id, &action);
+        if (id != peer_id)
+            return;
+
+        g_variant_unref(peer_call("CloseNotification", g_variant_new("(u)", id), NULL));
+        g_print("%s\n", action);
+        die(0);
+    } else if (strcmp(signal_name, "NotificationClosed") == 0) {
+        guint32 reason;
+        g_variant_get(parameters, "(uu)", &id, &reason);
+        if (id != peer_id)
+            return;
+
+        g_print("%d\n", reason);
+        die(0);
+    }
+}
+
+/*
+ * Talk to dunst directly through its peer socket. Behaves like the libnotify
+ * path in main(), but skips the session bus.
+ */
+void notify_peer(void)
+{
+    GError *err = NULL;
+    char *address = g_strconcat("unix:path=", peer_socket, NULL);
+
+    peer = g_dbus_connection_new_for_address_sync(address,
+                                                  G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                                  NULL, NULL, &err);
+    g_free(address);
+    if (!peer) {
+        g_printerr("Unable to connect to %s: %s\n", peer_socket, err->message);
+        die(1);
+    }
+
+    if (close_id > 0) {
+        g_variant_unref(peer_call("CloseNotification", g_variant_new("(u)", close_id), NULL));
+        die(0);
+    }
+
+    GVariantBuilder actions;
+    g_variant_builder_init(&actions, G_VARIANT_TYPE("as"));
+    if (action_strs)
+        for (int i = 0; action_strs[i]; i++) {
+            char *label = split_action(action_strs[i]);
+            if (label) {
+                g_variant_builder_add(&actions, "s", action_strs[i]);
+                g_variant_builder_add(&actions, "s", label);
+            }
+        }
+
+    // dunst only looks at the first value of a hint, so the urgency
+    // goes last to let the user's hints override it like in libnotify
+    GVariantBuilder hints;
+    g_variant_builder_init(&hints, G_VARIANT_TYPE("a{sv}"));
+    if (hint_strs)
+        for (int i = 0; hint_strs[i]; i++) {
+            char *name;
+            GVariant *value = parse_hint(hint_strs[i], &name);
+            if (value)
+                g_variant_builder_add(&hints, "{sv}", name, value);
+        }
+
+    if (raw_icon_path) {
+        GdkPixbuf *raw_icon = gdk_pixbuf_new_from_file(raw_icon_path, &err);
+        if (err) {
+            g_printerr("Unable to get raw icon: %s\n", err->message);
+            die(1);
+        }
+        g_variant_builder_add(&hints, "{sv}", "image-data", pixbuf_to_variant(raw_icon));
+        g_object_unref(raw_icon);
+    }
+    g_variant_builder_add(&hints, "{sv}", "urgency", g_variant_new_byte(urgency));
+
+    // Subscribe before sending, the signals are only dispatched once the
+    // main loop runs, so the id is known by then
+    if (block || action_strs)
+        g_dbus_connection_signal_subscribe(peer,
+                                           NULL,
+                                           "org.freedesktop.Notifications",
+                                           NULL,
+                                           "/org/freedesktop/Notifications",
+                                           NULL,
+                                           G_DBUS_SIGNAL_FLAGS_NONE,
+                                           peer_signal,
+                                           NULL,
+                                           NULL);
+
+    GVariant *reply = peer_call("Notify",
+                                g_variant_new("(susssasa{sv}i)",
+                                              appname,
+                                              replace_id,
+                                              icon ? icon : "",
+                                              summary,
+                                              body ? body : "",
+                                              &actions,
+                                              &hints,
+                                              timeout),
+                                G_VARIANT_TYPE("(u)"));
+    g_variant_get(reply, "(u)", &peer_id);
+    g_variant_unref(reply);
+
+    if (printid)
+        g_print("%d\n", peer_id);
+
+    if (block || action_strs) {
+        GMainLoop *l = g_main_loop_new(NULL, false);
+        g_main_loop_run(l);
+    }
+
+    die(0);
 }
 
 int main(int argc, char *argv[])
@@ -292,6 +490,9 @@ int main(int argc, char *argv[])
     #endif
     parse_commandline(argc, argv);
 
+    if (peer_socket)
+        notify_peer();
+
     if (!notify_init(appname)) {
         g_printerr("Unable to initialize libnotify\n");
         die(1);
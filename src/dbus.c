@@ -2,16 +2,26 @@
 #include "dbus.h"
 
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 #include <glib.h>
+#include <glib-unix.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "draw.h"
 #include "dunst.h"
+#include "hash.h"
 #include "log.h"
 #include "menu.h"
 #include "notification.h"
 #include "queues.h"
 #include "settings.h"
+#include "shm-ring.h"
+#include "stats.h"
+#include "trace.h"
 #include "utils.h"
 #include "rules.h"
 
@@ -25,10 +35,50 @@
 
 #define PROPERTIES_IFAC "org.freedesktop.DBus.Properties"
 
+/* The prefix of the client names given to connections on the peer socket */
+#define PEER_PREFIX "peer:"
+
+#define RING_SLOTS 256
+#define RING_SLOT_SIZE 1024
+#define RING_SPILL_SIZE (256 * 1024)
+#define RING_BATCH 256  /**< Messages taken out of a ring before other sources get their turn */
+
 GDBusConnection *dbus_conn;
 
 static GDBusNodeInfo *introspection_data = NULL;
 
+static GDBusServer *peer_server = NULL;
+static char *peer_path = NULL;
+static GHashTable *peers = NULL;        /**< Maps the peer names to their GDBusConnection */
+static guint peer_serial = 0;
+
+/* A change of the history, which wasn't signalled yet */
+struct history_change {
+        struct notification *n;
+        bool added;
+};
+
+static GQueue history_changes = G_QUEUE_INIT;
+static guint changes_source = 0;
+static guint signalled_lengths[3] = { 0 };   /**< displayed, history and waiting */
+
+/* A shared memory ring opened by a client */
+struct dbus_ring {
+        struct shm_ring *ring;
+        char *client;
+        guint doorbell_id;
+        guint watch_id;
+};
+
+static GSList *rings = NULL;
+
+/* The decoding of notifications off the main thread. The pool hands the
+ * decoded calls back on a stack, which is swapped atomically. */
+static GThreadPool *decode_pool = NULL;
+static gpointer finished_jobs = NULL;   /**< struct decode_job, pool -> main */
+static gint finish_scheduled = 0;
+static GHashTable *pending_jobs = NULL; /**< Maps the senders to a GQueue of their jobs, in the order of the calls */
+
 static const char *introspection_xml =
     "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
     "<node name=\""FDN_PATH"\">"
@@ -73,7 +123,13 @@ static const char *introspection_xml =
     "    </interface>"
     "    <interface name=\""DUNST_IFAC"\">"
 
+    "        <method name=\"CloseBatch\">"
+    "            <arg direction=\"in\"  name=\"ids\"             type=\"au\"/>"
+    "        </method>"
     "        <method name=\"ContextMenuCall\"       />"
+    "        <method name=\"GetStats\">"
+    "            <arg direction=\"out\" name=\"stats\"           type=\"a{sv}\"/>"
+    "        </method>"
     "        <method name=\"NotificationAction\">"
     "            <arg name=\"number\"     type=\"u\"/>"
     "        </method>"
@@ -86,19 +142,47 @@ static const char *introspection_xml =
     "            <arg direction=\"in\"  name=\"id\"              type=\"u\"/>"
     "        </method>"
     "        <method name=\"NotificationShow\"      />"
+    "        <method name=\"NotifyBatch\">"
+    "            <arg direction=\"in\"  name=\"notifications\"   type=\"a(susssasa{sv}i)\"/>"
+    "            <arg direction=\"out\" name=\"ids\"             type=\"au\"/>"
+    "        </method>"
+    "        <method name=\"OpenRing\">"
+    "            <arg direction=\"out\" name=\"ring\"            type=\"h\"/>"
+    "            <arg direction=\"out\" name=\"doorbell\"        type=\"h\"/>"
+    "        </method>"
     "        <method name=\"RuleEnable\">"
     "            <arg name=\"name\"     type=\"s\"/>"
     "            <arg name=\"state\"    type=\"i\"/>"
     "        </method>"
     "        <method name=\"Ping\"                  />"
+    "        <method name=\"TraceDump\">"
+    "            <arg direction=\"in\"  name=\"path\"            type=\"s\"/>"
+    "        </method>"
 
     "        <property name=\"paused\" type=\"b\" access=\"readwrite\">"
     "            <annotation name=\"org.freedesktop.DBus.Property.EmitsChangedSignal\" value=\"true\"/>"
     "        </property>"
 
-    "        <property name=\"displayedLength\" type=\"u\" access=\"read\" />"
-    "        <property name=\"historyLength\" type=\"u\" access=\"read\" />"
-    "        <property name=\"waitingLength\" type=\"u\" access=\"read\" />"
+    "        <property name=\"displayedLength\" type=\"u\" access=\"read\">"
+    "            <annotation name=\"org.freedesktop.DBus.Property.EmitsChangedSignal\" value=\"true\"/>"
+    "        </property>"
+    "        <property name=\"historyLength\" type=\"u\" access=\"read\">"
+    "            <annotation name=\"org.freedesktop.DBus.Property.EmitsChangedSignal\" value=\"true\"/>"
+    "        </property>"
+    "        <property name=\"waitingLength\" type=\"u\" access=\"read\">"
+    "            <annotation name=\"org.freedesktop.DBus.Property.EmitsChangedSignal\" value=\"true\"/>"
+    "        </property>"
+    "        <property name=\"insertedCount\" type=\"u\" access=\"read\" />"
+    "        <property name=\"redrawCount\" type=\"u\" access=\"read\" />"
+    "        <property name=\"droppedFrameCount\" type=\"u\" access=\"read\" />"
+    "        <property name=\"tracing\" type=\"b\" access=\"readwrite\" />"
+
+    "        <signal name=\"HistoryAdded\">"
+    "            <arg name=\"notification\" type=\"a{sv}\"/>"
+    "        </signal>"
+    "        <signal name=\"HistoryRemoved\">"
+    "            <arg name=\"id\"           type=\"u\"/>"
+    "        </signal>"
 
     "    </interface>"
     "</node>";
@@ -110,6 +194,160 @@ static const char *stack_tag_hints[] = {
         "x-dunst-stack-tag"
 };
 
+/// The hints dunst knows about
+enum hint_key {
+        HINT_URGENCY,
+        HINT_CATEGORY,
+        HINT_DESKTOP_ENTRY,
+        HINT_VALUE,
+        HINT_STACK_TAG,         /**< The first of the stack_tag_hints, in the same order */
+        HINT_STACK_TAG_LAST = HINT_STACK_TAG + G_N_ELEMENTS(stack_tag_hints) - 1,
+        HINT_TRANSIENT,
+        HINT_IMAGE_PATH,
+        HINT_IMAGE_DATA,        /**< image-data and its deprecated aliases, by priority */
+        HINT_IMAGE_DATA_LEGACY,
+        HINT_ICON_DATA,
+        HINT_FGCOLOR,
+        HINT_BGCOLOR,
+        HINT_FRCOLOR,
+        HINT_HLCOLOR,
+        HINT_COUNT,
+        HINT_IGNORED = HINT_COUNT, /**< Known, but not used by dunst */
+};
+
+struct hint_slot {
+        const char *name;
+        enum hint_key key;
+};
+
+#define HINT_HASH_SEED 0x811d388bu
+#define HINT_TABLE_BITS 6
+
+/* A perfect hash table of the known hints. Every name hashes to its own
+ * slot with hint_hash(). If a hint gets added, the seed has to be changed
+ * until that's the case again, which the tests check. */
+static const struct hint_slot hint_table[1 << HINT_TABLE_BITS] = {
+        [34] = { "urgency",                         HINT_URGENCY },
+        [63] = { "category",                        HINT_CATEGORY },
+        [21] = { "desktop-entry",                   HINT_DESKTOP_ENTRY },
+        [18] = { "value",                           HINT_VALUE },
+        [25] = { "synchronous",                     HINT_STACK_TAG },
+        [8]  = { "private-synchronous",             HINT_STACK_TAG + 1 },
+        [28] = { "x-canonical-private-synchronous", HINT_STACK_TAG + 2 },
+        [53] = { "x-dunst-stack-tag",               HINT_STACK_TAG + 3 },
+        [52] = { "transient",                       HINT_TRANSIENT },
+        [40] = { "image-path",                      HINT_IMAGE_PATH },
+        [5]  = { "image-data",                      HINT_IMAGE_DATA },
+        [14] = { "image_data",                      HINT_IMAGE_DATA_LEGACY },
+        [61] = { "icon_data",                       HINT_ICON_DATA },
+        [43] = { "fgcolor",                         HINT_FGCOLOR },
+        [27] = { "bgcolor",                         HINT_BGCOLOR },
+        [7]  = { "frcolor",                         HINT_FRCOLOR },
+        [62] = { "hlcolor",                         HINT_HLCOLOR },
+        [46] = { "action-icons",                    HINT_IGNORED },
+        [49] = { "resident",                        HINT_IGNORED },
+        [51] = { "sound-file",                      HINT_IGNORED },
+        [60] = { "sound-name",                      HINT_IGNORED },
+        [4]  = { "suppress-sound",                  HINT_IGNORED },
+        [13] = { "x",                               HINT_IGNORED },
+        [12] = { "y",                               HINT_IGNORED },
+        [36] = { "sender-pid",                      HINT_IGNORED },
+};
+
+/**
+ * The values of the known hints of a notification
+ */
+struct dbus_hints {
+        GVariant *values[HINT_COUNT];   /**< The first value given for each hint */
+};
+
+/**
+ * Hash a hint name into hint_table (FNV-1a, folded to the table size).
+ */
+static guint hint_hash(const char *name)
+{
+        guint32 hash = HINT_HASH_SEED;
+        for (const unsigned char *c = (const unsigned char *) name; *c; c++) {
+                hash ^= *c;
+                hash *= 16777619u;
+        }
+        return hash >> (32 - HINT_TABLE_BITS);
+}
+
+/**
+ * Look up a hint name in hint_table.
+ *
+ * @retval -1 if the hint is unknown
+ */
+static int hint_lookup(const char *name)
+{
+        const struct hint_slot *slot = &hint_table[hint_hash(name)];
+        if (slot->name && STR_EQ(slot->name, name))
+                return slot->key;
+        return -1;
+}
+
+/**
+ * Sort the hints of a Notify call by their key in a single pass. Like
+ * g_variant_lookup_value(), only the first value of a hint counts.
+ *
+ * @param hints The hints of type a{sv}
+ * @param out (out) The decoded hints. Free them with dbus_hints_clear().
+ */
+static void dbus_hints_decode(GVariant *hints, struct dbus_hints *out)
+{
+        memset(out, 0, sizeof(*out));
+
+        GVariantIter iter;
+        const char *name;
+        GVariant *value;
+
+        g_variant_iter_init(&iter, hints);
+        while (g_variant_iter_next(&iter, "{&sv}", &name, &value)) {
+                int key = hint_lookup(name);
+                if (key < 0)
+                        LOG_D("Ignoring unknown hint '%s'", name);
+
+                if (key < 0 || key == HINT_IGNORED || out->values[key]) {
+                        g_variant_unref(value);
+                        continue;
+                }
+
+                out->values[key] = value;
+        }
+}
+
+static void dbus_hints_clear(struct dbus_hints *hints)
+{
+        for (int i = 0; i < HINT_COUNT; i++)
+                g_clear_pointer(&hints->values[i], g_variant_unref);
+}
+
+/**
+ * Get the value of a hint, if it has the given type.
+ *
+ * @returns the value, owned by \p hints
+ * @retval NULL if the hint is missing or has another type
+ */
+static GVariant *dbus_hints_get(const struct dbus_hints *hints, enum hint_key key,
+                                const GVariantType *type)
+{
+        GVariant *value = hints->values[key];
+        return value && g_variant_is_of_type(value, type) ? value : NULL;
+}
+
+/**
+ * Get the value of a string hint.
+ *
+ * @returns a newly allocated copy of the string
+ * @retval NULL if the hint is missing or isn't a string
+ */
+static char *dbus_hints_dup_string(const struct dbus_hints *hints, enum hint_key key)
+{
+        GVariant *value = dbus_hints_get(hints, key, G_VARIANT_TYPE_STRING);
+        return value ? g_variant_dup_string(value, NULL) : NULL;
+}
+
 struct dbus_method {
   const char *method_name;
   void (*method)  (GDBusConnection *connection,
@@ -152,6 +390,8 @@ void dbus_cb_fdn_methods(GDBusConnection *connection,
                         GDBusMethodInvocation *invocation,
                         gpointer user_data)
 {
+        // Peers have no bus name, their name is passed as user_data instead
+        const gchar *client = sender ? sender : user_data;
 
         struct dbus_method *m = bsearch(method_name,
                                         methods_fdn,
@@ -160,33 +400,43 @@ void dbus_cb_fdn_methods(GDBusConnection *connection,
                                         cmp_methods);
 
         if (m) {
-                m->method(connection, sender, parameters, invocation);
+                m->method(connection, client, parameters, invocation);
         } else {
                 LOG_M("Unknown method name: '%s' (sender: '%s').",
                       method_name,
-                      sender);
+                      client);
         }
 }
 
+DBUS_METHOD(dunst_CloseBatch);
 DBUS_METHOD(dunst_ContextMenuCall);
+DBUS_METHOD(dunst_GetStats);
 DBUS_METHOD(dunst_NotificationAction);
 DBUS_METHOD(dunst_NotificationCloseAll);
 DBUS_METHOD(dunst_NotificationCloseLast);
 DBUS_METHOD(dunst_NotificationListHistory);
 DBUS_METHOD(dunst_NotificationPopHistory);
 DBUS_METHOD(dunst_NotificationShow);
+DBUS_METHOD(dunst_NotifyBatch);
+DBUS_METHOD(dunst_OpenRing);
 DBUS_METHOD(dunst_RuleEnable);
 DBUS_METHOD(dunst_Ping);
+DBUS_METHOD(dunst_TraceDump);
 static struct dbus_method methods_dunst[] = {
+        {"CloseBatch",                dbus_cb_dunst_CloseBatch},
         {"ContextMenuCall",           dbus_cb_dunst_ContextMenuCall},
+        {"GetStats",                  dbus_cb_dunst_GetStats},
         {"NotificationAction",        dbus_cb_dunst_NotificationAction},
         {"NotificationCloseAll",      dbus_cb_dunst_NotificationCloseAll},
         {"NotificationCloseLast",     dbus_cb_dunst_NotificationCloseLast},
         {"NotificationListHistory",   dbus_cb_dunst_NotificationListHistory},
         {"NotificationPopHistory",    dbus_cb_dunst_NotificationPopHistory},
         {"NotificationShow",          dbus_cb_dunst_NotificationShow},
+        {"NotifyBatch",               dbus_cb_dunst_NotifyBatch},
+        {"OpenRing",                  dbus_cb_dunst_OpenRing},
         {"Ping",                      dbus_cb_dunst_Ping},
         {"RuleEnable",                dbus_cb_dunst_RuleEnable},
+        {"TraceDump",                 dbus_cb_dunst_TraceDump},
 };
 
 void dbus_cb_dunst_methods(GDBusConnection *connection,
@@ -198,6 +448,7 @@ void dbus_cb_dunst_methods(GDBusConnection *connection,
                            GDBusMethodInvocation *invocation,
                            gpointer user_data)
 {
+        const gchar *client = sender ? sender : user_data;
 
         struct dbus_method *m = bsearch(method_name,
                                         methods_dunst,
@@ -206,11 +457,11 @@ void dbus_cb_dunst_methods(GDBusConnection *connection,
                                         cmp_methods);
 
         if (m) {
-                m->method(connection, sender, parameters, invocation);
+                m->method(connection, client, parameters, invocation);
         } else {
                 LOG_M("Unknown method name: '%s' (sender: '%s').",
                       method_name,
-                      sender);
+                      client);
         }
 }
 
@@ -226,6 +477,50 @@ static void dbus_cb_dunst_ContextMenuCall(GDBusConnection *connection,
         g_dbus_connection_flush(connection, NULL, NULL, NULL);
 }
 
+static void dbus_stats_add_bucket(guint64 upper, guint count, gpointer data)
+{
+        g_variant_builder_add(data, "(tu)", upper, count);
+}
+
+static void dbus_cb_dunst_GetStats(GDBusConnection *connection,
+                                   const gchar *sender,
+                                   GVariant *parameters,
+                                   GDBusMethodInvocation *invocation)
+{
+        LOG_D("CMD: Getting the statistics");
+
+        GVariantBuilder builder;
+        g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+
+        for (int c = 0; c < STATS_COUNTER_COUNT; c++)
+                g_variant_builder_add(&builder, "{sv}", stats_counter_name(c),
+                                      g_variant_new_uint32(stats_counter_get(c)));
+
+        for (int h = 0; h < STATS_HISTOGRAM_COUNT; h++) {
+                struct stats_summary summary;
+                stats_histogram_summary(h, &summary);
+
+                GVariantBuilder buckets;
+                g_variant_builder_init(&buckets, G_VARIANT_TYPE("a(tu)"));
+                stats_histogram_foreach(h, dbus_stats_add_bucket, &buckets);
+
+                GVariantDict dict;
+                g_variant_dict_init(&dict, NULL);
+                g_variant_dict_insert(&dict, "count", "t", summary.count);
+                g_variant_dict_insert(&dict, "p50", "t", summary.p50);
+                g_variant_dict_insert(&dict, "p90", "t", summary.p90);
+                g_variant_dict_insert(&dict, "p99", "t", summary.p99);
+                g_variant_dict_insert(&dict, "max", "t", summary.max);
+                g_variant_dict_insert_value(&dict, "buckets", g_variant_builder_end(&buckets));
+
+                g_variant_builder_add(&builder, "{sv}", stats_histogram_name(h),
+                                      g_variant_dict_end(&dict));
+        }
+
+        g_dbus_method_invocation_return_value(invocation, g_variant_new("(a{sv})", &builder));
+        g_dbus_connection_flush(connection, NULL, NULL, NULL);
+}
+
 static void dbus_cb_dunst_NotificationAction(GDBusConnection *connection,
                                              const gchar *sender,
                                              GVariant *parameters,
@@ -299,6 +594,66 @@ static void dbus_cb_dunst_NotificationShow(GDBusConnection *connection,
         g_dbus_connection_flush(connection, NULL, NULL, NULL);
 }
 
+/**
+ * Describe a notification in history.
+ *
+ * @returns a floating a{sv} as listed by NotificationListHistory
+ */
+static GVariant *dbus_history_entry(const struct notification *n)
+{
+        GVariantBuilder n_builder;
+        g_variant_builder_init(&n_builder, G_VARIANT_TYPE("a{sv}"));
+
+        char *body, *msg, *summary, *appname, *category;
+        char *default_action_name, *icon_path;
+
+        body      = (n->body      == NULL) ? "" : n->body;
+        msg       = (n->msg       == NULL) ? "" : n->msg;
+        summary   = (n->summary   == NULL) ? "" : n->summary;
+        appname   = (n->appname   == NULL) ? "" : n->appname;
+        category  = (n->category  == NULL) ? "" : n->category;
+        default_action_name= (n->default_action_name == NULL) ?
+                "" : n->default_action_name;
+        icon_path = (n->icon_path == NULL) ? "" : n->icon_path;
+
+        g_variant_builder_add(&n_builder, "{sv}", "body",
+                g_variant_new_from_bytes(G_VARIANT_TYPE("s"),
+                g_bytes_new(body, strlen(body)+1), TRUE));
+        g_variant_builder_add(&n_builder, "{sv}", "message",
+                g_variant_new_from_bytes(G_VARIANT_TYPE("s"),
+                g_bytes_new(msg, strlen(msg)+1), TRUE));
+        g_variant_builder_add(&n_builder, "{sv}", "summary",
+                g_variant_new_from_bytes(G_VARIANT_TYPE("s"),
+                g_bytes_new(summary, strlen(summary)+1), TRUE));
+        g_variant_builder_add(&n_builder, "{sv}", "appname",
+                g_variant_new_from_bytes(G_VARIANT_TYPE("s"),
+                g_bytes_new(appname, strlen(appname)+1), TRUE));
+        g_variant_builder_add(&n_builder, "{sv}", "category",
+                g_variant_new_from_bytes(G_VARIANT_TYPE("s"),
+                g_bytes_new(category, strlen(category)+1), TRUE));
+        g_variant_builder_add(&n_builder, "{sv}", "default_action_name",
+                g_variant_new_from_bytes(G_VARIANT_TYPE("s"),
+                g_bytes_new(default_action_name,
+                strlen(default_action_name)+1), TRUE));
+        g_variant_builder_add(&n_builder, "{sv}", "icon_path",
+                g_variant_new_from_bytes(G_VARIANT_TYPE("s"),
+                g_bytes_new(icon_path, strlen(icon_path)+1), TRUE));
+        g_variant_builder_add(&n_builder, "{sv}", "id",
+                g_variant_new_from_bytes(G_VARIANT_TYPE("i"),
+                g_bytes_new(&n->id, sizeof(int)), TRUE));
+        g_variant_builder_add(&n_builder, "{sv}", "timestamp",
+                g_variant_new_from_bytes(G_VARIANT_TYPE("x"),
+                g_bytes_new(&n->timestamp, sizeof(gint64)), TRUE));
+        g_variant_builder_add(&n_builder, "{sv}", "timeout",
+                g_variant_new_from_bytes(G_VARIANT_TYPE("x"),
+                g_bytes_new(&n->timeout, sizeof(gint64)), TRUE));
+        g_variant_builder_add(&n_builder, "{sv}", "progress",
+                g_variant_new_from_bytes(G_VARIANT_TYPE("i"),
+                g_bytes_new(&n->progress, sizeof(int)), TRUE));
+
+        return g_variant_builder_end(&n_builder);
+}
+
 static void dbus_cb_dunst_NotificationListHistory(GDBusConnection *connection,
                                            const gchar *sender,
                                            GVariant *parameters,
@@ -318,59 +673,7 @@ static void dbus_cb_dunst_NotificationListHistory(GDBusConnection *connection,
                 struct notification *n;
                 n = g_list_nth_data(notification_list, i-1);
 
-                GVariantBuilder n_builder;
-
-                g_variant_builder_init(&n_builder, g_variant_type_new("a{sv}"));
-
-                char *body, *msg, *summary, *appname, *category;
-                char *default_action_name, *icon_path;
-
-                body      = (n->body      == NULL) ? "" : n->body;
-                msg       = (n->msg       == NULL) ? "" : n->msg;
-                summary   = (n->summary   == NULL) ? "" : n->summary;
-                appname   = (n->appname   == NULL) ? "" : n->appname;
-                category  = (n->category  == NULL) ? "" : n->category;
-                default_action_name= (n->default_action_name == NULL) ?
-                        "" : n->default_action_name;
-                icon_path = (n->icon_path == NULL) ? "" : n->icon_path;
-
-                g_variant_builder_add(&n_builder, "{sv}", "body",
-                        g_variant_new_from_bytes(G_VARIANT_TYPE("s"),
-                        g_bytes_new(body, strlen(body)+1), TRUE));
-                g_variant_builder_add(&n_builder, "{sv}", "message",
-                        g_variant_new_from_bytes(G_VARIANT_TYPE("s"),
-                        g_bytes_new(msg, strlen(msg)+1), TRUE));
-                g_variant_builder_add(&n_builder, "{sv}", "summary",
-                        g_variant_new_from_bytes(G_VARIANT_TYPE("s"),
-                        g_bytes_new(summary, strlen(summary)+1), TRUE));
-                g_variant_builder_add(&n_builder, "{sv}", "appname",
-                        g_variant_new_from_bytes(G_VARIANT_TYPE("s"),
-                        g_bytes_new(appname, strlen(appname)+1), TRUE));
-                g_variant_builder_add(&n_builder, "{sv}", "category",
-                        g_variant_new_from_bytes(G_VARIANT_TYPE("s"),
-                        g_bytes_new(category, strlen(category)+1), TRUE));
-                g_variant_builder_add(&n_builder, "{sv}", "default_action_name",
-                        g_variant_new_from_bytes(G_VARIANT_TYPE("s"),
-                        g_bytes_new(default_action_name,
-                        strlen(default_action_name)+1), TRUE));
-                g_variant_builder_add(&n_builder, "{sv}", "icon_path",
-                        g_variant_new_from_bytes(G_VARIANT_TYPE("s"),
-                        g_bytes_new(icon_path, strlen(icon_path)+1), TRUE));
-                g_variant_builder_add(&n_builder, "{sv}", "id",
-                        g_variant_new_from_bytes(G_VARIANT_TYPE("i"),
-                        g_bytes_new(&n->id, sizeof(int)), TRUE));
-                g_variant_builder_add(&n_builder, "{sv}", "timestamp",
-                        g_variant_new_from_bytes(G_VARIANT_TYPE("x"),
-                        g_bytes_new(&n->timestamp, sizeof(gint64)), TRUE));
-                g_variant_builder_add(&n_builder, "{sv}", "timeout",
-                        g_variant_new_from_bytes(G_VARIANT_TYPE("x"),
-                        g_bytes_new(&n->timeout, sizeof(gint64)), TRUE));
-                g_variant_builder_add(&n_builder, "{sv}", "progress",
-                        g_variant_new_from_bytes(G_VARIANT_TYPE("i"),
-                        g_bytes_new(&n->progress, sizeof(int)), TRUE));
-
-                g_variant_builder_add(builder, "a{sv}", &n_builder);
-
+                g_variant_builder_add_value(builder, dbus_history_entry(n));
         }
 
         answer = g_variant_new("(aa{sv})", builder);
@@ -436,6 +739,7 @@ static void dbus_cb_dunst_RuleEnable(GDBusConnection *connection,
                 target_rule->enabled = true;
         else if (state == 2)
                 target_rule->enabled = !target_rule->enabled;
+        rules_generation++;
 
         g_dbus_method_invocation_return_value(invocation, NULL);
         g_dbus_connection_flush(connection, NULL, NULL, NULL);
@@ -452,6 +756,39 @@ static void dbus_cb_dunst_Ping(GDBusConnection *connection,
         g_dbus_connection_flush(connection, NULL, NULL, NULL);
 }
 
+static void dbus_cb_dunst_TraceDump(GDBusConnection *connection,
+                                    const gchar *sender,
+                                    GVariant *parameters,
+                                    GDBusMethodInvocation *invocation)
+{
+        const char *path = NULL;
+        g_variant_get(parameters, "(&s)", &path);
+
+        LOG_D("CMD: Dumping the trace to '%s'", path);
+
+        // The working directory of dunst is of no use to the caller
+        if (!g_path_is_absolute(path)) {
+                g_dbus_method_invocation_return_error(invocation,
+                        G_DBUS_ERROR,
+                        G_DBUS_ERROR_INVALID_ARGS,
+                        "The path \"%s\" is not absolute",
+                        path);
+                return;
+        }
+
+        if (!trace_dump(path)) {
+                g_dbus_method_invocation_return_error(invocation,
+                        G_DBUS_ERROR,
+                        G_DBUS_ERROR_FAILED,
+                        "Cannot write the trace to \"%s\"",
+                        path);
+                return;
+        }
+
+        g_dbus_method_invocation_return_value(invocation, NULL);
+        g_dbus_connection_flush(connection, NULL, NULL, NULL);
+}
+
 
 static void dbus_cb_GetCapabilities(
                 GDBusConnection *connection,
@@ -484,8 +821,142 @@ static void dbus_cb_GetCapabilities(
         g_dbus_connection_flush(connection, NULL, NULL, NULL);
 }
 
-static struct notification *dbus_message_to_notification(const gchar *sender, GVariant *parameters)
+/**
+ * Read the progress from the "value" hint.
+ *
+ * @returns the progress or -1, if there is none
+ */
+static int dbus_hints_get_progress(const struct dbus_hints *hints)
+{
+        GVariant *dict_value;
+        int progress = -1;
+
+        if ((dict_value = dbus_hints_get(hints, HINT_VALUE, G_VARIANT_TYPE_INT32)))
+                progress = g_variant_get_int32(dict_value);
+        else if ((dict_value = dbus_hints_get(hints, HINT_VALUE, G_VARIANT_TYPE_UINT32)))
+                progress = g_variant_get_uint32(dict_value);
+
+        return progress < 0 ? -1 : progress;
+}
+
+/**
+ * Check if the hints carry a raw icon. Calls with a raw icon never get
+ * updated in place: hashing the pixels again for their signature would
+ * double the work of icon_get_for_data(), which compares them by their
+ * icon_id on the full path anyway.
+ */
+static bool dbus_hints_have_raw_icon(const struct dbus_hints *hints)
 {
+        for (int i = HINT_IMAGE_DATA; i <= HINT_ICON_DATA; i++)
+                if (dbus_hints_get(hints, i, G_VARIANT_TYPE("(iiibiiay)")))
+                        return true;
+        return false;
+}
+
+/**
+ * Hash the parameters of a Notify call, leaving out everything a progress
+ * update may change: the replaces_id, the body and the "value" hint.
+ *
+ * Only calls without a raw icon get hashed, see dbus_hints_have_raw_icon().
+ *
+ * @param parameters The parameters of type (susssasa{sv}i)
+ */
+static guint64 dbus_message_signature(GVariant *parameters)
+{
+        struct hash_state state;
+        hash_init(&state, 0);
+
+        gsize n_children = g_variant_n_children(parameters);
+        for (gsize i = 0; i < n_children; i++) {
+                if (i == 1 || i == 4)
+                        continue;
+
+                GVariant *child = g_variant_get_child_value(parameters, i);
+                if (i != 6) {
+                        gsize size = g_variant_get_size(child);
+                        hash_update(&state, &size, sizeof(size));
+                        hash_update(&state, g_variant_get_data(child), size);
+                        g_variant_unref(child);
+                        continue;
+                }
+
+                GVariantIter iter;
+                GVariant *entry;
+                g_variant_iter_init(&iter, child);
+                while ((entry = g_variant_iter_next_value(&iter))) {
+                        const char *key;
+                        g_variant_get_child(entry, 0, "&s", &key);
+                        if (!STR_EQ(key, "value")) {
+                                gsize size = g_variant_get_size(entry);
+                                hash_update(&state, &size, sizeof(size));
+                                hash_update(&state, g_variant_get_data(entry), size);
+                        }
+                        g_variant_unref(entry);
+                }
+                g_variant_unref(child);
+        }
+
+        return hash_digest(&state);
+}
+
+/**
+ * Apply a Notify call, which only changes the progress or the body of the
+ * notification it replaces, without decoding the whole notification again.
+ *
+ * @returns the id of the updated notification
+ * @retval 0 if the call has to go through dbus_message_to_notification()
+ */
+static guint32 dbus_notify_update_progress(const gchar *sender, GVariant *parameters)
+{
+        if (!g_variant_is_of_type(parameters, G_VARIANT_TYPE("(susssasa{sv}i)")))
+                return 0;
+
+        guint32 id;
+        g_variant_get_child(parameters, 1, "u", &id);
+        if (id == 0)
+                return 0;
+
+        const char *body;
+        GVariant *hints;
+        struct dbus_hints decoded;
+        g_variant_get_child(parameters, 4, "&s", &body);
+        g_variant_get_child(parameters, 6, "@a{sv}", &hints);
+        dbus_hints_decode(hints, &decoded);
+        int progress = dbus_hints_get_progress(&decoded);
+        bool raw_icon = dbus_hints_have_raw_icon(&decoded);
+        dbus_hints_clear(&decoded);
+        g_variant_unref(hints);
+
+        if (raw_icon)
+                return 0;
+
+        if (!queues_notification_update_progress(id, sender,
+                                                 dbus_message_signature(parameters),
+                                                 progress, body))
+                return 0;
+
+        LOG_D("Updated progress of notification %u in place", id);
+        return id;
+}
+
+/* What decoding off the main thread needs from the main thread */
+struct dbus_decode_context {
+        const struct rule_snapshot *rules;
+        double scale;           /**< The output scale to rasterise raw icons for */
+};
+
+/**
+ * Decode the parameters of a Notify call into a new notification.
+ *
+ * @param ctx The rules and the output scale to use off the main thread.
+ *            NULL on the main thread.
+ * @retval NULL if the parameters cannot be decoded
+ */
+static struct notification *dbus_message_decode(const gchar *sender, GVariant *parameters,
+                                                const struct dbus_decode_context *ctx)
+{
+        gint64 start = g_get_monotonic_time();
+
         /* Assert that the parameters' type is actually correct. Albeit usually DBus
          * already rejects ill typed parameters, it may not be always the case. */
         GVariantType *required_type = g_variant_type_new("(susssasa{sv}i)");
@@ -527,46 +998,26 @@ static struct notification *dbus_message_to_notification(const gchar *sender, GV
                 }
         }
 
+        struct dbus_hints decoded;
         GVariant *dict_value;
         GVariant *icon_value = NULL;
 
+        dbus_hints_decode(hints, &decoded);
+
         // First process the items that can be filtered on
-        if ((dict_value = g_variant_lookup_value(hints, "urgency", G_VARIANT_TYPE_BYTE))) {
+        if ((dict_value = dbus_hints_get(&decoded, HINT_URGENCY, G_VARIANT_TYPE_BYTE)))
                 n->urgency = g_variant_get_byte(dict_value);
-                g_variant_unref(dict_value);
-        }
 
-        if ((dict_value = g_variant_lookup_value(hints, "category", G_VARIANT_TYPE_STRING))) {
-                n->category = g_variant_dup_string(dict_value, NULL);
-                g_variant_unref(dict_value);
-        }
-
-        if ((dict_value = g_variant_lookup_value(hints, "desktop-entry", G_VARIANT_TYPE_STRING))) {
-                n->desktop_entry = g_variant_dup_string(dict_value, NULL);
-                g_variant_unref(dict_value);
-        }
-
-        if ((dict_value = g_variant_lookup_value(hints, "value", G_VARIANT_TYPE_INT32))) {
-                n->progress = g_variant_get_int32(dict_value);
-                g_variant_unref(dict_value);
-        } else if ((dict_value = g_variant_lookup_value(hints, "value", G_VARIANT_TYPE_UINT32))) {
-                n->progress = g_variant_get_uint32(dict_value);
-                g_variant_unref(dict_value);
-        }
-        if (n->progress < 0)
-                n->progress = -1;
+        n->category = dbus_hints_dup_string(&decoded, HINT_CATEGORY);
+        n->desktop_entry = dbus_hints_dup_string(&decoded, HINT_DESKTOP_ENTRY);
+        n->progress = dbus_hints_get_progress(&decoded);
 
         /* Check for hints that define the stack_tag
          *
          * Only accept to first one we find.
          */
-        for (int i = 0; i < sizeof(stack_tag_hints)/sizeof(*stack_tag_hints); ++i) {
-                if ((dict_value = g_variant_lookup_value(hints, stack_tag_hints[i], G_VARIANT_TYPE_STRING))) {
-                        n->stack_tag = g_variant_dup_string(dict_value, NULL);
-                        g_variant_unref(dict_value);
-                        break;
-                }
-        }
+        for (int i = HINT_STACK_TAG; i <= HINT_STACK_TAG_LAST && !n->stack_tag; i++)
+                n->stack_tag = dbus_hints_dup_string(&decoded, i);
 
         /* Check for transient hints
          *
@@ -574,40 +1025,33 @@ static struct notification *dbus_message_to_notification(const gchar *sender, GV
          * But notify-send does not support hints of type 'boolean'.
          * So let's check for int and boolean until notify-send is fixed.
          */
-        if ((dict_value = g_variant_lookup_value(hints, "transient", G_VARIANT_TYPE_BOOLEAN))) {
+        if ((dict_value = dbus_hints_get(&decoded, HINT_TRANSIENT, G_VARIANT_TYPE_BOOLEAN)))
                 n->transient = g_variant_get_boolean(dict_value);
-                g_variant_unref(dict_value);
-        } else if ((dict_value = g_variant_lookup_value(hints, "transient", G_VARIANT_TYPE_UINT32))) {
+        else if ((dict_value = dbus_hints_get(&decoded, HINT_TRANSIENT, G_VARIANT_TYPE_UINT32)))
                 n->transient = g_variant_get_uint32(dict_value) > 0;
-                g_variant_unref(dict_value);
-        } else if ((dict_value = g_variant_lookup_value(hints, "transient", G_VARIANT_TYPE_INT32))) {
+        else if ((dict_value = dbus_hints_get(&decoded, HINT_TRANSIENT, G_VARIANT_TYPE_INT32)))
                 n->transient = g_variant_get_int32(dict_value) > 0;
-                g_variant_unref(dict_value);
-        }
 
-        if ((dict_value = g_variant_lookup_value(hints, "image-path", G_VARIANT_TYPE_STRING))) {
+        if ((dict_value = dbus_hints_get(&decoded, HINT_IMAGE_PATH, G_VARIANT_TYPE_STRING))) {
                 g_free(n->iconname);
                 n->iconname = g_variant_dup_string(dict_value, NULL);
-                g_variant_unref(dict_value);
         }
 
         // Set raw icon data only after initializing the notification, so the
         // desired icon size is known. This way the buffer can be immediately
         // rescaled. If at some point you might want to match by if a
         // notificaton has an image, this has to be reworked.
-        dict_value = g_variant_lookup_value(hints, "image-data", G_VARIANT_TYPE("(iiibiiay)"));
-        if (!dict_value)
-                dict_value = g_variant_lookup_value(hints, "image_data", G_VARIANT_TYPE("(iiibiiay)"));
-        if (!dict_value)
-                dict_value = g_variant_lookup_value(hints, "icon_data", G_VARIANT_TYPE("(iiibiiay)"));
-        if (dict_value) {
+        for (int i = HINT_IMAGE_DATA; i <= HINT_ICON_DATA && !icon_value; i++)
+                icon_value = dbus_hints_get(&decoded, i, G_VARIANT_TYPE("(iiibiiay)"));
+        if (icon_value) {
                 // Signal that the notification is still waiting for a raw
                 // icon. It cannot be set now, because min_icon_size and
                 // max_icon_size aren't known yet. It cannot be set later,
                 // because it has to be overwritten by the new_icon rule.
                 n->receiving_raw_icon = true;
-                icon_value = dict_value;
-                dict_value = NULL;
+        } else {
+                // Only these can be updated in place later on
+                n->dbus_signature = dbus_message_signature(parameters);
         }
 
         // Set the dbus timeout
@@ -617,43 +1061,296 @@ static struct notification *dbus_message_to_notification(const gchar *sender, GV
         // All attributes that have to be set before initializations are set,
         // so we can initialize the notification. This applies all rules that
         // are defined and applies the formatting to the message.
-        notification_init(n);
-
-        if (icon_value) {
-                if (n->receiving_raw_icon)
+        stats_record(STATS_DECODE, g_get_monotonic_time() - start);
+        if (ctx)
+                notification_init_detached(n, ctx->rules);
+        else
+                notification_init(n);
+
+        if (icon_value && n->receiving_raw_icon) {
+                if (ctx)
+                        notification_icon_replace_data_scaled(n, icon_value, ctx->scale);
+                else
                         notification_icon_replace_data(n, icon_value);
-                g_variant_unref(icon_value);
         }
 
         // Modify these values after the notification is initialized and all rules are applied.
-        if ((dict_value = g_variant_lookup_value(hints, "fgcolor", G_VARIANT_TYPE_STRING))) {
-                g_free(n->colors.fg);
-                n->colors.fg = g_variant_dup_string(dict_value, NULL);
-                g_variant_unref(dict_value);
+        char **colors[] = { &n->colors.fg, &n->colors.bg, &n->colors.frame, &n->colors.highlight };
+        for (int i = 0; i < G_N_ELEMENTS(colors); i++) {
+                char *color = dbus_hints_dup_string(&decoded, HINT_FGCOLOR + i);
+                if (color) {
+                        g_free(*colors[i]);
+                        *colors[i] = color;
+                }
+        }
+
+        dbus_hints_clear(&decoded);
+        g_variant_unref(hints);
+        g_variant_type_free(required_type);
+        g_free(actions); // the strv is only a shallow copy
+
+        return n;
+}
+
+static struct notification *dbus_message_to_notification(const gchar *sender, GVariant *parameters)
+{
+        return dbus_message_decode(sender, parameters, NULL);
+}
+
+/**
+ * Close the notification with the given id on behalf of a client.
+ */
+static void dbus_close_notification(guint32 id)
+{
+        if (settings.ignore_dbusclose) {
+                LOG_D("Ignoring CloseNotification message");
+                // Stay commpliant by lying to the sender,  telling him we closed the notification
+                if (id > 0) {
+                        struct notification *n = queues_get_by_id(id);
+                        if (n)
+                                signal_notification_closed(n, REASON_SIG);
+                }
+        } else {
+                queues_notification_close_id(id, REASON_SIG);
+        }
+}
+
+/* A notification of a call, which gets decoded by the decode pool */
+struct decode_item {
+        GVariant *parameters;           /**< NULL, if the notification got updated in place */
+        struct notification *n;         /**< The decoded notification, NULL if it failed */
+        guint32 id;
+};
+
+/* The calls, which are completed in order per sender */
+enum decode_call {
+        DECODE_NOTIFY,          /**< Notify, returns the id */
+        DECODE_NOTIFY_BATCH,    /**< NotifyBatch, returns an array of ids */
+        DECODE_RING,            /**< The messages of a ring aren't answered */
+        DECODE_CLOSE,           /**< CloseNotification and CloseBatch, nothing to decode */
+};
+
+/* The notifications of a call, which get decoded by the decode pool */
+struct decode_job {
+        struct decode_job *next;        /**< The next job in finished_jobs */
+        char *sender;
+        GDBusMethodInvocation *invocation;
+        enum decode_call call;
+        struct rule_snapshot *rules;
+        double scale;
+        bool done;                      /**< If it got decoded, only used on the main thread */
+        gsize count;
+        struct decode_item items[];
+};
+
+/**
+ * Insert the notifications of \p job, answer the call and free the job.
+ *
+ * @returns if there were any notifications in the job
+ */
+static bool decode_job_complete(struct decode_job *job)
+{
+        if (job->call == DECODE_CLOSE) {
+                // Every notification still gets its own NotificationClosed signal
+                for (gsize i = 0; i < job->count; i++)
+                        dbus_close_notification(job->items[i].id);
+
+                g_dbus_method_invocation_return_value(job->invocation, NULL);
+                g_dbus_connection_flush(g_dbus_method_invocation_get_connection(job->invocation),
+                                        NULL, NULL, NULL);
+
+                g_free(job->sender);
+                g_free(job);
+                return true;
         }
 
-        if ((dict_value = g_variant_lookup_value(hints, "bgcolor", G_VARIANT_TYPE_STRING))) {
-                g_free(n->colors.bg);
-                n->colors.bg = g_variant_dup_string(dict_value, NULL);
-                g_variant_unref(dict_value);
+        GPtrArray *discarded = g_ptr_array_new();
+        GVariantBuilder ids;
+        g_variant_builder_init(&ids, G_VARIANT_TYPE("au"));
+
+        // Everything gets inserted before the queues get updated and the
+        // notifications get drawn
+        for (gsize i = 0; i < job->count; i++) {
+                struct decode_item *item = &job->items[i];
+
+                if (item->n) {
+                        item->id = queues_notification_insert(item->n);
+                        if (item->id == 0)
+                                g_ptr_array_add(discarded, item->n);
+                } else if (item->parameters) {
+                        LOG_W("A notification failed to decode.");
+                }
+
+                g_variant_builder_add(&ids, "u", item->id);
+                g_clear_pointer(&item->parameters, g_variant_unref);
         }
 
-        if ((dict_value = g_variant_lookup_value(hints, "frcolor", G_VARIANT_TYPE_STRING))) {
-                g_free(n->colors.frame);
-                n->colors.frame = g_variant_dup_string(dict_value, NULL);
-                g_variant_unref(dict_value);
+        if (job->call == DECODE_NOTIFY_BATCH) {
+                g_dbus_method_invocation_return_value(job->invocation, g_variant_new("(au)", &ids));
+        } else {
+                g_variant_builder_clear(&ids);
+                if (job->call == DECODE_NOTIFY && job->items[0].id == 0 && !job->items[0].n)
+                        g_dbus_method_invocation_return_dbus_error(
+                                        job->invocation,
+                                        FDN_IFAC".Error",
+                                        "Cannot decode notification!");
+                else if (job->call == DECODE_NOTIFY)
+                        g_dbus_method_invocation_return_value(job->invocation,
+                                                              g_variant_new("(u)", job->items[0].id));
         }
 
-        if ((dict_value = g_variant_lookup_value(hints, "hlcolor", G_VARIANT_TYPE_STRING))) {
-                n->colors.highlight = g_variant_dup_string(dict_value, NULL);
-                g_variant_unref(dict_value);
+        if (job->invocation)
+                g_dbus_connection_flush(g_dbus_method_invocation_get_connection(job->invocation),
+                                        NULL, NULL, NULL);
+
+        // The messages got discarded
+        for (guint i = 0; i < discarded->len; i++) {
+                struct notification *n = g_ptr_array_index(discarded, i);
+                signal_notification_closed(n, REASON_USER);
+                notification_unref(n);
         }
+        g_ptr_array_free(discarded, TRUE);
+
+        bool any = job->count > 0;
+        if (job->rules)
+                rule_snapshot_free(job->rules);
+        g_free(job->sender);
+        g_free(job);
+        return any;
+}
 
-        g_variant_unref(hints);
-        g_variant_type_free(required_type);
-        g_free(actions); // the strv is only a shallow copy
+/**
+ * Complete the jobs handed back by the decode pool. The jobs of a sender
+ * get completed in the order of its calls, a later call may replace a
+ * notification of an earlier one by id.
+ *
+ * @returns if any notifications got inserted
+ */
+static bool decode_jobs_complete_finished(void)
+{
+        struct decode_job *job;
+        do {
+                job = g_atomic_pointer_get(&finished_jobs);
+        } while (!g_atomic_pointer_compare_and_exchange(&finished_jobs, job, NULL));
+
+        bool inserted = false;
+        for (struct decode_job *next; job; job = next) {
+                next = job->next;
+                job->done = true;
+
+                gpointer sender;
+                GQueue *pending;
+                if (!g_hash_table_lookup_extended(pending_jobs, job->sender,
+                                                  &sender, (gpointer *) &pending))
+                        continue;
+
+                while (!g_queue_is_empty(pending)
+                       && ((struct decode_job *) g_queue_peek_head(pending))->done)
+                        inserted |= decode_job_complete(g_queue_pop_head(pending));
+
+                if (g_queue_is_empty(pending))
+                        g_hash_table_remove(pending_jobs, sender);
+        }
 
-        return n;
+        return inserted;
+}
+
+static gboolean dbus_cb_decode_finished(gpointer data)
+{
+        // Clear the flag first, so a job finishing from now on schedules
+        // another callback
+        g_atomic_int_set(&finish_scheduled, 0);
+
+        if (decode_jobs_complete_finished())
+                wake_up();
+
+        return G_SOURCE_REMOVE;
+}
+
+static void decode_job_run(gpointer data, gpointer user_data)
+{
+        struct decode_job *job = data;
+        struct dbus_decode_context ctx = { job->rules, job->scale };
+
+        TRACE_BEGIN("decode_job_run");
+        for (gsize i = 0; i < job->count; i++) {
+                struct decode_item *item = &job->items[i];
+                if (item->parameters)
+                        item->n = dbus_message_decode(job->sender, item->parameters, &ctx);
+        }
+        TRACE_END("decode_job_run");
+
+        // Hand the job back to the main thread
+        do {
+                job->next = g_atomic_pointer_get(&finished_jobs);
+        } while (!g_atomic_pointer_compare_and_exchange(&finished_jobs, job->next, job));
+
+        if (g_atomic_int_compare_and_exchange(&finish_scheduled, 0, 1))
+                g_idle_add_full(G_PRIORITY_DEFAULT, dbus_cb_decode_finished, NULL, NULL);
+}
+
+/**
+ * Insert the notifications described by the parameters of Notify calls
+ * and answer the call afterwards.
+ *
+ * The notifications get decoded and initialised by the decode pool. Only
+ * inserting them and answering the call happens on the main thread.
+ *
+ * @param sender The dbus client
+ * @param parameters \p count parameters of type (susssasa{sv}i)
+ * @param invocation The call to answer, NULL for DECODE_RING
+ * @param call The kind of the call
+ */
+static void dbus_notify_dispatch(const gchar *sender, GVariant **parameters, gsize count,
+                                 GDBusMethodInvocation *invocation, enum decode_call call)
+{
+        struct decode_job *job = g_malloc0(sizeof(struct decode_job)
+                                           + count * sizeof(struct decode_item));
+        job->sender = g_strdup(sender);
+        job->invocation = invocation;
+        job->call = call;
+        job->count = count;
+
+        GQueue *pending = pending_jobs ? g_hash_table_lookup(pending_jobs, sender) : NULL;
+        bool decode = false;
+        for (gsize i = 0; i < count; i++) {
+                // Progress bars get updated a lot, skip the full decoding
+                // for them. Unless they'd overtake a call being decoded.
+                if (!pending && !decode)
+                        job->items[i].id = dbus_notify_update_progress(sender, parameters[i]);
+                if (job->items[i].id)
+                        continue;
+
+                job->items[i].parameters = g_variant_ref(parameters[i]);
+                decode = true;
+        }
+
+        if (!decode || !decode_pool) {
+                for (gsize i = 0; i < count; i++) {
+                        struct decode_item *item = &job->items[i];
+                        if (item->parameters)
+                                item->n = dbus_message_to_notification(sender, item->parameters);
+                }
+                if (decode_job_complete(job))
+                        wake_up();
+                return;
+        }
+
+        // Settings don't change after startup, but rules may get enabled or
+        // disabled meanwhile. The scale is only known on the main thread.
+        job->rules = rule_snapshot_new();
+        job->scale = draw_get_scale();
+
+        if (!pending_jobs)
+                pending_jobs = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                     g_free, (GDestroyNotify) g_queue_free);
+        if (!pending) {
+                pending = g_queue_new();
+                g_hash_table_insert(pending_jobs, g_strdup(sender), pending);
+        }
+        g_queue_push_tail(pending, job);
+
+        g_thread_pool_push(decode_pool, job, NULL);
 }
 
 static void dbus_cb_Notify(
@@ -662,29 +1359,43 @@ static void dbus_cb_Notify(
                 GVariant *parameters,
                 GDBusMethodInvocation *invocation)
 {
-        struct notification *n = dbus_message_to_notification(sender, parameters);
-        if (!n) {
-                LOG_W("A notification failed to decode.");
-                g_dbus_method_invocation_return_dbus_error(
-                                invocation,
-                                FDN_IFAC".Error",
-                                "Cannot decode notification!");
-                return;
-        }
-
-        int id = queues_notification_insert(n);
-
-        GVariant *reply = g_variant_new("(u)", id);
-        g_dbus_method_invocation_return_value(invocation, reply);
-        g_dbus_connection_flush(connection, NULL, NULL, NULL);
+        TRACE_BEGIN("dbus_cb_Notify");
+        dbus_notify_dispatch(sender, &parameters, 1, invocation, DECODE_NOTIFY);
+        TRACE_END("dbus_cb_Notify");
+}
 
-        // The message got discarded
-        if (id == 0) {
-                signal_notification_closed(n, REASON_USER);
-                notification_unref(n);
+/**
+ * Close the notifications with the given ids on behalf of \p sender and
+ * answer the call afterwards.
+ *
+ * A close mustn't overtake a Notify call of the same sender, which is still
+ * being decoded. It might replace the notification to close.
+ *
+ * @param ids The ids of the notifications to close
+ */
+static void dbus_close_dispatch(const gchar *sender, GArray *ids,
+                                GDBusMethodInvocation *invocation)
+{
+        GQueue *pending = pending_jobs ? g_hash_table_lookup(pending_jobs, sender) : NULL;
+
+        struct decode_job *job = g_malloc0(sizeof(struct decode_job)
+                                           + ids->len * sizeof(struct decode_item));
+        job->sender = g_strdup(sender);
+        job->invocation = invocation;
+        job->call = DECODE_CLOSE;
+        job->count = ids->len;
+        for (guint i = 0; i < ids->len; i++)
+                job->items[i].id = g_array_index(ids, guint32, i);
+
+        if (!pending) {
+                if (decode_job_complete(job))
+                        wake_up();
+                return;
         }
 
-        wake_up();
+        // There's nothing to decode, it's completed with the calls before
+        job->done = true;
+        g_queue_push_tail(pending, job);
 }
 
 static void dbus_cb_CloseNotification(
@@ -693,21 +1404,191 @@ static void dbus_cb_CloseNotification(
                 GVariant *parameters,
                 GDBusMethodInvocation *invocation)
 {
+        GArray *ids = g_array_sized_new(FALSE, FALSE, sizeof(guint32), 1);
         guint32 id;
         g_variant_get(parameters, "(u)", &id);
-        if (settings.ignore_dbusclose) {
-                LOG_D("Ignoring CloseNotification message");
-                // Stay commpliant by lying to the sender,  telling him we closed the notification
-                if (id > 0) {
-                        struct notification *n = queues_get_by_id(id);
-                        if (n)
-                                signal_notification_closed(n, REASON_SIG);
-                }
-        } else {
-                queues_notification_close_id(id, REASON_SIG);
+        g_array_append_val(ids, id);
+
+        dbus_close_dispatch(sender, ids, invocation);
+        g_array_free(ids, TRUE);
+}
+
+static void dbus_cb_dunst_NotifyBatch(GDBusConnection *connection,
+                                      const gchar *sender,
+                                      GVariant *parameters,
+                                      GDBusMethodInvocation *invocation)
+{
+        GVariant *notifications = g_variant_get_child_value(parameters, 0);
+        gsize count = g_variant_n_children(notifications);
+        GVariant **children = g_new(GVariant *, count);
+
+        LOG_D("CMD: Inserting %" G_GSIZE_FORMAT " notifications", count);
+
+        for (gsize i = 0; i < count; i++)
+                children[i] = g_variant_get_child_value(notifications, i);
+
+        dbus_notify_dispatch(sender, children, count, invocation, DECODE_NOTIFY_BATCH);
+
+        for (gsize i = 0; i < count; i++)
+                g_variant_unref(children[i]);
+        g_free(children);
+        g_variant_unref(notifications);
+}
+
+static void dbus_cb_dunst_CloseBatch(GDBusConnection *connection,
+                                     const gchar *sender,
+                                     GVariant *parameters,
+                                     GDBusMethodInvocation *invocation)
+{
+        GVariantIter *iter;
+        guint32 id;
+
+        g_variant_get(parameters, "(au)", &iter);
+        LOG_D("CMD: Closing %" G_GSIZE_FORMAT " notifications", g_variant_iter_n_children(iter));
+
+        GArray *ids = g_array_sized_new(FALSE, FALSE, sizeof(guint32),
+                                        g_variant_iter_n_children(iter));
+        while (g_variant_iter_next(iter, "u", &id))
+                g_array_append_val(ids, id);
+        g_variant_iter_free(iter);
+
+        dbus_close_dispatch(sender, ids, invocation);
+        g_array_free(ids, TRUE);
+}
+
+static void dbus_ring_free(struct dbus_ring *r)
+{
+        rings = g_slist_remove(rings, r);
+
+        if (r->doorbell_id)
+                g_source_remove(r->doorbell_id);
+        if (r->watch_id)
+                g_bus_unwatch_name(r->watch_id);
+
+        shm_ring_free(r->ring);
+        g_free(r->client);
+        g_free(r);
+}
+
+/**
+ * Free all rings opened by \p client.
+ */
+static void dbus_rings_drop(const char *client)
+{
+        for (GSList *iter = rings; iter;) {
+                struct dbus_ring *r = iter->data;
+                iter = iter->next;
+                if (STR_EQ(r->client, client))
+                        dbus_ring_free(r);
         }
-        wake_up();
-        g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+static void dbus_ring_collect(GVariant *message, gpointer data)
+{
+        g_ptr_array_add(data, g_variant_ref(message));
+}
+
+static gboolean dbus_cb_ring_doorbell(gint fd, GIOCondition condition, gpointer user_data)
+{
+        struct dbus_ring *r = user_data;
+        GPtrArray *messages = g_ptr_array_new_with_free_func((GDestroyNotify) g_variant_unref);
+
+        int count = shm_ring_drain(r->ring, RING_BATCH, dbus_ring_collect, messages);
+
+        if (messages->len > 0)
+                dbus_notify_dispatch(r->client, (GVariant **) messages->pdata, messages->len,
+                                     NULL, DECODE_RING);
+        g_ptr_array_free(messages, TRUE);
+
+        if (count < 0) {
+                LOG_W("Closing the ring of '%s'.", r->client);
+                // The source goes away by returning G_SOURCE_REMOVE
+                r->doorbell_id = 0;
+                dbus_ring_free(r);
+                return G_SOURCE_REMOVE;
+        }
+
+        return G_SOURCE_CONTINUE;
+}
+
+static void dbus_cb_ring_client_vanished(GDBusConnection *connection,
+                                         const gchar *name,
+                                         gpointer user_data)
+{
+        struct dbus_ring *r = user_data;
+        LOG_D("Closing the ring of '%s', it disconnected.", r->client);
+        dbus_ring_free(r);
+}
+
+static void dbus_cb_dunst_OpenRing(GDBusConnection *connection,
+                                   const gchar *sender,
+                                   GVariant *parameters,
+                                   GDBusMethodInvocation *invocation)
+{
+        if (!(g_dbus_connection_get_capabilities(connection) & G_DBUS_CAPABILITY_FLAGS_UNIX_FD_PASSING)) {
+                g_dbus_method_invocation_return_error(invocation,
+                                                      G_DBUS_ERROR,
+                                                      G_DBUS_ERROR_NOT_SUPPORTED,
+                                                      "The connection cannot pass file descriptors");
+                return;
+        }
+
+        if (settings.shm_rings <= 0) {
+                g_dbus_method_invocation_return_error(invocation,
+                                                      G_DBUS_ERROR,
+                                                      G_DBUS_ERROR_ACCESS_DENIED,
+                                                      "Rings are disabled");
+                return;
+        }
+
+        // Producers with several threads open a ring for each of them, so
+        // only the shared memory of all rings together is limited. Clients
+        // could get around a limit per client with more connections anyway.
+        if (g_slist_length(rings) >= settings.shm_rings) {
+                g_dbus_method_invocation_return_error(invocation,
+                                                      G_DBUS_ERROR,
+                                                      G_DBUS_ERROR_LIMITS_EXCEEDED,
+                                                      "Too many rings are open already");
+                return;
+        }
+
+        struct shm_ring *ring = shm_ring_new(RING_SLOTS, RING_SLOT_SIZE, RING_SPILL_SIZE);
+        if (!ring) {
+                g_dbus_method_invocation_return_error(invocation,
+                                                      G_DBUS_ERROR,
+                                                      G_DBUS_ERROR_FAILED,
+                                                      "Cannot create the ring");
+                return;
+        }
+
+        LOG_D("CMD: Opening a ring for '%s'", sender);
+
+        struct dbus_ring *r = g_malloc0(sizeof(struct dbus_ring));
+        r->ring = ring;
+        r->client = g_strdup(sender);
+        r->doorbell_id = g_unix_fd_add(shm_ring_get_doorbell(ring), G_IO_IN,
+                                       dbus_cb_ring_doorbell, r);
+        // The rings of peers are dropped together with their connection
+        if (!g_str_has_prefix(sender, PEER_PREFIX))
+                r->watch_id = g_bus_watch_name_on_connection(connection,
+                                                             sender,
+                                                             G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                             NULL,
+                                                             dbus_cb_ring_client_vanished,
+                                                             r,
+                                                             NULL);
+        rings = g_slist_prepend(rings, r);
+
+        GUnixFDList *fds = g_unix_fd_list_new();
+        gint ring_handle = g_unix_fd_list_append(fds, shm_ring_get_fd(ring), NULL);
+        gint doorbell_handle = g_unix_fd_list_append(fds, shm_ring_get_doorbell(ring), NULL);
+
+        g_dbus_method_invocation_return_value_with_unix_fd_list(invocation,
+                                                                g_variant_new("(hh)",
+                                                                              ring_handle,
+                                                                              doorbell_handle),
+                                                                fds);
+        g_object_unref(fds);
         g_dbus_connection_flush(connection, NULL, NULL, NULL);
 }
 
@@ -723,6 +1604,26 @@ static void dbus_cb_GetServerInformation(
         g_dbus_connection_flush(connection, NULL, NULL, NULL);
 }
 
+/**
+ * Look up the connection, on which the signals for the notifications of
+ * \p client have to be emitted.
+ *
+ * @param client The dbus_client of a notification
+ * @param destination Set to the destination of the signals. Connections on
+ *                    the peer socket have no bus names, so this is NULL for them.
+ * @retval NULL if \p client is a peer, which has disconnected already
+ */
+static GDBusConnection *dbus_client_connection(const char *client, const char **destination)
+{
+        if (client && g_str_has_prefix(client, PEER_PREFIX)) {
+                *destination = NULL;
+                return peers ? g_hash_table_lookup(peers, client) : NULL;
+        }
+
+        *destination = client;
+        return dbus_conn;
+}
+
 void signal_notification_closed(struct notification *n, enum reason reason)
 {
         if (!n->dbus_valid) {
@@ -735,15 +1636,23 @@ void signal_notification_closed(struct notification *n, enum reason reason)
                 reason = REASON_UNDEF;
         }
 
-        if (!dbus_conn) {
+        const char *destination;
+        GDBusConnection *connection = dbus_client_connection(n->dbus_client, &destination);
+
+        if (!connection && destination) {
                 LOG_E("Unable to close notification: No DBus connection.");
+        } else if (!connection) {
+                // The peer is gone, there is nobody left to tell
+                notification_invalidate_actions(n);
+                n->dbus_valid = false;
+                return;
         }
 
         GVariant *body = g_variant_new("(uu)", n->id, reason);
         GError *err = NULL;
 
-        g_dbus_connection_emit_signal(dbus_conn,
-                                      n->dbus_client,
+        g_dbus_connection_emit_signal(connection,
+                                      destination,
                                       FDN_PATH,
                                       FDN_IFAC,
                                       "NotificationClosed",
@@ -790,11 +1699,19 @@ void signal_action_invoked(const struct notification *n, const char *identifier)
                 return;
         }
 
+        const char *destination;
+        GDBusConnection *connection = dbus_client_connection(n->dbus_client, &destination);
+        if (!connection) {
+                LOG_W("Invoking action '%s' not supported. "
+                      "The client is gone.", identifier);
+                return;
+        }
+
         GVariant *body = g_variant_new("(us)", n->id, identifier);
         GError *err = NULL;
 
-        g_dbus_connection_emit_signal(dbus_conn,
-                                      n->dbus_client,
+        g_dbus_connection_emit_signal(connection,
+                                      destination,
                                       FDN_PATH,
                                       FDN_IFAC,
                                       "ActionInvoked",
@@ -807,6 +1724,149 @@ void signal_action_invoked(const struct notification *n, const char *identifier)
         }
 }
 
+/**
+ * Emit a signal to everybody on the bus and to all peers.
+ *
+ * @param body (transfer floating) The parameters of the signal
+ */
+static void dbus_emit_broadcast(const char *interface, const char *signal, GVariant *body)
+{
+        GError *err = NULL;
+        g_variant_ref_sink(body);
+
+        if (dbus_conn && !g_dbus_connection_emit_signal(dbus_conn, NULL, FDN_PATH,
+                                                        interface, signal, body, &err)) {
+                LOG_W("Unable to emit %s: %s", signal, err->message);
+                g_clear_error(&err);
+        }
+
+        if (peers) {
+                GHashTableIter iter;
+                gpointer connection;
+                g_hash_table_iter_init(&iter, peers);
+                while (g_hash_table_iter_next(&iter, NULL, &connection))
+                        g_dbus_connection_emit_signal(connection, NULL, FDN_PATH,
+                                                      interface, signal, body, NULL);
+        }
+
+        g_variant_unref(body);
+}
+
+static gboolean dbus_cb_signal_changes(gpointer data)
+{
+        changes_source = 0;
+
+        struct history_change *change;
+        while ((change = g_queue_pop_head(&history_changes))) {
+                if (change->added)
+                        dbus_emit_broadcast(DUNST_IFAC, "HistoryAdded",
+                                            g_variant_new("(@a{sv})", dbus_history_entry(change->n)));
+                else
+                        dbus_emit_broadcast(DUNST_IFAC, "HistoryRemoved",
+                                            g_variant_new("(u)", change->n->id));
+
+                notification_unref(change->n);
+                g_free(change);
+        }
+
+        const char *names[] = { "displayedLength", "historyLength", "waitingLength" };
+        guint lengths[] = { queues_length_displayed(), queues_length_history(), queues_length_waiting() };
+        G_STATIC_ASSERT(G_N_ELEMENTS(names) == G_N_ELEMENTS(signalled_lengths));
+
+        GVariantBuilder changed;
+        bool any = false;
+        g_variant_builder_init(&changed, G_VARIANT_TYPE("a{sv}"));
+        for (int i = 0; i < G_N_ELEMENTS(names); i++) {
+                if (lengths[i] == signalled_lengths[i])
+                        continue;
+
+                signalled_lengths[i] = lengths[i];
+                g_variant_builder_add(&changed, "{sv}", names[i], g_variant_new_uint32(lengths[i]));
+                any = true;
+        }
+
+        if (any)
+                dbus_emit_broadcast("org.freedesktop.DBus.Properties", "PropertiesChanged",
+                                    g_variant_new("(sa{sv}as)", DUNST_IFAC, &changed, NULL));
+        else
+                g_variant_builder_clear(&changed);
+
+        return G_SOURCE_REMOVE;
+}
+
+/**
+ * Signal the collected changes, once the main loop is done with everything
+ * else it has to do right now.
+ *
+ * @retval false if nobody could listen
+ */
+static bool dbus_schedule_changes(void)
+{
+        if (!dbus_conn && !peers)
+                return false;
+
+        if (!changes_source)
+                changes_source = g_idle_add(dbus_cb_signal_changes, NULL);
+        return true;
+}
+
+static void dbus_clear_changes(void)
+{
+        if (changes_source) {
+                g_source_remove(changes_source);
+                changes_source = 0;
+        }
+
+        struct history_change *change;
+        while ((change = g_queue_pop_head(&history_changes))) {
+                notification_unref(change->n);
+                g_free(change);
+        }
+}
+
+/* see dbus.h */
+void signal_history_added(struct notification *n)
+{
+        if (!dbus_schedule_changes())
+                return;
+
+        struct history_change *change = g_malloc(sizeof(struct history_change));
+        notification_ref(n);
+        change->n = n;
+        change->added = true;
+        g_queue_push_tail(&history_changes, change);
+}
+
+/* see dbus.h */
+void signal_history_removed(struct notification *n)
+{
+        if (!dbus_schedule_changes())
+                return;
+
+        // Nobody saw it in history yet, so just forget it
+        for (GList *iter = g_queue_peek_tail_link(&history_changes); iter; iter = iter->prev) {
+                struct history_change *change = iter->data;
+                if (change->n == n && change->added) {
+                        notification_unref(change->n);
+                        g_free(change);
+                        g_queue_delete_link(&history_changes, iter);
+                        return;
+                }
+        }
+
+        struct history_change *change = g_malloc(sizeof(struct history_change));
+        notification_ref(n);
+        change->n = n;
+        change->added = false;
+        g_queue_push_tail(&history_changes, change);
+}
+
+/* see dbus.h */
+void signal_queues_changed(void)
+{
+        dbus_schedule_changes();
+}
+
 GVariant *dbus_cb_dunst_Properties_Get(GDBusConnection *connection,
                                        const gchar *sender,
                                        const gchar *object_path,
@@ -828,6 +1888,14 @@ GVariant *dbus_cb_dunst_Properties_Get(GDBusConnection *connection,
         } else if (STR_EQ(property_name, "waitingLength")) {
                 unsigned int waiting =  queues_length_waiting();
                 return g_variant_new_uint32(waiting);
+        } else if (STR_EQ(property_name, "insertedCount")) {
+                return g_variant_new_uint32(stats_counter_get(STATS_INSERTED));
+        } else if (STR_EQ(property_name, "redrawCount")) {
+                return g_variant_new_uint32(stats_counter_get(STATS_REDRAWS));
+        } else if (STR_EQ(property_name, "droppedFrameCount")) {
+                return g_variant_new_uint32(stats_counter_get(STATS_DROPPED_FRAMES));
+        } else if (STR_EQ(property_name, "tracing")) {
+                return g_variant_new_boolean(trace_is_active());
         } else {
                 LOG_W("Unknown property!\n");
                 *error = g_error_new(G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY, "Unknown property");
@@ -864,6 +1932,12 @@ gboolean dbus_cb_dunst_Properties_Set(GDBusConnection *connection,
                                                             invalidated_builder),
                                               NULL);
                 return true;
+        } else if (STR_EQ(property_name, "tracing")) {
+                if (g_variant_get_boolean(value))
+                        trace_start();
+                else
+                        trace_stop();
+                return true;
         }
 
         *error = g_error_new(G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY, "Unknown property");
@@ -1052,6 +2126,187 @@ static void dbus_cb_name_lost(GDBusConnection *connection,
         exit(1);
 }
 
+static gboolean dbus_cb_peer_authorize(GDBusAuthObserver *observer,
+                                       GIOStream *stream,
+                                       GCredentials *credentials,
+                                       gpointer user_data)
+{
+        // The socket is as powerful as the session bus, so only let
+        // the processes of our own user in
+        GCredentials *own = g_credentials_new();
+        gboolean same_user = credentials && g_credentials_is_same_user(credentials, own, NULL);
+        g_object_unref(own);
+
+        if (!same_user)
+                LOG_W("Rejecting a peer of another user on '%s'.", peer_path);
+
+        return same_user;
+}
+
+static void dbus_cb_peer_closed(GDBusConnection *connection,
+                                gboolean remote_peer_vanished,
+                                GError *error,
+                                gpointer user_data)
+{
+        const char *name = user_data;
+
+        LOG_D("Peer '%s' disconnected.", name);
+        dbus_rings_drop(name);
+        if (peers)
+                g_hash_table_remove(peers, name);
+}
+
+static gboolean dbus_cb_peer_new_connection(GDBusServer *server,
+                                            GDBusConnection *connection,
+                                            gpointer user_data)
+{
+        char *name = g_strdup_printf(PEER_PREFIX "%u", ++peer_serial);
+        GError *err = NULL;
+
+        // Every registration owns a copy of the name, as messages might
+        // still get dispatched after the peer got removed
+        if (!g_dbus_connection_register_object(
+                                connection,
+                                FDN_PATH,
+                                introspection_data->interfaces[0],
+                                &interface_vtable_fdn,
+                                g_strdup(name),
+                                g_free,
+                                &err)
+            || !g_dbus_connection_register_object(
+                                connection,
+                                FDN_PATH,
+                                introspection_data->interfaces[1],
+                                &interface_vtable_dunst,
+                                g_strdup(name),
+                                g_free,
+                                &err)) {
+                LOG_W("Unable to register the interfaces for peer '%s': %s", name, err->message);
+                g_error_free(err);
+                g_free(name);
+                return FALSE;
+        }
+
+        g_signal_connect_data(connection, "closed",
+                              G_CALLBACK(dbus_cb_peer_closed),
+                              g_strdup(name), (GClosureNotify) g_free, 0);
+        g_dbus_connection_set_exit_on_close(connection, FALSE);
+
+        LOG_D("Peer '%s' connected.", name);
+        g_hash_table_insert(peers, name, g_object_ref(connection));
+        return TRUE;
+}
+
+/**
+ * Listen for peer-to-peer D-Bus connections on the unix socket at \p path.
+ *
+ * @retval true if the socket is listening
+ */
+static bool dbus_peer_start(const char *path)
+{
+        ASSERT_OR_RET(!peer_server, false);
+
+        GError *err = NULL;
+        struct stat st;
+
+        peer_path = string_to_path(g_strdup(path));
+
+        // Clean up after a previous instance, but never remove anything
+        // which isn't a socket
+        if (stat(peer_path, &st) == 0) {
+                if (!S_ISSOCK(st.st_mode)) {
+                        LOG_W("Not listening on '%s': The file exists already.", peer_path);
+                        g_clear_pointer(&peer_path, g_free);
+                        return false;
+                }
+                unlink(peer_path);
+        }
+
+        char *dir = g_path_get_dirname(peer_path);
+        g_mkdir_with_parents(dir, 0700);
+        g_free(dir);
+
+        char *address = g_strconcat("unix:path=", peer_path, NULL);
+        char *guid = g_dbus_generate_guid();
+        GDBusAuthObserver *observer = g_dbus_auth_observer_new();
+        g_signal_connect(observer, "authorize-authenticated-peer",
+                         G_CALLBACK(dbus_cb_peer_authorize), NULL);
+
+        peer_server = g_dbus_server_new_sync(address,
+                                             G_DBUS_SERVER_FLAGS_NONE,
+                                             guid,
+                                             observer,
+                                             NULL,
+                                             &err);
+        g_object_unref(observer);
+        g_free(guid);
+        g_free(address);
+
+        if (!peer_server) {
+                LOG_W("Unable to listen on '%s': %s", peer_path, err->message);
+                g_error_free(err);
+                g_clear_pointer(&peer_path, g_free);
+                return false;
+        }
+
+        peers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+        g_signal_connect(peer_server, "new-connection",
+                         G_CALLBACK(dbus_cb_peer_new_connection), NULL);
+        g_dbus_server_start(peer_server);
+
+        LOG_I("Listening for peers on '%s'.", peer_path);
+        return true;
+}
+
+/**
+ * Close all peer connections and remove the socket.
+ */
+static void dbus_peer_stop(void)
+{
+        if (!peer_server)
+                return;
+
+        g_dbus_server_stop(peer_server);
+        g_clear_object(&peer_server);
+
+        GHashTable *gone = peers;
+        peers = NULL;
+        GHashTableIter iter;
+        gpointer conn;
+        g_hash_table_iter_init(&iter, gone);
+        while (g_hash_table_iter_next(&iter, NULL, &conn))
+                g_dbus_connection_close(conn, NULL, NULL, NULL);
+        g_hash_table_unref(gone);
+
+        unlink(peer_path);
+        g_clear_pointer(&peer_path, g_free);
+}
+
+static void dbus_decode_start(void)
+{
+        GError *err = NULL;
+        decode_pool = g_thread_pool_new(decode_job_run, NULL,
+                                        g_get_num_processors(), FALSE, &err);
+        if (!decode_pool) {
+                LOG_W("Cannot start the decoder, decoding notifications on the main thread: %s",
+                      err->message);
+                g_error_free(err);
+        }
+}
+
+static void dbus_decode_stop(void)
+{
+        if (decode_pool) {
+                // The calls, which are still being decoded, get answered
+                g_thread_pool_free(decode_pool, FALSE, TRUE);
+                decode_pool = NULL;
+        }
+
+        decode_jobs_complete_finished();
+        g_clear_pointer(&pending_jobs, g_hash_table_unref);
+        g_atomic_int_set(&finish_scheduled, 0);
+}
+
 int dbus_init(void)
 {
         guint owner_id;
@@ -1068,11 +2323,21 @@ int dbus_init(void)
                                   NULL,
                                   NULL);
 
+        if (!STR_EMPTY(settings.peer_socket))
+                dbus_peer_start(settings.peer_socket);
+
+        dbus_decode_start();
+
         return owner_id;
 }
 
 void dbus_teardown(int owner_id)
 {
+        dbus_decode_stop();
+        dbus_clear_changes();
+        while (rings)
+                dbus_ring_free(rings->data);
+        dbus_peer_stop();
         g_clear_pointer(&introspection_data, g_dbus_node_info_unref);
 
         g_bus_unown_name(owner_id);
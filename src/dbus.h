@@ -21,5 +21,24 @@ void dbus_teardown(int id);
 void signal_notification_closed(struct notification *n, enum reason reason);
 void signal_action_invoked(const struct notification *n, const char *identifier);
 
+/**
+ * Signal that \p n was added to history. The signal is sent, once the main
+ * loop is idle, together with all other changes of the queues.
+ */
+void signal_history_added(struct notification *n);
+
+/**
+ * Signal that \p n was removed from history. If the addition wasn't
+ * signalled yet, neither of them will be.
+ */
+void signal_history_removed(struct notification *n);
+
+/**
+ * Emit PropertiesChanged for the lengths of the queues, which changed.
+ * Has to be called after the queues got updated. Calls in the same main
+ * loop iteration result in a single signal.
+ */
+void signal_queues_changed(void);
+
 #endif
 /* vim: set ft=c tabstop=8 shiftwidth=8 expandtab textwidth=0: */
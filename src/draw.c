@@ -1,6 +1,7 @@
 #include "draw.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <math.h>
 #include <pango/pango-attributes.h>
 #include <pango/pangocairo.h>
@@ -8,17 +9,24 @@
 #include <pango/pango-layout.h>
 #include <pango/pango-types.h>
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 #include <glib.h>
+#include <semaphore.h>
 
 #include "dunst.h"
 #include "icon.h"
+#include "icon-cache.h"
+#include "icon-disk-cache.h"
+#include "icon-index.h"
 #include "log.h"
 #include "markup.h"
 #include "notification.h"
 #include "queues.h"
 #include "output.h"
 #include "settings.h"
+#include "stats.h"
+#include "trace.h"
 #include "utils.h"
 #include "icon-lookup.h"
 
@@ -29,6 +37,63 @@ struct color {
         double a;
 };
 
+/**
+ * The layout inputs of a single notification. They get copied out of the
+ * notification on the main thread, so the render thread never has to look
+ * at the queues.
+ */
+struct draw_item {
+        int id;
+        char *text;             /**< The text_to_render of the notification */
+        bool is_xmore;
+        bool first_render;
+        gint64 arrival;         /**< The timestamp of a notification, which was never shown, 0 otherwise */
+        enum urgency urgency;
+        cairo_surface_t *icon;  /**< A reference to the notification's icon */
+        int icon_slot;          /**< The size reserved for an icon, which is still being loaded */
+        enum icon_position icon_position;
+        bool hide_text;
+        bool word_wrap;
+        PangoEllipsizeMode ellipsize;
+        PangoAlignment alignment;
+        PangoAlignment progress_bar_alignment;
+        int progress;
+        struct color fg;
+        struct color bg;
+        struct color highlight;
+        struct color frame;
+        guint dirty;            /**< The #notification_dirty parts, which changed since the last scene */
+
+        /* Output of the render thread */
+        int displayed_height;
+        int content_y;          /**< The top of the content area in the window */
+        int content_width;
+        int content_height;
+        int progress_bar_y;     /**< The top of the progress bar in the content area */
+};
+
+/**
+ * An immutable snapshot of everything needed to render a frame. A scene is
+ * created on the main thread and is owned by the render thread afterwards.
+ */
+struct scene {
+        gint ref;
+        gint serial;
+        double scale;
+        int dpi;
+        int screen_width;
+        GSList *items;          /**< The draw_items in display order */
+};
+
+/**
+ * A rendered frame, which is handed back to the main thread to present it.
+ */
+struct frame {
+        struct scene *scene;
+        cairo_surface_t *srf;
+        struct dimensions dim;
+};
+
 struct colored_layout {
         PangoLayout *l;
         struct color fg;
@@ -38,7 +103,8 @@ struct colored_layout {
         char *text;
         PangoAttrList *attr;
         cairo_surface_t *icon;
-        struct notification *n;
+        int icon_slot;          /**< The size reserved for the icon, while there's none yet */
+        struct draw_item *n;
         bool is_xmore;
 };
 
@@ -47,26 +113,48 @@ window win;
 
 PangoFontDescription *pango_fdesc;
 
+/* The handoff between the main thread and the render thread.
+ *
+ * Both directions use a single slot, which is swapped atomically. Only the
+ * most recent scene or frame is of interest, so a producer simply replaces
+ * an item the consumer didn't pick up yet and frees it. */
+static GThread *render_thread = NULL;
+static sem_t render_doorbell;
+static gint render_quit = 0;
+static gpointer pending_scene = NULL;   /**< struct scene, main -> render */
+static gpointer finished_frame = NULL;  /**< struct frame, render -> main */
+static gint present_scheduled = 0;
+static gint scene_serial = 0;
+static gint cancelled_serial = 0;
+
 #define UINT_MAX_N(bits) ((1 << bits) - 1)
 
 void load_icon_themes()
 {
-        bool loaded_theme = false;
-
+        // The themes are only loaded once the first icon is looked up.
+        // If none of them exists, the lookup falls back to hicolor.
         for (int i = 0; settings.icon_theme[i] != NULL; i++) {
                 char *theme = settings.icon_theme[i];
-                int theme_index = load_icon_theme(theme);
-                if (theme_index >= 0) {
-                        LOG_I("Adding theme %s", theme);
-                        add_default_theme(theme_index);
-                        loaded_theme = true;
-                }
-        }
-        if (!loaded_theme) {
-                int theme_index = load_icon_theme("hicolor");
-                add_default_theme(theme_index);
+                LOG_I("Adding theme %s", theme);
+                add_default_theme(register_icon_theme(theme));
         }
+        if (!settings.icon_theme[0])
+                add_default_theme(register_icon_theme("hicolor"));
+}
+
+static void render_thread_start(void);
 
+static double pinned_scale = 0;        /**< The scale the default icons are pinned for */
+static guint pin_source = 0;
+
+static gboolean pin_default_icons(gpointer data)
+{
+        // Keep the variants of other scales pinned as well, so moving
+        // between outputs doesn't decode them again
+        pinned_scale = output->get_scale();
+        icon_cache_pin_defaults(pinned_scale);
+        pin_source = 0;
+        return G_SOURCE_REMOVE;
 }
 
 void draw_setup(void)
@@ -80,6 +168,13 @@ void draw_setup(void)
 
         if (settings.enable_recursive_icon_lookup)
                 load_icon_themes();
+
+        // Looking up the default icons loads the icon themes, which
+        // shouldn't hold up the startup
+        pin_source = g_idle_add(pin_default_icons, NULL);
+        icon_cache_loader_start();
+
+        render_thread_start();
 }
 
 static struct color hex_to_color(uint32_t hexValue, int dpc)
@@ -167,10 +262,11 @@ static struct color layout_get_sepcolor(struct colored_layout *cl,
         }
 }
 
-static int get_horizontal_text_icon_padding(struct notification *n)
+static int get_horizontal_text_icon_padding(const struct draw_item *n)
 {
         bool horizontal_icon = (
-                n->icon && (n->icon_position == ICON_LEFT || n->icon_position == ICON_RIGHT)
+                (n->icon || n->icon_slot)
+                && (n->icon_position == ICON_LEFT || n->icon_position == ICON_RIGHT)
         );
         if (settings.text_icon_padding && horizontal_icon) {
                 return settings.text_icon_padding;
@@ -179,9 +275,9 @@ static int get_horizontal_text_icon_padding(struct notification *n)
         }
 }
 
-static int get_vertical_text_icon_padding(struct notification *n)
+static int get_vertical_text_icon_padding(const struct draw_item *n)
 {
-        bool vertical_icon = n->icon && (n->icon_position == ICON_TOP);
+        bool vertical_icon = (n->icon || n->icon_slot) && (n->icon_position == ICON_TOP);
         if (settings.text_icon_padding && vertical_icon) {
                 return settings.text_icon_padding;
         } else {
@@ -189,6 +285,28 @@ static int get_vertical_text_icon_padding(struct notification *n)
         }
 }
 
+/**
+ * Check if there's room for an icon in the layout. An icon, which is still
+ * being loaded, gets its room reserved, so it doesn't reflow the layout
+ * once it arrives.
+ */
+static bool layout_has_icon(const struct colored_layout *cl)
+{
+        return cl->icon || cl->icon_slot > 0;
+}
+
+/* The unscaled width of the room for the icon, see layout_has_icon() */
+static int layout_get_icon_width(const struct colored_layout *cl, double scale)
+{
+        return cl->icon ? get_icon_width(cl->icon, scale) : cl->icon_slot;
+}
+
+/* The unscaled height of the room for the icon, see layout_has_icon() */
+static int layout_get_icon_height(const struct colored_layout *cl, double scale)
+{
+        return cl->icon ? get_icon_height(cl->icon, scale) : cl->icon_slot;
+}
+
 static bool have_progress_bar(const struct colored_layout *cl)
 {
         return (cl->n->progress >= 0 && settings.progress_bar == true &&
@@ -210,9 +328,8 @@ static void get_text_size(PangoLayout *l, int *w, int *h, double scale) {
 // @param height The maximum text height in pixels.
 static void layout_setup_pango(PangoLayout *layout, int width, int height,
                 bool word_wrap, PangoEllipsizeMode ellipsize_mode,
-                PangoAlignment alignment)
+                PangoAlignment alignment, double scale)
 {
-        double scale = output->get_scale();
         pango_layout_set_wrap(layout, PANGO_WRAP_WORD_CHAR);
         pango_layout_set_width(layout, round(width * scale * PANGO_SCALE));
 
@@ -234,11 +351,11 @@ static void layout_setup_pango(PangoLayout *layout, int width, int height,
 static void layout_setup(struct colored_layout *cl, int width, int height, double scale)
 {
         int horizontal_padding = get_horizontal_text_icon_padding(cl->n);
-        int icon_width = cl->icon ? get_icon_width(cl->icon, scale) + horizontal_padding : 0;
+        int icon_width = layout_has_icon(cl) ? layout_get_icon_width(cl, scale) + horizontal_padding : 0;
         int text_width = width - 2 * settings.h_padding - (cl->n->icon_position == ICON_TOP ? 0 : icon_width);
         int progress_bar_height = have_progress_bar(cl) ? settings.progress_bar_height + settings.padding : 0;
         int max_text_height = MAX(0, settings.height - progress_bar_height - 2 * settings.padding);
-        layout_setup_pango(cl->l, text_width, max_text_height, cl->n->word_wrap, cl->n->ellipsize, cl->n->alignment);
+        layout_setup_pango(cl->l, text_width, max_text_height, cl->n->word_wrap, cl->n->ellipsize, cl->n->alignment, scale);
 }
 
 static void free_colored_layout(void *data)
@@ -250,6 +367,72 @@ static void free_colored_layout(void *data)
         g_free(cl);
 }
 
+/**
+ * Copy the layout inputs of a notification. Has to be called on the main
+ * thread.
+ */
+static struct draw_item *draw_item_new(struct notification *n)
+{
+        struct draw_item *item = g_malloc0(sizeof(struct draw_item));
+
+        item->id = n->id;
+        item->text = g_strdup(n->text_to_render);
+        item->is_xmore = false;
+        item->first_render = n->first_render;
+        item->arrival = n->first_render ? n->timestamp : 0;
+        item->urgency = n->urgency;
+        item->icon = n->icon ? cairo_surface_reference(n->icon) : NULL;
+        item->icon_slot = n->icon ? 0 : notification_icon_pending_size(n);
+        item->icon_position = n->icon_position;
+        item->hide_text = n->hide_text;
+        item->word_wrap = n->word_wrap;
+        item->ellipsize = n->ellipsize;
+        item->alignment = n->alignment;
+        item->progress_bar_alignment = n->progress_bar_alignment;
+        item->progress = n->progress;
+        item->fg = string_to_color(n->colors.fg);
+        item->bg = string_to_color(n->colors.bg);
+        item->highlight = string_to_color(n->colors.highlight);
+        item->frame = string_to_color(n->colors.frame);
+        item->dirty = n->dirty;
+        item->progress_bar_y = -1;
+
+        return item;
+}
+
+static void draw_item_free(gpointer data)
+{
+        struct draw_item *item = data;
+        if (item->icon)
+                cairo_surface_destroy(item->icon);
+        g_free(item->text);
+        g_free(item);
+}
+
+static struct scene *scene_ref(struct scene *scene)
+{
+        g_atomic_int_inc(&scene->ref);
+        return scene;
+}
+
+static void scene_unref(struct scene *scene)
+{
+        if (!scene || !g_atomic_int_dec_and_test(&scene->ref))
+                return;
+        g_slist_free_full(scene->items, draw_item_free);
+        g_free(scene);
+}
+
+static void frame_free(struct frame *frame)
+{
+        if (!frame)
+                return;
+        scene_unref(frame->scene);
+        if (frame->srf)
+                cairo_surface_destroy(frame->srf);
+        g_free(frame);
+}
+
 // calculates the minimum dimensions of the notification excluding the frame
 static struct dimensions calculate_notification_dimensions(struct colored_layout *cl, double scale)
 {
@@ -257,8 +440,8 @@ static struct dimensions calculate_notification_dimensions(struct colored_layout
         layout_setup(cl, settings.width.max, settings.height, scale);
 
         int horizontal_padding = get_horizontal_text_icon_padding(cl->n);
-        int icon_width = cl->icon? get_icon_width(cl->icon, scale) + horizontal_padding : 0;
-        int icon_height = cl->icon? get_icon_height(cl->icon, scale) : 0;
+        int icon_width = layout_has_icon(cl) ? layout_get_icon_width(cl, scale) + horizontal_padding : 0;
+        int icon_height = layout_has_icon(cl) ? layout_get_icon_height(cl, scale) : 0;
         int progress_bar_height = have_progress_bar(cl) ? settings.progress_bar_height + settings.padding : 0;
 
         int vertical_padding;
@@ -271,7 +454,7 @@ static struct dimensions calculate_notification_dimensions(struct colored_layout
                 vertical_padding = get_vertical_text_icon_padding(cl->n);
         }
 
-        if (cl->n->icon_position == ICON_TOP && cl->n->icon) {
+        if (cl->n->icon_position == ICON_TOP && layout_has_icon(cl)) {
                 dim.h = icon_height + dim.text_height + vertical_padding;
         } else {
                 dim.h = MAX(icon_height, dim.text_height);
@@ -291,28 +474,27 @@ static struct dimensions calculate_notification_dimensions(struct colored_layout
         return dim;
 }
 
-static struct dimensions calculate_dimensions(GSList *layouts)
+/**
+ * Add the dimensions of a single notification to the window dimensions.
+ */
+static void dimensions_add(struct dimensions *dim, struct dimensions n_dim)
 {
-        int layout_count = g_slist_length(layouts);
-        struct dimensions dim = { 0 };
-        double scale = output->get_scale();
-
-        dim.corner_radius = settings.corner_radius;
-
-        for (GSList *iter = layouts; iter; iter = iter->next) {
-                struct colored_layout *cl = iter->data;
-                struct dimensions n_dim = calculate_notification_dimensions(cl, scale);
-                dim.h += n_dim.h;
-                LOG_D("Notification dimensions %ix%i", n_dim.w, n_dim.h);
-                dim.w = MAX(dim.w, n_dim.w + settings.frame_width);
-        }
+        dim->h += n_dim.h;
+        LOG_D("Notification dimensions %ix%i", n_dim.w, n_dim.h);
+        dim->w = MAX(dim->w, n_dim.w + settings.frame_width);
+}
 
+/**
+ * Add the frames, separators and gaps to the summed up dimensions of
+ * all notifications.
+ */
+static struct dimensions dimensions_finish(struct dimensions dim, int layout_count, const struct scene *scene)
+{
         dim.w += 2 * settings.frame_width;
         dim.corner_radius = MIN(dim.corner_radius, dim.h/2);
 
         /* clamp max width to screen width */
-        const struct screen_info *scr = output->get_active_screen();
-        int max_width = scr->w - settings.offset.x;
+        int max_width = scene->screen_width - settings.offset.x;
         if (dim.w > max_width) {
                 dim.w = max_width;
         }
@@ -330,83 +512,106 @@ static struct dimensions calculate_dimensions(GSList *layouts)
         return dim;
 }
 
-static PangoLayout *layout_create(cairo_t *c)
+static struct dimensions calculate_dimensions(GSList *layouts, const struct scene *scene)
 {
-        const struct screen_info *screen = output->get_active_screen();
+        struct dimensions dim = { 0 };
+        double scale = scene->scale;
 
-        PangoContext *context = pango_cairo_create_context(c);
-        pango_cairo_context_set_resolution(context, screen->dpi);
+        dim.corner_radius = settings.corner_radius;
 
-        PangoLayout *layout = pango_layout_new(context);
+        for (GSList *iter = layouts; iter; iter = iter->next) {
+                struct colored_layout *cl = iter->data;
+                dimensions_add(&dim, calculate_notification_dimensions(cl, scale));
+        }
 
-        g_object_unref(context);
+        return dimensions_finish(dim, g_slist_length(layouts), scene);
+}
 
-        return layout;
+static PangoLayout *layout_create(int dpi)
+{
+        PangoContext *context = output_get_measure_context(dpi);
+
+        return pango_layout_new(context);
 }
 
-static struct colored_layout *layout_init_shared(cairo_t *c, struct notification *n)
+static struct colored_layout *layout_init_shared(struct draw_item *n, int dpi)
 {
         struct colored_layout *cl = g_malloc(sizeof(struct colored_layout));
-        cl->l = layout_create(c);
+        cl->l = layout_create(dpi);
 
-        cl->fg = string_to_color(n->colors.fg);
-        cl->bg = string_to_color(n->colors.bg);
-        cl->highlight = string_to_color(n->colors.highlight);
-        cl->frame = string_to_color(n->colors.frame);
+        cl->fg = n->fg;
+        cl->bg = n->bg;
+        cl->highlight = n->highlight;
+        cl->frame = n->frame;
         cl->is_xmore = false;
 
         cl->n = n;
         return cl;
 }
 
-static struct colored_layout *layout_derive_xmore(cairo_t *c, struct notification *n, int qlen)
+static struct colored_layout *layout_derive_xmore(struct draw_item *n, int dpi)
 {
-        struct colored_layout *cl = layout_init_shared(c, n);
-        cl->text = g_strdup_printf("(%d more)", qlen);
+        struct colored_layout *cl = layout_init_shared(n, dpi);
+        cl->text = g_strdup(n->text);
         cl->attr = NULL;
         cl->is_xmore = true;
         cl->icon = NULL;
+        cl->icon_slot = 0;
         pango_layout_set_text(cl->l, cl->text, -1);
         return cl;
 }
 
-static struct colored_layout *layout_from_notification(cairo_t *c, struct notification *n)
+static struct colored_layout *layout_from_item(struct draw_item *n, int dpi)
 {
 
-        struct colored_layout *cl = layout_init_shared(c, n);
+        struct colored_layout *cl = layout_init_shared(n, dpi);
 
         if (n->icon_position != ICON_OFF && n->icon) {
                 cl->icon = n->icon;
         } else {
                 cl->icon = NULL;
         }
+        cl->icon_slot = n->icon_position != ICON_OFF ? n->icon_slot : 0;
 
         /* markup */
         GError *err = NULL;
-        pango_parse_markup(n->text_to_render, -1, 0, &(cl->attr), &(cl->text), NULL, &err);
+        pango_parse_markup(n->text, -1, 0, &(cl->attr), &(cl->text), NULL, &err);
 
         if (!err) {
                 pango_layout_set_text(cl->l, cl->text, -1);
                 pango_layout_set_attributes(cl->l, cl->attr);
         } else {
                 /* remove markup and display plain message instead */
-                n->text_to_render = markup_strip(n->text_to_render);
+                n->text = markup_strip(n->text);
                 cl->text = NULL;
                 cl->attr = NULL;
-                pango_layout_set_text(cl->l, n->text_to_render, -1);
+                pango_layout_set_text(cl->l, n->text, -1);
                 if (n->first_render) {
                         LOG_W("Unable to parse markup: %s", err->message);
                 }
                 g_error_free(err);
         }
 
-        n->first_render = false;
         return cl;
 }
 
-static GSList *create_layouts(cairo_t *c)
+/**
+ * Take a snapshot of the displayed notifications. Has to be called on the
+ * main thread.
+ */
+static struct scene *scene_create(void)
 {
-        GSList *layouts = NULL;
+        struct scene *scene = g_malloc0(sizeof(struct scene));
+        const struct screen_info *scr = output->get_active_screen();
+
+        scene->ref = 1;
+        scene->serial = g_atomic_int_add(&scene_serial, 1) + 1;
+        scene->scale = output->get_scale();
+        scene->dpi = scr->dpi;
+        scene->screen_width = scr->w;
+
+        if (scene->scale != pinned_scale && !pin_source)
+                pin_source = g_idle_add(pin_default_icons, NULL);
 
         int qlen = queues_length_waiting();
         bool xmore_is_needed = qlen > 0 && settings.indicate_hidden;
@@ -416,6 +621,9 @@ static GSList *create_layouts(cairo_t *c)
         {
                 struct notification *n = iter->data;
 
+                // The age and the indicators may have changed the text
+                char *old_ttr = n->text_to_render;
+                n->text_to_render = NULL;
                 notification_update_text_to_render(n);
 
                 if (!iter->next && xmore_is_needed && settings.notification_limit == 1) {
@@ -423,17 +631,84 @@ static GSList *create_layouts(cairo_t *c)
                         g_free(n->text_to_render);
                         n->text_to_render = new_ttr;
                 }
-                layouts = g_slist_append(layouts,
-                                layout_from_notification(c, n));
+
+                if (!STR_EQ(old_ttr, n->text_to_render))
+                        n->dirty |= DIRTY_TEXT;
+                g_free(old_ttr);
+
+                // The output scale may have changed since the icon was
+                // rasterised, e.g. by moving to another monitor
+                notification_icon_update_scale(n, scene->scale);
+
+                scene->items = g_slist_prepend(scene->items, draw_item_new(n));
+                n->first_render = false;
+                n->dirty = DIRTY_NONE;
         }
 
         if (xmore_is_needed && settings.notification_limit != 1) {
                 /* append xmore message as new message */
-                layouts = g_slist_append(layouts,
-                        layout_derive_xmore(c, queues_get_head_waiting(), qlen));
+                struct draw_item *xmore = draw_item_new(queues_get_head_waiting());
+                g_free(xmore->text);
+                xmore->text = g_strdup_printf("(%d more)", qlen);
+                xmore->is_xmore = true;
+                scene->items = g_slist_prepend(scene->items, xmore);
         }
 
-        return layouts;
+        scene->items = g_slist_reverse(scene->items);
+        return scene;
+}
+
+/**
+ * Add the changes of the notifications in \p stale, which never got
+ * rendered, to the same notifications in \p scene.
+ */
+static void scene_merge_dirty(struct scene *scene, const struct scene *stale)
+{
+        for (GSList *iter = scene->items; iter; iter = iter->next) {
+                struct draw_item *item = iter->data;
+                for (const GSList *old = stale->items; old; old = old->next) {
+                        const struct draw_item *prev = old->data;
+                        if (prev->id == item->id && prev->is_xmore == item->is_xmore) {
+                                item->dirty |= prev->dirty;
+                                if (!item->arrival)
+                                        item->arrival = prev->arrival;
+                        }
+                }
+        }
+}
+
+/**
+ * Carry the arrival times of the notifications in \p stale, which never got
+ * shown, over to the same notifications in \p scene. Unlike
+ * scene_merge_dirty(), this is safe for scenes, which got rendered already.
+ */
+static void scene_merge_arrival(struct scene *scene, const struct scene *stale)
+{
+        for (GSList *iter = scene->items; iter; iter = iter->next) {
+                struct draw_item *item = iter->data;
+                for (const GSList *old = stale->items; old && !item->arrival; old = old->next) {
+                        const struct draw_item *prev = old->data;
+                        if (prev->id == item->id && !prev->is_xmore && !item->is_xmore)
+                                item->arrival = prev->arrival;
+                }
+        }
+}
+
+static GSList *create_layouts(const struct scene *scene)
+{
+        GSList *layouts = NULL;
+
+        TRACE_BEGIN("create_layouts");
+        for (GSList *iter = scene->items; iter; iter = iter->next) {
+                struct draw_item *item = iter->data;
+                if (item->is_xmore)
+                        layouts = g_slist_prepend(layouts, layout_derive_xmore(item, scene->dpi));
+                else
+                        layouts = g_slist_prepend(layouts, layout_from_item(item, scene->dpi));
+        }
+        TRACE_END("create_layouts");
+
+        return g_slist_reverse(layouts);
 }
 
 
@@ -451,15 +726,15 @@ static int layout_get_height(struct colored_layout *cl, double scale)
                 vertical_padding = get_vertical_text_icon_padding(cl->n);
         }
 
-        if (cl->icon)
-                h_icon = get_icon_height(cl->icon, scale);
+        if (layout_has_icon(cl))
+                h_icon = layout_get_icon_height(cl, scale);
 
         if (have_progress_bar(cl)) {
                 h_progress_bar = settings.progress_bar_height + settings.padding;
         }
 
 
-        if (cl->n->icon_position == ICON_TOP && cl->n->icon) {
+        if (cl->n->icon_position == ICON_TOP && layout_has_icon(cl)) {
                 return h_icon + h_text + h_progress_bar + vertical_padding;
         } else {
                 return MAX(h_text, h_icon) + h_progress_bar;
@@ -493,18 +768,10 @@ static int frame_internal_radius (int r, int w, int h)
 }
 
 /**
- * Create a path on the given cairo context to draw the background of a notification.
- * The top corners will get rounded by `corner_radius`, if `first` is set.
- * Respectably the same for `last` with the bottom corners.
+ * Create a path with the given geometry in device pixels. See draw_rounded_rect().
  */
-void draw_rounded_rect(cairo_t *c, int x, int y, int width, int height, int corner_radius, double scale, bool first, bool last)
+static void draw_rounded_rect_px(cairo_t *c, int x, int y, int width, int height, int corner_radius, bool first, bool last)
 {
-        width = round(width * scale);
-        height = round(height * scale);
-        x = round(x * scale);
-        y = round(y * scale);
-        corner_radius = round(corner_radius * scale);
-
         const double degrees = M_PI / 180.0;
 
         cairo_new_sub_path(c);
@@ -552,6 +819,22 @@ void draw_rounded_rect(cairo_t *c, int x, int y, int width, int height, int corn
         cairo_close_path(c);
 }
 
+/**
+ * Create a path on the given cairo context to draw the background of a notification.
+ * The top corners will get rounded by `corner_radius`, if `first` is set.
+ * Respectably the same for `last` with the bottom corners.
+ */
+void draw_rounded_rect(cairo_t *c, int x, int y, int width, int height, int corner_radius, double scale, bool first, bool last)
+{
+        draw_rounded_rect_px(c,
+                             round(x * scale),
+                             round(y * scale),
+                             round(width * scale),
+                             round(height * scale),
+                             round(corner_radius * scale),
+                             first, last);
+}
+
 /**
  * A small wrapper around cairo_rectange for drawing a scaled rectangle.
  */
@@ -559,6 +842,211 @@ static void draw_rect(cairo_t *c, double x, double y, double width, double heigh
         cairo_rectangle(c, round(x * scale), round(y * scale), round(width * scale), round(height * scale));
 }
 
+/**
+ * The shape of a notification's background in device pixels
+ */
+struct frame_geometry {
+        int width;              /**< The outer width */
+        int height;             /**< The outer height */
+        int radius;             /**< The outer corner radius */
+        int radius_int;         /**< The corner radius of the background */
+        int left, right, top, bottom; /**< The frame width on each side */
+        bool first;
+        bool last;
+};
+
+/**
+ * Fill the frame and the background of a notification at \p x, \p y. The
+ * context has to use CAIRO_OPERATOR_ADD, so adjacent notifications combine
+ * correctly.
+ */
+static void frame_fill(cairo_t *c, const struct frame_geometry *g, int x, int y,
+                       struct color frame, struct color bg)
+{
+        int width_int = g->width - g->left - g->right;
+        int height_int = g->height - g->top - g->bottom;
+
+        /* stroke area doesn't intersect with main area */
+        cairo_set_fill_rule(c, CAIRO_FILL_RULE_EVEN_ODD);
+
+        draw_rounded_rect_px(c, x, y, g->width, g->height, g->radius, g->first, g->last);
+        draw_rounded_rect_px(c, x + g->left, y + g->top, width_int, height_int,
+                             g->radius_int, g->first, g->last);
+        cairo_set_source_rgba(c, frame.r, frame.g, frame.b, frame.a);
+        cairo_fill(c);
+
+        draw_rounded_rect_px(c, x + g->left, y + g->top, width_int, height_int,
+                             g->radius_int, g->first, g->last);
+        cairo_set_source_rgba(c, bg.r, bg.g, bg.b, bg.a);
+        cairo_fill(c);
+}
+
+/**
+ * A background pre-rendered as nine slices. The corners are blitted as they
+ * are, the edges and the centre are a single pixel wide or high and get
+ * repeated to fill any size.
+ */
+struct frame_tiles {
+        gint ref;
+        int widths[3];                  /**< left, centre and right column */
+        int heights[3];                 /**< top, centre and bottom row */
+        cairo_surface_t *slices[9];     /**< Row major, NULL if empty */
+};
+
+/* The distinct backgrounds only differ by rules changing the colours, so
+ * a handful of entries is plenty. */
+#define FRAME_TILES_MAX 64
+
+static GMutex frame_tiles_lock;
+static GHashTable *frame_tiles = NULL;  /**< Maps the shape and colours to frame_tiles */
+
+static void frame_tiles_unref(gpointer data)
+{
+        struct frame_tiles *tiles = data;
+
+        if (!g_atomic_int_dec_and_test(&tiles->ref))
+                return;
+
+        for (int i = 0; i < 9; i++)
+                if (tiles->slices[i])
+                        cairo_surface_destroy(tiles->slices[i]);
+        g_free(tiles);
+}
+
+/**
+ * Render the smallest background with the shape and colours of \p g and cut
+ * it into slices.
+ */
+static struct frame_tiles *frame_tiles_new(const struct frame_geometry *g,
+                                           struct color frame, struct color bg)
+{
+        struct frame_tiles *tiles = g_malloc0(sizeof(struct frame_tiles));
+        tiles->ref = 1;
+
+        /* Everything the arcs touch goes into the corners */
+        tiles->widths[0] = MAX(g->radius, g->left + g->radius_int);
+        tiles->widths[1] = 1;
+        tiles->widths[2] = MAX(g->radius, g->right + g->radius_int);
+        tiles->heights[0] = g->first ? MAX(g->radius, g->top + g->radius_int) : g->top;
+        tiles->heights[1] = 1;
+        tiles->heights[2] = g->last ? MAX(g->radius, g->bottom + g->radius_int) : g->bottom;
+
+        struct frame_geometry template = *g;
+        template.width = tiles->widths[0] + tiles->widths[1] + tiles->widths[2];
+        template.height = tiles->heights[0] + tiles->heights[1] + tiles->heights[2];
+
+        cairo_surface_t *srf = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                                          template.width,
+                                                          template.height);
+        cairo_t *c = cairo_create(srf);
+        cairo_set_operator(c, CAIRO_OPERATOR_ADD);
+        frame_fill(c, &template, 0, 0, frame, bg);
+        cairo_destroy(c);
+
+        for (int row = 0, y = 0; row < 3; y += tiles->heights[row++]) {
+                for (int col = 0, x = 0; col < 3; x += tiles->widths[col++]) {
+                        if (tiles->widths[col] == 0 || tiles->heights[row] == 0)
+                                continue;
+
+                        cairo_surface_t *slice = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                                                            tiles->widths[col],
+                                                                            tiles->heights[row]);
+                        c = cairo_create(slice);
+                        cairo_set_operator(c, CAIRO_OPERATOR_SOURCE);
+                        cairo_set_source_surface(c, srf, -x, -y);
+                        cairo_paint(c);
+                        cairo_destroy(c);
+
+                        tiles->slices[row * 3 + col] = slice;
+                }
+        }
+
+        cairo_surface_destroy(srf);
+        return tiles;
+}
+
+static struct frame_tiles *frame_tiles_get(const struct frame_geometry *g,
+                                           struct color frame, struct color bg)
+{
+        char *key = g_strdup_printf("%d|%d|%d|%d|%d|%d|%d|%d"
+                                    "|%.17g|%.17g|%.17g|%.17g|%.17g|%.17g|%.17g|%.17g",
+                                    g->radius, g->radius_int,
+                                    g->left, g->right, g->top, g->bottom,
+                                    g->first, g->last,
+                                    frame.r, frame.g, frame.b, frame.a,
+                                    bg.r, bg.g, bg.b, bg.a);
+
+        g_mutex_lock(&frame_tiles_lock);
+        if (!frame_tiles)
+                frame_tiles = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                    g_free, frame_tiles_unref);
+
+        struct frame_tiles *tiles = g_hash_table_lookup(frame_tiles, key);
+        if (!tiles) {
+                if (g_hash_table_size(frame_tiles) >= FRAME_TILES_MAX)
+                        g_hash_table_remove_all(frame_tiles);
+
+                tiles = frame_tiles_new(g, frame, bg);
+                g_hash_table_insert(frame_tiles, key, tiles);
+                key = NULL;
+        }
+        g_atomic_int_inc(&tiles->ref);
+        g_mutex_unlock(&frame_tiles_lock);
+
+        g_free(key);
+        return tiles;
+}
+
+static void frame_tiles_clear(void)
+{
+        g_mutex_lock(&frame_tiles_lock);
+        g_clear_pointer(&frame_tiles, g_hash_table_unref);
+        g_mutex_unlock(&frame_tiles_lock);
+}
+
+/**
+ * Compose the background of \p g at \p x, \p y from cached slices. The
+ * result is the same as frame_fill(), as the slices are always placed at
+ * whole pixels.
+ *
+ * @returns false, if the background is too small to be sliced. Use
+ *          frame_fill() then.
+ */
+static bool frame_blit(cairo_t *c, const struct frame_geometry *g, int x, int y,
+                       struct color frame, struct color bg)
+{
+        int left = MAX(g->radius, g->left + g->radius_int);
+        int right = MAX(g->radius, g->right + g->radius_int);
+        int top = g->first ? MAX(g->radius, g->top + g->radius_int) : g->top;
+        int bottom = g->last ? MAX(g->radius, g->bottom + g->radius_int) : g->bottom;
+
+        if (g->width < left + right || g->height < top + bottom
+            || g->left < 0 || g->right < 0 || g->top < 0 || g->bottom < 0
+            || g->radius < 0 || g->radius_int < 0)
+                return false;
+
+        struct frame_tiles *tiles = frame_tiles_get(g, frame, bg);
+
+        int widths[3] = { left, g->width - left - right, right };
+        int heights[3] = { top, g->height - top - bottom, bottom };
+
+        for (int row = 0, dy = y; row < 3; dy += heights[row++]) {
+                for (int col = 0, dx = x; col < 3; dx += widths[col++]) {
+                        cairo_surface_t *slice = tiles->slices[row * 3 + col];
+                        if (!slice || widths[col] == 0 || heights[row] == 0)
+                                continue;
+
+                        cairo_set_source_surface(c, slice, dx, dy);
+                        cairo_pattern_set_extend(cairo_get_source(c), CAIRO_EXTEND_REPEAT);
+                        cairo_rectangle(c, dx, dy, widths[col], heights[row]);
+                        cairo_fill(c);
+                }
+        }
+
+        frame_tiles_unref(tiles);
+        return true;
+}
+
 static cairo_surface_t *render_background(cairo_surface_t *srf,
                                           struct colored_layout *cl,
                                           struct colored_layout *cl_next,
@@ -573,12 +1061,10 @@ static cairo_surface_t *render_background(cairo_surface_t *srf,
 {
         int x = 0;
         int radius_int = corner_radius;
+        struct frame_geometry g = { .first = first, .last = last };
 
         cairo_t *c = cairo_create(srf);
 
-        /* stroke area doesn't intersect with main area */
-        cairo_set_fill_rule(c, CAIRO_FILL_RULE_EVEN_ODD);
-
         /* for correct combination of adjacent areas */
         cairo_set_operator(c, CAIRO_OPERATOR_ADD);
 
@@ -589,7 +1075,11 @@ static cairo_surface_t *render_background(cairo_surface_t *srf,
         else
                 height += settings.separator_height;
 
-        draw_rounded_rect(c, x, y, width, height, corner_radius, scale, first, last);
+        int outer_x = round(x * scale);
+        int outer_y = round(y * scale);
+        g.width = round(width * scale);
+        g.height = round(height * scale);
+        g.radius = round(corner_radius * scale);
 
         /* adding frame */
         x += settings.frame_width;
@@ -607,13 +1097,16 @@ static cairo_surface_t *render_background(cairo_surface_t *srf,
 
         radius_int = frame_internal_radius(corner_radius, settings.frame_width, height);
 
-        draw_rounded_rect(c, x, y, width, height, radius_int, scale, first, last);
-        cairo_set_source_rgba(c, cl->frame.r, cl->frame.g, cl->frame.b, cl->frame.a);
-        cairo_fill(c);
+        /* The frame widths after rounding, so the background ends up
+         * exactly where scaling its own coordinates would put it */
+        g.radius_int = round(radius_int * scale);
+        g.left = round(x * scale) - outer_x;
+        g.top = round(y * scale) - outer_y;
+        g.right = outer_x + g.width - round(x * scale) - round(width * scale);
+        g.bottom = outer_y + g.height - round(y * scale) - round(height * scale);
 
-        draw_rounded_rect(c, x, y, width, height, radius_int, scale, first, last);
-        cairo_set_source_rgba(c, cl->bg.r, cl->bg.g, cl->bg.b, cl->bg.a);
-        cairo_fill(c);
+        if (!frame_blit(c, &g, outer_x, outer_y, cl->frame, cl->bg))
+                frame_fill(c, &g, outer_x, outer_y, cl->frame, cl->bg);
 
         cairo_set_operator(c, CAIRO_OPERATOR_SOURCE);
 
@@ -638,6 +1131,66 @@ static cairo_surface_t *render_background(cairo_surface_t *srf,
                                                   round(width * scale), round(height * scale));
 }
 
+/**
+ * Draw the progress bar of a notification.
+ *
+ * @param c The context of the content area
+ * @param cl The layout of the notification
+ * @param width The width of the content area
+ * @param frame_y The top of the progress bar
+ * @param scale The output scale
+ */
+static void render_progress_bar(cairo_t *c, struct colored_layout *cl, int width, int frame_y, double scale)
+{
+        int progress = MIN(cl->n->progress, 100);
+        unsigned int frame_x = 0;
+        unsigned int frame_width = settings.progress_bar_frame_width,
+                     progress_width = MIN(width - 2 * settings.h_padding, settings.progress_bar_max_width),
+                     progress_height = settings.progress_bar_height - frame_width,
+                     progress_width_without_frame = progress_width - 2 * frame_width,
+                     progress_width_1 = progress_width_without_frame * progress / 100,
+                     progress_width_2 = progress_width_without_frame - progress_width_1;
+
+        switch (cl->n->progress_bar_alignment) {
+                case PANGO_ALIGN_LEFT:
+                     frame_x = settings.h_padding;
+                     break;
+                case PANGO_ALIGN_CENTER:
+                     frame_x = width/2 - progress_width/2;
+                     break;
+                case PANGO_ALIGN_RIGHT:
+                     frame_x = width - progress_width - settings.h_padding;
+                     break;
+        }
+        unsigned int x_bar_1 = frame_x + frame_width,
+                     x_bar_2 = x_bar_1 + progress_width_1;
+
+        double half_frame_width = frame_width / 2.0;
+
+        // draw progress bar
+        // Note: the bar could be drawn a bit smaller, because the frame is drawn on top
+        // left side
+        cairo_set_source_rgba(c, cl->highlight.r, cl->highlight.g, cl->highlight.b, cl->highlight.a);
+        draw_rect(c, x_bar_1, frame_y, progress_width_1, progress_height, scale);
+        cairo_fill(c);
+        // right side
+        cairo_set_source_rgba(c, cl->bg.r, cl->bg.g, cl->bg.b, cl->bg.a);
+        draw_rect(c, x_bar_2, frame_y, progress_width_2, progress_height, scale);
+        cairo_fill(c);
+        // border
+        cairo_set_source_rgba(c, cl->frame.r, cl->frame.g, cl->frame.b, cl->frame.a);
+        // TODO draw_rect instead of cairo_rectangle resulted
+        // in blurry lines due to rounding (half_frame_width
+        // can be non-integer)
+        cairo_rectangle(c,
+                        (frame_x + half_frame_width) * scale,
+                        (frame_y + half_frame_width) * scale,
+                        (progress_width - frame_width) * scale,
+                        progress_height * scale);
+        cairo_set_line_width(c, frame_width * scale);
+        cairo_stroke(c);
+}
+
 static void render_content(cairo_t *c, struct colored_layout *cl, int width, double scale)
 {
         // Redo layout setup, while knowing the width. This is to make
@@ -659,7 +1212,7 @@ static void render_content(cairo_t *c, struct colored_layout *cl, int width, dou
                     text_y = settings.padding + h_without_progress_bar / 2 - h_text / 2;
 
                 // text positioning
-                if (cl->icon) {
+                if (layout_has_icon(cl)) {
                         // vertical alignment
                         if (settings.vertical_alignment == VERTICAL_TOP) {
                                 text_y = settings.padding;
@@ -671,9 +1224,9 @@ static void render_content(cairo_t *c, struct colored_layout *cl, int width, dou
 
                         // icon position
                         if (cl->n->icon_position == ICON_LEFT) {
-                                text_x = get_icon_width(cl->icon, scale) + settings.h_padding + get_horizontal_text_icon_padding(cl->n);
+                                text_x = layout_get_icon_width(cl, scale) + settings.h_padding + get_horizontal_text_icon_padding(cl->n);
                         } else if (cl->n->icon_position == ICON_TOP) {
-                                text_y = get_icon_height(cl->icon, scale) + settings.padding + get_vertical_text_icon_padding(cl->n);
+                                text_y = layout_get_icon_height(cl, scale) + settings.padding + get_vertical_text_icon_padding(cl->n);
                         } // else ICON_RIGHT
                 }
                 cairo_move_to(c, round(text_x * scale), round(text_y * scale));
@@ -713,56 +1266,36 @@ static void render_content(cairo_t *c, struct colored_layout *cl, int width, dou
         }
 
         // progress bar positioning
-        if (have_progress_bar(cl)){
-                int progress = MIN(cl->n->progress, 100);
-                unsigned int frame_x = 0;
-                unsigned int frame_width = settings.progress_bar_frame_width,
-                             progress_width = MIN(width - 2 * settings.h_padding, settings.progress_bar_max_width),
-                             progress_height = settings.progress_bar_height - frame_width,
-                             frame_y = settings.padding + h - settings.progress_bar_height,
-                             progress_width_without_frame = progress_width - 2 * frame_width,
-                             progress_width_1 = progress_width_without_frame * progress / 100,
-                             progress_width_2 = progress_width_without_frame - progress_width_1;
-
-                switch (cl->n->progress_bar_alignment) {
-                        case PANGO_ALIGN_LEFT:
-                             frame_x = settings.h_padding;
-                             break;
-                        case PANGO_ALIGN_CENTER:
-                             frame_x = width/2 - progress_width/2;
-                             break;
-                        case PANGO_ALIGN_RIGHT:
-                             frame_x = width - progress_width - settings.h_padding;
-                             break;
-                }
-                unsigned int x_bar_1 = frame_x + frame_width,
-                             x_bar_2 = x_bar_1 + progress_width_1;
+        if (have_progress_bar(cl)) {
+                cl->n->progress_bar_y = settings.padding + h - settings.progress_bar_height;
+                render_progress_bar(c, cl, width, cl->n->progress_bar_y, scale);
+        }
+}
 
-                double half_frame_width = frame_width / 2.0;
+/**
+ * Move the vertical position in \p dim below a notification of the layout
+ * height \p cl_h.
+ */
+static struct dimensions layout_advance(struct dimensions dim, int cl_h, bool first, bool last)
+{
+        /* adding frame */
+        if (first)
+                dim.y += settings.frame_width;
 
-                // draw progress bar
-                // Note: the bar could be drawn a bit smaller, because the frame is drawn on top
-                // left side
-                cairo_set_source_rgba(c, cl->highlight.r, cl->highlight.g, cl->highlight.b, cl->highlight.a);
-                draw_rect(c, x_bar_1, frame_y, progress_width_1, progress_height, scale);
-                cairo_fill(c);
-                // right side
-                cairo_set_source_rgba(c, cl->bg.r, cl->bg.g, cl->bg.b, cl->bg.a);
-                draw_rect(c, x_bar_2, frame_y, progress_width_2, progress_height, scale);
-                cairo_fill(c);
-                // border
-                cairo_set_source_rgba(c, cl->frame.r, cl->frame.g, cl->frame.b, cl->frame.a);
-                // TODO draw_rect instead of cairo_rectangle resulted
-                // in blurry lines due to rounding (half_frame_width
-                // can be non-integer)
-                cairo_rectangle(c,
-                                (frame_x + half_frame_width) * scale,
-                                (frame_y + half_frame_width) * scale,
-                                (progress_width - frame_width) * scale,
-                                progress_height * scale);
-                cairo_set_line_width(c, frame_width * scale);
-                cairo_stroke(c);
-        }
+        if (last)
+                dim.y += settings.frame_width;
+
+        if ((2 * settings.padding + cl_h) < settings.height)
+                dim.y += cl_h + 2 * settings.padding;
+        else
+                dim.y += settings.height;
+
+        if (settings.gap_size)
+                dim.y += settings.gap_size;
+        else
+                dim.y += settings.separator_height;
+
+        return dim;
 }
 
 static struct dimensions layout_render(cairo_surface_t *srf,
@@ -770,9 +1303,10 @@ static struct dimensions layout_render(cairo_surface_t *srf,
                                        struct colored_layout *cl_next,
                                        struct dimensions dim,
                                        bool first,
-                                       bool last)
+                                       bool last,
+                                       double scale)
 {
-        double scale = output->get_scale();
+        TRACE_BEGIN("layout_render");
         const int cl_h = layout_get_height(cl, scale);
 
         int h_text = 0;
@@ -784,28 +1318,16 @@ static struct dimensions layout_render(cairo_surface_t *srf,
         cairo_surface_t *content = render_background(srf, cl, cl_next, dim.y, dim.w, bg_height, dim.corner_radius, first, last, &bg_width, scale);
         cairo_t *c = cairo_create(content);
 
-        render_content(c, cl, bg_width, scale);
-
-        /* adding frame */
-        if (first)
-                dim.y += settings.frame_width;
-
-        if (last)
-                dim.y += settings.frame_width;
-
-        if ((2 * settings.padding + cl_h) < settings.height)
-                dim.y += cl_h + 2 * settings.padding;
-        else
-                dim.y += settings.height;
+        cl->n->content_y = first ? dim.y + settings.frame_width : dim.y;
+        cl->n->content_width = bg_width;
+        cl->n->content_height = bg_height;
 
-        if (settings.gap_size)
-                dim.y += settings.gap_size;
-        else
-                dim.y += settings.separator_height;
+        render_content(c, cl, bg_width, scale);
 
         cairo_destroy(c);
         cairo_surface_destroy(content);
-        return dim;
+        TRACE_END("layout_render");
+        return layout_advance(dim, cl_h, first, last);
 }
 
 /**
@@ -858,19 +1380,483 @@ void calc_window_pos(const struct screen_info *scr, int width, int height, int *
         }
 }
 
-void draw(void)
+/**
+ * A notification, which got rasterised on its own. It gets composited
+ * again, as long as neither the notification nor its surroundings change.
+ */
+struct render_tile {
+        const struct draw_item *item;           /**< The item in the last scene */
+        const struct draw_item *item_next;      /**< The item below it in the last scene */
+        struct dimensions dim;  /**< The dimensions of the notification */
+        int cl_h;               /**< The layout height of the notification */
+        struct dimensions window;       /**< The window's dimensions at the top of the notification */
+        bool first;
+        bool last;
+        cairo_surface_t *srf;
+        int y;                  /**< Vertical offset of the tile in pixels */
+        int h;                  /**< Height of the tile in pixels */
+};
+
+/* The last rendered scene and its frame. When only the progress of some
+ * notifications changed, just their progress bars get redrawn on a copy.
+ * Only used by the thread calling render_scene(). */
+static struct scene *last_scene = NULL;
+static cairo_surface_t *last_srf = NULL;
+static struct dimensions last_dim;
+/* The tiles of the notifications in last_scene by their id, if it got
+ * rendered in tiles */
+static GHashTable *last_tiles = NULL;
+
+static void render_tile_free(gpointer data)
 {
-        assert(queues_length_displayed() > 0);
+        struct render_tile *tile = data;
+        cairo_surface_destroy(tile->srf);
+        g_free(tile);
+}
 
-        GSList *layouts = create_layouts(output->win_get_context(win));
+static bool color_equal(struct color a, struct color b)
+{
+        return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+/**
+ * Compare everything about two items, which is drawn, except the progress.
+ */
+static bool draw_item_looks_equal(const struct draw_item *prev,
+                                  const struct draw_item *item)
+{
+        return STR_EQ(prev->text, item->text)
+               && prev->urgency == item->urgency
+               && prev->icon == item->icon
+               && prev->icon_slot == item->icon_slot
+               && prev->icon_position == item->icon_position
+               && prev->hide_text == item->hide_text
+               && prev->word_wrap == item->word_wrap
+               && prev->ellipsize == item->ellipsize
+               && prev->alignment == item->alignment
+               && prev->progress_bar_alignment == item->progress_bar_alignment
+               && color_equal(prev->fg, item->fg)
+               && color_equal(prev->bg, item->bg)
+               && color_equal(prev->highlight, item->highlight)
+               && color_equal(prev->frame, item->frame);
+}
+
+/**
+ * Check if \p item differs from \p prev in nothing but its progress and if
+ * its progress bar can be redrawn on its own.
+ */
+static bool draw_item_progress_only(const struct draw_item *prev,
+                                    const struct draw_item *item,
+                                    double scale)
+{
+        if (prev->id != item->id || prev->is_xmore != item->is_xmore)
+                return false;
+
+        // Notifications keep track of what changed since the last scene,
+        // the indicator of the hidden ones has to be compared
+        if (item->is_xmore ? !draw_item_looks_equal(prev, item)
+                           : (item->dirty & ~DIRTY_PROGRESS))
+                return false;
+
+        if (prev->progress == item->progress)
+                return true;
+
+        // Showing or hiding the bar changes the layout
+        if (prev->progress < 0 || item->progress < 0 || prev->progress_bar_y < 0)
+                return false;
+
+        // The bar has to be surrounded by the plain background, away
+        // from the rounded corners
+        int radius = round(settings.corner_radius * scale);
+        return floor(prev->progress_bar_y * scale) >= radius
+               && ceil((prev->progress_bar_y + settings.progress_bar_height) * scale) + radius
+                  <= round(prev->content_height * scale);
+}
+
+/**
+ * Check if the items of \p scene get laid out for the same output as the
+ * ones of \p prev.
+ */
+static bool scene_same_output(const struct scene *prev, const struct scene *scene)
+{
+        return prev->scale == scene->scale
+               && prev->dpi == scene->dpi
+               && prev->screen_width == scene->screen_width;
+}
+
+/**
+ * Check if \p item gets laid out the same way as \p prev, which is the
+ * same notification in the last scene.
+ */
+static bool draw_item_layout_equal(const struct draw_item *prev,
+                                   const struct draw_item *item)
+{
+        // The progress bar only takes up room, if there's one
+        return !(item->dirty & ~DIRTY_PROGRESS)
+               && (prev->progress < 0) == (item->progress < 0);
+}
+
+static bool scene_progress_only(const struct scene *prev, const struct scene *scene)
+{
+        if (!scene_same_output(prev, scene)
+            || g_slist_length(prev->items) != g_slist_length(scene->items))
+                return false;
+
+        for (const GSList *a = prev->items, *b = scene->items; a && b; a = a->next, b = b->next)
+                if (!draw_item_progress_only(a->data, b->data, scene->scale))
+                        return false;
+
+        return true;
+}
+
+/**
+ * A unit of work of rendering a scene in tiles. Each job covers a single
+ * notification.
+ *
+ * PangoLayouts must not leave the worker thread, which created them, as
+ * the fontmap behind the thread's PangoContext isn't thread safe. So every
+ * step creates its own layout.
+ */
+struct render_job {
+        struct render_batch *batch;
+        void (*run)(struct render_job *job);
+        const struct scene *scene;
+        struct draw_item *item;
+        struct draw_item *item_next;
+        struct render_tile *cached;     /**< The tile of the notification in the last scene */
+        bool done;              /**< The current step got taken over from the cached tile */
+        struct dimensions dim;  /**< The notification's dimensions */
+        struct dimensions window;       /**< The window's dimensions at the top of the notification */
+        int cl_h;               /**< The layout height of the notification */
+        bool first;
+        bool last;
+        cairo_surface_t *tile;  /**< The rasterised notification */
+        int tile_y;             /**< Vertical offset of the tile in pixels */
+        int tile_h;             /**< Height of the tile in pixels */
+        gint64 cost;            /**< Time spent on the job in microseconds */
+};
+
+struct render_batch {
+        GMutex lock;
+        GCond done;
+        int pending;
+};
+
+/* The estimated cost (in microseconds) the jobs of a step have to exceed to
+ * get run on the worker pool. Below it, the overhead of dispatching eats up
+ * the gain. */
+#define PARALLEL_RENDER_MIN_COST 2000
+
+static GThreadPool *render_pool = NULL;
+/* Moving average of the measured cost to render a single notification in
+ * microseconds. Only used by the thread calling render_scene(). */
+static gint64 render_item_cost = 0;
+
+static void render_job_execute(gpointer data, gpointer user_data)
+{
+        struct render_job *job = data;
 
-        struct dimensions dim = calculate_dimensions(layouts);
-        LOG_D("Window dimensions %ix%i", dim.w, dim.h);
-        double scale = output->get_scale();
+        gint64 start = g_get_monotonic_time();
+        job->run(job);
+        job->cost += g_get_monotonic_time() - start;
+
+        if (!job->batch)
+                return;
+
+        g_mutex_lock(&job->batch->lock);
+        if (--job->batch->pending == 0)
+                g_cond_signal(&job->batch->done);
+        g_mutex_unlock(&job->batch->lock);
+}
+
+/**
+ * Run \p run for every job, which isn't done yet, and wait for all of them
+ * to finish. The jobs get spread over the worker pool, when the measured
+ * cost of previous scenes suggests it pays off.
+ *
+ * @return the amount of jobs, which ran
+ */
+static int render_jobs_dispatch(struct render_job *jobs, int count, void (*run)(struct render_job *job))
+{
+        int pending = 0;
+        for (int i = 0; i < count; i++) {
+                jobs[i].batch = NULL;
+                jobs[i].run = run;
+                if (!jobs[i].done)
+                        pending++;
+        }
+
+        if (pending < 2 || pending * render_item_cost < PARALLEL_RENDER_MIN_COST) {
+                for (int i = 0; i < count; i++)
+                        if (!jobs[i].done)
+                                render_job_execute(&jobs[i], NULL);
+                return pending;
+        }
+
+        if (!render_pool)
+                render_pool = g_thread_pool_new(render_job_execute, NULL,
+                                                g_get_num_processors(), FALSE, NULL);
+
+        struct render_batch batch;
+        g_mutex_init(&batch.lock);
+        g_cond_init(&batch.done);
+        batch.pending = pending;
+
+        for (int i = 0; i < count; i++) {
+                if (jobs[i].done)
+                        continue;
+                jobs[i].batch = &batch;
+                g_thread_pool_push(render_pool, &jobs[i], NULL);
+        }
+
+        g_mutex_lock(&batch.lock);
+        while (batch.pending > 0)
+                g_cond_wait(&batch.done, &batch.lock);
+        g_mutex_unlock(&batch.lock);
+
+        g_cond_clear(&batch.done);
+        g_mutex_clear(&batch.lock);
+        return pending;
+}
+
+static struct colored_layout *render_job_create_layout(struct render_job *job)
+{
+        struct colored_layout *cl;
+        if (job->item->is_xmore)
+                cl = layout_derive_xmore(job->item, job->scene->dpi);
+        else
+                cl = layout_from_item(job->item, job->scene->dpi);
+
+        job->dim = calculate_notification_dimensions(cl, job->scene->scale);
+        return cl;
+}
+
+static void render_job_layout(struct render_job *job)
+{
+        struct colored_layout *cl = render_job_create_layout(job);
+        job->cl_h = layout_get_height(cl, job->scene->scale);
+        free_colored_layout(cl);
+}
+
+static void render_job_raster(struct render_job *job)
+{
+        double scale = job->scene->scale;
+        struct dimensions window = job->window;
+        struct colored_layout *cl = render_job_create_layout(job);
+
+        // The separator only needs the colours of the next notification
+        struct colored_layout cl_next = { 0 };
+        if (job->item_next) {
+                cl_next.n = job->item_next;
+                cl_next.fg = job->item_next->fg;
+                cl_next.bg = job->item_next->bg;
+                cl_next.highlight = job->item_next->highlight;
+                cl_next.frame = job->item_next->frame;
+        }
+
+        job->tile = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                               round(window.w * scale),
+                                               job->tile_h);
+
+        // Draw with the coordinates of the whole window
+        cairo_surface_set_device_offset(job->tile, 0, -job->tile_y);
+        layout_render(job->tile, cl, job->item_next ? &cl_next : NULL,
+                      window, job->first, job->last, scale);
+        cairo_surface_set_device_offset(job->tile, 0, 0);
+
+        free_colored_layout(cl);
+}
+
+/**
+ * Check if the cached tile of a notification can be composited in place of
+ * rasterising it again.
+ */
+static bool render_job_tile_reusable(const struct render_job *job, double scale)
+{
+        const struct render_tile *tile = job->cached;
+
+        if (!tile
+            || tile->first != job->first
+            || tile->last != job->last
+            || tile->h != job->tile_h
+            || tile->window.w != job->window.w
+            || tile->window.corner_radius != job->window.corner_radius
+            || tile->item->progress != job->item->progress)
+                return false;
+
+        // The separator depends on the notification below
+        if (!tile->item_next != !job->item_next)
+                return false;
+        if (job->item_next
+            && (tile->item_next->urgency != job->item_next->urgency
+                || !color_equal(tile->item_next->frame, job->item_next->frame)))
+                return false;
+
+        // A tile, which moved by whole pixels, still has the same pixels
+        double shift = (job->window.y - tile->window.y) * scale;
+        return shift == round(shift) && job->tile_y - tile->y == (int) shift;
+}
+
+/**
+ * Lay out and rasterise every notification of a scene into its own tile and
+ * composite them in order.
+ *
+ * The tiles get kept in last_tiles. A notification, which didn't change
+ * since the last scene apart from its progress, gets its layout taken over.
+ * If its progress and surroundings didn't change either, its tile gets
+ * composited again, so only the changed notifications get rasterised.
+ *
+ * @param scene The scene to render
+ * @param count The amount of items in the scene
+ * @param dim (out) The dimensions of the frame
+ * @param rendered (out) The amount of rasterised notifications
+ * @param cost (out) The accumulated time spent on them in microseconds
+ * @return the image surface of the frame
+ */
+static cairo_surface_t *render_scene_tiles(struct scene *scene, int count,
+                                           struct dimensions *dim,
+                                           int *rendered, gint64 *cost)
+{
+        double scale = scene->scale;
+        struct render_job *jobs = g_malloc0_n(count, sizeof(struct render_job));
+        GHashTable *tiles = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                                  NULL, render_tile_free);
+        bool reuse = last_scene && last_tiles && scene_same_output(last_scene, scene);
+
+        int i = 0;
+        for (GSList *iter = scene->items; iter; iter = iter->next, i++) {
+                struct render_job *job = &jobs[i];
+                job->scene = scene;
+                job->item = iter->data;
+
+                // The indicator of the hidden notifications borrows an id
+                if (reuse && !job->item->is_xmore)
+                        job->cached = g_hash_table_lookup(last_tiles, GINT_TO_POINTER(job->item->id));
+                if (job->cached && !draw_item_layout_equal(job->cached->item, job->item))
+                        job->cached = NULL;
+
+                if (job->cached) {
+                        job->dim = job->cached->dim;
+                        job->cl_h = job->cached->cl_h;
+                        job->item->displayed_height = job->cached->item->displayed_height;
+                        job->done = true;
+                }
+        }
+
+        render_jobs_dispatch(jobs, count, render_job_layout);
+
+        struct dimensions window = { 0 };
+        window.corner_radius = settings.corner_radius;
+        for (i = 0; i < count; i++)
+                dimensions_add(&window, jobs[i].dim);
+        window = dimensions_finish(window, count, scene);
+        LOG_D("Window dimensions %ix%i", window.w, window.h);
+
+        int height = round(window.h * scale);
+
+        /* Lay out the tiles the same way the serial rendering advances
+         * through the window. The tiles get an extra pixel to catch the
+         * rounding at fractional scales. */
+        for (i = 0; i < count; i++) {
+                bool first = i == 0 || settings.gap_size;
+                bool last = i == count - 1 || settings.gap_size;
+
+                jobs[i].item_next = i < count - 1 ? jobs[i + 1].item : NULL;
+                jobs[i].first = first;
+                jobs[i].last = last;
+                jobs[i].window = window;
+
+                struct dimensions next = layout_advance(window, jobs[i].cl_h, first, last);
+
+                jobs[i].tile_y = MAX(0, floor(window.y * scale) - 1);
+                jobs[i].tile_h = MIN(height, ceil(next.y * scale) + 1) - jobs[i].tile_y;
+                jobs[i].done = render_job_tile_reusable(&jobs[i], scale);
+                window = next;
+        }
+
+        *rendered = render_jobs_dispatch(jobs, count, render_job_raster);
 
         cairo_surface_t *image_surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
-                                                                    round(dim.w * scale),
-                                                                    round(dim.h * scale));
+                                                                    round(window.w * scale),
+                                                                    height);
+        cairo_t *c = cairo_create(image_surface);
+
+        /* same as rendering the backgrounds directly onto the window */
+        cairo_set_operator(c, CAIRO_OPERATOR_ADD);
+
+        *cost = 0;
+        for (i = 0; i < count; i++) {
+                struct render_job *job = &jobs[i];
+                struct render_tile *tile;
+
+                if (job->done) {
+                        tile = job->cached;
+                        g_hash_table_steal(last_tiles, GINT_TO_POINTER(job->item->id));
+
+                        const struct draw_item *prev = tile->item;
+                        job->item->content_y = prev->content_y + job->window.y - tile->window.y;
+                        job->item->content_width = prev->content_width;
+                        job->item->content_height = prev->content_height;
+                        job->item->progress_bar_y = prev->progress_bar_y;
+                } else {
+                        tile = g_malloc0(sizeof(struct render_tile));
+                        tile->srf = job->tile;
+                }
+
+                if (job->tile_h > 0) {
+                        cairo_set_source_surface(c, tile->srf, 0, job->tile_y);
+                        cairo_rectangle(c, 0, job->tile_y, round(window.w * scale), job->tile_h);
+                        cairo_fill(c);
+                }
+
+                tile->item = job->item;
+                tile->item_next = job->item_next;
+                tile->dim = job->dim;
+                tile->cl_h = job->cl_h;
+                tile->window = job->window;
+                tile->first = job->first;
+                tile->last = job->last;
+                tile->y = job->tile_y;
+                tile->h = job->tile_h;
+
+                if (job->item->is_xmore)
+                        render_tile_free(tile);
+                else
+                        g_hash_table_insert(tiles, GINT_TO_POINTER(job->item->id), tile);
+
+                *cost += job->cost;
+        }
+
+        cairo_destroy(c);
+        g_free(jobs);
+
+        if (last_tiles)
+                g_hash_table_unref(last_tiles);
+        last_tiles = tiles;
+
+        *dim = window;
+        return image_surface;
+}
+
+/**
+ * Lay out and rasterise the notifications of a scene one after another
+ * directly into the window.
+ *
+ * @param scene The scene to render
+ * @param dim (out) The dimensions of the frame
+ * @return the image surface of the frame
+ */
+static cairo_surface_t *render_scene_serial(struct scene *scene, struct dimensions *dim)
+{
+        GSList *layouts = create_layouts(scene);
+
+        struct dimensions window = calculate_dimensions(layouts, scene);
+        LOG_D("Window dimensions %ix%i", window.w, window.h);
+        double scale = scene->scale;
+
+        cairo_surface_t *image_surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                                                    round(window.w * scale),
+                                                                    round(window.h * scale));
 
         bool first = true;
         bool last;
@@ -885,23 +1871,356 @@ void draw(void)
                         last = true;
                 }
 
-                dim = layout_render(image_surface, cl_this, cl_next, dim, first, last);
+                window = layout_render(image_surface, cl_this, cl_next, window, first, last, scale);
 
                 first = false;
         }
 
-        output->display_surface(image_surface, win, &dim);
-
-        cairo_surface_destroy(image_surface);
         g_slist_free_full(layouts, free_colored_layout);
+
+        *dim = window;
+        return image_surface;
+}
+
+/**
+ * Render a scene, which differs from the last one only in the progress of
+ * some notifications, by redrawing their progress bars on a copy of the
+ * last frame.
+ *
+ * @param scene The scene to render
+ * @param dim (out) The dimensions of the frame
+ * @return the image surface of the frame
+ */
+static cairo_surface_t *render_scene_progress(struct scene *scene, struct dimensions *dim)
+{
+        double scale = scene->scale;
+        cairo_surface_t *srf = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                                          cairo_image_surface_get_width(last_srf),
+                                                          cairo_image_surface_get_height(last_srf));
+        cairo_t *c = cairo_create(srf);
+        cairo_set_operator(c, CAIRO_OPERATOR_SOURCE);
+        cairo_set_source_surface(c, last_srf, 0, 0);
+        cairo_paint(c);
+        cairo_destroy(c);
+
+        for (GSList *old = last_scene->items, *iter = scene->items;
+             old && iter;
+             old = old->next, iter = iter->next) {
+                struct draw_item *prev = old->data;
+                struct draw_item *item = iter->data;
+
+                item->displayed_height = prev->displayed_height;
+                item->content_y = prev->content_y;
+                item->content_width = prev->content_width;
+                item->content_height = prev->content_height;
+                item->progress_bar_y = prev->progress_bar_y;
+
+                // The tiles stay valid for the next scene, as long as
+                // the progress didn't change
+                struct render_tile *tile = NULL;
+                if (last_tiles && !item->is_xmore)
+                        tile = g_hash_table_lookup(last_tiles, GINT_TO_POINTER(item->id));
+                if (tile) {
+                        tile->item = item;
+                        tile->item_next = iter->next ? iter->next->data : NULL;
+                }
+
+                if (item->progress == prev->progress)
+                        continue;
+
+                if (tile)
+                        g_hash_table_remove(last_tiles, GINT_TO_POINTER(item->id));
+
+                cairo_surface_t *content = cairo_surface_create_for_rectangle(srf,
+                                round(settings.frame_width * scale),
+                                round(item->content_y * scale),
+                                round(item->content_width * scale),
+                                round(item->content_height * scale));
+                c = cairo_create(content);
+
+                // Restore the background of the rows the bar covers
+                int top = floor(item->progress_bar_y * scale);
+                int bottom = ceil((item->progress_bar_y + settings.progress_bar_height) * scale);
+                cairo_rectangle(c, 0, top, round(item->content_width * scale), bottom - top);
+                cairo_clip(c);
+                cairo_set_operator(c, CAIRO_OPERATOR_SOURCE);
+                cairo_set_source_rgba(c, item->bg.r, item->bg.g, item->bg.b, item->bg.a);
+                cairo_paint(c);
+                cairo_set_operator(c, CAIRO_OPERATOR_OVER);
+
+                struct colored_layout cl = {
+                        .n = item,
+                        .fg = item->fg,
+                        .bg = item->bg,
+                        .highlight = item->highlight,
+                        .frame = item->frame,
+                };
+                render_progress_bar(c, &cl, item->content_width, item->progress_bar_y, scale);
+
+                cairo_destroy(c);
+                cairo_surface_destroy(content);
+        }
+
+        *dim = last_dim;
+        return srf;
+}
+
+/**
+ * Forget the last rendered frame.
+ */
+static void render_scene_forget(void)
+{
+        g_clear_pointer(&last_scene, scene_unref);
+        g_clear_pointer(&last_srf, cairo_surface_destroy);
+        g_clear_pointer(&last_tiles, g_hash_table_unref);
+}
+
+/**
+ * Lay out and rasterise a scene. This is thread agnostic, as long as the
+ * scene isn't shared and only a single thread renders scenes.
+ *
+ * Only the notifications, which changed since the last scene, get
+ * rasterised again. Their work is spread over a worker pool, when the
+ * measured cost of previous scenes suggests it pays off.
+ *
+ * @param scene (transfer full) The scene to render
+ * @return a frame to present with present_frame()
+ */
+static struct frame *render_scene(struct scene *scene)
+{
+        struct frame *frame = g_malloc0(sizeof(struct frame));
+        int count = g_slist_length(scene->items);
+        gint64 start = g_get_monotonic_time();
+        gint64 cost = 0;
+        int rendered = count;
+
+        // The scenes in between got dropped, so the changes they carried
+        // are lost
+        if (last_scene && last_scene->serial < g_atomic_int_get(&cancelled_serial))
+                render_scene_forget();
+
+        if (last_scene && scene_progress_only(last_scene, scene)) {
+                LOG_D("Only redrawing the progress bars");
+                frame->srf = render_scene_progress(scene, &frame->dim);
+        } else {
+                // A single notification has nothing to keep apart
+                if (count > 1) {
+                        frame->srf = render_scene_tiles(scene, count, &frame->dim, &rendered, &cost);
+                } else {
+                        gint64 serial_start = g_get_monotonic_time();
+                        frame->srf = render_scene_serial(scene, &frame->dim);
+                        cost = g_get_monotonic_time() - serial_start;
+                        g_clear_pointer(&last_tiles, g_hash_table_unref);
+                }
+
+                if (rendered > 0)
+                        render_item_cost = (3 * render_item_cost + cost / rendered) / 4;
+        }
+
+        g_clear_pointer(&last_scene, scene_unref);
+        g_clear_pointer(&last_srf, cairo_surface_destroy);
+        last_scene = scene_ref(scene);
+        last_srf = cairo_surface_reference(frame->srf);
+        last_dim = frame->dim;
+
+        frame->scene = scene;
+        stats_record(STATS_RENDER, g_get_monotonic_time() - start);
+        return frame;
+}
+
+/**
+ * Show a rendered frame on screen. Has to be called on the main thread.
+ *
+ * @param frame (transfer full) The frame to present
+ */
+static void present_frame(struct frame *frame)
+{
+        /* The notifications went away while the frame was being rendered */
+        if (frame->scene->serial <= g_atomic_int_get(&cancelled_serial)
+            || queues_length_displayed() == 0) {
+                frame_free(frame);
+                return;
+        }
+
+        /* The input handling needs to know where each notification is */
+        for (GSList *iter = frame->scene->items; iter; iter = iter->next) {
+                struct draw_item *item = iter->data;
+                if (item->is_xmore)
+                        continue;
+
+                struct notification *n = queues_get_by_id(item->id);
+                if (n)
+                        n->displayed_height = item->displayed_height;
+        }
+
+        gint64 start = g_get_monotonic_time();
+        TRACE_BEGIN("display_surface");
+        output->display_surface(frame->srf, win, &frame->dim);
+        TRACE_END("display_surface");
+        output->win_show(win);
+        stats_record(STATS_PRESENT, g_get_monotonic_time() - start);
+        stats_count(STATS_REDRAWS);
+
+        gint64 now = time_monotonic_now();
+        for (GSList *iter = frame->scene->items; iter; iter = iter->next) {
+                struct draw_item *item = iter->data;
+                if (!item->is_xmore && item->arrival)
+                        stats_record(STATS_LATENCY, now - item->arrival);
+        }
+
+        frame_free(frame);
+}
+
+/**
+ * Atomically replace the content of \p slot with \p new.
+ *
+ * @return the previous content of the slot
+ */
+static gpointer slot_swap(gpointer *slot, gpointer new)
+{
+        gpointer old;
+        do {
+                old = g_atomic_pointer_get(slot);
+        } while (!g_atomic_pointer_compare_and_exchange(slot, old, new));
+        return old;
+}
+
+static gboolean present_idle(gpointer data)
+{
+        // Clear the flag first, so a frame arriving from now on schedules
+        // another idle callback
+        g_atomic_int_set(&present_scheduled, 0);
+
+        struct frame *frame = slot_swap(&finished_frame, NULL);
+        if (frame)
+                present_frame(frame);
+
+        return G_SOURCE_REMOVE;
+}
+
+static gpointer render_thread_main(gpointer data)
+{
+        while (true) {
+                if (sem_wait(&render_doorbell) != 0) {
+                        if (errno == EINTR)
+                                continue;
+                        LOG_E("Render thread cannot wait for scenes: %s", strerror(errno));
+                }
+
+                if (g_atomic_int_get(&render_quit))
+                        break;
+
+                struct scene *scene = slot_swap(&pending_scene, NULL);
+                if (!scene)
+                        continue;
+
+                // Don't bother rendering stale scenes
+                if (scene->serial <= g_atomic_int_get(&cancelled_serial)) {
+                        scene_unref(scene);
+                        continue;
+                }
+
+                struct frame *frame = render_scene(scene);
+
+                // The main thread didn't present the previous frame yet. It's
+                // outdated by now.
+                struct frame *outdated = slot_swap(&finished_frame, frame);
+                if (outdated) {
+                        stats_count(STATS_DROPPED_FRAMES);
+                        scene_merge_arrival(frame->scene, outdated->scene);
+                        frame_free(outdated);
+                }
+
+                if (g_atomic_int_compare_and_exchange(&present_scheduled, 0, 1))
+                        g_idle_add_full(G_PRIORITY_HIGH_IDLE, present_idle, NULL, NULL);
+        }
+
+        output_free_measure_context();
+        return NULL;
+}
+
+static void render_thread_start(void)
+{
+        if (sem_init(&render_doorbell, 0, 0) != 0) {
+                LOG_W("Cannot create render thread, rendering on the main thread: %s",
+                      strerror(errno));
+                return;
+        }
+
+        g_atomic_int_set(&render_quit, 0);
+        render_thread = g_thread_new("dunst-render", render_thread_main, NULL);
+}
+
+static void render_thread_stop(void)
+{
+        if (!render_thread)
+                return;
+
+        g_atomic_int_set(&render_quit, 1);
+        sem_post(&render_doorbell);
+        g_thread_join(render_thread);
+        render_thread = NULL;
+        sem_destroy(&render_doorbell);
+
+        scene_unref(slot_swap(&pending_scene, NULL));
+        frame_free(slot_swap(&finished_frame, NULL));
+        render_scene_forget();
+}
+
+void draw(void)
+{
+        assert(queues_length_displayed() > 0);
+
+        gint64 start = g_get_monotonic_time();
+        struct scene *scene = scene_create();
+        stats_record(STATS_DRAW, g_get_monotonic_time() - start);
+
+        if (!render_thread) {
+                present_frame(render_scene(scene));
+                return;
+        }
+
+        // If the render thread didn't pick up the previous scene yet, it's
+        // replaced by this one. What changed in there has to be redrawn
+        // nevertheless.
+        struct scene *stale = slot_swap(&pending_scene, NULL);
+        if (stale) {
+                stats_count(STATS_DROPPED_FRAMES);
+                scene_merge_dirty(scene, stale);
+                scene_unref(stale);
+        }
+
+        slot_swap(&pending_scene, scene);
+        sem_post(&render_doorbell);
+}
+
+void draw_cancel(void)
+{
+        g_atomic_int_set(&cancelled_serial, g_atomic_int_get(&scene_serial));
 }
 
 void draw_deinit(void)
 {
+        render_thread_stop();
+        if (pin_source) {
+                g_source_remove(pin_source);
+                pin_source = 0;
+        }
+        render_scene_forget();
+        icon_cache_loader_stop();
+        icon_disk_cache_deinit();
+        if (render_pool) {
+                g_thread_pool_free(render_pool, FALSE, TRUE);
+                render_pool = NULL;
+        }
         output->win_destroy(win);
         output->deinit();
+        output_free_measure_context();
         if (settings.enable_recursive_icon_lookup)
                 free_all_themes();
+        icon_index_clear();
+        icon_cache_clear();
+        frame_tiles_clear();
 }
 
 double draw_get_scale(void)
@@ -10,8 +10,19 @@ extern const struct output *output;
 
 void draw_setup(void);
 
+/**
+ * Snapshot the displayed notifications and render them. When the render
+ * thread is running, the frame gets presented asynchronously from the main
+ * loop, which also shows the window.
+ */
 void draw(void);
 
+/**
+ * Discard all frames, which are still being rendered or are waiting to be
+ * presented. Call this before hiding the window.
+ */
+void draw_cancel(void);
+
 void draw_rounded_rect(cairo_t *c, int x, int y, int width, int height, int corner_radius, double scale, bool first, bool last);
 
 // TODO get rid of this function by passing scale to everything that needs it.
@@ -85,10 +85,11 @@ static gboolean run(void *data)
         bool active = queues_length_displayed() > 0;
 
         if (active) {
-                // Call draw before showing the window to avoid flickering
+                // The window gets shown once the first frame is presented,
+                // to avoid flickering
                 draw();
-                output->win_show(win);
         } else {
+                draw_cancel();
                 output->win_hide(win);
         }
 
@@ -106,6 +107,8 @@ static gboolean run(void *data)
                 }
         }
 
+        signal_queues_changed();
+
         /* If the execution got triggered by g_timeout_add,
          * we have to remove the timeout (which is actually a
          * recurring interval), as we have set a new one
@@ -0,0 +1,155 @@
+#include "hash.h"
+
+#include <string.h>
+
+/* An implementation of XXH64, see
+ * https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md */
+
+#define PRIME64_1 G_GUINT64_CONSTANT(0x9E3779B185EBCA87)
+#define PRIME64_2 G_GUINT64_CONSTANT(0xC2B2AE3D27D4EB4F)
+#define PRIME64_3 G_GUINT64_CONSTANT(0x165667B19E3779F9)
+#define PRIME64_4 G_GUINT64_CONSTANT(0x85EBCA77C2B2AE63)
+#define PRIME64_5 G_GUINT64_CONSTANT(0x27D4EB2F165667C5)
+
+static inline guint64 rotl64(guint64 x, int r)
+{
+        return (x << r) | (x >> (64 - r));
+}
+
+static inline guint64 read64(const unsigned char *p)
+{
+        guint64 v;
+        memcpy(&v, p, sizeof(v));
+        return GUINT64_FROM_LE(v);
+}
+
+static inline guint32 read32(const unsigned char *p)
+{
+        guint32 v;
+        memcpy(&v, p, sizeof(v));
+        return GUINT32_FROM_LE(v);
+}
+
+static inline guint64 hash_round(guint64 acc, guint64 input)
+{
+        acc += input * PRIME64_2;
+        acc = rotl64(acc, 31);
+        return acc * PRIME64_1;
+}
+
+static inline guint64 hash_merge_round(guint64 acc, guint64 val)
+{
+        acc ^= hash_round(0, val);
+        return acc * PRIME64_1 + PRIME64_4;
+}
+
+static inline void hash_stripe(guint64 acc[4], const unsigned char *p)
+{
+        acc[0] = hash_round(acc[0], read64(p));
+        acc[1] = hash_round(acc[1], read64(p + 8));
+        acc[2] = hash_round(acc[2], read64(p + 16));
+        acc[3] = hash_round(acc[3], read64(p + 24));
+}
+
+/* see hash.h */
+void hash_init(struct hash_state *state, guint64 seed)
+{
+        memset(state, 0, sizeof(*state));
+        state->seed = seed;
+        state->acc[0] = seed + PRIME64_1 + PRIME64_2;
+        state->acc[1] = seed + PRIME64_2;
+        state->acc[2] = seed;
+        state->acc[3] = seed - PRIME64_1;
+}
+
+/* see hash.h */
+void hash_update(struct hash_state *state, const void *data, gsize len)
+{
+        const unsigned char *p = data;
+        if (len == 0)
+                return;
+
+        state->total_len += len;
+
+        // Complete a previously started stripe
+        if (state->buf_len > 0) {
+                gsize fill = MIN(len, sizeof(state->buf) - state->buf_len);
+                memcpy(state->buf + state->buf_len, p, fill);
+                state->buf_len += fill;
+                p += fill;
+                len -= fill;
+
+                if (state->buf_len < sizeof(state->buf))
+                        return;
+
+                hash_stripe(state->acc, state->buf);
+                state->buf_len = 0;
+        }
+
+        for (; len >= 32; p += 32, len -= 32)
+                hash_stripe(state->acc, p);
+
+        if (len > 0) {
+                memcpy(state->buf, p, len);
+                state->buf_len = len;
+        }
+}
+
+/* see hash.h */
+guint64 hash_digest(const struct hash_state *state)
+{
+        const guint64 *acc = state->acc;
+        guint64 h;
+
+        if (state->total_len >= 32) {
+                h = rotl64(acc[0], 1) + rotl64(acc[1], 7)
+                  + rotl64(acc[2], 12) + rotl64(acc[3], 18);
+                h = hash_merge_round(h, acc[0]);
+                h = hash_merge_round(h, acc[1]);
+                h = hash_merge_round(h, acc[2]);
+                h = hash_merge_round(h, acc[3]);
+        } else {
+                h = state->seed + PRIME64_5;
+        }
+
+        h += state->total_len;
+
+        const unsigned char *p = state->buf;
+        gsize len = state->buf_len;
+
+        for (; len >= 8; p += 8, len -= 8) {
+                h ^= hash_round(0, read64(p));
+                h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+        }
+
+        if (len >= 4) {
+                h ^= (guint64) read32(p) * PRIME64_1;
+                h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+                p += 4;
+                len -= 4;
+        }
+
+        for (; len > 0; p++, len--) {
+                h ^= *p * PRIME64_5;
+                h = rotl64(h, 11) * PRIME64_1;
+        }
+
+        h ^= h >> 33;
+        h *= PRIME64_2;
+        h ^= h >> 29;
+        h *= PRIME64_3;
+        h ^= h >> 32;
+
+        return h;
+}
+
+/* see hash.h */
+guint64 hash_data(const void *data, gsize len, guint64 seed)
+{
+        struct hash_state state;
+        hash_init(&state, seed);
+        hash_update(&state, data, len);
+        return hash_digest(&state);
+}
+
+/* vim: set ft=c tabstop=8 shiftwidth=8 expandtab textwidth=0: */
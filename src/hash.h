@@ -0,0 +1,52 @@
+#ifndef DUNST_HASH_H
+#define DUNST_HASH_H
+
+#include <glib.h>
+
+/**
+ * The state of an incremental XXH64 hash computation.
+ *
+ * XXH64 is a fast non-cryptographic hash. It's used to identify content,
+ * where MD5 would be needlessly slow. The result is the same, no matter in
+ * how many chunks the data gets fed in.
+ */
+struct hash_state {
+        guint64 total_len;
+        guint64 acc[4];
+        unsigned char buf[32];
+        gsize buf_len;
+        guint64 seed;
+};
+
+/**
+ * Start a new hash computation.
+ *
+ * @param state The state to initialise
+ * @param seed The seed of the hash
+ */
+void hash_init(struct hash_state *state, guint64 seed);
+
+/**
+ * Feed the next chunk of data into the hash.
+ *
+ * @param state The state of the computation
+ * @param data (nullable) The data, only NULL when \p len is 0
+ * @param len The length of \p data in bytes
+ */
+void hash_update(struct hash_state *state, const void *data, gsize len);
+
+/**
+ * Finish the hash computation. The state is left untouched, so more data
+ * can be fed into it afterwards.
+ *
+ * @returns the hash of all data fed into \p state
+ */
+guint64 hash_digest(const struct hash_state *state);
+
+/**
+ * Hash a single chunk of data.
+ */
+guint64 hash_data(const void *data, gsize len, guint64 seed);
+
+#endif
+/* vim: set ft=c tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -0,0 +1,400 @@
+#include "icon-cache.h"
+
+#include <sys/stat.h>
+
+#include "icon.h"
+#include "icon-disk-cache.h"
+#include "log.h"
+#include "notification.h"
+#include "rules.h"
+#include "settings.h"
+#include "utils.h"
+
+struct icon_cache_entry {
+        char *key;
+        cairo_surface_t *srf;
+        gsize size;     /**< The size of the pixel data in bytes */
+        GList *link;    /**< Position in the LRU list, NULL if pinned */
+};
+
+static GMutex cache_lock;
+static GHashTable *entries = NULL;      /**< Maps the keys to icon_cache_entry */
+static GQueue lru = G_QUEUE_INIT;       /**< Unpinned entries, most recently used first */
+static gsize unpinned_size = 0;
+static gsize pinned_size = 0;
+
+struct icon_request {
+        char *path;                     /**< The file to load, NULL for a source */
+        cairo_surface_t *source;        /**< The raw icon to scale, see icon_get_for_source() */
+        char *id;
+        int width;
+        int height;
+        int min_size;
+        int max_size;
+        double scale;
+        gint cancelled;
+        cairo_surface_t *srf;
+        icon_loaded_cb callback;
+        gpointer data;
+        GDestroyNotify destroy;
+};
+
+static GThreadPool *loader = NULL;
+static GHashTable *requests = NULL;     /**< The unfinished requests, only used on the main loop */
+
+static gsize icon_cache_budget(void)
+{
+        return (gsize) MAX(0, settings.icon_cache_size) * 1024;
+}
+
+/* Has to be called with the lock held */
+static void icon_cache_remove(struct icon_cache_entry *entry)
+{
+        g_hash_table_remove(entries, entry->key);
+
+        if (entry->link) {
+                g_queue_delete_link(&lru, entry->link);
+                unpinned_size -= entry->size;
+        } else {
+                pinned_size -= entry->size;
+        }
+
+        cairo_surface_destroy(entry->srf);
+        g_free(entry->key);
+        g_free(entry);
+}
+
+/* Has to be called with the lock held */
+static void icon_cache_evict(void)
+{
+        gsize budget = icon_cache_budget();
+
+        while (unpinned_size > budget && !g_queue_is_empty(&lru)) {
+                struct icon_cache_entry *entry = g_queue_peek_tail(&lru);
+                LOG_D("Evicting icon %s from the cache", entry->key);
+                icon_cache_remove(entry);
+        }
+}
+
+/* see icon-cache.h */
+char *icon_cache_key(const char *source, int min_size, int max_size, double scale)
+{
+        return g_strdup_printf("%s|%d|%d|%g", source, min_size, max_size, scale);
+}
+
+/* see icon-cache.h */
+cairo_surface_t *icon_cache_get(const char *key)
+{
+        ASSERT_OR_RET(key, NULL);
+
+        cairo_surface_t *srf = NULL;
+
+        g_mutex_lock(&cache_lock);
+        struct icon_cache_entry *entry = entries ? g_hash_table_lookup(entries, key) : NULL;
+        if (entry) {
+                if (entry->link) {
+                        g_queue_unlink(&lru, entry->link);
+                        g_queue_push_head_link(&lru, entry->link);
+                }
+                srf = cairo_surface_reference(entry->srf);
+        }
+        g_mutex_unlock(&cache_lock);
+
+        return srf;
+}
+
+/* see icon-cache.h */
+void icon_cache_put(const char *key, cairo_surface_t *srf, bool pinned)
+{
+        ASSERT_OR_RET(key,);
+        ASSERT_OR_RET(srf,);
+
+        if (!pinned && icon_cache_budget() == 0)
+                return;
+
+        struct icon_cache_entry *entry = g_malloc0(sizeof(struct icon_cache_entry));
+        entry->key = g_strdup(key);
+        entry->srf = cairo_surface_reference(srf);
+        entry->size = (gsize) cairo_image_surface_get_stride(srf)
+                      * cairo_image_surface_get_height(srf);
+
+        g_mutex_lock(&cache_lock);
+        if (!entries)
+                entries = g_hash_table_new(g_str_hash, g_str_equal);
+
+        struct icon_cache_entry *old = g_hash_table_lookup(entries, key);
+        if (old)
+                icon_cache_remove(old);
+
+        g_hash_table_insert(entries, entry->key, entry);
+        if (pinned) {
+                pinned_size += entry->size;
+        } else {
+                g_queue_push_head(&lru, entry);
+                entry->link = lru.head;
+                unpinned_size += entry->size;
+                icon_cache_evict();
+        }
+        g_mutex_unlock(&cache_lock);
+}
+
+static cairo_surface_t *icon_cache_load_file_full(const char *path, int min_size, int max_size,
+                                                  double scale, bool pinned)
+{
+        ASSERT_OR_RET(path, NULL);
+
+        char *expanded = string_to_path(g_strdup(path));
+        struct stat st;
+        char *key = NULL;
+
+        // Bind the entry to the file's modification time, so changed
+        // icons get picked up
+        if (stat(expanded, &st) == 0) {
+                char *source = g_strdup_printf("%s@%" G_GINT64_FORMAT, expanded, (gint64) st.st_mtime);
+                key = icon_cache_key(source, min_size, max_size, scale);
+                g_free(source);
+        }
+        g_free(expanded);
+
+        cairo_surface_t *srf = key ? icon_cache_get(key) : NULL;
+        if (!srf && key) {
+                // Another instance might have rasterised it already
+                srf = icon_disk_cache_get(key);
+                if (srf)
+                        icon_cache_put(key, srf, pinned);
+        } else if (srf && pinned) {
+                icon_cache_put(key, srf, pinned);
+        }
+
+        if (!srf) {
+                GdkPixbuf *pixbuf = get_pixbuf_from_file(path, min_size, max_size, scale);
+                if (pixbuf) {
+                        srf = gdk_pixbuf_to_cairo_surface(pixbuf);
+                        g_object_unref(pixbuf);
+                }
+                if (srf && key) {
+                        icon_cache_put(key, srf, pinned);
+                        icon_disk_cache_put(key, srf);
+                }
+        }
+
+        g_free(key);
+        return srf;
+}
+
+/* see icon-cache.h */
+cairo_surface_t *icon_cache_load_file(const char *path, int min_size, int max_size, double scale)
+{
+        return icon_cache_load_file_full(path, min_size, max_size, scale, false);
+}
+
+static void icon_request_free(struct icon_request *req)
+{
+        if (req->destroy)
+                req->destroy(req->data);
+        if (req->srf)
+                cairo_surface_destroy(req->srf);
+        if (req->source)
+                cairo_surface_destroy(req->source);
+        g_free(req->path);
+        g_free(req->id);
+        g_free(req);
+}
+
+/* Runs on the main loop, once the worker is done with the request */
+static gboolean icon_request_finish(gpointer data)
+{
+        struct icon_request *req = data;
+
+        g_hash_table_remove(requests, req);
+        if (!g_atomic_int_get(&req->cancelled))
+                req->callback(req->srf, req->data);
+
+        icon_request_free(req);
+        return G_SOURCE_REMOVE;
+}
+
+static cairo_surface_t *icon_request_load(const struct icon_request *req)
+{
+        if (req->source)
+                return icon_get_for_source(req->source, req->id,
+                                           req->width, req->height, req->scale,
+                                           req->min_size, req->max_size);
+
+        return icon_cache_load_file(req->path, req->min_size, req->max_size, req->scale);
+}
+
+static void icon_request_run(gpointer data, gpointer user_data)
+{
+        struct icon_request *req = data;
+
+        // Don't bother decoding icons nobody is waiting for anymore
+        if (!g_atomic_int_get(&req->cancelled))
+                req->srf = icon_request_load(req);
+
+        g_idle_add(icon_request_finish, req);
+}
+
+/* see icon-cache.h */
+void icon_cache_loader_start(void)
+{
+        if (loader)
+                return;
+
+        GError *err = NULL;
+        loader = g_thread_pool_new(icon_request_run, NULL,
+                                   g_get_num_processors(), FALSE, &err);
+        if (!loader) {
+                LOG_W("Cannot start the icon loader, loading icons synchronously: %s",
+                      err->message);
+                g_error_free(err);
+                return;
+        }
+        requests = g_hash_table_new(g_direct_hash, g_direct_equal);
+}
+
+/* see icon-cache.h */
+void icon_cache_loader_stop(void)
+{
+        if (!loader)
+                return;
+
+        // Nobody gets the icons anymore, so the queued requests only have
+        // to pass through the workers
+        GHashTableIter iter;
+        gpointer req;
+        g_hash_table_iter_init(&iter, requests);
+        while (g_hash_table_iter_next(&iter, &req, NULL))
+                icon_cache_request_cancel(req);
+
+        g_thread_pool_free(loader, FALSE, TRUE);
+        loader = NULL;
+
+        // The workers are done, every request still waits for its idle callback
+        g_hash_table_iter_init(&iter, requests);
+        while (g_hash_table_iter_next(&iter, &req, NULL)) {
+                g_idle_remove_by_data(req);
+                icon_request_free(req);
+        }
+        g_clear_pointer(&requests, g_hash_table_unref);
+}
+
+static struct icon_request *icon_request_new(int min_size, int max_size, double scale,
+                                             icon_loaded_cb callback,
+                                             gpointer data, GDestroyNotify destroy)
+{
+        struct icon_request *req = g_malloc0(sizeof(struct icon_request));
+        req->min_size = min_size;
+        req->max_size = max_size;
+        req->scale = scale;
+        req->callback = callback;
+        req->data = data;
+        req->destroy = destroy;
+        return req;
+}
+
+static struct icon_request *icon_request_push(struct icon_request *req)
+{
+        g_hash_table_add(requests, req);
+        g_thread_pool_push(loader, req, NULL);
+        return req;
+}
+
+/* see icon-cache.h */
+struct icon_request *icon_cache_load_file_async(const char *path, int min_size, int max_size,
+                                                double scale, icon_loaded_cb callback,
+                                                gpointer data, GDestroyNotify destroy)
+{
+        ASSERT_OR_RET(path, NULL);
+        ASSERT_OR_RET(callback, NULL);
+
+        if (!loader)
+                return NULL;
+
+        struct icon_request *req = icon_request_new(min_size, max_size, scale,
+                                                    callback, data, destroy);
+        req->path = g_strdup(path);
+        return icon_request_push(req);
+}
+
+/* see icon-cache.h */
+struct icon_request *icon_cache_load_source_async(cairo_surface_t *source, const char *id,
+                                                  int width, int height,
+                                                  int min_size, int max_size,
+                                                  double scale, icon_loaded_cb callback,
+                                                  gpointer data, GDestroyNotify destroy)
+{
+        ASSERT_OR_RET(source, NULL);
+        ASSERT_OR_RET(id, NULL);
+        ASSERT_OR_RET(callback, NULL);
+
+        if (!loader)
+                return NULL;
+
+        struct icon_request *req = icon_request_new(min_size, max_size, scale,
+                                                    callback, data, destroy);
+        req->source = cairo_surface_reference(source);
+        req->id = g_strdup(id);
+        req->width = width;
+        req->height = height;
+        return icon_request_push(req);
+}
+
+/* see icon-cache.h */
+void icon_cache_request_cancel(struct icon_request *req)
+{
+        ASSERT_OR_RET(req,);
+        g_atomic_int_set(&req->cancelled, 1);
+}
+
+/* see icon-cache.h */
+void icon_cache_pin_defaults(double scale)
+{
+        // The icon sizes of notifications without any matching rule
+        struct notification *n = notification_create();
+        struct rule *global = get_rule("global");
+        if (global)
+                rule_apply(global, n);
+
+        for (int urg = URG_MIN; urg <= URG_MAX; urg++) {
+                if (STR_EMPTY(settings.icons[urg]))
+                        continue;
+
+                char *path = get_path_from_icon_name(settings.icons[urg], n->min_icon_size);
+                if (!path)
+                        continue;
+
+                cairo_surface_t *srf = icon_cache_load_file_full(path, n->min_icon_size,
+                                                                 n->max_icon_size, scale, true);
+                if (srf)
+                        cairo_surface_destroy(srf);
+                g_free(path);
+        }
+
+        notification_unref(n);
+}
+
+/* see icon-cache.h */
+gsize icon_cache_size(void)
+{
+        g_mutex_lock(&cache_lock);
+        gsize size = unpinned_size + pinned_size;
+        g_mutex_unlock(&cache_lock);
+        return size;
+}
+
+/* see icon-cache.h */
+void icon_cache_clear(void)
+{
+        g_mutex_lock(&cache_lock);
+        if (entries) {
+                GList *values = g_hash_table_get_values(entries);
+                for (GList *iter = values; iter; iter = iter->next)
+                        icon_cache_remove(iter->data);
+                g_list_free(values);
+                g_clear_pointer(&entries, g_hash_table_unref);
+        }
+        g_mutex_unlock(&cache_lock);
+}
+
+/* vim: set ft=c tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -0,0 +1,148 @@
+#ifndef DUNST_ICON_CACHE_H
+#define DUNST_ICON_CACHE_H
+
+#include <cairo.h>
+#include <glib.h>
+#include <stdbool.h>
+
+/**
+ * A least recently used cache of decoded icon surfaces, shared by all
+ * notifications. The cache holds a reference on every surface it stores,
+ * so evicting a surface never affects a notification still showing it.
+ *
+ * The amount of memory held by unpinned surfaces is limited by
+ * settings.icon_cache_size. All functions are thread safe.
+ */
+
+/**
+ * Build the cache key for an icon, which was rasterised from \p source.
+ *
+ * @param source The identifier of the icon source, e.g. a path
+ * @param min_size The minimum icon size the icon was clamped to
+ * @param max_size The maximum icon size the icon was clamped to
+ * @param scale The output scale the icon was rasterised for
+ * @returns a newly allocated key
+ */
+char *icon_cache_key(const char *source, int min_size, int max_size, double scale);
+
+/**
+ * Look up a surface in the cache and mark it as most recently used.
+ *
+ * @returns a new reference to the cached surface
+ * @retval NULL if there is no surface for \p key
+ */
+cairo_surface_t *icon_cache_get(const char *key);
+
+/**
+ * Store a surface in the cache. If the cache exceeds its budget afterwards,
+ * the least recently used unpinned surfaces are evicted.
+ *
+ * @param key The key to store the surface for
+ * @param srf The surface. The cache takes its own reference.
+ * @param pinned Exclude the surface from eviction. Pinned surfaces don't
+ *               count against the budget.
+ */
+void icon_cache_put(const char *key, cairo_surface_t *srf, bool pinned);
+
+/**
+ * Load an icon file, scaled according to the given sizes, through the cache.
+ * The cache entry is bound to the modification time of the file.
+ *
+ * @param path The full path of the icon
+ * @param min_size An integer representing the desired minimum unscaled icon size.
+ * @param max_size An integer representing the desired maximum unscaled icon size.
+ * @param scale The output scale
+ * @returns a new reference to the surface
+ * @retval NULL if the icon cannot be loaded
+ */
+cairo_surface_t *icon_cache_load_file(const char *path, int min_size, int max_size, double scale);
+
+/**
+ * Called on the main loop with the result of an asynchronous icon load.
+ *
+ * @param srf The loaded surface or NULL, if the icon could not be loaded.
+ *            Take a reference to keep it.
+ * @param data The data given to icon_cache_load_file_async()
+ */
+typedef void (*icon_loaded_cb)(cairo_surface_t *srf, gpointer data);
+
+/** A pending asynchronous icon load */
+struct icon_request;
+
+/**
+ * Start the worker threads, which decode icons for
+ * icon_cache_load_file_async().
+ */
+void icon_cache_loader_start(void);
+
+/**
+ * Stop the worker threads. Requests, which have not finished yet, get
+ * cancelled and freed: their callbacks aren't invoked anymore, but their
+ * destroy functions are.
+ */
+void icon_cache_loader_stop(void);
+
+/**
+ * Load an icon like icon_cache_load_file(), but decode it on a worker
+ * thread. \p callback gets invoked on the main loop once the icon is loaded,
+ * unless the request got cancelled before.
+ *
+ * @param path The full path of the icon
+ * @param min_size An integer representing the desired minimum unscaled icon size.
+ * @param max_size An integer representing the desired maximum unscaled icon size.
+ * @param scale The output scale
+ * @param callback The function to receive the icon
+ * @param data The data passed to \p callback
+ * @param destroy Frees \p data after the request finished or got cancelled.
+ *                May be NULL.
+ * @returns the request, which stays valid until \p callback got called or
+ *          the request got cancelled.
+ * @retval NULL if the loader isn't running. Load the icon synchronously then.
+ */
+struct icon_request *icon_cache_load_file_async(const char *path, int min_size, int max_size,
+                                                double scale, icon_loaded_cb callback,
+                                                gpointer data, GDestroyNotify destroy);
+
+/**
+ * Rasterise a raw icon for another scale like icon_get_for_source(), but on
+ * a worker thread. Otherwise it behaves like icon_cache_load_file_async().
+ *
+ * @param source The icon as returned by icon_get_for_data()
+ * @param id The id of \p source
+ * @param width The width of the raw image data
+ * @param height The height of the raw image data
+ * @returns the request, see icon_cache_load_file_async()
+ * @retval NULL if the loader isn't running. Use icon_get_for_source() then.
+ */
+struct icon_request *icon_cache_load_source_async(cairo_surface_t *source, const char *id,
+                                                  int width, int height,
+                                                  int min_size, int max_size,
+                                                  double scale, icon_loaded_cb callback,
+                                                  gpointer data, GDestroyNotify destroy);
+
+/**
+ * Cancel a pending request. Its callback won't be called anymore and the
+ * request must not be used afterwards.
+ */
+void icon_cache_request_cancel(struct icon_request *req);
+
+/**
+ * Load the default icons of every urgency into the cache and pin them, so
+ * they are never decoded again.
+ *
+ * @param scale The output scale
+ */
+void icon_cache_pin_defaults(double scale);
+
+/**
+ * The amount of bytes held by the cache, including pinned surfaces.
+ */
+gsize icon_cache_size(void);
+
+/**
+ * Remove all surfaces from the cache, including pinned ones.
+ */
+void icon_cache_clear(void);
+
+#endif
+/* vim: set ft=c tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -0,0 +1,512 @@
+#include "icon-disk-cache.h"
+
+#include <fcntl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hash.h"
+#include "log.h"
+#include "settings.h"
+#include "utils.h"
+
+#define PACK_MAGIC "DUNSTIC1"
+#define PACK_MAX_SIZE (64 * 1024 * 1024) /**< The oldest icons are dropped beyond this size */
+#define PACK_ALIGN 16
+#define PACK_FLUSH_DELAY 2      /**< Seconds to collect new icons before writing them */
+
+struct pack_header {
+        char magic[8];
+        guint32 n_entries;
+        guint32 reserved;
+};
+
+/* The entries follow the header, sorted by the hash of their keys. The keys
+ * are stored NUL terminated. */
+struct pack_entry {
+        guint64 hash;
+        guint64 data_offset;
+        guint32 key_offset;
+        guint32 key_len;
+        gint32 format;
+        gint32 width;
+        gint32 height;
+        gint32 stride;
+};
+
+/* A mapped pack file */
+struct pack {
+        gint refcount;
+        guint8 *data;
+        gsize size;
+        struct stat st;         /**< Identifies the mapped file */
+        guint32 n_entries;
+        const struct pack_entry *entries;
+};
+
+/* An icon to be written */
+struct pack_item {
+        guint64 hash;
+        const char *key;
+        guint32 key_len;
+        cairo_format_t format;
+        int width;
+        int height;
+        int stride;
+        const guint8 *data;
+};
+
+struct pending_icon {
+        char *key;
+        cairo_surface_t *srf;
+};
+
+static const cairo_user_data_key_t pack_user_data_key;
+
+static GMutex lock;                     /**< Protects the fields below */
+static char *pack_path = NULL;
+static struct pack *current = NULL;     /**< The pack used for lookups */
+static GPtrArray *pending = NULL;       /**< The icons waiting to be written */
+static guint flush_source = 0;
+
+static GThread *writer = NULL;          /**< Only used from the main thread */
+
+static struct pack *pack_ref(struct pack *pack)
+{
+        g_atomic_int_inc(&pack->refcount);
+        return pack;
+}
+
+static void pack_unref(struct pack *pack)
+{
+        if (!g_atomic_int_dec_and_test(&pack->refcount))
+                return;
+
+        munmap(pack->data, pack->size);
+        g_free(pack);
+}
+
+static struct pack *pack_open(const char *path)
+{
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+                return NULL;
+
+        struct stat st;
+        void *data = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(struct pack_header))
+                data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+
+        if (data == MAP_FAILED)
+                return NULL;
+
+        const struct pack_header *header = data;
+        gsize max_entries = (st.st_size - sizeof(struct pack_header)) / sizeof(struct pack_entry);
+        if (memcmp(header->magic, PACK_MAGIC, sizeof(header->magic)) != 0
+            || header->n_entries > max_entries) {
+                LOG_W("Ignoring invalid icon pack '%s'", path);
+                munmap(data, st.st_size);
+                return NULL;
+        }
+
+        struct pack *pack = g_malloc0(sizeof(struct pack));
+        pack->refcount = 1;
+        pack->data = data;
+        pack->size = st.st_size;
+        pack->st = st;
+        pack->n_entries = header->n_entries;
+        pack->entries = (const struct pack_entry *) (pack->data + sizeof(struct pack_header));
+        return pack;
+}
+
+/* Never trust the pack file, another instance might have written garbage */
+static bool pack_entry_is_valid(const struct pack *pack, const struct pack_entry *e)
+{
+        if ((gsize) e->key_offset + e->key_len >= pack->size
+            || pack->data[e->key_offset + e->key_len] != '\0')
+                return false;
+
+        if (e->format != CAIRO_FORMAT_ARGB32 && e->format != CAIRO_FORMAT_RGB24)
+                return false;
+
+        if (e->width <= 0 || e->height <= 0)
+                return false;
+
+        // The width may be too large for cairo, then there's no valid stride
+        int min_stride = cairo_format_stride_for_width(e->format, e->width);
+        if (min_stride < 0 || e->stride <= 0 || e->stride < min_stride
+            || e->data_offset % PACK_ALIGN != 0
+            || e->data_offset > pack->size
+            || (pack->size - e->data_offset) / e->stride < e->height)
+                return false;
+
+        return true;
+}
+
+static cairo_surface_t *pack_lookup(struct pack *pack, const char *key)
+{
+        guint32 key_len = strlen(key);
+        guint64 hash = hash_data(key, key_len, 0);
+
+        // Find the first entry with the hash
+        guint32 lo = 0, hi = pack->n_entries;
+        while (lo < hi) {
+                guint32 mid = lo + (hi - lo) / 2;
+                if (pack->entries[mid].hash < hash)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+
+        for (guint32 i = lo; i < pack->n_entries && pack->entries[i].hash == hash; i++) {
+                const struct pack_entry *e = &pack->entries[i];
+                if (!pack_entry_is_valid(pack, e) || e->key_len != key_len
+                    || memcmp(pack->data + e->key_offset, key, key_len) != 0)
+                        continue;
+
+                cairo_surface_t *srf = cairo_image_surface_create_for_data(
+                                pack->data + e->data_offset, e->format,
+                                e->width, e->height, e->stride);
+                if (cairo_surface_status(srf) != CAIRO_STATUS_SUCCESS) {
+                        cairo_surface_destroy(srf);
+                        return NULL;
+                }
+
+                // The mapping has to outlive the surface
+                cairo_surface_set_user_data(srf, &pack_user_data_key, pack_ref(pack),
+                                            (cairo_destroy_func_t) pack_unref);
+                return srf;
+        }
+
+        return NULL;
+}
+
+/* Has to be called with the lock held */
+static const char *icon_disk_cache_path(void)
+{
+        if (!pack_path)
+                pack_path = g_build_filename(g_get_user_cache_dir(), "dunst", "icons.pack", NULL);
+        return pack_path;
+}
+
+/* Map the pack file again, if it got replaced.
+ * Has to be called with the lock held */
+static void icon_disk_cache_refresh(void)
+{
+        struct stat st;
+        if (stat(icon_disk_cache_path(), &st) != 0) {
+                g_clear_pointer(&current, pack_unref);
+                return;
+        }
+
+        if (current
+            && current->st.st_dev == st.st_dev
+            && current->st.st_ino == st.st_ino
+            && current->st.st_mtime == st.st_mtime
+            && current->st.st_size == st.st_size)
+                return;
+
+        g_clear_pointer(&current, pack_unref);
+        current = pack_open(icon_disk_cache_path());
+}
+
+/* see icon-disk-cache.h */
+cairo_surface_t *icon_disk_cache_get(const char *key)
+{
+        ASSERT_OR_RET(key, NULL);
+
+        if (!settings.icon_disk_cache)
+                return NULL;
+
+        g_mutex_lock(&lock);
+        icon_disk_cache_refresh();
+        struct pack *pack = current ? pack_ref(current) : NULL;
+        g_mutex_unlock(&lock);
+
+        if (!pack)
+                return NULL;
+
+        cairo_surface_t *srf = pack_lookup(pack, key);
+        pack_unref(pack);
+        return srf;
+}
+
+static void pending_icon_free(gpointer data)
+{
+        struct pending_icon *icon = data;
+        cairo_surface_destroy(icon->srf);
+        g_free(icon->key);
+        g_free(icon);
+}
+
+static gint pack_item_cmp(gconstpointer a, gconstpointer b)
+{
+        const struct pack_item *item_a = a, *item_b = b;
+        return (item_a->hash > item_b->hash) - (item_a->hash < item_b->hash);
+}
+
+/**
+ * Add an item to write, unless there's an item with the same key already
+ * or the pack would get too big.
+ */
+static void pack_items_add(GArray *items, GHashTable *keys, gsize *total,
+                           const struct pack_item *item)
+{
+        if (g_hash_table_contains(keys, item->key))
+                return;
+
+        gsize size = sizeof(struct pack_entry) + item->key_len + 1 + PACK_ALIGN
+                     + (gsize) item->stride * item->height;
+        if (*total + size > PACK_MAX_SIZE)
+                return;
+
+        *total += size;
+        g_hash_table_add(keys, (gpointer) item->key);
+        g_array_append_vals(items, item, 1);
+}
+
+static bool pack_write_padding(FILE *f, gsize *offset)
+{
+        static const char zeros[PACK_ALIGN] = { 0 };
+        gsize padding = (PACK_ALIGN - *offset % PACK_ALIGN) % PACK_ALIGN;
+        *offset += padding;
+        return fwrite(zeros, 1, padding, f) == padding;
+}
+
+static bool pack_write_items(FILE *f, GArray *items)
+{
+        struct pack_header header = { .n_entries = items->len };
+        memcpy(header.magic, PACK_MAGIC, sizeof(header.magic));
+        if (fwrite(&header, sizeof(header), 1, f) != 1)
+                return false;
+
+        // The keys directly follow the entries, then the aligned pixel data
+        gsize key_offset = sizeof(header) + items->len * sizeof(struct pack_entry);
+        gsize data_offset = key_offset;
+        for (guint i = 0; i < items->len; i++)
+                data_offset += g_array_index(items, struct pack_item, i).key_len + 1;
+
+        for (guint i = 0; i < items->len; i++) {
+                const struct pack_item *item = &g_array_index(items, struct pack_item, i);
+                data_offset += (PACK_ALIGN - data_offset % PACK_ALIGN) % PACK_ALIGN;
+
+                struct pack_entry entry = {
+                        .hash = item->hash,
+                        .data_offset = data_offset,
+                        .key_offset = key_offset,
+                        .key_len = item->key_len,
+                        .format = item->format,
+                        .width = item->width,
+                        .height = item->height,
+                        .stride = item->stride,
+                };
+                if (fwrite(&entry, sizeof(entry), 1, f) != 1)
+                        return false;
+
+                key_offset += item->key_len + 1;
+                data_offset += (gsize) item->stride * item->height;
+        }
+
+        gsize offset = sizeof(header) + items->len * sizeof(struct pack_entry);
+        for (guint i = 0; i < items->len; i++) {
+                const struct pack_item *item = &g_array_index(items, struct pack_item, i);
+                if (fwrite(item->key, 1, item->key_len + 1, f) != item->key_len + 1)
+                        return false;
+                offset += item->key_len + 1;
+        }
+
+        for (guint i = 0; i < items->len; i++) {
+                const struct pack_item *item = &g_array_index(items, struct pack_item, i);
+                gsize size = (gsize) item->stride * item->height;
+                if (!pack_write_padding(f, &offset) || fwrite(item->data, 1, size, f) != size)
+                        return false;
+                offset += size;
+        }
+
+        return true;
+}
+
+/**
+ * Write a new pack file with the given icons and the icons of the current
+ * pack file and move it in place.
+ */
+static void pack_write(const char *path, GPtrArray *icons)
+{
+        char *dir = g_path_get_dirname(path);
+        int ret = g_mkdir_with_parents(dir, 0700);
+        g_free(dir);
+        if (ret != 0) {
+                LOG_W("Cannot create the directory for the icon pack '%s'", path);
+                return;
+        }
+
+        // Another instance may have replaced the pack meanwhile,
+        // so merge with the latest one
+        struct pack *old = pack_open(path);
+
+        GArray *items = g_array_new(FALSE, FALSE, sizeof(struct pack_item));
+        GHashTable *keys = g_hash_table_new(g_str_hash, g_str_equal);
+        gsize total = sizeof(struct pack_header);
+
+        // The newest icons go first, so they are kept if the pack gets too big
+        for (guint i = icons->len; i-- > 0;) {
+                struct pending_icon *icon = icons->pdata[i];
+                struct pack_item item = {
+                        .key = icon->key,
+                        .key_len = strlen(icon->key),
+                        .format = cairo_image_surface_get_format(icon->srf),
+                        .width = cairo_image_surface_get_width(icon->srf),
+                        .height = cairo_image_surface_get_height(icon->srf),
+                        .stride = cairo_image_surface_get_stride(icon->srf),
+                        .data = cairo_image_surface_get_data(icon->srf),
+                };
+                item.hash = hash_data(item.key, item.key_len, 0);
+                if (item.data)
+                        pack_items_add(items, keys, &total, &item);
+        }
+
+        for (guint32 i = 0; old && i < old->n_entries; i++) {
+                const struct pack_entry *e = &old->entries[i];
+                if (!pack_entry_is_valid(old, e))
+                        continue;
+
+                struct pack_item item = {
+                        .hash = e->hash,
+                        .key = (const char *) old->data + e->key_offset,
+                        .key_len = e->key_len,
+                        .format = e->format,
+                        .width = e->width,
+                        .height = e->height,
+                        .stride = e->stride,
+                        .data = old->data + e->data_offset,
+                };
+                pack_items_add(items, keys, &total, &item);
+        }
+
+        g_array_sort(items, pack_item_cmp);
+
+        char *tmp = g_strconcat(path, ".XXXXXX", NULL);
+        int fd = g_mkstemp(tmp);
+        FILE *f = fd >= 0 ? fdopen(fd, "wb") : NULL;
+        bool written = f && pack_write_items(f, items);
+        if (f)
+                written = (fclose(f) == 0) && written;
+        else if (fd >= 0)
+                close(fd);
+
+        // Readers still using the old pack keep their mapping
+        if (written && rename(tmp, path) == 0) {
+                LOG_D("Wrote %u icons to the icon pack '%s'", items->len, path);
+        } else {
+                LOG_W("Cannot write the icon pack '%s'", path);
+                if (fd >= 0)
+                        g_unlink(tmp);
+        }
+
+        g_free(tmp);
+        g_hash_table_unref(keys);
+        g_array_free(items, TRUE);
+        if (old)
+                pack_unref(old);
+}
+
+/**
+ * Write all pending icons to the pack file.
+ */
+static void icon_disk_cache_flush(void)
+{
+        g_mutex_lock(&lock);
+        GPtrArray *icons = pending;
+        pending = NULL;
+        char *path = g_strdup(icon_disk_cache_path());
+        g_mutex_unlock(&lock);
+
+        if (icons) {
+                pack_write(path, icons);
+                g_ptr_array_unref(icons);
+        }
+        g_free(path);
+}
+
+static gpointer icon_disk_cache_writer(gpointer data)
+{
+        icon_disk_cache_flush();
+        return NULL;
+}
+
+static gboolean icon_disk_cache_flush_timeout(gpointer data)
+{
+        g_mutex_lock(&lock);
+        flush_source = 0;
+        g_mutex_unlock(&lock);
+
+        if (writer)
+                g_thread_join(writer);
+
+        // Writing the pack may take a while, don't block the main loop
+        writer = g_thread_try_new("icon-disk-cache", icon_disk_cache_writer, NULL, NULL);
+        if (!writer)
+                icon_disk_cache_flush();
+
+        return G_SOURCE_REMOVE;
+}
+
+/* see icon-disk-cache.h */
+void icon_disk_cache_put(const char *key, cairo_surface_t *srf)
+{
+        ASSERT_OR_RET(key,);
+        ASSERT_OR_RET(srf,);
+
+        if (!settings.icon_disk_cache
+            || cairo_surface_get_type(srf) != CAIRO_SURFACE_TYPE_IMAGE)
+                return;
+
+        cairo_format_t format = cairo_image_surface_get_format(srf);
+        if (format != CAIRO_FORMAT_ARGB32 && format != CAIRO_FORMAT_RGB24)
+                return;
+
+        cairo_surface_flush(srf);
+
+        struct pending_icon *icon = g_malloc(sizeof(struct pending_icon));
+        icon->key = g_strdup(key);
+        icon->srf = cairo_surface_reference(srf);
+
+        g_mutex_lock(&lock);
+        if (!pending)
+                pending = g_ptr_array_new_with_free_func(pending_icon_free);
+        g_ptr_array_add(pending, icon);
+
+        if (!flush_source)
+                flush_source = g_timeout_add_seconds(PACK_FLUSH_DELAY,
+                                                     icon_disk_cache_flush_timeout, NULL);
+        g_mutex_unlock(&lock);
+}
+
+/* see icon-disk-cache.h */
+void icon_disk_cache_deinit(void)
+{
+        g_mutex_lock(&lock);
+        if (flush_source) {
+                g_source_remove(flush_source);
+                flush_source = 0;
+        }
+        g_mutex_unlock(&lock);
+
+        if (writer) {
+                g_thread_join(writer);
+                writer = NULL;
+        }
+        icon_disk_cache_flush();
+
+        g_mutex_lock(&lock);
+        g_clear_pointer(&current, pack_unref);
+        g_clear_pointer(&pack_path, g_free);
+        g_mutex_unlock(&lock);
+}
+
+/* vim: set ft=c tabstop=8 shiftwidth=8 expandtab textwidth=0: */
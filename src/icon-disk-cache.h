@@ -0,0 +1,47 @@
+#ifndef DUNST_ICON_DISK_CACHE_H
+#define DUNST_ICON_DISK_CACHE_H
+
+#include <cairo.h>
+
+/**
+ * A persistent cache of rasterised icons, shared by all dunst instances of
+ * a user. It's used, if settings.icon_disk_cache is enabled.
+ *
+ * The icons are stored as premultiplied ARGB32 or RGB24 pixels in a single
+ * pack file in $XDG_CACHE_HOME/dunst. The pack file is never modified in
+ * place. New icons are collected for a while and then written to a new pack
+ * file, which atomically replaces the old one, so readers never need a lock.
+ *
+ * All functions are thread safe.
+ */
+
+/**
+ * Look up an icon in the pack file.
+ *
+ * The surface maps the pixel data of the pack file directly and keeps the
+ * mapping alive. Its pixels are read-only and must never be drawn into.
+ *
+ * @param key The key of the icon, as used for the icon cache
+ * @returns a new surface
+ * @retval NULL if the icon isn't in the pack file or the cache is disabled
+ */
+cairo_surface_t *icon_disk_cache_get(const char *key);
+
+/**
+ * Queue an icon to be written to the pack file. The pack file is rewritten
+ * in the background a few seconds later, with all icons queued meanwhile.
+ *
+ * @param key The key of the icon, as used for the icon cache
+ * @param srf The ARGB32 or RGB24 image surface of the icon. The cache takes
+ *            its own reference, so don't change its pixels anymore.
+ */
+void icon_disk_cache_put(const char *key, cairo_surface_t *srf);
+
+/**
+ * Write all queued icons to the pack file right away and drop the mapping
+ * of the pack file.
+ */
+void icon_disk_cache_deinit(void);
+
+#endif
+/* vim: set ft=c tabstop=8 shiftwidth=8 expandtab textwidth=0: */
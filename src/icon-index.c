@@ -0,0 +1,216 @@
+#include "icon-index.h"
+
+#include <errno.h>
+#include <glib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "log.h"
+#include "utils.h"
+
+/** The maximum amount of remembered misses */
+#define MISSING_MAX 512
+
+/* A directory used by a lookup */
+struct icon_dir {
+        GHashTable *files;      /**< The set of files in the directory, NULL if it doesn't exist */
+        bool watched;           /**< If changes to the files get noticed */
+};
+
+static GHashTable *dirs = NULL;         /**< Maps the used directories to their struct icon_dir */
+static GHashTable *missing = NULL;      /**< The remembered misses */
+static GQueue missing_order = G_QUEUE_INIT; /**< The remembered misses, oldest first */
+static bool lookup_unwatched = false;   /**< The current lookup checked files, which aren't watched */
+static int inotify_fd = -1;
+
+static void icon_dir_free(gpointer data)
+{
+        struct icon_dir *d = data;
+        if (d->files)
+                g_hash_table_unref(d->files);
+        g_free(d);
+}
+
+/**
+ * Drop everything, if any of the watched directories changed.
+ */
+static void icon_index_process_events(void)
+{
+#ifdef __linux__
+        if (inotify_fd < 0)
+                return;
+
+        char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        bool changed = false;
+        while (read(inotify_fd, buf, sizeof(buf)) > 0)
+                changed = true;
+
+        if (changed) {
+                LOG_D("Icon directories changed, dropping the icon index");
+                icon_index_clear();
+        }
+#endif
+}
+
+/**
+ * Watch a directory for files being added or removed.
+ *
+ * @retval true if the directory is watched
+ * @retval false if it can't be watched
+ */
+static bool icon_index_watch(const char *path)
+{
+#ifdef __linux__
+        if (inotify_fd < 0) {
+                inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+                if (inotify_fd < 0) {
+                        LOG_D("Cannot watch icon directories: %s", strerror(errno));
+                        return false;
+                }
+        }
+
+        const uint32_t events = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+                              | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+        return inotify_add_watch(inotify_fd, path, events) >= 0;
+#else
+        return false;
+#endif
+}
+
+/**
+ * Watch the closest ancestor of \p dir, which exists. It notices \p dir, or
+ * one of the directories in between, getting created.
+ *
+ * @retval false if no ancestor can be watched
+ */
+static bool icon_index_watch_ancestor(const char *dir)
+{
+        bool watched;
+        char *path = g_path_get_dirname(dir);
+
+        while (!(watched = g_file_test(path, G_FILE_TEST_IS_DIR) && icon_index_watch(path))) {
+                char *parent = g_path_get_dirname(path);
+                bool top = STR_EQ(parent, path);
+                g_free(path);
+                path = parent;
+                if (top)
+                        break;
+        }
+
+        g_free(path);
+        return watched;
+}
+
+/**
+ * Read the files of a directory into the index. Directories, which can't
+ * be watched, are remembered as well, so they aren't tried again.
+ */
+static struct icon_dir *icon_index_add_dir(const char *dir)
+{
+        struct icon_dir *d = g_malloc0(sizeof(struct icon_dir));
+
+        // Watch first, so nothing gets lost between reading and watching
+        if (icon_index_watch(dir)) {
+                d->watched = true;
+                d->files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+                GDir *gdir = g_dir_open(dir, 0, NULL);
+                const char *name;
+                while (gdir && (name = g_dir_read_name(gdir)))
+                        g_hash_table_add(d->files, g_strdup(name));
+                if (gdir)
+                        g_dir_close(gdir);
+        } else if (!g_file_test(dir, G_FILE_TEST_EXISTS)) {
+                // Lots of theme directories don't exist. Notice if they get
+                // created.
+                d->watched = icon_index_watch_ancestor(dir);
+        }
+
+        if (!dirs)
+                dirs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, icon_dir_free);
+        g_hash_table_insert(dirs, g_strdup(dir), d);
+        return d;
+}
+
+/* see icon-index.h */
+bool icon_index_has_file(const char *dir, const char *filename)
+{
+        ASSERT_OR_RET(dir, false);
+        ASSERT_OR_RET(filename, false);
+
+        icon_index_process_events();
+
+        struct icon_dir *d = dirs ? g_hash_table_lookup(dirs, dir) : NULL;
+        if (!d)
+                d = icon_index_add_dir(dir);
+
+        if (d->watched && !d->files)
+                return false;
+
+        // Only the files directly inside the directory are indexed
+        bool nested = strchr(filename, '/');
+        if (d->watched && !nested)
+                return g_hash_table_contains(d->files, filename);
+
+        // Without a watch, we'd never notice the file showing up
+        lookup_unwatched = true;
+
+        char *path = g_build_filename(dir, filename, NULL);
+        bool exists = g_file_test(path, G_FILE_TEST_EXISTS);
+        g_free(path);
+        return exists;
+}
+
+/* see icon-index.h */
+bool icon_index_is_missing(const char *key)
+{
+        ASSERT_OR_RET(key, false);
+
+        // A new lookup starts
+        lookup_unwatched = false;
+
+        icon_index_process_events();
+        return missing && g_hash_table_contains(missing, key);
+}
+
+/* see icon-index.h */
+void icon_index_remember_missing(const char *key)
+{
+        ASSERT_OR_RET(key,);
+
+        // Without a watch, we'd never notice the icon showing up
+        if (lookup_unwatched)
+                return;
+
+        if (!missing)
+                missing = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        if (g_hash_table_contains(missing, key))
+                return;
+
+        char *copy = g_strdup(key);
+        g_hash_table_add(missing, copy);
+        g_queue_push_tail(&missing_order, copy);
+
+        while (g_queue_get_length(&missing_order) > MISSING_MAX)
+                g_hash_table_remove(missing, g_queue_pop_head(&missing_order));
+}
+
+/* see icon-index.h */
+void icon_index_clear(void)
+{
+        g_clear_pointer(&dirs, g_hash_table_unref);
+        g_clear_pointer(&missing, g_hash_table_unref);
+        g_queue_clear(&missing_order);
+
+        // Closing the descriptor removes all watches along with the
+        // events still pending for them
+        if (inotify_fd >= 0) {
+                close(inotify_fd);
+                inotify_fd = -1;
+        }
+}
+
+/* vim: set ft=c tabstop=8 shiftwidth=8 expandtab textwidth=0: */
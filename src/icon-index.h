@@ -0,0 +1,56 @@
+#ifndef DUNST_ICON_INDEX_H
+#define DUNST_ICON_INDEX_H
+
+#include <stdbool.h>
+
+/**
+ * An in-memory index of the files in icon directories, and a bounded cache
+ * of icon lookups which found nothing.
+ *
+ * Directories get indexed on their first use and are watched with inotify.
+ * Any change to a watched directory drops the whole index and all remembered
+ * misses, so newly installed icons are found without a restart. Missing
+ * directories are watched through their closest existing ancestor. Where a
+ * directory can't be watched, lookups go straight to the file system and
+ * their misses aren't remembered.
+ *
+ * Not thread safe, only use it from the main thread.
+ */
+
+/**
+ * Check if \p dir contains a file called \p filename.
+ *
+ * This doesn't check if the file is readable, do that for the file
+ * you're actually going to use.
+ *
+ * @param dir The full path to the directory
+ * @param filename The name of the file within \p dir
+ */
+bool icon_index_has_file(const char *dir, const char *filename);
+
+/**
+ * Check if a lookup has been remembered as unsuccessful with
+ * icon_index_remember_missing(). Call this at the start of every lookup,
+ * it also starts tracking, if the lookup only checks watched directories.
+ *
+ * @param key Describes the lookup, e.g. the icon name and all other
+ *            parameters influencing the result.
+ */
+bool icon_index_is_missing(const char *key);
+
+/**
+ * Remember that a lookup found nothing. Only a limited amount of misses is
+ * remembered, the oldest are forgotten first. Nothing is remembered, if
+ * the lookup checked any file in a directory, which isn't watched.
+ *
+ * @param key Describes the lookup, see icon_index_is_missing()
+ */
+void icon_index_remember_missing(const char *key);
+
+/**
+ * Drop the index and all remembered misses.
+ */
+void icon_index_clear(void);
+
+#endif
+/* vim: set ft=c tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -3,10 +3,13 @@
 
 #include <glib.h>
 #include <stdio.h>
+#include <string.h>
 #include <malloc.h>
 #include <unistd.h>
 #include <assert.h>
 
+#include "icon-index.h"
+#include "icon-theme-cache.h"
 #include "ini.h"
 #include "utils.h"
 #include "log.h"
@@ -16,6 +19,28 @@ int icon_themes_count = 0;
 int *default_themes_index = NULL;
 int default_themes_count = 0;
 
+/**
+ * Find the position of every theme directory in the theme's cache.
+ */
+static void icon_theme_map_cache_dirs(struct icon_theme *theme)
+{
+        GHashTable *cache_dirs = g_hash_table_new(g_str_hash, g_str_equal);
+        int count = icon_theme_cache_dir_count(theme->cache);
+        for (int i = 0; i < count; i++) {
+                const char *name = icon_theme_cache_dir_name(theme->cache, i);
+                if (name)
+                        g_hash_table_insert(cache_dirs, (gpointer) name, GINT_TO_POINTER(i + 1));
+        }
+
+        for (int i = 0; i < theme->dirs_count; i++) {
+                // 0 means not found, so the indices are stored off by one
+                theme->dirs[i].cache_index =
+                        GPOINTER_TO_INT(g_hash_table_lookup(cache_dirs, theme->dirs[i].name)) - 1;
+        }
+
+        g_hash_table_unref(cache_dirs);
+}
+
 int get_icon_theme(char *name) {
         for (int i = 0; i < icon_themes_count; i++) {
                 if (STR_EQ(icon_themes[i].subdir_theme, name)){
@@ -26,133 +51,160 @@ int get_icon_theme(char *name) {
 }
 
 /**
- * Load a theme from a directory. Don't call this function if the theme is
- * already loaded. It also loads the inherited themes. If there are no
- * inherited themes, the theme "hicolor" is inherited.
+ * Append a theme, which isn't loaded yet, to the list "icon_themes".
  *
- * If it succeeds loading the theme, it adds theme to the list "icon_themes".
- *
- * @param icon_dir A directory where icon themes are stored
  * @param subdir_theme The subdirectory in which the theme is located
+ * @returns the index of the new theme
+ */
+static int icon_theme_append(const char *subdir_theme)
+{
+        icon_themes_count++;
+        icon_themes = realloc(icon_themes, icon_themes_count * sizeof(struct icon_theme));
+        int index = icon_themes_count - 1;
+        memset(&icon_themes[index], 0, sizeof(struct icon_theme));
+        icon_themes[index].subdir_theme = g_strdup(subdir_theme);
+        icon_themes[index].state = THEME_UNLOADED;
+        return index;
+}
+
+/**
+ * Parse the index.theme of a theme. The inherited themes are only
+ * remembered by name and get resolved once they are needed. If there are no
+ * inherited themes, the theme "hicolor" is inherited.
  *
- * @returns the index to the theme that was loaded
- * @retval -1 means no index was found
+ * @param theme The theme to fill in, which has its subdir_theme set. It's
+ *              left untouched if parsing fails.
+ * @param icon_dir A directory where icon themes are stored
+ * @retval false if the theme isn't located in \p icon_dir
  */
-int load_icon_theme_from_dir(const char *icon_dir, const char *subdir_theme) {
-        LOG_D("Loading theme %s/%s\n", icon_dir, subdir_theme);
-        char *theme_index_dir = g_build_filename(icon_dir, subdir_theme, "index.theme", NULL);
+static bool icon_theme_parse(struct icon_theme *theme, const char *icon_dir)
+{
+        LOG_D("Loading theme %s/%s\n", icon_dir, theme->subdir_theme);
+        char *theme_index_dir = g_build_filename(icon_dir, theme->subdir_theme, "index.theme", NULL);
         FILE *theme_index = fopen(theme_index_dir, "r");
         g_free(theme_index_dir);
         if (!theme_index)
-                return -1;
+                return false;
 
         struct ini *ini = load_ini_file(theme_index);
         fclose(theme_index);
         if (ini->section_count == 0) {
                 finish_ini(ini);
                 free(ini);
-                return -1;
+                return false;
         }
 
-        icon_themes_count++;
-        icon_themes = realloc(icon_themes, icon_themes_count * sizeof(struct icon_theme));
-        int index = icon_themes_count - 1;
-        icon_themes[index].name = g_strdup(section_get_value(ini, &ini->sections[0], "Name"));
-        icon_themes[index].location = g_strdup(icon_dir);
-        icon_themes[index].subdir_theme = g_strdup(subdir_theme);
-        icon_themes[index].inherits_index = NULL;
-        icon_themes[index].inherits_count = 0;
+        theme->name = g_strdup(section_get_value(ini, &ini->sections[0], "Name"));
+        theme->location = g_strdup(icon_dir);
+        theme->inherits = NULL;
+        theme->inherits_index = NULL;
+        theme->inherits_count = 0;
+
+        char *theme_dir = g_build_filename(icon_dir, theme->subdir_theme, NULL);
+        theme->cache = icon_theme_cache_open(theme_dir);
+        g_free(theme_dir);
 
         // load theme directories
-        icon_themes[index].dirs_count = ini->section_count - 1;
-        icon_themes[index].dirs = calloc(icon_themes[index].dirs_count, sizeof(struct icon_theme_dir));
+        theme->dirs_count = ini->section_count - 1;
+        theme->dirs = calloc(theme->dirs_count, sizeof(struct icon_theme_dir));
 
-        for (int i = 0; i < icon_themes[index].dirs_count; i++) {
+        for (int i = 0; i < theme->dirs_count; i++) {
                 struct section section = ini->sections[i+1];
-                icon_themes[index].dirs[i].name = g_strdup(section.name);
+                theme->dirs[i].name = g_strdup(section.name);
 
                 // read size
                 const char *size_str = section_get_value(ini, &section, "Size");
-                safe_string_to_int(&icon_themes[index].dirs[i].size, size_str);
+                safe_string_to_int(&theme->dirs[i].size, size_str);
 
                 // read optional scale, defaulting to 1
                 const char *scale_str = section_get_value(ini, &section, "Scale");
-                icon_themes[index].dirs[i].scale = 1;
+                theme->dirs[i].scale = 1;
                 if (scale_str){
-                        safe_string_to_int(&icon_themes[index].dirs[i].scale, scale_str);
+                        safe_string_to_int(&theme->dirs[i].scale, scale_str);
                 }
 
                 // read type
                 const char *type = section_get_value(ini, &section, "Type");
                 if (STR_EQ(type, "Fixed")) {
-                        icon_themes[index].dirs[i].type = THEME_DIR_FIXED;
+                        theme->dirs[i].type = THEME_DIR_FIXED;
                 } else if (STR_EQ(type, "Scalable")) {
-                        icon_themes[index].dirs[i].type = THEME_DIR_SCALABLE;
+                        theme->dirs[i].type = THEME_DIR_SCALABLE;
                 } else if (STR_EQ(type, "Threshold")) {
-                        icon_themes[index].dirs[i].type = THEME_DIR_THRESHOLD;
+                        theme->dirs[i].type = THEME_DIR_THRESHOLD;
                 } else {
                         // default to type threshold
-                        icon_themes[index].dirs[i].type = THEME_DIR_THRESHOLD;
+                        theme->dirs[i].type = THEME_DIR_THRESHOLD;
                 }
 
                 // read type-specific data
-                if (icon_themes[index].dirs[i].type == THEME_DIR_SCALABLE) {
+                if (theme->dirs[i].type == THEME_DIR_SCALABLE) {
                         const char *min_size = section_get_value(ini, &section, "MinSize");
                         if (min_size)
-                                safe_string_to_int(&icon_themes[index].dirs[i].min_size, min_size);
+                                safe_string_to_int(&theme->dirs[i].min_size, min_size);
                         else
-                                icon_themes[index].dirs[i].min_size = icon_themes[index].dirs[i].size;
+                                theme->dirs[i].min_size = theme->dirs[i].size;
 
                         const char *max_size = section_get_value(ini, &section, "MaxSize");
                         if (max_size)
-                                safe_string_to_int(&icon_themes[index].dirs[i].max_size, max_size);
+                                safe_string_to_int(&theme->dirs[i].max_size, max_size);
                         else
-                                icon_themes[index].dirs[i].max_size = icon_themes[index].dirs[i].size;
+                                theme->dirs[i].max_size = theme->dirs[i].size;
 
-                } else if (icon_themes[index].dirs[i].type == THEME_DIR_THRESHOLD) {
-                        icon_themes[index].dirs[i].threshold = 2;
+                } else if (theme->dirs[i].type == THEME_DIR_THRESHOLD) {
+                        theme->dirs[i].threshold = 2;
                         const char *threshold = section_get_value(ini, &section, "Threshold");
                         if (threshold){
-                                safe_string_to_int(&icon_themes[index].dirs[i].threshold, threshold);
+                                safe_string_to_int(&theme->dirs[i].threshold, threshold);
                         }
                 }
         }
 
+        if (theme->cache)
+                icon_theme_map_cache_dirs(theme);
 
-        // load inherited themes
-        if (!STR_EQ(icon_themes[index].name, "Hicolor"))
+        // remember inherited themes
+        if (!STR_EQ(theme->name, "Hicolor"))
         {
                 char **inherits = string_to_array(get_value(ini, "Icon Theme", "Inherits"), ",");
-                icon_themes[index].inherits_count = string_array_length(inherits);
-                LOG_D("Theme has %i inherited themes\n", icon_themes[index].inherits_count);
-                if (icon_themes[index].inherits_count <= 0) {
+                theme->inherits_count = string_array_length(inherits);
+                LOG_D("Theme has %i inherited themes\n", theme->inherits_count);
+                if (theme->inherits_count <= 0) {
                         // set fallback theme to hicolor if there are no inherits
                         g_strfreev(inherits);
                         inherits = calloc(2, sizeof(char*));
                         inherits[0] = g_strdup("hicolor");
                         inherits[1] = NULL;
-                        icon_themes[index].inherits_count = 1;
+                        theme->inherits_count = 1;
                 }
-
-                icon_themes[index].inherits_index = calloc(icon_themes[index].inherits_count, sizeof(int));
-
-                for (int i = 0; inherits[i] != NULL; i++) {
-                        LOG_D("inherits: %s\n", inherits[i]);
-                        icon_themes[index].inherits_index[i] = get_icon_theme(inherits[i]);
-                        if (icon_themes[index].inherits_index[i] == -1) {
-                                LOG_D("Loading inherited theme\n");
-                                // FIXME don't use a pointer to the theme,
-                                // since it may be invalidated after realloc. Use an index instead
-                                icon_themes[index].inherits_index[i] = load_icon_theme(inherits[i]);
-                        }
-                }
-                g_strfreev(inherits);
+                theme->inherits = inherits;
         }
 
-
+        theme->state = THEME_LOADED;
 
         finish_ini(ini);
         free(ini);
+        return true;
+}
+
+/**
+ * Load a theme from a directory. Don't call this function if the theme is
+ * already loaded. The inherited themes are loaded once they are needed.
+ *
+ * If it succeeds loading the theme, it adds theme to the list "icon_themes".
+ *
+ * @param icon_dir A directory where icon themes are stored
+ * @param subdir_theme The subdirectory in which the theme is located
+ *
+ * @returns the index to the theme that was loaded
+ * @retval -1 means no index was found
+ */
+int load_icon_theme_from_dir(const char *icon_dir, const char *subdir_theme) {
+        int index = icon_theme_append(subdir_theme);
+        if (!icon_theme_parse(&icon_themes[index], icon_dir)) {
+                g_free(icon_themes[index].subdir_theme);
+                icon_themes_count--;
+                return -1;
+        }
         return index;
 }
 
@@ -175,20 +227,65 @@ void get_theme_path() {
         }
 }
 
-// see icon-lookup.h
-int load_icon_theme(char *name) {
+/**
+ * Load a registered theme, unless that has been tried before.
+ *
+ * @param theme_index The index of the theme
+ * @retval true if the theme is loaded
+ */
+static bool icon_theme_ensure_loaded(int theme_index)
+{
+        struct icon_theme *theme = &icon_themes[theme_index];
+        if (theme->state != THEME_UNLOADED)
+                return theme->state == THEME_LOADED;
+
         if(!theme_path) {
                 get_theme_path();
         }
 
         for (int i = 0; i < theme_path->len; i++) {
-                int theme_index = load_icon_theme_from_dir(theme_path->pdata[i], name);
-                if (theme_index != -1)
-                        return theme_index;
+                if (icon_theme_parse(theme, theme_path->pdata[i]))
+                        return true;
         }
 
-        LOG_W("Could not find theme %s", name);
-        return -1;
+        LOG_W("Could not find theme %s", theme->subdir_theme);
+        theme->state = THEME_FAILED;
+        return false;
+}
+
+/**
+ * Look up the registered inherited themes of a loaded theme, registering
+ * them if necessary.
+ */
+static void icon_theme_resolve_inherits(int theme_index)
+{
+        if (icon_themes[theme_index].inherits_index)
+                return;
+
+        int count = icon_themes[theme_index].inherits_count;
+        int *inherits_index = calloc(MAX(count, 1), sizeof(int));
+        for (int i = 0; i < count; i++) {
+                // Registering moves icon_themes, so don't keep a pointer into it
+                LOG_D("inherits: %s\n", icon_themes[theme_index].inherits[i]);
+                inherits_index[i] = register_icon_theme(icon_themes[theme_index].inherits[i]);
+        }
+        icon_themes[theme_index].inherits_index = inherits_index;
+}
+
+// see icon-lookup.h
+int register_icon_theme(char *name) {
+        int theme_index = get_icon_theme(name);
+        if (theme_index == -1)
+                theme_index = icon_theme_append(name);
+        return theme_index;
+}
+
+// see icon-lookup.h
+int load_icon_theme(char *name) {
+        int theme_index = register_icon_theme(name);
+        if (!icon_theme_ensure_loaded(theme_index))
+                return -1;
+        return theme_index;
 }
 
 void finish_icon_theme_dir(struct icon_theme_dir *dir) {
@@ -207,7 +304,12 @@ void finish_icon_theme(struct icon_theme *theme) {
         free(theme->location);
         free(theme->subdir_theme);
         free(theme->inherits_index);
+        g_strfreev(theme->inherits);
         free(theme->dirs);
+        if (theme->size_dirs)
+                g_hash_table_unref(theme->size_dirs);
+        if (theme->cache)
+                icon_theme_cache_close(theme->cache);
 }
 
 void free_all_themes() {
@@ -242,54 +344,140 @@ void add_default_theme(int theme_index) {
         default_themes_index[default_themes_count - 1] = theme_index;
 }
 
+static bool icon_theme_dir_matches_size(const struct icon_theme_dir *dir, int size)
+{
+        switch (dir->type) {
+                case THEME_DIR_FIXED:
+                        return dir->size == size;
+
+                case THEME_DIR_SCALABLE:
+                        return dir->min_size <= size && dir->max_size >= size;
+
+                case THEME_DIR_THRESHOLD:
+                        return (float)dir->size / dir->threshold <= size
+                                && dir->size * dir->threshold >= size;
+        }
+        return false;
+}
+
+/**
+ * The directories of a theme, which contain icons that can be scaled to
+ * \p size, in the order they are listed in index.theme. The list is
+ * computed once per size.
+ *
+ * @returns an array of indices into theme->dirs, owned by the theme
+ */
+static GArray *icon_theme_dirs_for_size(struct icon_theme *theme, int size)
+{
+        if (!theme->size_dirs)
+                theme->size_dirs = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                                         NULL, (GDestroyNotify) g_array_unref);
+
+        GArray *dirs = g_hash_table_lookup(theme->size_dirs, GINT_TO_POINTER(size));
+        if (!dirs) {
+                dirs = g_array_new(FALSE, FALSE, sizeof(int));
+                for (int i = 0; i < theme->dirs_count; i++) {
+                        if (icon_theme_dir_matches_size(&theme->dirs[i], size))
+                                g_array_append_val(dirs, i);
+                }
+                g_hash_table_insert(theme->size_dirs, GINT_TO_POINTER(size), dirs);
+        }
+
+        return dirs;
+}
+
+/**
+ * Find an icon with the help of the theme's cache. Only the chosen file
+ * gets checked on disk.
+ */
+static char *find_icon_in_theme_cache(const char *name, struct icon_theme *theme, GArray *dirs)
+{
+        int count = icon_theme_cache_dir_count(theme->cache);
+        guint16 *flags = g_new0(guint16, MAX(count, 1));
+        char *icon = NULL;
+
+        if (!icon_theme_cache_lookup(theme->cache, name, flags))
+                goto out;
+
+        for (int i = 0; i < dirs->len && !icon; i++) {
+                struct icon_theme_dir *dir = &theme->dirs[g_array_index(dirs, int, i)];
+                if (dir->cache_index < 0 || !flags[dir->cache_index])
+                        continue;
+
+                guint16 dir_flags = flags[dir->cache_index];
+                const char *suffix = NULL;
+                if (dir_flags & ICON_THEME_CACHE_SVG)
+                        suffix = ".svg";
+                else if (dir_flags & ICON_THEME_CACHE_PNG)
+                        suffix = ".png";
+                else if (dir_flags & ICON_THEME_CACHE_XPM)
+                        suffix = ".xpm";
+                else
+                        continue;
+
+                char *name_with_extension = g_strconcat(name, suffix, NULL);
+                icon = g_build_filename(theme->location, theme->subdir_theme,
+                                dir->name, name_with_extension, NULL);
+                g_free(name_with_extension);
+
+                // The cache may be stale, if the icon got removed meanwhile
+                if (!is_readable_file(icon))
+                        g_clear_pointer(&icon, g_free);
+        }
+
+out:
+        g_free(flags);
+        return icon;
+}
+
 // see icon-lookup.h
 char *find_icon_in_theme(const char *name, int theme_index, int size) {
+        if (!icon_theme_ensure_loaded(theme_index))
+                return NULL;
+
         struct icon_theme *theme = &icon_themes[theme_index];
         LOG_D("Finding icon %s in theme %s\n", name, theme->name);
-        for (int i = 0; i < theme->dirs_count; i++) {
-                bool match_size = false;
-                struct icon_theme_dir dir = theme->dirs[i];
-                switch (dir.type) {
-                        case THEME_DIR_FIXED:
-                                match_size = dir.size == size;
-                                break;
-
-                        case THEME_DIR_SCALABLE:
-                                match_size = dir.min_size <= size && dir.max_size >= size;
-                                break;
-
-                        case THEME_DIR_THRESHOLD:
-                                match_size = (float)dir.size / dir.threshold <= size
-                                        && dir.size * dir.threshold >= size;
-                                break;
-                }
-                if (match_size) {
-                        const char *suffixes[] = { ".svg", ".svgz", ".png", ".xpm", NULL };
-                        for (const char **suf = suffixes; *suf; suf++) {
-                                char *name_with_extension = g_strconcat(name, *suf, NULL);
-                                char *icon = g_build_filename(theme->location, theme->subdir_theme,
-                                                dir.name, name_with_extension,
-                                                NULL);
-                                if (is_readable_file(icon)) {
-                                        g_free(name_with_extension);
-                                        return icon;
-                                }
-                                g_free(name_with_extension);
-                                g_free(icon);
+        GArray *dirs = icon_theme_dirs_for_size(theme, size);
+        if (theme->cache)
+                return find_icon_in_theme_cache(name, theme, dirs);
+
+        char *key = g_strdup_printf("%s/%s|%d|%s", theme->location, theme->subdir_theme, size, name);
+        if (icon_index_is_missing(key)) {
+                g_free(key);
+                return NULL;
+        }
+
+        char *icon = NULL;
+        for (int i = 0; i < dirs->len && !icon; i++) {
+                struct icon_theme_dir dir = theme->dirs[g_array_index(dirs, int, i)];
+                char *dir_path = g_build_filename(theme->location, theme->subdir_theme,
+                                dir.name, NULL);
+                const char *suffixes[] = { ".svg", ".svgz", ".png", ".xpm", NULL };
+                for (const char **suf = suffixes; *suf && !icon; suf++) {
+                        char *name_with_extension = g_strconcat(name, *suf, NULL);
+                        if (icon_index_has_file(dir_path, name_with_extension)) {
+                                icon = g_build_filename(dir_path, name_with_extension, NULL);
+                                if (!is_readable_file(icon))
+                                        g_clear_pointer(&icon, g_free);
                         }
+                        g_free(name_with_extension);
                 }
+                g_free(dir_path);
         }
-        return NULL;
+
+        if (!icon)
+                icon_index_remember_missing(key);
+        g_free(key);
+        return icon;
 }
 
 char *find_icon_in_theme_with_inherit(const char *name, int theme_index, int size) {
         char *icon = find_icon_in_theme(name, theme_index, size);
-        if (icon)
+        if (icon || icon_themes[theme_index].state != THEME_LOADED)
                 return icon;
 
+        icon_theme_resolve_inherits(theme_index);
         for (int i = 0; i < icon_themes[theme_index].inherits_count; i++) {
-                if (icon_themes[theme_index].inherits_index[i] <= 0)
-                        continue; // inherited theme could not be found
                 icon = find_icon_in_theme(name,
                                 icon_themes[theme_index].inherits_index[i],
                                 size);
@@ -326,12 +514,19 @@ char *find_icon_path(const char *name, int size) {
                 LOG_W("No icon theme has been set.\n");
                 return NULL;
         }
+        bool any_loaded = false;
         for (int i = 0; i < default_themes_count; i++) {
                 char *icon = find_icon_in_theme_with_inherit(name,
                                 default_themes_index[i], size);
                 if (icon)
                         return icon;
 
+                any_loaded |= icon_themes[default_themes_index[i]].state == THEME_LOADED;
         }
+
+        // None of the themes exist, fall back to hicolor
+        if (!any_loaded)
+                return find_icon_in_theme_with_inherit(name, register_icon_theme("hicolor"), size);
+
         return NULL;
 }
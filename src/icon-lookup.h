@@ -1,16 +1,25 @@
 #ifndef DUNST_ICON_LOOKUP_H
 #define DUNST_ICON_LOOKUP_H
 
+#include <glib.h>
+
+enum icon_theme_state { THEME_UNLOADED, THEME_LOADED, THEME_FAILED };
+
 struct icon_theme {
         char *name;
         char *location; // full path to the theme
         char *subdir_theme; // name of the directory in which the theme is located
+        enum icon_theme_state state; // themes are only loaded once they're used
 
         int inherits_count;
-        int *inherits_index;
+        char **inherits; // names of the inherited themes
+        int *inherits_index; // NULL until the inherited themes are needed
 
         int dirs_count;
         struct icon_theme_dir *dirs;
+        GHashTable *size_dirs; // maps a size to a GArray of the indices of the dirs matching it
+
+        struct icon_theme_cache *cache; // icon-theme.cache of the theme, may be NULL
 };
 
 enum theme_dir_type { THEME_DIR_FIXED, THEME_DIR_SCALABLE, THEME_DIR_THRESHOLD };
@@ -22,12 +31,24 @@ struct icon_theme_dir {
         int min_size, max_size;
         int threshold;
         enum theme_dir_type type;
+        int cache_index; // index of the directory in the theme's cache, -1 if not listed
 };
 
 
 /**
- * Load a theme with given name from a standard icon directory. Don't call this
- * function if the theme is already loaded.
+ * Register a theme with given name without loading it. The theme gets
+ * loaded from a standard icon directory once an icon is looked up in it.
+ *
+ * @param name Name of the directory in which the theme is located. Note that
+ *             it is NOT the name of the theme as specified in index.theme.
+ * @returns The index of the theme, which can be used to set it as default.
+ *          If the theme has been registered before, the existing index is
+ *          returned.
+ */
+int register_icon_theme(char *name);
+
+/**
+ * Load a theme with given name from a standard icon directory right away.
  *
  * @param name Name of the directory in which the theme is located. Note that
  *             it is NOT the name of the theme as specified in index.theme.
@@ -43,6 +64,7 @@ int load_icon_theme(char *name);
  * only after that the next default theme will be used.
  *
  * @param theme_index The index of the theme as returned by #load_icon_theme
+ *                    or #register_icon_theme
  */
 void add_default_theme(int theme_index);
 
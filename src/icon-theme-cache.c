@@ -0,0 +1,207 @@
+#include "icon-theme-cache.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "utils.h"
+
+#define CACHE_MAJOR_VERSION 1
+#define CACHE_NO_OFFSET 0xffffffff
+
+struct icon_theme_cache {
+        const guint8 *data;
+        gsize size;
+        guint32 hash_offset;
+        guint32 dir_list_offset;
+        guint32 n_buckets;
+        guint32 n_dirs;
+};
+
+/* All values in the cache are big endian. The reads fail, if the cache is
+ * truncated, so a broken cache can never make us read past the mapping. */
+static bool cache_read16(const struct icon_theme_cache *cache, guint32 offset, guint16 *value)
+{
+        if ((gsize) offset + 2 > cache->size)
+                return false;
+
+        *value = (guint16) cache->data[offset] << 8 | cache->data[offset + 1];
+        return true;
+}
+
+static bool cache_read32(const struct icon_theme_cache *cache, guint32 offset, guint32 *value)
+{
+        if ((gsize) offset + 4 > cache->size)
+                return false;
+
+        *value = (guint32) cache->data[offset] << 24
+               | (guint32) cache->data[offset + 1] << 16
+               | (guint32) cache->data[offset + 2] << 8
+               | (guint32) cache->data[offset + 3];
+        return true;
+}
+
+static const char *cache_read_string(const struct icon_theme_cache *cache, guint32 offset)
+{
+        if (offset >= cache->size)
+                return NULL;
+
+        const char *str = (const char *) cache->data + offset;
+        if (!memchr(str, '\0', cache->size - offset))
+                return NULL;
+
+        return str;
+}
+
+/* The hash function used by gtk-update-icon-cache */
+static guint32 cache_hash(const char *name)
+{
+        const signed char *p = (const signed char *) name;
+        guint32 h = *p;
+
+        if (h)
+                for (p += 1; *p != '\0'; p++)
+                        h = (h << 5) - h + *p;
+
+        return h;
+}
+
+static struct icon_theme_cache *icon_theme_cache_open_file(const char *path)
+{
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+                return NULL;
+
+        struct stat st;
+        void *data = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+                data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+
+        if (data == MAP_FAILED)
+                return NULL;
+
+        struct icon_theme_cache *cache = g_malloc0(sizeof(struct icon_theme_cache));
+        cache->data = data;
+        cache->size = st.st_size;
+
+        guint16 major;
+        if (!cache_read16(cache, 0, &major)
+            || major != CACHE_MAJOR_VERSION
+            || !cache_read32(cache, 4, &cache->hash_offset)
+            || !cache_read32(cache, 8, &cache->dir_list_offset)
+            || !cache_read32(cache, cache->hash_offset, &cache->n_buckets)
+            || !cache_read32(cache, cache->dir_list_offset, &cache->n_dirs)
+            || cache->n_buckets == 0) {
+                LOG_W("Ignoring invalid icon theme cache '%s'", path);
+                icon_theme_cache_close(cache);
+                return NULL;
+        }
+
+        return cache;
+}
+
+/* see icon-theme-cache.h */
+struct icon_theme_cache *icon_theme_cache_open(const char *theme_dir)
+{
+        ASSERT_OR_RET(theme_dir, NULL);
+
+        char *path = g_build_filename(theme_dir, "icon-theme.cache", NULL);
+        struct stat cache_st, dir_st;
+        struct icon_theme_cache *cache = NULL;
+
+        // Like GTK, don't trust a cache which is older than the theme, since
+        // icons got installed or removed after generating it.
+        if (stat(path, &cache_st) == 0 && stat(theme_dir, &dir_st) == 0) {
+                if (cache_st.st_mtime >= dir_st.st_mtime)
+                        cache = icon_theme_cache_open_file(path);
+                else
+                        LOG_D("Ignoring outdated icon theme cache '%s'", path);
+        }
+
+        g_free(path);
+        return cache;
+}
+
+/* see icon-theme-cache.h */
+void icon_theme_cache_close(struct icon_theme_cache *cache)
+{
+        ASSERT_OR_RET(cache,);
+
+        munmap((void *) cache->data, cache->size);
+        g_free(cache);
+}
+
+/* see icon-theme-cache.h */
+int icon_theme_cache_dir_count(const struct icon_theme_cache *cache)
+{
+        ASSERT_OR_RET(cache, 0);
+        return MIN(cache->n_dirs, G_MAXINT);
+}
+
+/* see icon-theme-cache.h */
+const char *icon_theme_cache_dir_name(const struct icon_theme_cache *cache, int index)
+{
+        ASSERT_OR_RET(cache, NULL);
+        ASSERT_OR_RET(index >= 0 && index < cache->n_dirs, NULL);
+
+        guint32 offset;
+        if (!cache_read32(cache, cache->dir_list_offset + 4 + 4 * (guint32) index, &offset))
+                return NULL;
+
+        return cache_read_string(cache, offset);
+}
+
+/* see icon-theme-cache.h */
+bool icon_theme_cache_lookup(const struct icon_theme_cache *cache, const char *name,
+                             guint16 *flags)
+{
+        ASSERT_OR_RET(cache, false);
+        ASSERT_OR_RET(STR_FULL(name), false);
+
+        guint32 bucket = cache_hash(name) % cache->n_buckets;
+        guint32 icon_offset;
+        if (!cache_read32(cache, cache->hash_offset + 4 + 4 * bucket, &icon_offset))
+                return false;
+
+        // Walk the chain of the bucket. Every icon can only be visited once,
+        // which stops us from looping forever on a broken cache.
+        for (guint32 visited = 0;
+             icon_offset != CACHE_NO_OFFSET && visited * 12 < cache->size;
+             visited++) {
+                guint32 chain_offset, name_offset, image_list_offset;
+                if (!cache_read32(cache, icon_offset, &chain_offset)
+                    || !cache_read32(cache, icon_offset + 4, &name_offset)
+                    || !cache_read32(cache, icon_offset + 8, &image_list_offset))
+                        return false;
+
+                const char *icon_name = cache_read_string(cache, name_offset);
+                if (!STR_EQ(icon_name, name)) {
+                        icon_offset = chain_offset;
+                        continue;
+                }
+
+                guint32 n_images;
+                if (!cache_read32(cache, image_list_offset, &n_images))
+                        return false;
+
+                for (guint32 i = 0; i < n_images; i++) {
+                        guint32 image_offset = image_list_offset + 4 + 8 * i;
+                        guint16 dir_index, image_flags;
+                        if (!cache_read16(cache, image_offset, &dir_index)
+                            || !cache_read16(cache, image_offset + 2, &image_flags))
+                                return false;
+
+                        if (dir_index < cache->n_dirs)
+                                flags[dir_index] |= image_flags;
+                }
+                return true;
+        }
+
+        return false;
+}
+
+/* vim: set ft=c tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -0,0 +1,69 @@
+#ifndef DUNST_ICON_THEME_CACHE_H
+#define DUNST_ICON_THEME_CACHE_H
+
+#include <glib.h>
+#include <stdbool.h>
+
+/**
+ * Reader for the icon-theme.cache files generated by gtk-update-icon-cache.
+ *
+ * The cache maps every icon name of a theme to the theme directories which
+ * contain the icon, so a lookup doesn't have to probe the file system for
+ * every directory and suffix. The file is mapped into memory and all values
+ * are read in place.
+ */
+
+/** The icon is available as .xpm */
+#define ICON_THEME_CACHE_XPM (1 << 0)
+/** The icon is available as .svg */
+#define ICON_THEME_CACHE_SVG (1 << 1)
+/** The icon is available as .png */
+#define ICON_THEME_CACHE_PNG (1 << 2)
+
+struct icon_theme_cache;
+
+/**
+ * Open the icon-theme.cache in the directory of a theme.
+ *
+ * @param theme_dir The full path to the theme
+ * @returns the cache
+ * @retval NULL if there is no cache, it is malformed or older than the
+ *          theme directory.
+ */
+struct icon_theme_cache *icon_theme_cache_open(const char *theme_dir);
+
+/**
+ * Unmap and free the cache.
+ */
+void icon_theme_cache_close(struct icon_theme_cache *cache);
+
+/**
+ * The amount of directories listed in the cache.
+ */
+int icon_theme_cache_dir_count(const struct icon_theme_cache *cache);
+
+/**
+ * The name of a directory listed in the cache, relative to the theme.
+ *
+ * @returns a pointer into the mapped cache
+ * @retval NULL if \p index is invalid
+ */
+const char *icon_theme_cache_dir_name(const struct icon_theme_cache *cache, int index);
+
+/**
+ * Look up the directories, which contain the icon \p name.
+ *
+ * @param cache The cache
+ * @param name The icon name without any suffix
+ * @param flags An array with icon_theme_cache_dir_count() elements. For every
+ *              directory containing the icon, the element at the directory's
+ *              index is set to the ICON_THEME_CACHE_* flags of the available
+ *              suffixes. The other elements are left untouched.
+ * @retval true if the icon is part of the theme
+ * @retval false if the theme doesn't have an icon with this name
+ */
+bool icon_theme_cache_lookup(const struct icon_theme_cache *cache, const char *name,
+                             guint16 *flags);
+
+#endif
+/* vim: set ft=c tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -7,12 +7,260 @@
 #include <string.h>
 #include <math.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_PIXEL_SIMD
+#include <immintrin.h>
+#endif
+
+#include "hash.h"
+#include "icon-cache.h"
+#include "icon-index.h"
 #include "log.h"
 #include "notification.h"
 #include "settings.h"
 #include "utils.h"
 #include "icon-lookup.h"
 
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+static const size_t CAIRO_B = 0;
+static const size_t CAIRO_G = 1;
+static const size_t CAIRO_R = 2;
+static const size_t CAIRO_A = 3;
+#elif G_BYTE_ORDER == G_BIG_ENDIAN
+static const size_t CAIRO_A = 0;
+static const size_t CAIRO_R = 1;
+static const size_t CAIRO_G = 2;
+static const size_t CAIRO_B = 3;
+#elif G_BYTE_ORDER == G_PDP_ENDIAN
+static const size_t CAIRO_R = 0;
+static const size_t CAIRO_A = 1;
+static const size_t CAIRO_B = 2;
+static const size_t CAIRO_G = 3;
+#else
+// GLib doesn't support any other endiannesses
+#error Unsupported Endianness
+#endif
+
+/**
+ * A set of functions converting a single row of GdkPixbuf pixels into
+ * cairo's native ARGB32 format.
+ */
+struct pixel_kernels {
+        const char *name;
+        bool (*supported)(void); /**< NULL, if the kernels run on every CPU */
+        void (*rgb)(const unsigned char *src, unsigned char *dst, int width);
+        void (*rgba)(const unsigned char *src, unsigned char *dst, int width); /**< Also premultiplies the alpha */
+};
+
+/* Exact integer replacement for round(c * a / 255.0) */
+static inline unsigned char premultiply(unsigned char c, unsigned char a)
+{
+        unsigned int t = c * a + 128;
+        return (t + (t >> 8)) >> 8;
+}
+
+static void pixel_row_rgb_scalar(const unsigned char *src, unsigned char *dst, int width)
+{
+        for (int w = 0; w < width; w++) {
+                dst[CAIRO_R] = src[0];
+                dst[CAIRO_G] = src[1];
+                dst[CAIRO_B] = src[2];
+                dst[CAIRO_A] = 0xff;
+                dst += 4;
+                src += 3;
+        }
+}
+
+static void pixel_row_rgba_scalar(const unsigned char *src, unsigned char *dst, int width)
+{
+        for (int w = 0; w < width; w++) {
+                dst[CAIRO_R] = premultiply(src[0], src[3]);
+                dst[CAIRO_G] = premultiply(src[1], src[3]);
+                dst[CAIRO_B] = premultiply(src[2], src[3]);
+                dst[CAIRO_A] = src[3];
+                dst += 4;
+                src += 4;
+        }
+}
+
+static const struct pixel_kernels pixel_kernels_scalar = {
+        "scalar",
+        NULL,
+        pixel_row_rgb_scalar,
+        pixel_row_rgba_scalar,
+};
+
+#ifdef HAVE_PIXEL_SIMD
+/* The vectorised kernels only handle the bulk of a row and leave the
+ * remaining pixels to the scalar kernels. All of them assume the little
+ * endian byte order of x86, so cairo's ARGB32 pixels are stored as BGRA. */
+
+/* RGBX in each 32bit lane -> BGRA with opaque alpha */
+#define RGBX_TO_BGRA_SSE2(v) \
+        _mm_or_si128(_mm_or_si128(_mm_and_si128((v), _mm_set1_epi32(0x0000ff00)), \
+                                  _mm_and_si128(_mm_slli_epi32((v), 16), _mm_set1_epi32(0x00ff0000))), \
+                     _mm_or_si128(_mm_and_si128(_mm_srli_epi32((v), 16), _mm_set1_epi32(0x000000ff)), \
+                                  _mm_set1_epi32(0xff000000)))
+
+__attribute__((target("sse2")))
+static void pixel_row_rgb_sse2(const unsigned char *src, unsigned char *dst, int width)
+{
+        int w = 0;
+        // Every iteration loads 16 bytes to convert 4 pixels (12 bytes)
+        for (; w + 6 <= width; w += 4) {
+                __m128i v = _mm_loadu_si128((const __m128i *)(src + 3 * w));
+                __m128i p01 = _mm_unpacklo_epi32(v, _mm_srli_si128(v, 3));
+                __m128i p23 = _mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9));
+                __m128i px = _mm_unpacklo_epi64(p01, p23);
+                _mm_storeu_si128((__m128i *)(dst + 4 * w), RGBX_TO_BGRA_SSE2(px));
+        }
+        pixel_row_rgb_scalar(src + 3 * w, dst + 4 * w, width - w);
+}
+
+/* Premultiply two RGBA pixels in 16bit lanes and reorder them to BGRA */
+__attribute__((target("sse2")))
+static inline __m128i premultiply_sse2(__m128i px)
+{
+        __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3)),
+                                            _MM_SHUFFLE(3, 3, 3, 3));
+        // Multiply the alpha channel with 255 to keep it as is
+        __m128i alpha_mask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+        alpha = _mm_or_si128(_mm_andnot_si128(alpha_mask, alpha),
+                             _mm_and_si128(alpha_mask, _mm_set1_epi16(0xff)));
+
+        __m128i t = _mm_add_epi16(_mm_mullo_epi16(px, alpha), _mm_set1_epi16(128));
+        t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+
+        return _mm_shufflehi_epi16(_mm_shufflelo_epi16(t, _MM_SHUFFLE(3, 0, 1, 2)),
+                                   _MM_SHUFFLE(3, 0, 1, 2));
+}
+
+__attribute__((target("sse2")))
+static void pixel_row_rgba_sse2(const unsigned char *src, unsigned char *dst, int width)
+{
+        const __m128i zero = _mm_setzero_si128();
+        int w = 0;
+        for (; w + 4 <= width; w += 4) {
+                __m128i v = _mm_loadu_si128((const __m128i *)(src + 4 * w));
+                __m128i lo = premultiply_sse2(_mm_unpacklo_epi8(v, zero));
+                __m128i hi = premultiply_sse2(_mm_unpackhi_epi8(v, zero));
+                _mm_storeu_si128((__m128i *)(dst + 4 * w), _mm_packus_epi16(lo, hi));
+        }
+        pixel_row_rgba_scalar(src + 4 * w, dst + 4 * w, width - w);
+}
+
+static bool pixel_kernels_sse2_supported(void)
+{
+        return __builtin_cpu_supports("sse2");
+}
+
+static const struct pixel_kernels pixel_kernels_sse2 = {
+        "sse2",
+        pixel_kernels_sse2_supported,
+        pixel_row_rgb_sse2,
+        pixel_row_rgba_sse2,
+};
+
+__attribute__((target("avx2")))
+static void pixel_row_rgb_avx2(const unsigned char *src, unsigned char *dst, int width)
+{
+        // Spread the 12 bytes of 4 RGB pixels over the 4 lanes of a 128bit half
+        const __m256i spread = _mm256_setr_epi8(
+                        2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1,
+                        2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+        const __m256i opaque = _mm256_set1_epi32(0xff000000);
+        int w = 0;
+        // Every iteration loads 28 bytes to convert 8 pixels (24 bytes)
+        for (; w + 10 <= width; w += 8) {
+                const unsigned char *p = src + 3 * w;
+                __m256i v = _mm256_inserti128_si256(
+                                _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p)),
+                                _mm_loadu_si128((const __m128i *)(p + 12)), 1);
+                v = _mm256_or_si256(_mm256_shuffle_epi8(v, spread), opaque);
+                _mm256_storeu_si256((__m256i *)(dst + 4 * w), v);
+        }
+        pixel_row_rgb_scalar(src + 3 * w, dst + 4 * w, width - w);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i premultiply_avx2(__m256i px)
+{
+        // Broadcast the alpha of each pixel and use 255 for the alpha itself
+        const __m256i spread_alpha = _mm256_setr_epi8(
+                        6, -1, 6, -1, 6, -1, -1, -1, 14, -1, 14, -1, 14, -1, -1, -1,
+                        6, -1, 6, -1, 6, -1, -1, -1, 14, -1, 14, -1, 14, -1, -1, -1);
+        const __m256i alpha_255 = _mm256_setr_epi16(0, 0, 0, 0xff, 0, 0, 0, 0xff,
+                                                    0, 0, 0, 0xff, 0, 0, 0, 0xff);
+        __m256i alpha = _mm256_or_si256(_mm256_shuffle_epi8(px, spread_alpha), alpha_255);
+
+        __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(px, alpha), _mm256_set1_epi16(128));
+        t = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+
+        return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(t, _MM_SHUFFLE(3, 0, 1, 2)),
+                                      _MM_SHUFFLE(3, 0, 1, 2));
+}
+
+__attribute__((target("avx2")))
+static void pixel_row_rgba_avx2(const unsigned char *src, unsigned char *dst, int width)
+{
+        const __m256i zero = _mm256_setzero_si256();
+        int w = 0;
+        for (; w + 8 <= width; w += 8) {
+                __m256i v = _mm256_loadu_si256((const __m256i *)(src + 4 * w));
+                __m256i lo = premultiply_avx2(_mm256_unpacklo_epi8(v, zero));
+                __m256i hi = premultiply_avx2(_mm256_unpackhi_epi8(v, zero));
+                _mm256_storeu_si256((__m256i *)(dst + 4 * w), _mm256_packus_epi16(lo, hi));
+        }
+        pixel_row_rgba_scalar(src + 4 * w, dst + 4 * w, width - w);
+}
+
+static bool pixel_kernels_avx2_supported(void)
+{
+        return __builtin_cpu_supports("avx2");
+}
+
+static const struct pixel_kernels pixel_kernels_avx2 = {
+        "avx2",
+        pixel_kernels_avx2_supported,
+        pixel_row_rgb_avx2,
+        pixel_row_rgba_avx2,
+};
+#endif
+
+/* All kernels in the order of preference */
+static const struct pixel_kernels *pixel_kernels_all[] = {
+#ifdef HAVE_PIXEL_SIMD
+        &pixel_kernels_avx2,
+        &pixel_kernels_sse2,
+#endif
+        &pixel_kernels_scalar,
+};
+
+/**
+ * Pick the fastest kernels the CPU supports. The choice is made once.
+ */
+static const struct pixel_kernels *pixel_kernels_get(void)
+{
+        static gsize selected = 0;
+
+        if (g_once_init_enter(&selected)) {
+                const struct pixel_kernels *kernels = &pixel_kernels_scalar;
+#ifdef HAVE_PIXEL_SIMD
+                __builtin_cpu_init();
+#endif
+                for (int i = 0; i < G_N_ELEMENTS(pixel_kernels_all); i++) {
+                        if (!pixel_kernels_all[i]->supported || pixel_kernels_all[i]->supported()) {
+                                kernels = pixel_kernels_all[i];
+                                break;
+                        }
+                }
+                LOG_D("Converting icon pixels with the %s kernels", kernels->name);
+                g_once_init_leave(&selected, (gsize) kernels);
+        }
+
+        return (const struct pixel_kernels *) selected;
+}
+
 /**
  * Reassemble the data parts of a GdkPixbuf into a cairo_surface_t's data field.
  *
@@ -27,60 +275,17 @@ static void pixbuf_data_to_cairo_data(
                 int height,
                 int n_channels)
 {
-#if G_BYTE_ORDER == G_LITTLE_ENDIAN
-        static const size_t CAIRO_B = 0;
-        static const size_t CAIRO_G = 1;
-        static const size_t CAIRO_R = 2;
-        static const size_t CAIRO_A = 3;
-#elif G_BYTE_ORDER == G_BIG_ENDIAN
-        static const size_t CAIRO_A = 0;
-        static const size_t CAIRO_R = 1;
-        static const size_t CAIRO_G = 2;
-        static const size_t CAIRO_B = 3;
-#elif G_BYTE_ORDER == G_PDP_ENDIAN
-        static const size_t CAIRO_R = 0;
-        static const size_t CAIRO_A = 1;
-        static const size_t CAIRO_B = 2;
-        static const size_t CAIRO_G = 3;
-#else
-// GLib doesn't support any other endiannesses
-#error Unsupported Endianness
-#endif
-
         assert(pixels_p);
         assert(pixels_c);
         assert(width > 0);
         assert(height > 0);
 
-        if (n_channels == 3) {
-                for (int h = 0; h < height; h++) {
-                              unsigned char *iter_c = pixels_c + h * rowstride_c;
-                        const unsigned char *iter_p = pixels_p + h * rowstride_p;
-                        for (int w = 0; w < width; w++) {
-                                iter_c[CAIRO_R] = iter_p[0];
-                                iter_c[CAIRO_G] = iter_p[1];
-                                iter_c[CAIRO_B] = iter_p[2];
-                                iter_c[CAIRO_A] = 0xff;
-                                iter_c += 4;
-                                iter_p += n_channels;
-                        }
-                }
-        } else {
-                for (int h = 0; h < height; h++) {
-                              unsigned char *iter_c = pixels_c + h * rowstride_c;
-                        const unsigned char *iter_p = pixels_p + h * rowstride_p;
-                        for (int w = 0; w < width; w++) {
-                                double alpha_factor = iter_p[3] / (double)0xff;
-                                iter_c[CAIRO_R] = (unsigned char)(iter_p[0] * alpha_factor + .5);
-                                iter_c[CAIRO_G] = (unsigned char)(iter_p[1] * alpha_factor + .5);
-                                iter_c[CAIRO_B] = (unsigned char)(iter_p[2] * alpha_factor + .5);
-                                iter_c[CAIRO_A] =                 iter_p[3];
-                                iter_c += 4;
-                                iter_p += n_channels;
-                        }
-                }
+        const struct pixel_kernels *kernels = pixel_kernels_get();
+        void (*convert_row)(const unsigned char *, unsigned char *, int) =
+                n_channels == 3 ? kernels->rgb : kernels->rgba;
 
-        }
+        for (int h = 0; h < height; h++)
+                convert_row(pixels_p + h * rowstride_p, pixels_c + h * rowstride_c, width);
 }
 
 int get_icon_width(cairo_surface_t *icon, double scale) {
@@ -168,7 +373,6 @@ static GdkPixbuf *icon_pixbuf_scale_to_size(GdkPixbuf *pixbuf, double dpi_scale,
         int w = gdk_pixbuf_get_width(pixbuf);
         int h = gdk_pixbuf_get_height(pixbuf);
 
-        // TODO immediately rescale icon upon scale changes
         if(icon_size_clamp(&w, &h, min_size, max_size)) {
                 w = round(w * dpi_scale);
                 h = round(h * dpi_scale);
@@ -195,7 +399,6 @@ GdkPixbuf *get_pixbuf_from_file(const char *filename, int min_size, int max_size
                 return NULL;
         }
         GdkPixbuf *pixbuf = NULL;
-        // TODO immediately rescale icon upon scale changes
         icon_size_clamp(&w, &h, min_size, max_size);
         pixbuf = gdk_pixbuf_new_from_file_at_scale(path,
                         round(w * scale),
@@ -225,6 +428,7 @@ char *get_path_from_icon_name(const char *iconname, int size)
         const char *suffixes[] = { ".svg", ".svgz", ".png", ".xpm", NULL };
         gchar *uri_path = NULL;
         char *new_name = NULL;
+        char *key;
 
         if (g_str_has_prefix(iconname, "file://")) {
                 uri_path = g_filename_from_uri(iconname, NULL, NULL);
@@ -232,10 +436,13 @@ char *get_path_from_icon_name(const char *iconname, int size)
                         iconname = uri_path;
         }
 
+        // Remembers unsuccessful lookups in the icon path
+        key = g_strconcat(settings.icon_path, "|", iconname, NULL);
+
         /* absolute path? */
         if (iconname[0] == '/' || iconname[0] == '~') {
                 new_name = g_strdup(iconname);
-        } else {
+        } else if (!icon_index_is_missing(key)) {
         /* search in icon_path */
                 char *start = settings.icon_path,
                      *end, *current_folder, *maybe_icon_path;
@@ -247,12 +454,13 @@ char *get_path_from_icon_name(const char *iconname, int size)
 
                         for (const char **suf = suffixes; *suf; suf++) {
                                 gchar *name_with_extension = g_strconcat(iconname, *suf, NULL);
-                                maybe_icon_path = g_build_filename(current_folder, name_with_extension, NULL);
-                                if (is_readable_file(maybe_icon_path)) {
-                                        new_name = g_strdup(maybe_icon_path);
+                                if (icon_index_has_file(current_folder, name_with_extension)) {
+                                        maybe_icon_path = g_build_filename(current_folder, name_with_extension, NULL);
+                                        if (is_readable_file(maybe_icon_path))
+                                                new_name = g_strdup(maybe_icon_path);
+                                        g_free(maybe_icon_path);
                                 }
                                 g_free(name_with_extension);
-                                g_free(maybe_icon_path);
 
                                 if (new_name)
                                         break;
@@ -264,15 +472,212 @@ char *get_path_from_icon_name(const char *iconname, int size)
 
                         start = end + 1;
                 } while (STR_FULL(end));
-                if (!new_name)
+                if (!new_name) {
                         LOG_W("No icon found in path: '%s'", iconname);
+                        icon_index_remember_missing(key);
+                }
         }
 
+        g_free(key);
         g_free(uri_path);
         return new_name;
 }
 
-GdkPixbuf *icon_get_for_data(GVariant *data, char **id, double dpi_scale, int min_size, int max_size)
+/**
+ * Compute the content hash of raw image data. Only the pixel data of each
+ * row is hashed in place, so the garbage in the spacers doesn't matter.
+ */
+static guint64 icon_hash_raw_data(const unsigned char *data,
+                                  int width,
+                                  int height,
+                                  int rowstride,
+                                  int has_alpha,
+                                  int bits_per_sample,
+                                  int n_channels,
+                                  gsize pixelstride)
+{
+        struct hash_state state;
+        hash_init(&state, 0);
+
+        // Same pixels in a differently shaped image are a different image
+        gint32 header[] = { width, height, has_alpha, bits_per_sample, n_channels };
+        hash_update(&state, header, sizeof(header));
+
+        for (int i = 0; i < height; i++)
+                hash_update(&state, data + (gsize) i * rowstride, pixelstride * width);
+
+        return hash_digest(&state);
+}
+
+/**
+ * Downscale raw image data straight into a new cairo surface with a box
+ * filter. The source rows are consumed one after another, so apart from the
+ * surface itself only a single row of accumulators is needed.
+ *
+ * Only 8 bit RGB and RGBA data is supported and the output size must not
+ * exceed the source size in either direction.
+ */
+static cairo_surface_t *icon_downscale_raw_data(const unsigned char *data,
+                                                int width,
+                                                int height,
+                                                int rowstride,
+                                                bool has_alpha,
+                                                int n_channels,
+                                                int out_width,
+                                                int out_height)
+{
+        cairo_format_t fmt = has_alpha ? CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24;
+        cairo_surface_t *srf = cairo_image_surface_create(fmt, out_width, out_height);
+        if (cairo_surface_status(srf) != CAIRO_STATUS_SUCCESS) {
+                cairo_surface_destroy(srf);
+                return NULL;
+        }
+
+        cairo_surface_flush(srf);
+        unsigned char *dst = cairo_image_surface_get_data(srf);
+        int dst_stride = cairo_image_surface_get_stride(srf);
+
+        // Per output column: the sums of red, green and blue weighted by
+        // alpha and the sum of alpha
+        guint64 *acc = g_new(guint64, (gsize) out_width * 4);
+
+        for (int oy = 0; oy < out_height; oy++) {
+                int y0 = (gint64) oy * height / out_height;
+                int y1 = (gint64) (oy + 1) * height / out_height;
+
+                memset(acc, 0, sizeof(guint64) * out_width * 4);
+
+                for (int y = y0; y < y1; y++) {
+                        const unsigned char *row = data + (gsize) y * rowstride;
+                        for (int ox = 0; ox < out_width; ox++) {
+                                int x0 = (gint64) ox * width / out_width;
+                                int x1 = (gint64) (ox + 1) * width / out_width;
+                                guint64 *sum = acc + 4 * ox;
+
+                                for (const unsigned char *p = row + x0 * n_channels;
+                                     p < row + x1 * n_channels;
+                                     p += n_channels) {
+                                        unsigned int alpha = has_alpha ? p[3] : 0xff;
+                                        sum[0] += p[0] * alpha;
+                                        sum[1] += p[1] * alpha;
+                                        sum[2] += p[2] * alpha;
+                                        sum[3] += alpha;
+                                }
+                        }
+                }
+
+                guint32 *out = (guint32 *) (dst + (gsize) oy * dst_stride);
+                for (int ox = 0; ox < out_width; ox++) {
+                        int x0 = (gint64) ox * width / out_width;
+                        int x1 = (gint64) (ox + 1) * width / out_width;
+                        guint64 count = (guint64) (x1 - x0) * (y1 - y0);
+                        guint64 *sum = acc + 4 * ox;
+
+                        // Rounded averages, premultiplied as cairo wants them
+                        guint32 r = (sum[0] + count * 0xff / 2) / (count * 0xff);
+                        guint32 g = (sum[1] + count * 0xff / 2) / (count * 0xff);
+                        guint32 b = (sum[2] + count * 0xff / 2) / (count * 0xff);
+                        guint32 a = (sum[3] + count / 2) / count;
+
+                        out[ox] = a << 24 | r << 16 | g << 8 | b;
+                }
+        }
+
+        g_free(acc);
+        cairo_surface_mark_dirty(srf);
+        return srf;
+}
+
+static void icon_pixbuf_release_variant(guchar *pixels, gpointer data)
+{
+        g_variant_unref(data);
+}
+
+/**
+ * Turn raw image data into a cairo surface of the final icon size.
+ *
+ * The data of the GVariant is read in place. Downscaling streams the source
+ * rows straight into the surface, so the peak memory only depends on the
+ * icon size. Only upscaling and exotic formats go through a GdkPixbuf,
+ * which borrows the data as well.
+ *
+ * @param data_variant (transfer full) The "ay" part of the image data
+ */
+static cairo_surface_t *icon_surface_from_raw_data(GVariant *data_variant,
+                                                   int width,
+                                                   int height,
+                                                   int rowstride,
+                                                   int has_alpha,
+                                                   int bits_per_sample,
+                                                   int n_channels,
+                                                   double dpi_scale,
+                                                   int min_size,
+                                                   int max_size)
+{
+        const unsigned char *data = g_variant_get_data(data_variant);
+        cairo_surface_t *icon_surface = NULL;
+
+        int w = width;
+        int h = height;
+        if (icon_size_clamp(&w, &h, min_size, max_size)) {
+                w = round(w * dpi_scale);
+                h = round(h * dpi_scale);
+        }
+
+        bool simple_format = bits_per_sample == 8
+                             && n_channels == (has_alpha ? 4 : 3)
+                             && width > 0 && height > 0
+                             && rowstride >= width * n_channels;
+
+        if (simple_format && w == width && h == height) {
+                cairo_format_t fmt = has_alpha ? CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24;
+                icon_surface = cairo_image_surface_create(fmt, width, height);
+
+                cairo_surface_flush(icon_surface);
+                pixbuf_data_to_cairo_data(data,
+                                          cairo_image_surface_get_data(icon_surface),
+                                          rowstride,
+                                          cairo_image_surface_get_stride(icon_surface),
+                                          width,
+                                          height,
+                                          n_channels);
+                cairo_surface_mark_dirty(icon_surface);
+                g_variant_unref(data_variant);
+                return icon_surface;
+        }
+
+        if (simple_format && w > 0 && h > 0 && w <= width && h <= height) {
+                icon_surface = icon_downscale_raw_data(data, width, height, rowstride,
+                                                       has_alpha, n_channels, w, h);
+                g_variant_unref(data_variant);
+                return icon_surface;
+        }
+
+        GdkPixbuf *pixbuf = gdk_pixbuf_new_from_data(data,
+                                                     GDK_COLORSPACE_RGB,
+                                                     has_alpha,
+                                                     bits_per_sample,
+                                                     width,
+                                                     height,
+                                                     rowstride,
+                                                     icon_pixbuf_release_variant,
+                                                     data_variant);
+        if (!pixbuf) {
+                /* Dear user, I'm sorry, I'd like to give you a more specific
+                 * error message. But sadly, I can't */
+                LOG_W("Cannot serialise raw icon data into pixbuf.");
+                g_variant_unref(data_variant);
+                return NULL;
+        }
+
+        pixbuf = icon_pixbuf_scale_to_size(pixbuf, dpi_scale, min_size, max_size);
+        icon_surface = gdk_pixbuf_to_cairo_surface(pixbuf);
+        g_object_unref(pixbuf);
+
+        return icon_surface;
+}
+
+cairo_surface_t *icon_get_for_data(GVariant *data, char **id, double dpi_scale, int min_size, int max_size)
 {
         ASSERT_OR_RET(data, NULL);
         ASSERT_OR_RET(id, NULL);
@@ -301,9 +706,7 @@ GdkPixbuf *icon_get_for_data(GVariant *data, char **id, double dpi_scale, int mi
          * row n:   |   data for row n    |
          */
 
-        GdkPixbuf *pixbuf = NULL;
         GVariant *data_variant = NULL;
-        unsigned char *data_pb;
 
         gsize len_expected;
         gsize len_actual;
@@ -340,51 +743,100 @@ GdkPixbuf *icon_get_for_data(GVariant *data, char **id, double dpi_scale, int mi
                 return NULL;
         }
 
-        // g_memdup is deprecated in glib 2.67.4 and higher.
-        // g_memdup2 is a safer alternative
-#if GLIB_CHECK_VERSION(2,67,3)
-        data_pb = (guchar *) g_memdup2(g_variant_get_data(data_variant), len_actual);
-#else
-        data_pb = (guchar *) g_memdup(g_variant_get_data(data_variant), len_actual);
-#endif
+        /* Identify the image by its content. A client sending the same
+         * image over and over again gets its already scaled surface from
+         * the cache. */
+        guint64 hash = icon_hash_raw_data(g_variant_get_data(data_variant),
+                                          width, height, rowstride,
+                                          has_alpha, bits_per_sample, n_channels,
+                                          pixelstride);
+        char *hash_str = g_strdup_printf("%016" G_GINT64_MODIFIER "x", hash);
+        char *key = icon_cache_key(hash_str, min_size, max_size, dpi_scale);
+
+        cairo_surface_t *icon_surface = icon_cache_get(key);
+        if (icon_surface) {
+                *id = hash_str;
+                g_free(key);
+                g_variant_unref(data_variant);
+                return icon_surface;
+        }
 
-        pixbuf = gdk_pixbuf_new_from_data(data_pb,
-                                          GDK_COLORSPACE_RGB,
-                                          has_alpha,
-                                          bits_per_sample,
-                                          width,
-                                          height,
-                                          rowstride,
-                                          (GdkPixbufDestroyNotify) g_free,
-                                          data_pb);
-        if (!pixbuf) {
-                /* Dear user, I'm sorry, I'd like to give you a more specific
-                 * error message. But sadly, I can't */
-                LOG_W("Cannot serialise raw icon data into pixbuf.");
+        icon_surface = icon_surface_from_raw_data(data_variant,
+                                                  width, height, rowstride,
+                                                  has_alpha, bits_per_sample, n_channels,
+                                                  dpi_scale, min_size, max_size);
+        if (!icon_surface) {
+                g_free(hash_str);
+                g_free(key);
                 return NULL;
         }
 
-        /* To calculate a checksum of the current image, we have to remove
-         * all excess spacers, so that our checksummed memory only contains
-         * real data. */
-        size_t data_chk_len = pixelstride * width * height;
-        unsigned char *data_chk = g_malloc(data_chk_len);
-        size_t rowstride_short = pixelstride * width;
-
-        for (int i = 0; i < height; i++) {
-                memcpy(data_chk + (i*rowstride_short),
-                       data_pb  + (i*rowstride),
-                       rowstride_short);
+        icon_cache_put(key, icon_surface, false);
+
+        *id = hash_str;
+        g_free(key);
+        return icon_surface;
+}
+
+/**
+ * Scale \p source to \p width x \p height pixels. Returns a new reference
+ * to \p source itself, if it has the right size already.
+ */
+static cairo_surface_t *icon_surface_scale(cairo_surface_t *source, int width, int height)
+{
+        int src_width = cairo_image_surface_get_width(source);
+        int src_height = cairo_image_surface_get_height(source);
+        if (src_width == width && src_height == height)
+                return cairo_surface_reference(source);
+
+        cairo_surface_t *icon_surface = cairo_image_surface_create(
+                        cairo_image_surface_get_format(source), width, height);
+        if (cairo_surface_status(icon_surface) != CAIRO_STATUS_SUCCESS) {
+                cairo_surface_destroy(icon_surface);
+                return NULL;
         }
 
-        *id = g_compute_checksum_for_data(G_CHECKSUM_MD5, data_chk, data_chk_len);
+        cairo_t *c = cairo_create(icon_surface);
+        cairo_scale(c, (double) width / src_width, (double) height / src_height);
+        cairo_set_source_surface(c, source, 0, 0);
+        cairo_pattern_set_filter(cairo_get_source(c), CAIRO_FILTER_GOOD);
+        cairo_set_operator(c, CAIRO_OPERATOR_SOURCE);
+        cairo_paint(c);
+        cairo_destroy(c);
 
-        g_free(data_chk);
-        g_variant_unref(data_variant);
+        return icon_surface;
+}
 
-        pixbuf = icon_pixbuf_scale_to_size(pixbuf, dpi_scale, min_size, max_size);
+/* see icon.h */
+cairo_surface_t *icon_get_for_source(cairo_surface_t *source, const char *id,
+                                     int width, int height,
+                                     double dpi_scale, int min_size, int max_size)
+{
+        ASSERT_OR_RET(source, NULL);
+        ASSERT_OR_RET(id, NULL);
+        ASSERT_OR_RET(width > 0 && height > 0, NULL);
 
-        return pixbuf;
+        char *key = icon_cache_key(id, min_size, max_size, dpi_scale);
+        cairo_surface_t *icon_surface = icon_cache_get(key);
+        if (icon_surface) {
+                g_free(key);
+                return icon_surface;
+        }
+
+        // The same size icon_surface_from_raw_data() would have picked
+        int w = width;
+        int h = height;
+        if (icon_size_clamp(&w, &h, min_size, max_size)) {
+                w = round(w * dpi_scale);
+                h = round(h * dpi_scale);
+        }
+
+        icon_surface = w > 0 && h > 0 ? icon_surface_scale(source, w, h) : NULL;
+        if (icon_surface)
+                icon_cache_put(key, icon_surface, false);
+
+        g_free(key);
+        return icon_surface;
 }
 
 /* vim: set ft=c tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -49,20 +49,43 @@ char *get_path_from_icon_name(const char *iconname, int size);
 
 /** Convert a GVariant like described in GdkPixbuf, scaled according to settings
  *
- * The returned id will be a unique identifier. To check if two given
- * GdkPixbufs are equal, it's sufficient to just compare the id strings.
+ * The returned id will be a unique identifier derived from the content of the
+ * image. To check if two given images are equal, it's sufficient to just
+ * compare the id strings. Repeatedly sent images are taken from the icon
+ * cache.
  *
  * @param data A GVariant in the format "(iiibii@ay)" filled with values
  *             like described in the notification spec.
- * @param id   (necessary) A unique identifier of the returned pixbuf.
+ * @param id   (necessary) A unique identifier of the returned surface.
  *             Only filled, if the return value is non-NULL.
  * @param dpi_scale An integer representing the output dpi scaling.
  * @param min_size An integer representing the desired minimum unscaled icon size.
  * @param max_size An integer representing the desired maximum unscaled icon size.
- * @return an instance of `GdkPixbuf` derived from the GVariant
+ * @return a new reference to a cairo surface derived from the GVariant
  * @retval NULL: GVariant parameter nulled, invalid or in wrong format
  */
-GdkPixbuf *icon_get_for_data(GVariant *data, char **id, double dpi_scale, int min_size, int max_size);
+cairo_surface_t *icon_get_for_data(GVariant *data, char **id, double dpi_scale, int min_size, int max_size);
+
+/**
+ * Rasterise a raw icon again for another scale, without the raw data. The
+ * icon, which icon_get_for_data() returned before, serves as source
+ * instead. Surfaces for each scale are shared through the icon cache.
+ *
+ * It's safe to call this off the main thread.
+ *
+ * @param source The icon as returned by icon_get_for_data()
+ * @param id The id icon_get_for_data() filled in for \p source
+ * @param width The width of the raw image data
+ * @param height The height of the raw image data
+ * @param dpi_scale The output dpi scaling to rasterise the icon for
+ * @param min_size An integer representing the desired minimum unscaled icon size.
+ * @param max_size An integer representing the desired maximum unscaled icon size.
+ * @return a new reference to a cairo surface
+ * @retval NULL: The icon can't be scaled to the size
+ */
+cairo_surface_t *icon_get_for_source(cairo_surface_t *source, const char *id,
+                                     int width, int height,
+                                     double dpi_scale, int min_size, int max_size);
 
 #endif
 /* vim: set ft=c tabstop=8 shiftwidth=8 expandtab textwidth=0: */
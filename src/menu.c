@@ -20,6 +20,7 @@
 #include "settings.h"
 #include "utils.h"
 
+static GMutex regex_lock;
 static bool is_initialized = false;
 static regex_t url_regex;
 
@@ -29,12 +30,7 @@ struct {
         GList *locked_notifications;
 } menu_ctx;
 
-/**
- * Initializes regexes needed for matching.
- *
- * @return true if initialization succeeded
- */
-static bool regex_init(void)
+static bool regex_init_locked(void)
 {
         if (is_initialized)
                 return true;
@@ -55,12 +51,28 @@ static bool regex_init(void)
         }
 }
 
+/**
+ * Initializes regexes needed for matching.
+ *
+ * @return true if initialization succeeded
+ */
+static bool regex_init(void)
+{
+        // Notifications get initialised by several threads at once
+        g_mutex_lock(&regex_lock);
+        bool initialized = regex_init_locked();
+        g_mutex_unlock(&regex_lock);
+        return initialized;
+}
+
 void regex_teardown(void)
 {
+        g_mutex_lock(&regex_lock);
         if (is_initialized) {
                 regfree(&url_regex);
                 is_initialized = false;
         }
+        g_mutex_unlock(&regex_lock);
 }
 
 /* see menu.h */
@@ -16,12 +16,15 @@
 #include "dbus.h"
 #include "dunst.h"
 #include "icon.h"
+#include "icon-cache.h"
 #include "log.h"
 #include "markup.h"
 #include "menu.h"
 #include "queues.h"
 #include "rules.h"
 #include "settings.h"
+#include "stats.h"
+#include "trace.h"
 #include "utils.h"
 #include "draw.h"
 #include "icon-lookup.h"
@@ -45,6 +48,12 @@ const char *enum_to_string_fullscreen(enum behavior_fullscreen in)
 
 struct _notification_private {
         gint refcount;
+        struct icon_request *icon_request; /**< The icon still being loaded */
+        double icon_scale;      /**< The output scale the icon got rasterised for */
+        cairo_surface_t *icon_source; /**< The raw icon as rasterised first, kept to rasterise it for other scales */
+        int icon_source_width;  /**< The width of the raw icon */
+        int icon_source_height; /**< The height of the raw icon */
+        bool detached;          /**< If it's being initialised off the main thread */
 };
 
 /* see notification.h */
@@ -126,11 +135,13 @@ void notification_run_script(struct notification *n)
                 if (STR_EMPTY(script))
                         continue;
 
+                TRACE_BEGIN("script_spawn");
                 int pid1 = fork();
 
                 if (pid1) {
                         int status;
                         waitpid(pid1, &status, 0);
+                        TRACE_END("script_spawn");
                 } else {
                         // second fork to prevent zombie processes
                         int pid2 = fork();
@@ -246,6 +257,8 @@ struct notification* notification_unlock(struct notification *n) {
 
 static void notification_private_free(NotificationPrivate *p)
 {
+        if (p->icon_source)
+                cairo_surface_destroy(p->icon_source);
         g_free(p);
 }
 
@@ -309,20 +322,199 @@ void notification_unref(struct notification *n)
 void notification_transfer_icon(struct notification *from, struct notification *to)
 {
         if (from->iconname && to->iconname
-                        && strcmp(from->iconname, to->iconname) == 0){
+                        && strcmp(from->iconname, to->iconname) == 0
+                        && from->icon) {
                 // Icons are the same. Transfer icon surface
+                notification_icon_load_cancel(to);
+                cairo_surface_destroy(to->icon);
                 to->icon = from->icon;
+                to->priv->icon_scale = from->priv->icon_scale;
+
+                if (to->priv->icon_source)
+                        cairo_surface_destroy(to->priv->icon_source);
+                to->priv->icon_source = from->priv->icon_source;
+                to->priv->icon_source_width = from->priv->icon_source_width;
+                to->priv->icon_source_height = from->priv->icon_source_height;
+                from->priv->icon_source = NULL;
+
+                g_free(to->icon_path);
+                to->icon_path = from->icon_path;
+                from->icon_path = NULL;
 
                 // prevent the surface being freed by the old notification
                 from->icon = NULL;
         }
 }
 
+static bool notification_actions_equal(GHashTable *a, GHashTable *b)
+{
+        if (g_hash_table_size(a) != g_hash_table_size(b))
+                return false;
+
+        GHashTableIter iter;
+        gpointer key, value;
+        g_hash_table_iter_init(&iter, a);
+        while (g_hash_table_iter_next(&iter, &key, &value))
+                if (!STR_EQ(value, g_hash_table_lookup(b, key)))
+                        return false;
+        return true;
+}
+
+static bool notification_scripts_equal(const struct notification *a,
+                                       const struct notification *b)
+{
+        if (a->script_count != b->script_count)
+                return false;
+
+        for (int i = 0; i < a->script_count; i++)
+                if (!STR_EQ(a->scripts[i], b->scripts[i]))
+                        return false;
+        return true;
+}
+
+/* see notification.h */
+guint notification_adopt_unchanged(struct notification *from, struct notification *to)
+{
+        guint dirty = DIRTY_NONE;
+
+        // The script gets to see the fields, which aren't part of the format
+        if (!STR_EQ(from->appname, to->appname)
+            || !STR_EQ(from->summary, to->summary)
+            || !STR_EQ(from->body, to->body)
+            || !STR_EQ(from->msg, to->msg)
+            || from->markup != to->markup)
+                dirty |= DIRTY_TEXT;
+
+        if (!STR_EQ(from->iconname, to->iconname)
+            || !STR_EQ(from->icon_id, to->icon_id)
+            || from->min_icon_size != to->min_icon_size
+            || from->max_icon_size != to->max_icon_size)
+                dirty |= DIRTY_ICON;
+
+        if (!STR_EQ(from->colors.fg, to->colors.fg)
+            || !STR_EQ(from->colors.bg, to->colors.bg)
+            || !STR_EQ(from->colors.highlight, to->colors.highlight)
+            || !STR_EQ(from->colors.frame, to->colors.frame)
+            || from->urgency != to->urgency)
+                dirty |= DIRTY_COLORS;
+
+        if (from->progress != to->progress)
+                dirty |= DIRTY_PROGRESS;
+
+        if (from->icon_position != to->icon_position
+            || from->progress_bar_alignment != to->progress_bar_alignment
+            || from->word_wrap != to->word_wrap
+            || from->ellipsize != to->ellipsize
+            || from->alignment != to->alignment
+            || from->hide_text != to->hide_text)
+                dirty |= DIRTY_LAYOUT;
+
+        if (!STR_EQ(from->category, to->category)
+            || !STR_EQ(from->stack_tag, to->stack_tag)
+            || !STR_EQ(from->desktop_entry, to->desktop_entry)
+            || !STR_EQ(from->urls, to->urls)
+            || from->timeout != to->timeout
+            || !notification_actions_equal(from->actions, to->actions)
+            || !notification_scripts_equal(from, to))
+                dirty |= DIRTY_SCRIPT;
+
+        if (!(dirty & DIRTY_ICON)) {
+                // An icon, which is still being loaded, has to be loaded
+                // again for the replacement
+                if (from->priv->icon_request)
+                        dirty |= DIRTY_ICON;
+                else
+                        notification_transfer_icon(from, to);
+        }
+
+        if (!(dirty & DIRTY_TEXT)) {
+                // The markup got parsed already, don't warn about it again
+                to->first_render = from->first_render;
+        }
+
+        // Keep the text drawn last, so the renderer can tell whether the
+        // age or the indicators changed
+        g_free(to->text_to_render);
+        to->text_to_render = from->text_to_render;
+        from->text_to_render = NULL;
+
+        return dirty;
+}
+
+/* see notification.h */
+void notification_icon_load_cancel(struct notification *n)
+{
+        ASSERT_OR_RET(n->priv->icon_request,);
+
+        icon_cache_request_cancel(n->priv->icon_request);
+        n->priv->icon_request = NULL;
+}
+
+static void notification_icon_loaded(cairo_surface_t *srf, gpointer data)
+{
+        struct notification *n = data;
+        n->priv->icon_request = NULL;
+
+        if (!srf) {
+                if (n->icon_path)
+                        LOG_W("No icon found in path: '%s'", n->icon_path);
+                else
+                        LOG_W("Cannot rasterise the raw icon for scale %g", n->priv->icon_scale);
+                return;
+        }
+
+        // When rescaling, the old icon is shown until the new one is ready
+        if (n->icon)
+                cairo_surface_destroy(n->icon);
+        n->icon = cairo_surface_reference(srf);
+        n->dirty |= DIRTY_ICON;
+
+        // Only the notifications on screen need to show the icon right away,
+        // the others pick it up once they get displayed.
+        if (g_list_find(queues_get_displayed(), n))
+                draw();
+}
+
+/**
+ * Rasterise the icon at n->icon_path for \p scale. The current icon stays
+ * in place until the new one is loaded.
+ */
+static void notification_icon_load_path(struct notification *n, double scale)
+{
+        notification_icon_load_cancel(n);
+        n->priv->icon_scale = scale;
+
+        // Decoding the icon may take a while, so the icon gets filled in
+        // later, when the loader is running. The request holds a reference
+        // to keep the notification alive until it finishes.
+        notification_ref(n);
+        n->priv->icon_request = icon_cache_load_file_async(n->icon_path,
+                        n->min_icon_size, n->max_icon_size, scale,
+                        notification_icon_loaded, n,
+                        (GDestroyNotify) notification_unref);
+        if (n->priv->icon_request)
+                return;
+
+        notification_unref(n);
+        cairo_surface_t *icon = icon_cache_load_file(n->icon_path,
+                        n->min_icon_size, n->max_icon_size, scale);
+        if (!icon) {
+                LOG_W("No icon found in path: '%s'", n->icon_path);
+                return;
+        }
+
+        if (n->icon)
+                cairo_surface_destroy(n->icon);
+        n->icon = icon;
+        n->dirty |= DIRTY_ICON;
+}
+
 void notification_icon_replace_path(struct notification *n, const char *new_icon)
 {
         ASSERT_OR_RET(n,);
         ASSERT_OR_RET(new_icon,);
-        if(n->iconname && n->icon && strcmp(n->iconname, new_icon) == 0) {
+        if(n->iconname && (n->icon || n->priv->icon_request)
+                        && strcmp(n->iconname, new_icon) == 0) {
                 return;
         }
 
@@ -332,39 +524,155 @@ void notification_icon_replace_path(struct notification *n, const char *new_icon
                 n->iconname = g_strdup(new_icon);
         }
 
+        notification_icon_load_cancel(n);
         cairo_surface_destroy(n->icon);
         n->icon = NULL;
+        n->dirty |= DIRTY_ICON;
         g_clear_pointer(&n->icon_id, g_free);
 
-        g_free(n->icon_path);
+        notification_icon_release_source(n);
+        g_clear_pointer(&n->icon_path, g_free);
+
+        // The lookup isn't thread safe. It happens once the notification
+        // gets inserted into the queues.
+        if (n->priv->detached)
+                return;
+
         n->icon_path = get_path_from_icon_name(new_icon, n->min_icon_size);
-        if (n->icon_path) {
-                GdkPixbuf *pixbuf = get_pixbuf_from_file(n->icon_path,
-                                n->min_icon_size, n->max_icon_size,
-                                draw_get_scale());
-                if (pixbuf) {
-                        n->icon = gdk_pixbuf_to_cairo_surface(pixbuf);
-                        g_object_unref(pixbuf);
-                } else {
-                        LOG_W("No icon found in path: '%s'", n->icon_path);
-                }
-        }
+        if (!n->icon_path)
+                return;
+
+        notification_icon_load_path(n, draw_get_scale());
 }
 
 void notification_icon_replace_data(struct notification *n, GVariant *new_icon)
+{
+        notification_icon_replace_data_scaled(n, new_icon, draw_get_scale());
+}
+
+/* see notification.h */
+void notification_icon_replace_data_scaled(struct notification *n, GVariant *new_icon, double scale)
 {
         ASSERT_OR_RET(n,);
         ASSERT_OR_RET(new_icon,);
 
+        notification_icon_load_cancel(n);
         cairo_surface_destroy(n->icon);
         n->icon = NULL;
         g_clear_pointer(&n->icon_id, g_free);
 
-        GdkPixbuf *icon = icon_get_for_data(new_icon, &n->icon_id,
-                        draw_get_scale(), n->min_icon_size, n->max_icon_size);
-        n->icon = gdk_pixbuf_to_cairo_surface(icon);
-        if (icon)
-                g_object_unref(icon);
+        notification_icon_release_source(n);
+        n->priv->icon_scale = scale;
+
+        n->icon = icon_get_for_data(new_icon, &n->icon_id,
+                        n->priv->icon_scale, n->min_icon_size, n->max_icon_size);
+        n->dirty |= DIRTY_ICON;
+        if (!n->icon)
+                return;
+
+        // Don't keep the raw data, it pins the whole message. The icon is
+        // the raw image already scaled down to the icon size.
+        n->priv->icon_source = cairo_surface_reference(n->icon);
+        g_variant_get_child(new_icon, 0, "i", &n->priv->icon_source_width);
+        g_variant_get_child(new_icon, 1, "i", &n->priv->icon_source_height);
+}
+
+/**
+ * Rasterise the raw icon of \p n for \p scale from its source. The current
+ * icon stays in place until the new one is ready.
+ */
+static void notification_icon_load_source(struct notification *n, double scale)
+{
+        notification_icon_load_cancel(n);
+        n->priv->icon_scale = scale;
+
+        // Another notification with the same icon may have needed it already
+        char *key = icon_cache_key(n->icon_id, n->min_icon_size, n->max_icon_size, scale);
+        cairo_surface_t *icon = icon_cache_get(key);
+        g_free(key);
+
+        if (!icon) {
+                notification_ref(n);
+                n->priv->icon_request = icon_cache_load_source_async(n->priv->icon_source,
+                                n->icon_id,
+                                n->priv->icon_source_width, n->priv->icon_source_height,
+                                n->min_icon_size, n->max_icon_size, scale,
+                                notification_icon_loaded, n,
+                                (GDestroyNotify) notification_unref);
+                if (n->priv->icon_request)
+                        return;
+
+                notification_unref(n);
+                icon = icon_get_for_source(n->priv->icon_source, n->icon_id,
+                                n->priv->icon_source_width, n->priv->icon_source_height,
+                                scale, n->min_icon_size, n->max_icon_size);
+                if (!icon)
+                        return;
+        }
+
+        if (n->icon)
+                cairo_surface_destroy(n->icon);
+        n->icon = icon;
+        n->dirty |= DIRTY_ICON;
+}
+
+/* see notification.h */
+int notification_icon_pending_size(const struct notification *n)
+{
+        ASSERT_OR_RET(n, 0);
+
+        if (!n->priv->icon_request)
+                return 0;
+
+        // Theme icons get looked up for min_icon_size, so that's where they
+        // end up most of the time. With min_icon_size == max_icon_size, it's
+        // the exact size.
+        return n->min_icon_size > 0 ? n->min_icon_size : n->max_icon_size;
+}
+
+/* see notification.h */
+void notification_icon_release_source(struct notification *n)
+{
+        ASSERT_OR_RET(n,);
+        g_clear_pointer(&n->priv->icon_source, cairo_surface_destroy);
+}
+
+/* see notification.h */
+void notification_icon_update_scale(struct notification *n, double scale)
+{
+        ASSERT_OR_RET(n,);
+
+        if (n->priv->icon_scale == scale)
+                return;
+
+        if (n->priv->icon_source) {
+                LOG_D("Rasterising the raw icon for scale %g", scale);
+                notification_icon_load_source(n, scale);
+        } else if (n->icon_path && (n->icon || n->priv->icon_request)) {
+                LOG_D("Rasterising icon '%s' for scale %g", n->icon_path, scale);
+                notification_icon_load_path(n, scale);
+        }
+}
+
+/* see notification.h */
+void notification_update_progress(struct notification *n, int progress, const char *body)
+{
+        ASSERT_OR_RET(n,);
+        ASSERT_OR_RET(body,);
+
+        int old_progress = n->progress;
+        n->progress = progress < 0 ? -1 : progress;
+        if (n->progress != old_progress)
+                n->dirty |= DIRTY_PROGRESS;
+
+        if (!STR_EQ(n->body, body)) {
+                g_free(n->body);
+                n->body = g_strdup(body);
+                notification_extract_urls(n);
+                n->dirty |= DIRTY_TEXT;
+        }
+
+        notification_format_message(n);
 }
 
 /* see notification.h */
@@ -438,12 +746,21 @@ struct notification *notification_create(void)
         n->default_action_name = g_strdup("default");
 
         n->script_count = 0;
+
+        // It has never been drawn
+        n->dirty = DIRTY_ALL;
         return n;
 }
 
-/* see notification.h */
-void notification_init(struct notification *n)
+/**
+ * Sanitize \p n and apply the rules. Takes the rules from \p rules, or
+ * from the global list if it's NULL.
+ */
+static void notification_init_internal(struct notification *n, const struct rule_snapshot *rules)
 {
+        gint64 start = g_get_monotonic_time();
+        TRACE_BEGIN("notification_init");
+
         /* default to empty string to avoid further NULL faults */
         n->appname  = n->appname  ? n->appname  : g_strdup("unknown");
         n->summary  = n->summary  ? n->summary  : g_strdup("");
@@ -489,7 +806,13 @@ void notification_init(struct notification *n)
                 n->progress = -1;
 
         /* Process rules */
-        rule_apply_all(n);
+        if (rules) {
+                rule_snapshot_apply(rules, n);
+                n->rules_generation = rule_snapshot_generation(rules);
+        } else {
+                rule_apply_all(n);
+                n->rules_generation = rules_generation;
+        }
 
         if (g_str_has_prefix(n->summary, "DUNST_COMMAND_")) {
                 char *msg = "DUNST_COMMAND_* has been removed, please switch to dunstctl. See #830 for more details. https://github.com/dunst-project/dunst/pull/830";
@@ -515,6 +838,24 @@ void notification_init(struct notification *n)
         if (n->dbus_timeout >= 0)
                 n->timeout = n->dbus_timeout;
 
+        stats_record(STATS_INIT, g_get_monotonic_time() - start);
+        TRACE_END("notification_init");
+}
+
+/* see notification.h */
+void notification_init(struct notification *n)
+{
+        notification_init_internal(n, NULL);
+}
+
+/* see notification.h */
+void notification_init_detached(struct notification *n, const struct rule_snapshot *rules)
+{
+        ASSERT_OR_RET(rules,);
+
+        n->priv->detached = true;
+        notification_init_internal(n, rules);
+        n->priv->detached = false;
 }
 
 static void notification_format_message(struct notification *n)
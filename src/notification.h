@@ -35,8 +35,22 @@ enum urgency {
         URG_MAX = 2,   /**< Maximum value, useful for boundary checking */
 };
 
+/// The parts of a notification, which have to be drawn again
+enum notification_dirty {
+        DIRTY_NONE     = 0,
+        DIRTY_TEXT     = 1 << 0, /**< The text to render or its markup */
+        DIRTY_ICON     = 1 << 1, /**< The icon surface */
+        DIRTY_COLORS   = 1 << 2, /**< The colors and the urgency */
+        DIRTY_PROGRESS = 1 << 3, /**< The progress value */
+        DIRTY_LAYOUT   = 1 << 4, /**< Anything else influencing the layout */
+        DIRTY_ALL      = (1 << 5) - 1, /**< Everything to draw */
+        DIRTY_SCRIPT   = 1 << 5, /**< Only seen by the scripts, nothing to draw */
+};
+
 typedef struct _notification_private NotificationPrivate;
 
+struct rule_snapshot;
+
 struct notification_colors {
         char *frame;
         char *bg;
@@ -105,6 +119,9 @@ struct notification {
         PangoEllipsizeMode ellipsize;
         PangoAlignment alignment;
         bool hide_text;
+        guint64 dbus_signature; /**< Hash of the Notify call without body and progress, 0 if unknown */
+        guint rules_generation; /**< The rules_generation of the rules applied to it */
+        guint dirty;            /**< The #notification_dirty parts, which changed since it got drawn last */
 
         /* derived fields */
         char *msg;            /**< formatted message */
@@ -142,6 +159,19 @@ void notification_ref(struct notification *n);
  */
 void notification_init(struct notification *n);
 
+/**
+ * Like notification_init(), but safe to call off the main thread, as long
+ * as no other thread accesses \p n meanwhile.
+ *
+ * The rules are taken from \p rules instead of the global list. Icons set
+ * by name are only remembered in n->iconname, looking them up is left to
+ * queues_notification_insert().
+ *
+ * @param n the notification to sanitize
+ * @param rules the rules to apply
+ */
+void notification_init_detached(struct notification *n, const struct rule_snapshot *rules);
+
 /**
  * Decrease the reference counter of the notification.
  *
@@ -178,16 +208,40 @@ struct notification *notification_unlock(struct notification *n);
  */
 void notification_transfer_icon(struct notification *from, struct notification *to);
 
+/**
+ * Compare \p to with the notification \p from, which it replaces, and move
+ * the resources, which are still valid, over to \p to. This includes the
+ * icon surface, if the icon didn't change, and the last rendered text.
+ *
+ * Both notifications have to be initialised already.
+ *
+ * @param from The notification, which gets replaced
+ * @param to The replacement
+ * @returns the #notification_dirty parts, which differ between both,
+ *          including #DIRTY_SCRIPT
+ */
+guint notification_adopt_unchanged(struct notification *from, struct notification *to);
+
 /**Replace the current notification's icon with the icon specified by path.
  *
  * Removes the reference for the previous icon automatically and will also free the
  * iconname field. So passing n->iconname as new_icon is invalid.
  *
+ * If the icon loader is running, the icon is decoded in the background and
+ * n->icon stays NULL until it's done. Displayed notifications get redrawn
+ * once their icon arrives.
+ *
  * @param n the notification to replace the icon
  * @param new_icon The path of the new icon. May be an absolute path or an icon name.
  */
 void notification_icon_replace_path(struct notification *n, const char *new_icon);
 
+/**
+ * Stop waiting for the icon, which is still being loaded for \p n.
+ * Does nothing if no icon is being loaded.
+ */
+void notification_icon_load_cancel(struct notification *n);
+
 /**Replace the current notification's icon with the raw icon given in the GVariant.
  *
  * Removes the reference for the previous icon automatically.
@@ -197,6 +251,55 @@ void notification_icon_replace_path(struct notification *n, const char *new_icon
  */
 void notification_icon_replace_data(struct notification *n, GVariant *new_icon);
 
+/**
+ * Like notification_icon_replace_data(), but rasterise the icon for
+ * \p scale instead of the current output scale. Unlike the former, it may
+ * be called off the main thread.
+ */
+void notification_icon_replace_data_scaled(struct notification *n, GVariant *new_icon, double scale);
+
+/**
+ * Rasterise the icon of \p n again, if it was rasterised for a different
+ * output scale. Like in notification_icon_replace_path(), the icon may
+ * arrive later, the icon for the old scale is kept until then.
+ *
+ * Raw icons are rasterised from the icon as it was rasterised first, the
+ * raw data isn't kept. Without that source, they stay as they are.
+ *
+ * @param n the notification
+ * @param scale The current output scale
+ */
+void notification_icon_update_scale(struct notification *n, double scale);
+
+/**
+ * Get the size to reserve for the icon of \p n, while it's still being
+ * loaded. Reserving it keeps the layout from changing, once the icon
+ * arrives.
+ *
+ * @param n the notification
+ * @returns the unscaled width and height of the icon to expect
+ * @retval 0 if no icon is being loaded
+ */
+int notification_icon_pending_size(const struct notification *n);
+
+/**
+ * Drop the source of a raw icon, which is kept to rasterise it for other
+ * scales. The icon stays at its current scale afterwards.
+ *
+ * @param n the notification
+ */
+void notification_icon_release_source(struct notification *n);
+
+/**
+ * Update the progress and the body of \p n in place. Only the fields
+ * derived from them get updated, everything else stays as it is.
+ *
+ * @param n the notification
+ * @param progress The new progress, -1 if there is none
+ * @param body The new body
+ */
+void notification_update_progress(struct notification *n, int progress, const char *body);
+
 /**
  * Run the script associated with the
  * given notification.
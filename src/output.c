@@ -13,6 +13,55 @@ bool is_running_wayland(void) {
         return !(wayland_display == NULL);
 }
 
+struct measure_context {
+        cairo_surface_t *srf;
+        cairo_t *c;
+        PangoContext *pango;
+        double dpi;
+};
+
+static void measure_context_free(gpointer data)
+{
+        struct measure_context *mc = data;
+        if (!mc)
+                return;
+
+        g_object_unref(mc->pango);
+        cairo_destroy(mc->c);
+        cairo_surface_destroy(mc->srf);
+        g_free(mc);
+}
+
+static GPrivate measure_context_key = G_PRIVATE_INIT(measure_context_free);
+
+/* see output.h */
+PangoContext *output_get_measure_context(double dpi)
+{
+        struct measure_context *mc = g_private_get(&measure_context_key);
+
+        if (!mc) {
+                mc = g_malloc0(sizeof(struct measure_context));
+                mc->srf = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
+                mc->c = cairo_create(mc->srf);
+                mc->pango = pango_cairo_create_context(mc->c);
+                pango_cairo_context_set_resolution(mc->pango, dpi);
+                mc->dpi = dpi;
+                g_private_set(&measure_context_key, mc);
+        } else if (mc->dpi != dpi) {
+                pango_cairo_context_set_resolution(mc->pango, dpi);
+                mc->dpi = dpi;
+        }
+
+        return mc->pango;
+}
+
+/* see output.h */
+void output_free_measure_context(void)
+{
+        // g_private_replace calls the destroy notify on the old value
+        g_private_replace(&measure_context_key, NULL);
+}
+
 const struct output output_x11 = {
         x_setup,
         x_free,
@@ -24,7 +73,6 @@ const struct output output_x11 = {
         x_win_hide,
 
         x_display_surface,
-        x_win_get_context,
 
         get_active_screen,
 
@@ -46,7 +94,6 @@ const struct output output_wl = {
         wl_win_hide,
 
         wl_display_surface,
-        wl_win_get_context,
 
         wl_get_active_screen,
 
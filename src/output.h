@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <glib.h>
 #include <cairo.h>
+#include <pango/pangocairo.h>
 
 typedef gpointer window;
 
@@ -40,8 +41,6 @@ struct output {
 
         void (*display_surface)(cairo_surface_t *srf, window win, const struct dimensions*);
 
-        cairo_t* (*win_get_context)(window);
-
         const struct screen_info* (*get_active_screen)(void);
 
         bool (*is_idle)(void);
@@ -59,5 +58,22 @@ const struct output* output_create(bool force_xwayland);
 
 bool is_running_wayland(void);
 
+/**
+ * Get a PangoContext to measure text with. It is backed by a 1x1 image
+ * surface, so creating layouts from it never touches the buffers used for
+ * presenting the notifications.
+ *
+ * The context is cached per thread and only updated when \p dpi changes.
+ *
+ * @param dpi The resolution of the screen the text is rendered on
+ * @return a context owned by the calling thread. Don't unref it.
+ */
+PangoContext *output_get_measure_context(double dpi);
+
+/**
+ * Free the measurement context of the calling thread, if there is any.
+ */
+void output_free_measure_context(void);
+
 #endif
 /* vim: set ft=c tabstop=8 shiftwidth=8 expandtab textwidth=0: */
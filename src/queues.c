@@ -23,7 +23,10 @@
 #include "dunst.h"
 #include "log.h"
 #include "notification.h"
+#include "rules.h"
 #include "settings.h"
+#include "stats.h"
+#include "trace.h"
 #include "utils.h"
 #include "output.h" // For checking if wayland is active.
 
@@ -176,6 +179,8 @@ int queues_notification_insert(struct notification *n)
                 return 0;
         }
 
+        stats_count(STATS_INSERTED);
+
         bool inserted = false;
         if (n->id != 0) {
                 if (!queues_notification_replace_id(n)) {
@@ -239,6 +244,7 @@ static bool queues_stack_duplicate(struct notification *new)
                                 notification_transfer_icon(old, new);
 
                                 notification_unref(old);
+                                stats_count(STATS_STACKED);
                                 return true;
                         }
                 }
@@ -275,6 +281,7 @@ static bool queues_stack_by_tag(struct notification *new)
                                 notification_transfer_icon(old, new);
 
                                 notification_unref(old);
+                                stats_count(STATS_STACKED);
                                 return true;
                         }
                 }
@@ -295,12 +302,23 @@ bool queues_notification_replace_id(struct notification *new)
                                 iter->data = new;
                                 new->dup_count = old->dup_count;
 
+                                guint changed = notification_adopt_unchanged(old, new);
+
+                                // Progress updates don't run the script again
+                                if (!(changed & ~DIRTY_PROGRESS))
+                                        new->script_run = old->script_run;
+
+                                // Changes, which didn't make it to the
+                                // screen yet, still have to be drawn
+                                new->dirty = (changed & DIRTY_ALL) | old->dirty;
+
                                 if (allqueues[i] == displayed) {
                                         new->start = time_monotonic_now();
                                         notification_run_script(new);
                                 }
 
                                 notification_unref(old);
+                                stats_count(STATS_REPLACED);
                                 return true;
                         }
                 }
@@ -308,6 +326,60 @@ bool queues_notification_replace_id(struct notification *new)
         return false;
 }
 
+/* see queues.h */
+bool queues_notification_update_progress(int id, const char *sender, guint64 signature,
+                                         int progress, const char *body)
+{
+        ASSERT_OR_RET(body, false);
+
+        GQueue *allqueues[] = { displayed, waiting };
+        for (int i = 0; i < sizeof(allqueues)/sizeof(GQueue*); i++) {
+                for (GList *iter = g_queue_peek_head_link(allqueues[i]);
+                            iter;
+                            iter = iter->next) {
+                        struct notification *n = iter->data;
+                        if (n->id != id)
+                                continue;
+
+                        if (signature == 0 || n->dbus_signature != signature
+                            || !STR_EQ(n->dbus_client, sender))
+                                return false;
+
+                        // A replacement would get the rules enabled now
+                        if (n->rules_generation != rules_generation)
+                                return false;
+
+                        // A different body may change which rules apply
+                        if (!STR_EQ(n->body, body) && rule_any_filters_body())
+                                return false;
+
+                        // The body got amended, so it cannot be compared
+                        if (g_str_has_prefix(n->summary, "DUNST_COMMAND_"))
+                                return false;
+
+                        bool body_changed = !STR_EQ(n->body, body);
+                        notification_update_progress(n, progress, body);
+                        n->timestamp = time_monotonic_now();
+
+                        // Behave like a replacement, which only runs the
+                        // script again if more than the progress changed
+                        if (allqueues[i] == displayed) {
+                                n->start = time_monotonic_now();
+                                if (body_changed)
+                                        n->script_run = false;
+                                notification_run_script(n);
+                        }
+
+                        if (settings.print_notifications)
+                                notification_print(n);
+
+                        stats_count(STATS_REPLACED);
+                        return true;
+                }
+        }
+        return false;
+}
+
 /* see queues.h */
 void queues_notification_close_id(int id, enum reason reason)
 {
@@ -327,6 +399,12 @@ void queues_notification_close_id(int id, enum reason reason)
         }
 
         if (target) {
+                stats_count_close(reason);
+
+                // Nobody is going to see the icon anymore, it gets
+                // loaded again when popping it from history
+                notification_icon_load_cancel(target);
+
                 //Don't notify clients if notification was pulled from history
                 if (!target->redisplayed)
                         signal_notification_closed(target, reason);
@@ -341,6 +419,21 @@ void queues_notification_close(struct notification *n, enum reason reason)
         queues_notification_close_id(n->id, reason);
 }
 
+/**
+ * Move a notification from history back to the waiting queue.
+ */
+static void queues_history_redisplay(struct notification *n)
+{
+        n->redisplayed = true;
+        n->timeout = settings.sticky_history ? 0 : n->timeout;
+
+        // The icon got dropped, if it was still loading when closed
+        if (!n->icon && n->iconname)
+                notification_icon_replace_path(n, n->iconname);
+
+        g_queue_insert_sorted(waiting, n, notification_cmp_data, NULL);
+}
+
 /* see queues.h */
 void queues_history_pop(void)
 {
@@ -348,9 +441,8 @@ void queues_history_pop(void)
                 return;
 
         struct notification *n = g_queue_pop_tail(history);
-        n->redisplayed = true;
-        n->timeout = settings.sticky_history ? 0 : n->timeout;
-        g_queue_insert_sorted(waiting, n, notification_cmp_data, NULL);
+        signal_history_removed(n);
+        queues_history_redisplay(n);
 }
 
 /* see queues.h */
@@ -376,9 +468,8 @@ void queues_history_pop_by_id(unsigned int id)
                 return;
 
         g_queue_remove(history, n);
-        n->redisplayed = true;
-        n->timeout = settings.sticky_history ? 0 : n->timeout;
-        g_queue_insert_sorted(waiting, n, notification_cmp_data, NULL);
+        signal_history_removed(n);
+        queues_history_redisplay(n);
 }
 
 /* see queues.h */
@@ -387,10 +478,15 @@ void queues_history_push(struct notification *n)
         if (!n->history_ignore) {
                 if (settings.history_length > 0 && history->length >= settings.history_length) {
                         struct notification *to_free = g_queue_pop_head(history);
+                        signal_history_removed(to_free);
                         notification_unref(to_free);
                 }
 
+                // Notifications in the history aren't drawn, they don't
+                // need anything to rasterise their icons again
+                notification_icon_release_source(n);
                 g_queue_push_tail(history, n);
+                signal_history_added(n);
         } else {
                 notification_unref(n);
         }
@@ -413,6 +509,8 @@ void queues_update(struct dunst_status status, gint64 time)
 {
         GList *iter, *nextiter;
 
+        TRACE_BEGIN("queues_update");
+
         /* Move back all notifications, which aren't eligible to get shown anymore
          * Will move the notifications back to waiting, if dunst isn't running or fullscreen
          * and notifications is not eligible to get shown anymore */
@@ -517,6 +615,8 @@ void queues_update(struct dunst_status status, gint64 time)
                         }
                 }
         }
+
+        TRACE_END("queues_update");
 }
 
 /* see queues.h */
@@ -79,6 +79,10 @@ int queues_notification_insert(struct notification *n);
  * the new notification. The given notification is inserted
  * right in the same position as the old notification.
  *
+ * Everything the old notification has in common with its replacement is
+ * reused, see notification_adopt_unchanged(). The script only runs again,
+ * if more than the progress changed.
+ *
  * @param new replacement for the old notification
  *
  * @retval true: a matching notification has been found and is replaced
@@ -86,6 +90,24 @@ int queues_notification_insert(struct notification *n);
  */
 bool queues_notification_replace_id(struct notification *new);
 
+/**
+ * Update the progress and the body of the notification with the given id
+ * in place, if a replacement wouldn't change anything else about it. This
+ * skips decoding the replacement, applying the rules and looking up its
+ * icon again.
+ *
+ * @param id The id of the notification to update
+ * @param sender The dbus client sending the update
+ * @param signature The hash of the update, see notification.dbus_signature
+ * @param progress The new progress, -1 if there is none
+ * @param body The new body
+ *
+ * @retval true: the notification got updated
+ * @retval false: the update has to replace the notification
+ */
+bool queues_notification_update_progress(int id, const char *sender, guint64 signature,
+                                         int progress, const char *body);
+
 /**
  * Close the notification that has n->id == id
  *
@@ -8,11 +8,52 @@
 #include <regex.h>
 
 #include "dunst.h"
+#include "trace.h"
 #include "utils.h"
 #include "settings_data.h"
 #include "log.h"
 
 GSList *rules = NULL;
+guint rules_generation = 0;
+
+struct rule_snapshot {
+        guint generation;       /**< The rules_generation at the time of the snapshot */
+        guint count;
+        struct rule *rules[];
+};
+
+/* The filters matching strings */
+enum rule_filter {
+        FILTER_APPNAME,
+        FILTER_DESKTOP_ENTRY,
+        FILTER_SUMMARY,
+        FILTER_BODY,
+        FILTER_ICON,
+        FILTER_CATEGORY,
+        FILTER_STACK_TAG,
+        FILTER_COUNT,
+};
+
+static const size_t filter_offsets[] = {
+        [FILTER_APPNAME]        = offsetof(struct rule, appname),
+        [FILTER_DESKTOP_ENTRY]  = offsetof(struct rule, desktop_entry),
+        [FILTER_SUMMARY]        = offsetof(struct rule, summary),
+        [FILTER_BODY]           = offsetof(struct rule, body),
+        [FILTER_ICON]           = offsetof(struct rule, icon),
+        [FILTER_CATEGORY]       = offsetof(struct rule, category),
+        [FILTER_STACK_TAG]      = offsetof(struct rule, stack_tag),
+};
+
+G_STATIC_ASSERT(G_N_ELEMENTS(filter_offsets) == FILTER_COUNT);
+
+/* A string filter prepared for matching */
+struct rule_pattern {
+        const char *source;     /**< The pattern it was prepared from */
+        bool is_regex;          /**< If it was prepared with settings.enable_regex */
+        bool literal;           /**< If it has no special characters */
+        bool valid;             /**< If the regex compiled */
+        regex_t regex;
+};
 
 /*
  * Apply rule to notification.
@@ -106,12 +147,14 @@ void rule_apply(struct rule *r, struct notification *n)
  */
 void rule_apply_all(struct notification *n)
 {
+        TRACE_BEGIN("rule_apply_all");
         for (GSList *iter = rules; iter; iter = iter->next) {
                 struct rule *r = iter->data;
                 if (rule_matches_notification(r, n)) {
                         rule_apply(r, n);
                 }
         }
+        TRACE_END("rule_apply_all");
 }
 
 bool rule_apply_special_filters(struct rule *r, const char *name) {
@@ -164,7 +207,7 @@ static inline bool rule_field_matches_string(const char *value, const char *patt
                 }
                 regex_t     regex;
 
-                // TODO compile each regex only once
+                // Rules from the config are compiled by rule_compile()
                 int err = regcomp(&regex, pattern, REG_NEWLINE | REG_EXTENDED | REG_NOSUB);
                 if (err) {
                         size_t err_size = regerror(err, &regex, NULL, 0);
@@ -188,22 +231,159 @@ static inline bool rule_field_matches_string(const char *value, const char *patt
         }
 }
 
+static const char *rule_filter_get(const struct rule *r, enum rule_filter f)
+{
+        return *(const char **) ((const char *) r + filter_offsets[f]);
+}
+
+static void rule_patterns_free(struct rule *r)
+{
+        ASSERT_OR_RET(r->patterns,);
+
+        for (int f = 0; f < FILTER_COUNT; f++)
+                if (r->patterns[f].valid)
+                        regfree(&r->patterns[f].regex);
+        g_clear_pointer(&r->patterns, g_free);
+}
+
+/* see rules.h */
+void rule_compile(struct rule *r)
+{
+        ASSERT_OR_RET(r,);
+
+        rule_patterns_free(r);
+        r->patterns = g_new0(struct rule_pattern, FILTER_COUNT);
+
+        for (int f = 0; f < FILTER_COUNT; f++) {
+                struct rule_pattern *p = &r->patterns[f];
+                p->source = rule_filter_get(r, f);
+                p->is_regex = settings.enable_regex;
+                if (!p->source)
+                        continue;
+
+                // Patterns without special characters are compared directly
+                p->literal = !strpbrk(p->source, p->is_regex ? ".[]()*+?{}|^$\\" : "*?[\\");
+                if (!p->is_regex || p->literal)
+                        continue;
+
+                int err = regcomp(&p->regex, p->source, REG_NEWLINE | REG_EXTENDED | REG_NOSUB);
+                if (err) {
+                        size_t err_size = regerror(err, &p->regex, NULL, 0);
+                        char *err_buf = g_malloc(err_size);
+                        regerror(err, &p->regex, err_buf, err_size);
+                        LOG_W("Rule '%s' never matches, %s: \"%s\"", r->name, err_buf, p->source);
+                        g_free(err_buf);
+                        continue;
+                }
+                p->valid = true;
+        }
+}
+
 /*
- * Check whether rule should be applied to n.
+ * Check whether the filter f of the rule matches value.
  */
-bool rule_matches_notification(struct rule *r, struct notification *n)
+static bool rule_field_matches(const struct rule *r, enum rule_filter f, const char *value)
+{
+        const char *pattern = rule_filter_get(r, f);
+        const struct rule_pattern *p = r->patterns ? &r->patterns[f] : NULL;
+
+        // The rule changed since it was compiled
+        if (!p || p->source != pattern || p->is_regex != settings.enable_regex)
+                return rule_field_matches_string(value, pattern);
+
+        if (!pattern)
+                return true;
+        if (!value)
+                return false;
+
+        // A regex matches anywhere in the value, unless it's anchored
+        if (p->literal)
+                return p->is_regex ? !!strstr(value, pattern) : STR_EQ(value, pattern);
+        if (p->is_regex)
+                return p->valid && !regexec(&p->regex, value, 0, NULL, 0);
+        return !fnmatch(pattern, value, 0);
+}
+
+/*
+ * Check whether the filters of the rule match n, no matter if it's enabled.
+ */
+static bool rule_filters_match(const struct rule *r, const struct notification *n)
 {
-        return  r->enabled
-                && (r->msg_urgency == URG_NONE || r->msg_urgency == n->urgency)
+        return  (r->msg_urgency == URG_NONE || r->msg_urgency == n->urgency)
                 && (r->match_dbus_timeout < 0 || (r->match_dbus_timeout == n->dbus_timeout))
                 && (r->match_transient == -1 || (r->match_transient == n->transient))
-                && rule_field_matches_string(n->appname,        r->appname)
-                && rule_field_matches_string(n->desktop_entry,  r->desktop_entry)
-                && rule_field_matches_string(n->summary,        r->summary)
-                && rule_field_matches_string(n->body,           r->body)
-                && rule_field_matches_string(n->iconname,       r->icon)
-                && rule_field_matches_string(n->category,       r->category)
-                && rule_field_matches_string(n->stack_tag,      r->stack_tag);
+                && rule_field_matches(r, FILTER_APPNAME,        n->appname)
+                && rule_field_matches(r, FILTER_DESKTOP_ENTRY,  n->desktop_entry)
+                && rule_field_matches(r, FILTER_SUMMARY,        n->summary)
+                && rule_field_matches(r, FILTER_BODY,           n->body)
+                && rule_field_matches(r, FILTER_ICON,           n->iconname)
+                && rule_field_matches(r, FILTER_CATEGORY,       n->category)
+                && rule_field_matches(r, FILTER_STACK_TAG,      n->stack_tag);
+}
+
+/*
+ * Check whether rule should be applied to n.
+ */
+bool rule_matches_notification(struct rule *r, struct notification *n)
+{
+        return r->enabled && rule_filters_match(r, n);
+}
+
+/* see rules.h */
+struct rule_snapshot *rule_snapshot_new(void)
+{
+        guint count = 0;
+        for (GSList *iter = rules; iter; iter = iter->next)
+                if (((struct rule *) iter->data)->enabled)
+                        count++;
+
+        struct rule_snapshot *s = g_malloc(sizeof(struct rule_snapshot)
+                                           + count * sizeof(struct rule *));
+        s->generation = rules_generation;
+        s->count = 0;
+        for (GSList *iter = rules; iter; iter = iter->next) {
+                struct rule *r = iter->data;
+                if (r->enabled)
+                        s->rules[s->count++] = r;
+        }
+
+        return s;
+}
+
+/* see rules.h */
+void rule_snapshot_free(struct rule_snapshot *s)
+{
+        g_free(s);
+}
+
+/* see rules.h */
+guint rule_snapshot_generation(const struct rule_snapshot *s)
+{
+        return s->generation;
+}
+
+/* see rules.h */
+void rule_snapshot_apply(const struct rule_snapshot *s, struct notification *n)
+{
+        ASSERT_OR_RET(s,);
+
+        TRACE_BEGIN("rule_snapshot_apply");
+        for (guint i = 0; i < s->count; i++) {
+                if (rule_filters_match(s->rules[i], n))
+                        rule_apply(s->rules[i], n);
+        }
+        TRACE_END("rule_snapshot_apply");
+}
+
+/* see rules.h */
+bool rule_any_filters_body(void)
+{
+        for (GSList *iter = rules; iter; iter = iter->next) {
+                struct rule *r = iter->data;
+                if (r->enabled && r->body)
+                        return true;
+        }
+        return false;
 }
 
 /**
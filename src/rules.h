@@ -58,10 +58,28 @@ struct rule {
         bool enabled;
         int progress_bar_alignment;
         char *set_stack_tag; // this has to be the last modifying rule
+
+        // The string filters prepared for matching by rule_compile(). This
+        // isn't a setting, so it has no offset in settings_data.h.
+        struct rule_pattern *patterns;
 };
 
 extern GSList *rules;
 
+/**
+ * Counts the changes of the enabled rules. It has to be incremented, when
+ * a rule gets enabled or disabled. Only used on the main thread.
+ */
+extern guint rules_generation;
+
+/**
+ * The rules, which were enabled at some point in time. Apart from the
+ * enabled flag, rules don't change once the settings are loaded. So a
+ * snapshot can be used off the main thread, while rules get enabled or
+ * disabled on the main thread.
+ */
+struct rule_snapshot;
+
 /**
  * Allocate a new rule with given name. The rule is fully initialised. If the
  * name is one of a special section (see settings_data.h), the rule is
@@ -74,10 +92,46 @@ extern GSList *rules;
  */
 struct rule *rule_new(const char *name);
 
+/**
+ * Prepare the string filters of \p r for matching. Regular expressions get
+ * compiled once here instead of for every notification. Invalid ones are
+ * reported here and never match.
+ *
+ * Has to be called again, if a filter or settings.enable_regex changes.
+ * Until then, the changed filters are matched without preparation.
+ */
+void rule_compile(struct rule *r);
+
 void rule_apply(struct rule *r, struct notification *n);
 void rule_apply_all(struct notification *n);
 bool rule_matches_notification(struct rule *r, struct notification *n);
 
+/**
+ * Take a snapshot of the enabled rules. Has to be called on the main thread.
+ *
+ * @returns the snapshot, free it with rule_snapshot_free()
+ */
+struct rule_snapshot *rule_snapshot_new(void);
+
+void rule_snapshot_free(struct rule_snapshot *s);
+
+/**
+ * @returns the rules_generation at the time \p s was taken
+ */
+guint rule_snapshot_generation(const struct rule_snapshot *s);
+
+/**
+ * Apply the rules of \p s, which match \p n, like rule_apply_all(). May be
+ * called from any thread, which owns \p n.
+ */
+void rule_snapshot_apply(const struct rule_snapshot *s, struct notification *n);
+
+/**
+ * Check if any enabled rule filters on the body of notifications. If not,
+ * changing the body cannot change which rules apply.
+ */
+bool rule_any_filters_body(void);
+
 /**
  * Get rule with this name from rules
  *
@@ -272,6 +272,7 @@ void load_settings(const char * const path) {
         for (GSList *iter = rules; iter; iter = iter->next) {
                 struct rule *r = iter->data;
                 print_rule(r);
+                rule_compile(r);
         }
         g_ptr_array_unref(conf_files);
 }
@@ -110,6 +110,8 @@ struct settings {
         int history_length;
         int show_indicators;
         int ignore_dbusclose;
+        char *peer_socket;
+        int shm_rings;
         int ignore_newline;
         int line_height;
         int separator_height;
@@ -131,6 +133,8 @@ struct settings {
         bool enable_recursive_icon_lookup; // experimental
         bool enable_regex; // experimental
         char *icon_path;
+        int icon_cache_size;
+        bool icon_disk_cache;
         enum follow_mode f_mode;
         bool always_run_script;
         struct keyboard_shortcut close_ks;
@@ -844,6 +844,26 @@ static const struct setting allowed_settings[] = {
                 .parser = string_parse_enum,
                 .parser_data = boolean_enum_data,
         },
+        {
+                .name = "peer_socket",
+                .section = "global",
+                .description = "Path of a socket accepting notifications without going through the session bus",
+                .type = TYPE_STRING,
+                .default_value = "",
+                .value = &settings.peer_socket,
+                .parser = NULL,
+                .parser_data = NULL,
+        },
+        {
+                .name = "shm_rings",
+                .section = "global",
+                .description = "Max amount of shared memory rings open at once, 0 disables them",
+                .type = TYPE_INT,
+                .default_value = "0",
+                .value = &settings.shm_rings,
+                .parser = NULL,
+                .parser_data = NULL,
+        },
         {
                 .name = "ignore_newline",
                 .section = "global",
@@ -1215,6 +1235,26 @@ static const struct setting allowed_settings[] = {
                 .parser = NULL,
                 .parser_data = NULL,
         },
+        {
+                .name = "icon_cache_size",
+                .section = "global",
+                .description = "Memory budget of the icon cache in kilobytes",
+                .type = TYPE_INT,
+                .default_value = "8192",
+                .value = &settings.icon_cache_size,
+                .parser = NULL,
+                .parser_data = NULL,
+        },
+        {
+                .name = "icon_disk_cache",
+                .section = "global",
+                .description = "Share rasterised icons with other instances through a file in $XDG_CACHE_HOME",
+                .type = TYPE_CUSTOM,
+                .default_value = "false",
+                .value = &settings.icon_disk_cache,
+                .parser = string_parse_bool,
+                .parser_data = boolean_enum_data,
+        },
         {
                 .name = "enable_recursive_icon_lookup",
                 .section = "global",
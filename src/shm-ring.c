@@ -0,0 +1,348 @@
+#define _GNU_SOURCE
+#include "shm-ring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "utils.h"
+
+#define SHM_RING_MAX_SIZE (64 * 1024 * 1024)
+
+G_STATIC_ASSERT(sizeof(struct shm_ring_header) == 192);
+G_STATIC_ASSERT(sizeof(struct shm_ring_slot) == 16);
+
+struct shm_ring {
+        int fd;
+        int doorbell;
+        struct shm_ring_header *hdr;
+        gsize size;
+        guint8 *slots;
+        guint8 *spill;
+
+        /* Private copies, the shared ones are never read back */
+        guint32 slot_count;
+        guint32 slot_size;
+        guint32 spill_size;
+        guint32 tail;
+        guint32 spill_tail;
+};
+
+struct shm_ring_producer {
+        int fd;
+        int doorbell;
+        struct shm_ring_header *hdr;
+        gsize size;
+        guint8 *slots;
+        guint8 *spill;
+
+        guint32 slot_count;
+        guint32 slot_size;
+        guint32 spill_size;
+        guint32 head;
+        guint32 spill_head;
+};
+
+#define IS_POW2(x) ((x) && !((x) & ((x) - 1)))
+
+/**
+ * The size of the memory of a ring with the given layout.
+ *
+ * @retval 0 if the layout is invalid
+ */
+static gsize shm_ring_layout_size(guint32 slot_count, guint32 slot_size, guint32 spill_size)
+{
+        if (!IS_POW2(slot_count) || !IS_POW2(slot_size) || !IS_POW2(spill_size))
+                return 0;
+        if (slot_size <= sizeof(struct shm_ring_slot))
+                return 0;
+
+        guint64 size = sizeof(struct shm_ring_header)
+                       + (guint64) slot_count * slot_size
+                       + spill_size;
+
+        return size <= SHM_RING_MAX_SIZE ? size : 0;
+}
+
+static inline struct shm_ring_slot *shm_ring_slot_at(guint8 *slots, guint32 slot_size, guint32 index)
+{
+        return (struct shm_ring_slot *) (slots + (gsize) index * slot_size);
+}
+
+static void shm_ring_ring_doorbell(int doorbell)
+{
+        guint64 one = 1;
+        // Only fails if the counter is about to overflow, which still
+        // leaves it readable
+        if (write(doorbell, &one, sizeof(one)) < 0 && errno != EAGAIN)
+                LOG_D("Cannot ring the doorbell: %s", strerror(errno));
+}
+
+/* see shm-ring.h */
+struct shm_ring *shm_ring_new(guint32 slot_count, guint32 slot_size, guint32 spill_size)
+{
+        gsize size = shm_ring_layout_size(slot_count, slot_size, spill_size);
+        ASSERT_OR_RET(size, NULL);
+
+        int fd = memfd_create("dunst-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (fd < 0) {
+                LOG_W("Cannot create the ring: %s", strerror(errno));
+                return NULL;
+        }
+
+        // The producer must not be able to shrink the memory under our feet
+        if (ftruncate(fd, size) < 0
+            || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+                LOG_W("Cannot resize and seal the ring: %s", strerror(errno));
+                close(fd);
+                return NULL;
+        }
+
+        void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mem == MAP_FAILED) {
+                LOG_W("Cannot map the ring: %s", strerror(errno));
+                close(fd);
+                return NULL;
+        }
+
+        int doorbell = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (doorbell < 0) {
+                LOG_W("Cannot create the doorbell of the ring: %s", strerror(errno));
+                munmap(mem, size);
+                close(fd);
+                return NULL;
+        }
+
+        struct shm_ring *ring = g_malloc0(sizeof(struct shm_ring));
+        ring->fd = fd;
+        ring->doorbell = doorbell;
+        ring->size = size;
+        ring->hdr = mem;
+        ring->slots = (guint8 *) mem + sizeof(struct shm_ring_header);
+        ring->spill = ring->slots + (gsize) slot_count * slot_size;
+        ring->slot_count = slot_count;
+        ring->slot_size = slot_size;
+        ring->spill_size = spill_size;
+
+        // The memfd is zeroed already
+        ring->hdr->slot_count = slot_count;
+        ring->hdr->slot_size = slot_size;
+        ring->hdr->spill_size = spill_size;
+        ring->hdr->waiting = 1;
+        g_atomic_int_set((gint *) &ring->hdr->magic, SHM_RING_MAGIC);
+
+        return ring;
+}
+
+/* see shm-ring.h */
+void shm_ring_free(struct shm_ring *ring)
+{
+        if (!ring)
+                return;
+
+        munmap(ring->hdr, ring->size);
+        close(ring->doorbell);
+        close(ring->fd);
+        g_free(ring);
+}
+
+/* see shm-ring.h */
+int shm_ring_get_fd(const struct shm_ring *ring)
+{
+        return ring->fd;
+}
+
+/* see shm-ring.h */
+int shm_ring_get_doorbell(const struct shm_ring *ring)
+{
+        return ring->doorbell;
+}
+
+/**
+ * Take the message at the tail of the ring.
+ *
+ * @retval false if the slot is corrupt
+ */
+static bool shm_ring_take(struct shm_ring *ring, shm_ring_message_cb callback, gpointer data)
+{
+        struct shm_ring_slot slot;
+        // Read the slot only once, the producer might change it any time
+        memcpy(&slot, shm_ring_slot_at(ring->slots, ring->slot_size, ring->tail & (ring->slot_count - 1)),
+               sizeof(slot));
+
+        const guint8 *src;
+        if (slot.flags & SHM_RING_SPILLED) {
+                guint32 pos = slot.spill_offset & (ring->spill_size - 1);
+                if (slot.spill_offset - ring->spill_tail >= ring->spill_size
+                    || slot.length > ring->spill_size - pos)
+                        return false;
+                src = ring->spill + pos;
+        } else {
+                if (slot.length > ring->slot_size - sizeof(struct shm_ring_slot))
+                        return false;
+                src = shm_ring_slot_at(ring->slots, ring->slot_size,
+                                       ring->tail & (ring->slot_count - 1))->data;
+        }
+
+        // The copy is ours, the decoder never sees the shared memory
+        GBytes *bytes = g_bytes_new(src, slot.length);
+        GVariant *message = g_variant_new_from_bytes(G_VARIANT_TYPE(SHM_RING_MESSAGE_TYPE),
+                                                     bytes, FALSE);
+        g_variant_ref_sink(message);
+        g_bytes_unref(bytes);
+
+        ring->tail++;
+        g_atomic_int_set((gint *) &ring->hdr->tail, ring->tail);
+        if (slot.flags & SHM_RING_SPILLED) {
+                ring->spill_tail = slot.spill_offset + slot.length;
+                g_atomic_int_set((gint *) &ring->hdr->spill_tail, ring->spill_tail);
+        }
+
+        callback(message, data);
+        g_variant_unref(message);
+        return true;
+}
+
+/* see shm-ring.h */
+int shm_ring_drain(struct shm_ring *ring, guint max, shm_ring_message_cb callback, gpointer data)
+{
+        ASSERT_OR_RET(ring, -1);
+        ASSERT_OR_RET(callback, -1);
+
+        guint64 rung;
+        // Reset the doorbell, so it only gets readable again for new messages
+        if (read(ring->doorbell, &rung, sizeof(rung)) < 0 && errno != EAGAIN)
+                LOG_D("Cannot reset the doorbell: %s", strerror(errno));
+
+        guint done = 0;
+        while (done < max) {
+                guint32 head = g_atomic_int_get((gint *) &ring->hdr->head);
+
+                if (head == ring->tail) {
+                        // Ask for the doorbell and look again, as the producer
+                        // might have published a message without ringing
+                        g_atomic_int_set((gint *) &ring->hdr->waiting, 1);
+                        if (g_atomic_int_get((gint *) &ring->hdr->head) == (gint) ring->tail)
+                                return done;
+                        g_atomic_int_set((gint *) &ring->hdr->waiting, 0);
+                        continue;
+                }
+
+                if (head - ring->tail > ring->slot_count || !shm_ring_take(ring, callback, data)) {
+                        LOG_W("The producer corrupted the ring.");
+                        return -1;
+                }
+                done++;
+        }
+
+        // There might be more, but let the other sources have their turn first
+        shm_ring_ring_doorbell(ring->doorbell);
+        return done;
+}
+
+/* see shm-ring.h */
+struct shm_ring_producer *shm_ring_producer_new(int fd, int doorbell)
+{
+        struct stat st;
+        struct shm_ring_header hdr;
+
+        if (fstat(fd, &st) < 0 || st.st_size < sizeof(hdr)
+            || pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)
+            || hdr.magic != SHM_RING_MAGIC
+            || shm_ring_layout_size(hdr.slot_count, hdr.slot_size, hdr.spill_size) != st.st_size) {
+                LOG_W("Not a valid ring.");
+                close(fd);
+                close(doorbell);
+                return NULL;
+        }
+
+        void *mem = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mem == MAP_FAILED) {
+                LOG_W("Cannot map the ring: %s", strerror(errno));
+                close(fd);
+                close(doorbell);
+                return NULL;
+        }
+
+        struct shm_ring_producer *p = g_malloc0(sizeof(struct shm_ring_producer));
+        p->fd = fd;
+        p->doorbell = doorbell;
+        p->size = st.st_size;
+        p->hdr = mem;
+        p->slots = (guint8 *) mem + sizeof(struct shm_ring_header);
+        p->spill = p->slots + (gsize) hdr.slot_count * hdr.slot_size;
+        p->slot_count = hdr.slot_count;
+        p->slot_size = hdr.slot_size;
+        p->spill_size = hdr.spill_size;
+        p->head = g_atomic_int_get((gint *) &p->hdr->head);
+        p->spill_head = p->hdr->spill_head;
+
+        return p;
+}
+
+/* see shm-ring.h */
+void shm_ring_producer_free(struct shm_ring_producer *p)
+{
+        if (!p)
+                return;
+
+        munmap(p->hdr, p->size);
+        close(p->doorbell);
+        close(p->fd);
+        g_free(p);
+}
+
+/* see shm-ring.h */
+bool shm_ring_producer_push(struct shm_ring_producer *p, GVariant *message)
+{
+        ASSERT_OR_RET(p, false);
+        ASSERT_OR_RET(message, false);
+
+        guint32 tail = g_atomic_int_get((gint *) &p->hdr->tail);
+        if (p->head - tail >= p->slot_count)
+                return false;
+
+        gsize length = g_variant_get_size(message);
+        struct shm_ring_slot *slot = shm_ring_slot_at(p->slots, p->slot_size,
+                                                      p->head & (p->slot_count - 1));
+
+        if (length <= p->slot_size - sizeof(struct shm_ring_slot)) {
+                g_variant_store(message, slot->data);
+                slot->flags = 0;
+        } else {
+                if (length > p->spill_size)
+                        return false;
+
+                guint32 start = p->spill_head;
+                guint32 pos = start & (p->spill_size - 1);
+                // Messages are never split, skip the rest of the spill area
+                if (length > p->spill_size - pos)
+                        start += p->spill_size - pos;
+
+                guint32 spill_tail = g_atomic_int_get((gint *) &p->hdr->spill_tail);
+                if (start + length - spill_tail > p->spill_size)
+                        return false;
+
+                g_variant_store(message, p->spill + (start & (p->spill_size - 1)));
+                slot->flags = SHM_RING_SPILLED;
+                slot->spill_offset = start;
+                p->spill_head = start + length;
+                p->hdr->spill_head = p->spill_head;
+        }
+        slot->length = length;
+
+        p->head++;
+        g_atomic_int_set((gint *) &p->hdr->head, p->head);
+
+        if (g_atomic_int_compare_and_exchange((gint *) &p->hdr->waiting, 1, 0))
+                shm_ring_ring_doorbell(p->doorbell);
+
+        return true;
+}
+
+/* vim: set ft=c tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -0,0 +1,148 @@
+#ifndef DUNST_SHM_RING_H
+#define DUNST_SHM_RING_H
+
+#include <glib.h>
+#include <stdbool.h>
+
+/**
+ * A ring buffer in shared memory, through which a local program can hand
+ * notifications over to dunst without a D-Bus round trip for each of them.
+ *
+ * dunst creates the ring in a sealed memfd and passes it to the producer
+ * together with an eventfd, the doorbell. Every ring has a single producer
+ * and dunst is its only consumer, producers with several threads have to
+ * open a ring for each of them. dunst only limits the number of rings open
+ * in total, see settings.shm_rings.
+ *
+ * The memory starts with a struct shm_ring_header, followed by slot_count
+ * slots of slot_size bytes and the spill area of spill_size bytes. All
+ * counters run freely and wrap around, positions in the slots and the spill
+ * area are taken modulo their sizes, which are powers of two.
+ *
+ * A message is the serialised GVariant of the parameters of a Notify call
+ * in the byte order of the machine. It is stored in the slot right after
+ * the struct shm_ring_slot. Messages, which don't fit there, go into the
+ * spill area instead. They are never split across the end of the spill
+ * area, the producer skips the rest of the area and starts over at its
+ * beginning.
+ *
+ * To publish a message, the producer fills the slot, increments head and
+ * rings the doorbell, if dunst is waiting for it. dunst increments tail and
+ * spill_tail after it has copied a message out of the ring.
+ */
+
+#define SHM_RING_MAGIC 0x474e5244 /**< "DRNG" */
+#define SHM_RING_MESSAGE_TYPE "(susssasa{sv}i)"
+
+/** The message of the slot is stored in the spill area */
+#define SHM_RING_SPILLED (1 << 0)
+
+/* The fields written by the producer and by dunst live on separate
+ * cache lines */
+struct shm_ring_header {
+        guint32 magic;
+        guint32 slot_count;
+        guint32 slot_size;
+        guint32 spill_size;
+        guint8 reserved0[48];
+
+        guint32 head;           /**< Written by the producer: messages published */
+        guint32 spill_head;     /**< Written by the producer: bytes used in the spill area */
+        guint8 reserved1[56];
+
+        guint32 tail;           /**< Written by dunst: messages consumed */
+        guint32 spill_tail;     /**< Written by dunst: bytes released in the spill area */
+        guint32 waiting;        /**< Non-zero if dunst waits for the doorbell */
+        guint8 reserved2[52];
+};
+
+struct shm_ring_slot {
+        guint32 length;         /**< The size of the message in bytes */
+        guint32 flags;          /**< SHM_RING_SPILLED */
+        guint32 spill_offset;   /**< The position of the message in the spill area */
+        guint32 reserved;
+        guint8 data[];
+};
+
+/** The consumer side of a ring */
+struct shm_ring;
+
+/** The producer side of a ring */
+struct shm_ring_producer;
+
+/**
+ * Called for every message taken from the ring.
+ *
+ * @param message The parameters of the Notify call
+ * @param data The data passed to shm_ring_drain()
+ */
+typedef void (*shm_ring_message_cb)(GVariant *message, gpointer data);
+
+/**
+ * Create a new ring and its doorbell.
+ *
+ * @param slot_count The number of slots, a power of two
+ * @param slot_size The size of a slot in bytes, a power of two, which
+ *                  includes the struct shm_ring_slot
+ * @param spill_size The size of the spill area in bytes, a power of two
+ * @returns the ring
+ * @retval NULL if the sizes are invalid or the ring cannot be created
+ */
+struct shm_ring *shm_ring_new(guint32 slot_count, guint32 slot_size, guint32 spill_size);
+
+/**
+ * Unmap the ring and close its file descriptors. The producer may keep on
+ * using its mapping, but nobody reads it anymore.
+ */
+void shm_ring_free(struct shm_ring *ring);
+
+/**
+ * The memfd of the ring, which has to be passed to the producer.
+ */
+int shm_ring_get_fd(const struct shm_ring *ring);
+
+/**
+ * The eventfd, which gets readable when the producer rings the doorbell.
+ */
+int shm_ring_get_doorbell(const struct shm_ring *ring);
+
+/**
+ * Take up to \p max messages out of the ring and pass them to \p callback.
+ *
+ * If messages are left afterwards, the doorbell is rung again, so the
+ * main loop comes back to the ring after it dispatched other sources.
+ * Otherwise, dunst waits for the doorbell again.
+ *
+ * The memory is shared with the producer, so everything in it is validated
+ * and the messages are copied before they get decoded.
+ *
+ * @returns the number of messages taken out of the ring
+ * @retval -1 if the producer corrupted the ring. Free it then.
+ */
+int shm_ring_drain(struct shm_ring *ring, guint max, shm_ring_message_cb callback, gpointer data);
+
+/**
+ * Map a ring passed by dunst.
+ *
+ * @param fd The memfd of the ring. The producer takes it over.
+ * @param doorbell The eventfd of the ring. The producer takes it over.
+ * @retval NULL if \p fd isn't a valid ring
+ */
+struct shm_ring_producer *shm_ring_producer_new(int fd, int doorbell);
+
+/**
+ * Unmap the ring and close its file descriptors.
+ */
+void shm_ring_producer_free(struct shm_ring_producer *p);
+
+/**
+ * Publish a message and ring the doorbell, if dunst is waiting for it.
+ *
+ * @param message A value of type #SHM_RING_MESSAGE_TYPE
+ * @retval false if the ring is full or the message is too big for it.
+ *         Try again later or fall back to D-Bus.
+ */
+bool shm_ring_producer_push(struct shm_ring_producer *p, GVariant *message);
+
+#endif
+/* vim: set ft=c tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -0,0 +1,174 @@
+#include "stats.h"
+
+#include "dbus.h"
+#include "utils.h"
+
+#define STATS_SUB_BITS 4
+#define STATS_SUB_COUNT (1 << STATS_SUB_BITS)
+/* The first STATS_SUB_COUNT buckets hold the values 0 to 15 exactly, every
+ * following power of two up to 2^32 gets STATS_SUB_COUNT buckets */
+#define STATS_BUCKETS ((32 - STATS_SUB_BITS + 1) * STATS_SUB_COUNT)
+
+struct histogram {
+        gint buckets[STATS_BUCKETS];
+};
+
+static struct histogram histograms[STATS_HISTOGRAM_COUNT];
+static gint counters[STATS_COUNTER_COUNT];
+
+static const char *histogram_names[] = {
+        [STATS_DECODE]  = "decode",
+        [STATS_INIT]    = "init",
+        [STATS_LATENCY] = "latency",
+        [STATS_DRAW]    = "draw",
+        [STATS_RENDER]  = "render",
+        [STATS_PRESENT] = "present",
+};
+
+static const char *counter_names[] = {
+        [STATS_INSERTED]        = "inserted",
+        [STATS_STACKED]         = "stacked",
+        [STATS_REPLACED]        = "replaced",
+        [STATS_CLOSED_TIME]     = "closed_time",
+        [STATS_CLOSED_USER]     = "closed_user",
+        [STATS_CLOSED_SIG]      = "closed_signal",
+        [STATS_CLOSED_UNDEF]    = "closed_undefined",
+        [STATS_REDRAWS]         = "redraws",
+        [STATS_DROPPED_FRAMES]  = "dropped_frames",
+};
+
+G_STATIC_ASSERT(G_N_ELEMENTS(histogram_names) == STATS_HISTOGRAM_COUNT);
+G_STATIC_ASSERT(G_N_ELEMENTS(counter_names) == STATS_COUNTER_COUNT);
+
+static guint stats_bucket(guint32 value)
+{
+        if (value < STATS_SUB_COUNT)
+                return value;
+
+        // Keep the STATS_SUB_BITS bits following the highest set bit
+        guint shift = g_bit_storage(value) - 1 - STATS_SUB_BITS;
+        return ((shift + 1) << STATS_SUB_BITS) + ((value >> shift) & (STATS_SUB_COUNT - 1));
+}
+
+static guint64 stats_bucket_upper(guint bucket)
+{
+        if (bucket < STATS_SUB_COUNT)
+                return bucket;
+
+        guint shift = (bucket >> STATS_SUB_BITS) - 1;
+        guint64 lower = (guint64) (STATS_SUB_COUNT + (bucket & (STATS_SUB_COUNT - 1))) << shift;
+        return lower + (G_GUINT64_CONSTANT(1) << shift) - 1;
+}
+
+/* see stats.h */
+void stats_record(enum stats_histogram h, gint64 usec)
+{
+        ASSERT_OR_RET(h >= 0 && h < STATS_HISTOGRAM_COUNT,);
+
+        guint32 value = CLAMP(usec, 0, G_MAXUINT32);
+        g_atomic_int_inc(&histograms[h].buckets[stats_bucket(value)]);
+}
+
+/* see stats.h */
+void stats_count(enum stats_counter c)
+{
+        ASSERT_OR_RET(c >= 0 && c < STATS_COUNTER_COUNT,);
+        g_atomic_int_inc(&counters[c]);
+}
+
+/* see stats.h */
+void stats_count_close(int reason)
+{
+        if (reason < REASON_MIN || reason > REASON_MAX)
+                reason = REASON_UNDEF;
+
+        stats_count(STATS_CLOSED_TIME + reason - REASON_MIN);
+}
+
+/* see stats.h */
+guint stats_counter_get(enum stats_counter c)
+{
+        ASSERT_OR_RET(c >= 0 && c < STATS_COUNTER_COUNT, 0);
+        return g_atomic_int_get(&counters[c]);
+}
+
+/* see stats.h */
+void stats_histogram_summary(enum stats_histogram h, struct stats_summary *summary)
+{
+        ASSERT_OR_RET(summary,);
+        *summary = (struct stats_summary) { 0 };
+        ASSERT_OR_RET(h >= 0 && h < STATS_HISTOGRAM_COUNT,);
+
+        // Work on a copy, other threads keep on recording meanwhile
+        guint counts[STATS_BUCKETS];
+        for (int i = 0; i < STATS_BUCKETS; i++) {
+                counts[i] = g_atomic_int_get(&histograms[h].buckets[i]);
+                summary->count += counts[i];
+        }
+
+        if (summary->count == 0)
+                return;
+
+        struct {
+                double fraction;
+                guint64 *value;
+        } percentiles[] = {
+                { 0.50, &summary->p50 },
+                { 0.90, &summary->p90 },
+                { 0.99, &summary->p99 },
+        };
+
+        guint64 seen = 0;
+        int p = 0;
+        for (int i = 0; i < STATS_BUCKETS; i++) {
+                if (!counts[i])
+                        continue;
+
+                seen += counts[i];
+                for (; p < G_N_ELEMENTS(percentiles)
+                       && seen >= percentiles[p].fraction * summary->count; p++)
+                        *percentiles[p].value = stats_bucket_upper(i);
+
+                summary->max = stats_bucket_upper(i);
+        }
+}
+
+/* see stats.h */
+void stats_histogram_foreach(enum stats_histogram h, stats_bucket_cb callback, gpointer data)
+{
+        ASSERT_OR_RET(h >= 0 && h < STATS_HISTOGRAM_COUNT,);
+        ASSERT_OR_RET(callback,);
+
+        for (int i = 0; i < STATS_BUCKETS; i++) {
+                guint count = g_atomic_int_get(&histograms[h].buckets[i]);
+                if (count)
+                        callback(stats_bucket_upper(i), count, data);
+        }
+}
+
+/* see stats.h */
+const char *stats_histogram_name(enum stats_histogram h)
+{
+        ASSERT_OR_RET(h >= 0 && h < STATS_HISTOGRAM_COUNT, NULL);
+        return histogram_names[h];
+}
+
+/* see stats.h */
+const char *stats_counter_name(enum stats_counter c)
+{
+        ASSERT_OR_RET(c >= 0 && c < STATS_COUNTER_COUNT, NULL);
+        return counter_names[c];
+}
+
+/* see stats.h */
+void stats_reset(void)
+{
+        for (int h = 0; h < STATS_HISTOGRAM_COUNT; h++)
+                for (int i = 0; i < STATS_BUCKETS; i++)
+                        g_atomic_int_set(&histograms[h].buckets[i], 0);
+
+        for (int c = 0; c < STATS_COUNTER_COUNT; c++)
+                g_atomic_int_set(&counters[c], 0);
+}
+
+/* vim: set ft=c tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -0,0 +1,111 @@
+#ifndef DUNST_STATS_H
+#define DUNST_STATS_H
+
+#include <glib.h>
+
+/**
+ * Always-on instrumentation of the notification pipeline.
+ *
+ * Durations are recorded into log-linear histograms with 16 sub-buckets
+ * for every power of two, so every recorded value is off by at most 6.25%.
+ * Recording a value or counting an event is a single atomic increment, so
+ * all functions may be called from any thread.
+ */
+
+/// The durations, which are recorded
+enum stats_histogram {
+        STATS_DECODE,   /**< Decoding the parameters of a Notify call */
+        STATS_INIT,     /**< notification_init(): rules, format and markup */
+        STATS_LATENCY,  /**< From the arrival of a notification until it's shown first */
+        STATS_DRAW,     /**< draw() on the main thread */
+        STATS_RENDER,   /**< Layout and rasterisation of a frame */
+        STATS_PRESENT,  /**< Putting a frame on screen */
+        STATS_HISTOGRAM_COUNT,
+};
+
+/// The events, which are counted
+enum stats_counter {
+        STATS_INSERTED,         /**< Notifications inserted into the queues */
+        STATS_STACKED,          /**< Notifications stacked onto a duplicate or by stack tag */
+        STATS_REPLACED,         /**< Notifications replaced or updated by id */
+        STATS_CLOSED_TIME,      /**< Notifications closed, because they timed out */
+        STATS_CLOSED_USER,      /**< Notifications closed by the user */
+        STATS_CLOSED_SIG,       /**< Notifications closed by a client */
+        STATS_CLOSED_UNDEF,     /**< Notifications closed for other reasons */
+        STATS_REDRAWS,          /**< Frames put on screen */
+        STATS_DROPPED_FRAMES,   /**< Scenes or frames replaced before they got shown */
+        STATS_COUNTER_COUNT,
+};
+
+/// A summary of a histogram, all values in microseconds
+struct stats_summary {
+        guint64 count;
+        guint64 p50;
+        guint64 p90;
+        guint64 p99;
+        guint64 max;
+};
+
+/**
+ * Called for every non-empty bucket of a histogram.
+ *
+ * @param upper The highest value in microseconds, which falls into the bucket
+ * @param count The number of values in the bucket
+ * @param data The data passed to stats_histogram_foreach()
+ */
+typedef void (*stats_bucket_cb)(guint64 upper, guint count, gpointer data);
+
+/**
+ * Record a duration.
+ *
+ * @param h The histogram to record into
+ * @param usec The duration in microseconds. Values beyond the range of
+ *             the histogram are clamped.
+ */
+void stats_record(enum stats_histogram h, gint64 usec);
+
+/**
+ * Count an event.
+ */
+void stats_count(enum stats_counter c);
+
+/**
+ * Count a closed notification.
+ *
+ * @param reason The #reason, it was closed for
+ */
+void stats_count_close(int reason);
+
+/**
+ * @returns how often the event \p c happened
+ */
+guint stats_counter_get(enum stats_counter c);
+
+/**
+ * Summarise the values recorded in a histogram. The percentiles are the
+ * upper bounds of the buckets they fall into.
+ */
+void stats_histogram_summary(enum stats_histogram h, struct stats_summary *summary);
+
+/**
+ * Call \p callback for every non-empty bucket of \p h, in ascending order.
+ */
+void stats_histogram_foreach(enum stats_histogram h, stats_bucket_cb callback, gpointer data);
+
+/**
+ * @returns the name of the histogram, as used on D-Bus
+ */
+const char *stats_histogram_name(enum stats_histogram h);
+
+/**
+ * @returns the name of the counter, as used on D-Bus
+ */
+const char *stats_counter_name(enum stats_counter c);
+
+/**
+ * Forget everything recorded so far.
+ */
+void stats_reset(void);
+
+#endif
+/* vim: set ft=c tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -0,0 +1,218 @@
+#define _GNU_SOURCE
+#include "trace.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "log.h"
+
+struct trace_record {
+        const char *name;
+        gint64 timestamp;
+        gint tid;
+        char phase;
+};
+
+/**
+ * The events of a thread. Only the owning thread writes into the buffer,
+ * so publishing an event is a plain increment of head.
+ */
+struct trace_buffer {
+        struct trace_record records[TRACE_BUFFER_SIZE];
+        guint head;     /**< The number of events recorded, runs freely */
+        gint tid;       /**< The id of the owning thread in the trace */
+        bool owned;     /**< If a thread owns the buffer, guarded by trace_lock */
+};
+
+gint trace_active = 0;
+
+static GMutex trace_lock;
+static GSList *buffers = NULL;          /**< All buffers, guarded by trace_lock */
+static GHashTable *thread_names = NULL; /**< Maps thread ids to names, guarded by trace_lock */
+static gint thread_count = 0;
+static gint64 trace_since = 0;
+
+/**
+ * Give the buffer of a thread, which exited, to the next new thread. Thread
+ * pools start and stop threads all the time.
+ */
+static void trace_buffer_release(gpointer data)
+{
+        struct trace_buffer *buf = data;
+
+        g_mutex_lock(&trace_lock);
+        buf->owned = false;
+        g_mutex_unlock(&trace_lock);
+}
+
+static GPrivate trace_buffer_key = G_PRIVATE_INIT(trace_buffer_release);
+
+static struct trace_buffer *trace_buffer_get(void)
+{
+        struct trace_buffer *buf = g_private_get(&trace_buffer_key);
+        if (buf)
+                return buf;
+
+        g_mutex_lock(&trace_lock);
+        for (GSList *iter = buffers; iter && !buf; iter = iter->next) {
+                struct trace_buffer *orphan = iter->data;
+                if (!orphan->owned)
+                        buf = orphan;
+        }
+        if (!buf) {
+                buf = g_malloc0(sizeof(struct trace_buffer));
+                buffers = g_slist_prepend(buffers, buf);
+        }
+
+        if (!thread_names)
+                thread_names = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+
+        // The records of the previous owner keep their thread id, but the
+        // name of a thread, which exited, mustn't pile up
+        if (buf->tid)
+                g_hash_table_remove(thread_names, GINT_TO_POINTER(buf->tid));
+        buf->owned = true;
+        buf->tid = ++thread_count;
+
+        char name[16] = "";
+        pthread_getname_np(pthread_self(), name, sizeof(name));
+        g_hash_table_insert(thread_names, GINT_TO_POINTER(buf->tid), g_strescape(name, NULL));
+        g_mutex_unlock(&trace_lock);
+
+        g_private_set(&trace_buffer_key, buf);
+        return buf;
+}
+
+/* see trace.h */
+void trace_event(const char *name, char phase)
+{
+        struct trace_buffer *buf = trace_buffer_get();
+        guint head = buf->head;
+        struct trace_record *record = &buf->records[head & (TRACE_BUFFER_SIZE - 1)];
+
+        record->name = name;
+        record->timestamp = g_get_monotonic_time();
+        record->tid = buf->tid;
+        record->phase = phase;
+
+        // Publish the record only after it got written completely
+        atomic_thread_fence(memory_order_release);
+        g_atomic_int_set((gint *) &buf->head, head + 1);
+}
+
+/* see trace.h */
+void trace_start(void)
+{
+        g_mutex_lock(&trace_lock);
+        trace_since = g_get_monotonic_time();
+        g_mutex_unlock(&trace_lock);
+
+        g_atomic_int_set(&trace_active, 1);
+        LOG_I("Tracing started");
+}
+
+/* see trace.h */
+void trace_stop(void)
+{
+        g_atomic_int_set(&trace_active, 0);
+        LOG_I("Tracing stopped");
+}
+
+/* see trace.h */
+bool trace_is_active(void)
+{
+        return g_atomic_int_get(&trace_active);
+}
+
+static void trace_append_separator(GString *json, bool *first)
+{
+        if (!*first)
+                g_string_append_c(json, ',');
+        *first = false;
+}
+
+/**
+ * Append the events of \p buf, which were recorded since trace_since. Has
+ * to be called with trace_lock held.
+ */
+static void trace_buffer_append(GString *json, struct trace_buffer *buf, int pid, bool *first)
+{
+        struct trace_record *copy = g_new(struct trace_record, TRACE_BUFFER_SIZE);
+        guint head = g_atomic_int_get((gint *) &buf->head);
+        guint start = head - TRACE_BUFFER_SIZE;
+
+        for (guint i = start; i != head; i++)
+                copy[i - start] = buf->records[i & (TRACE_BUFFER_SIZE - 1)];
+
+        // The owner may have overwritten the oldest records meanwhile. It
+        // writes the record at index now before it publishes it. The copy
+        // has to be done before head gets read again.
+        atomic_thread_fence(memory_order_acquire);
+        guint now = g_atomic_int_get((gint *) &buf->head);
+
+        for (guint i = start; i != head; i++) {
+                const struct trace_record *record = &copy[i - start];
+                if (now - i >= TRACE_BUFFER_SIZE || !record->name
+                    || record->timestamp < trace_since)
+                        continue;
+
+                trace_append_separator(json, first);
+                g_string_append_printf(json,
+                                       "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%" G_GINT64_FORMAT
+                                       ",\"pid\":%d,\"tid\":%d}",
+                                       record->name, record->phase, record->timestamp,
+                                       pid, record->tid);
+        }
+
+        g_free(copy);
+}
+
+/* see trace.h */
+char *trace_to_json(void)
+{
+        GString *json = g_string_new("{\"traceEvents\":[");
+        int pid = getpid();
+        bool first = true;
+
+        g_mutex_lock(&trace_lock);
+        for (GSList *iter = buffers; iter; iter = iter->next)
+                trace_buffer_append(json, iter->data, pid, &first);
+
+        if (thread_names) {
+                GHashTableIter iter;
+                gpointer tid, name;
+                g_hash_table_iter_init(&iter, thread_names);
+                while (g_hash_table_iter_next(&iter, &tid, &name)) {
+                        trace_append_separator(json, &first);
+                        g_string_append_printf(json,
+                                               "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d"
+                                               ",\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                                               pid, GPOINTER_TO_INT(tid), (char *) name);
+                }
+        }
+        g_mutex_unlock(&trace_lock);
+
+        g_string_append(json, "],\"displayTimeUnit\":\"ms\"}\n");
+        return g_string_free(json, FALSE);
+}
+
+/* see trace.h */
+bool trace_dump(const char *path)
+{
+        GError *err = NULL;
+        char *json = trace_to_json();
+        bool written = g_file_set_contents(path, json, -1, &err);
+
+        if (!written) {
+                LOG_W("Cannot write the trace to '%s': %s", path, err->message);
+                g_error_free(err);
+        } else {
+                LOG_I("Trace written to '%s'", path);
+        }
+
+        g_free(json);
+        return written;
+}
+
+/* vim: set ft=c tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -0,0 +1,78 @@
+#ifndef DUNST_TRACE_H
+#define DUNST_TRACE_H
+
+#include <glib.h>
+#include <stdbool.h>
+
+/**
+ * A timeline of the notification pipeline in the Chrome trace event format,
+ * which can be loaded into chrome://tracing or Perfetto.
+ *
+ * Every thread records its events into a ring buffer of its own, so
+ * recording takes no locks. Only the latest #TRACE_BUFFER_SIZE events of
+ * each thread are kept. While tracing is stopped, TRACE_BEGIN() and
+ * TRACE_END() cost a single branch.
+ */
+
+#define TRACE_BUFFER_SIZE 16384 /**< Events kept per thread, a power of two */
+
+extern gint trace_active;
+
+/**
+ * Mark the beginning of the span \p name in the current thread.
+ *
+ * @param name A string literal, it's referenced until the trace is dumped
+ */
+#define TRACE_BEGIN(name) do { \
+        if (G_UNLIKELY(g_atomic_int_get(&trace_active))) \
+                trace_event(name, 'B'); \
+} while (0)
+
+/**
+ * Mark the end of the span \p name in the current thread.
+ */
+#define TRACE_END(name) do { \
+        if (G_UNLIKELY(g_atomic_int_get(&trace_active))) \
+                trace_event(name, 'E'); \
+} while (0)
+
+/**
+ * Record an event. Use TRACE_BEGIN() and TRACE_END() instead.
+ *
+ * @param name A string literal
+ * @param phase 'B' for the beginning and 'E' for the end of a span
+ */
+void trace_event(const char *name, char phase);
+
+/**
+ * Start tracing. The events recorded before are forgotten.
+ */
+void trace_start(void);
+
+/**
+ * Stop tracing. The recorded events are kept until the next trace_start().
+ */
+void trace_stop(void);
+
+/**
+ * @returns if tracing is running
+ */
+bool trace_is_active(void);
+
+/**
+ * Serialise the recorded events. Threads may keep on recording meanwhile.
+ *
+ * @returns the trace as JSON object in the Chrome trace event format. Free
+ *          it with g_free().
+ */
+char *trace_to_json(void);
+
+/**
+ * Write the recorded events as JSON to \p path.
+ *
+ * @retval false if the file cannot be written
+ */
+bool trace_dump(const char *path);
+
+#endif
+/* vim: set ft=c tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -814,14 +814,6 @@ void wl_display_surface(cairo_surface_t *srf, window winptr, const struct dimens
         wl_display_roundtrip(ctx.display);
 }
 
-cairo_t* wl_win_get_context(window winptr) {
-        struct window_wl *win = (struct window_wl*)winptr;
-        ctx.current_buffer = get_next_buffer(ctx.shm, ctx.buffers, 500, 500);
-        win->c_surface = ctx.current_buffer->surface;
-        win->c_ctx = ctx.current_buffer->cairo;
-        return win->c_ctx;
-}
-
 const struct screen_info* wl_get_active_screen(void) {
         static struct screen_info scr = {
                 .w = 3840,
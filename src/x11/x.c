@@ -185,11 +185,6 @@ void x_display_surface(cairo_surface_t *srf, window winptr, const struct dimensi
 
 }
 
-cairo_t* x_win_get_context(window winptr)
-{
-        return ((struct window_x11*)win)->c_ctx;
-}
-
 static void setopacity(Window win, unsigned long opacity)
 {
         Atom _NET_WM_WINDOW_OPACITY =
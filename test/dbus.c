@@ -133,7 +133,7 @@ void dbus_signal_unsubscribe_closed(struct signal_closed *closed)
         closed->subscription_id = -1;
 }
 
-GVariant *dbus_invoke(const char *method, GVariant *params)
+GVariant *dbus_invoke_ifac(const char *method, GVariant *params, const char *ifac)
 {
         GDBusConnection *connection_client;
         GVariant *retdata;
@@ -144,7 +144,7 @@ GVariant *dbus_invoke(const char *method, GVariant *params)
                                 connection_client,
                                 FDN_NAME,
                                 FDN_PATH,
-                                FDN_IFAC,
+                                ifac,
                                 method,
                                 params,
                                 NULL,
@@ -162,6 +162,11 @@ GVariant *dbus_invoke(const char *method, GVariant *params)
         return retdata;
 }
 
+GVariant *dbus_invoke(const char *method, GVariant *params)
+{
+        return dbus_invoke_ifac(method, params, FDN_IFAC);
+}
+
 struct dbus_notification {
         const char* app_name;
         guint replaces_id;
@@ -195,10 +200,9 @@ void dbus_notification_free(struct dbus_notification *n)
         g_free(n);
 }
 
-bool dbus_notification_fire(struct dbus_notification *n, uint *id)
+GVariant *dbus_notification_to_variant(struct dbus_notification *n)
 {
         assert(n);
-        assert(id);
         GVariantBuilder b;
         GVariantType *t;
 
@@ -242,7 +246,15 @@ bool dbus_notification_fire(struct dbus_notification *n, uint *id)
 
         g_variant_builder_add(&b, "i", n->expire_timeout);
 
-        GVariant *reply = dbus_invoke("Notify", g_variant_builder_end(&b));
+        return g_variant_builder_end(&b);
+}
+
+bool dbus_notification_fire(struct dbus_notification *n, uint *id)
+{
+        assert(n);
+        assert(id);
+
+        GVariant *reply = dbus_invoke("Notify", dbus_notification_to_variant(n));
         if (reply) {
                 g_variant_get(reply, "(u)", id);
                 g_variant_unref(reply);
@@ -468,6 +480,133 @@ TEST test_hint_progress(void)
         PASS();
 }
 
+TEST test_progress_update_in_place(void)
+{
+        struct dbus_notification *n_dbus = dbus_notification_new();
+        n_dbus->app_name = "dunstteststack";
+        n_dbus->app_icon = "NONE";
+        n_dbus->summary = "test_progress_update_in_place";
+        n_dbus->body = "Copying";
+        g_hash_table_insert(n_dbus->hints,
+                            g_strdup("value"),
+                            g_variant_ref_sink(g_variant_new_int32(10)));
+
+        guint id, id_update;
+        ASSERT(dbus_notification_fire(n_dbus, &id));
+        struct notification *n = queues_debug_find_notification_by_id(id);
+        ASSERT(n);
+        notification_ref(n);
+
+        // Only the progress and the body change
+        n_dbus->replaces_id = id;
+        n_dbus->body = "Copying file 2";
+        g_hash_table_insert(n_dbus->hints,
+                            g_strdup("value"),
+                            g_variant_ref_sink(g_variant_new_uint32(50)));
+        ASSERT(dbus_notification_fire(n_dbus, &id_update));
+        ASSERT_EQ(id, id_update);
+        ASSERT_EQ(n, queues_debug_find_notification_by_id(id));
+        ASSERT_EQ(50, n->progress);
+        ASSERT_STR_EQ("Copying file 2", n->body);
+
+        // Anything else replaces the notification
+        n_dbus->summary = "test_progress_update_in_place replaced";
+        ASSERT(dbus_notification_fire(n_dbus, &id_update));
+        ASSERT_EQ(id, id_update);
+        struct notification *replaced = queues_debug_find_notification_by_id(id);
+        ASSERT(replaced != n);
+        ASSERT_EQ(50, replaced->progress);
+
+        notification_unref(n);
+        dbus_notification_free(n_dbus);
+        PASS();
+}
+
+TEST test_progress_update_rules_changed(void)
+{
+        struct rule *rule = rule_new("test_progress_update_rules_changed");
+        rule->summary = "test_progress_update_rules_changed";
+        rule->enabled = false;
+        rule_compile(rule);
+
+        struct dbus_notification *n_dbus = dbus_notification_new();
+        n_dbus->app_name = "dunstteststack";
+        n_dbus->app_icon = "NONE";
+        n_dbus->summary = "test_progress_update_rules_changed";
+        n_dbus->body = "Copying";
+        g_hash_table_insert(n_dbus->hints,
+                            g_strdup("value"),
+                            g_variant_ref_sink(g_variant_new_int32(10)));
+
+        guint id;
+        ASSERT(dbus_notification_fire(n_dbus, &id));
+        struct notification *n = queues_debug_find_notification_by_id(id);
+        ASSERT(n);
+        notification_ref(n);
+
+        // The update has to get the rules enabled now
+        GVariant *ret = dbus_invoke_ifac("RuleEnable",
+                                         g_variant_new("(si)", "test_progress_update_rules_changed", 1),
+                                         DUNST_IFAC);
+        ASSERT(ret);
+        g_variant_unref(ret);
+
+        n_dbus->replaces_id = id;
+        g_hash_table_insert(n_dbus->hints,
+                            g_strdup("value"),
+                            g_variant_ref_sink(g_variant_new_int32(50)));
+        ASSERT(dbus_notification_fire(n_dbus, &id));
+        struct notification *replaced = queues_debug_find_notification_by_id(id);
+        ASSERT(replaced != n);
+        ASSERT_EQ(50, replaced->progress);
+
+        rule->enabled = false;
+        queues_notification_close_id(id, REASON_UNDEF);
+        notification_unref(n);
+        dbus_notification_free(n_dbus);
+        PASS();
+}
+
+TEST test_progress_update_raw_icon(void)
+{
+        char *path = g_strconcat(base, "/data/icons/valid.png", NULL);
+        struct dbus_notification *n_dbus = dbus_notification_new();
+        n_dbus->app_name = "dunstteststack";
+        n_dbus->summary = "test_progress_update_raw_icon";
+        n_dbus->body = "Copying";
+        dbus_notification_set_raw_image(n_dbus, path);
+        g_hash_table_insert(n_dbus->hints,
+                            g_strdup("value"),
+                            g_variant_ref_sink(g_variant_new_int32(10)));
+
+        guint id;
+        ASSERT(dbus_notification_fire(n_dbus, &id));
+        struct notification *n = queues_debug_find_notification_by_id(id);
+        ASSERT(n);
+        notification_ref(n);
+        // The pixels don't get hashed twice
+        ASSERT_EQ(0, n->dbus_signature);
+        char *icon_id = g_strdup(n->icon_id);
+
+        // Compared by the icon_id on the full path
+        n_dbus->replaces_id = id;
+        g_hash_table_insert(n_dbus->hints,
+                            g_strdup("value"),
+                            g_variant_ref_sink(g_variant_new_int32(50)));
+        ASSERT(dbus_notification_fire(n_dbus, &id));
+        struct notification *replaced = queues_debug_find_notification_by_id(id);
+        ASSERT(replaced != n);
+        ASSERT_EQ(50, replaced->progress);
+        ASSERT_STR_EQ(icon_id, replaced->icon_id);
+
+        queues_notification_close_id(id, REASON_UNDEF);
+        notification_unref(n);
+        g_free(icon_id);
+        g_free(path);
+        dbus_notification_free(n_dbus);
+        PASS();
+}
+
 TEST test_hint_icons(void)
 {
         struct notification *n;
@@ -775,6 +914,534 @@ TEST test_close_and_signal(void)
         PASS();
 }
 
+TEST test_notify_batch(void)
+{
+        struct dbus_notification *n_dbus = dbus_notification_new();
+        n_dbus->app_name = "dunstteststack";
+        n_dbus->app_icon = "NONE";
+        n_dbus->body = "Text";
+
+        const char *summaries[] = { "test_notify_batch 1", "test_notify_batch 2", "test_notify_batch 3" };
+        GVariantBuilder b;
+        g_variant_builder_init(&b, G_VARIANT_TYPE("(a(susssasa{sv}i))"));
+        g_variant_builder_open(&b, G_VARIANT_TYPE("a(susssasa{sv}i)"));
+        for (int i = 0; i < G_N_ELEMENTS(summaries); i++) {
+                n_dbus->summary = summaries[i];
+                g_variant_builder_add_value(&b, dbus_notification_to_variant(n_dbus));
+        }
+        g_variant_builder_close(&b);
+
+        guint len = queues_length_waiting();
+        GVariant *reply = dbus_invoke_ifac("NotifyBatch", g_variant_builder_end(&b), DUNST_IFAC);
+        ASSERT(reply);
+
+        GVariant *ids = g_variant_get_child_value(reply, 0);
+        ASSERT_EQ(G_N_ELEMENTS(summaries), g_variant_n_children(ids));
+        ASSERT_EQ(len + G_N_ELEMENTS(summaries), queues_length_waiting());
+
+        for (int i = 0; i < G_N_ELEMENTS(summaries); i++) {
+                guint32 id;
+                g_variant_get_child(ids, i, "u", &id);
+                struct notification *n = queues_debug_find_notification_by_id(id);
+                ASSERT(n);
+                ASSERT_STR_EQ(summaries[i], n->summary);
+        }
+
+        // Close all of them again
+        GVariantBuilder close_ids;
+        g_variant_builder_init(&close_ids, G_VARIANT_TYPE("(au)"));
+        g_variant_builder_add_value(&close_ids, ids);
+        GVariant *ret = dbus_invoke_ifac("CloseBatch", g_variant_builder_end(&close_ids), DUNST_IFAC);
+        ASSERT(ret);
+        ASSERT_EQ(len, queues_length_waiting());
+
+        g_variant_unref(ret);
+        g_variant_unref(ids);
+        g_variant_unref(reply);
+        dbus_notification_free(n_dbus);
+        PASS();
+}
+
+TEST test_notify_order_per_sender(void)
+{
+        struct dbus_notification *n_dbus = dbus_notification_new();
+        n_dbus->app_name = "dunstteststack";
+        n_dbus->app_icon = "NONE";
+        n_dbus->summary = "test_notify_order_per_sender";
+        n_dbus->body = "0";
+
+        guint id;
+        ASSERT(dbus_notification_fire(n_dbus, &id));
+        guint len = queues_length_waiting();
+
+        // Replace it over and over without waiting for the replies. The
+        // calls get decoded in parallel, but have to be inserted in order.
+        GDBusConnection *conn = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+        n_dbus->replaces_id = id;
+        for (int i = 1; i < 50; i++) {
+                char *body = g_strdup_printf("%d", i);
+                n_dbus->body = body;
+                g_dbus_connection_call(conn, FDN_NAME, FDN_PATH, FDN_IFAC, "Notify",
+                                       dbus_notification_to_variant(n_dbus), NULL,
+                                       G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL, NULL);
+                g_free(body);
+        }
+        g_object_unref(conn);
+
+        n_dbus->body = "last";
+        guint replaced;
+        ASSERT(dbus_notification_fire(n_dbus, &replaced));
+        ASSERT_EQ(id, replaced);
+        ASSERT_EQ(len, queues_length_waiting());
+
+        struct notification *n = queues_debug_find_notification_by_id(id);
+        ASSERT(n);
+        ASSERT_STR_EQ("last", n->body);
+
+        queues_notification_close_id(id, REASON_UNDEF);
+        dbus_notification_free(n_dbus);
+        PASS();
+}
+
+TEST test_close_after_pending_notify(void)
+{
+        struct dbus_notification *n_dbus = dbus_notification_new();
+        n_dbus->app_name = "dunstteststack";
+        n_dbus->app_icon = "NONE";
+        n_dbus->summary = "test_close_after_pending_notify";
+        n_dbus->body = "Text";
+
+        guint len = queues_length_waiting();
+        guint id;
+        ASSERT(dbus_notification_fire(n_dbus, &id));
+        ASSERT_EQ(len + 1, queues_length_waiting());
+
+        // Replace it and close it right away, without waiting for the
+        // reply of the replacement. The close mustn't overtake it.
+        GDBusConnection *conn = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+        n_dbus->replaces_id = id;
+        n_dbus->summary = "test_close_after_pending_notify replaced";
+        g_dbus_connection_call(conn, FDN_NAME, FDN_PATH, FDN_IFAC, "Notify",
+                               dbus_notification_to_variant(n_dbus), NULL,
+                               G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL, NULL);
+        g_object_unref(conn);
+
+        GVariant *ret = dbus_invoke("CloseNotification", g_variant_new("(u)", id));
+        ASSERT(ret);
+        g_variant_unref(ret);
+
+        ASSERT_FALSE(queues_debug_find_notification_by_id(id));
+        ASSERT_EQ(len, queues_length_waiting());
+
+        dbus_notification_free(n_dbus);
+        PASS();
+}
+
+struct signal_history {
+        guint32 added;          /**< The id of the last notification added */
+        guint32 removed;        /**< The id of the last notification removed */
+        gint64 history_length;  /**< The last historyLength, -1 if never changed */
+        guint subscription_id;
+        GDBusConnection *conn;
+};
+
+static void dbus_signal_cb_history(GDBusConnection *connection,
+                                   const gchar *sender_name,
+                                   const gchar *object_path,
+                                   const gchar *interface_name,
+                                   const gchar *signal_name,
+                                   GVariant *parameters,
+                                   gpointer user_data)
+{
+        struct signal_history *sig = user_data;
+
+        if (STR_EQ(signal_name, "HistoryAdded")) {
+                gint32 id;
+                GVariant *entry = g_variant_get_child_value(parameters, 0);
+                if (g_variant_lookup(entry, "id", "i", &id))
+                        sig->added = id;
+                g_variant_unref(entry);
+        } else if (STR_EQ(signal_name, "HistoryRemoved")) {
+                g_variant_get(parameters, "(u)", &sig->removed);
+        } else if (STR_EQ(signal_name, "PropertiesChanged")) {
+                GVariant *changed = g_variant_get_child_value(parameters, 1);
+                guint32 length;
+                if (g_variant_lookup(changed, "historyLength", "u", &length))
+                        sig->history_length = length;
+                g_variant_unref(changed);
+        }
+}
+
+TEST test_history_signals(void)
+{
+        struct signal_history sig = { 0, 0, -1 };
+        sig.conn = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+        // Subscribe to both interfaces at once
+        sig.subscription_id = g_dbus_connection_signal_subscribe(sig.conn, FDN_NAME, NULL, NULL,
+                                                                 FDN_PATH, NULL,
+                                                                 G_DBUS_SIGNAL_FLAGS_NONE,
+                                                                 dbus_signal_cb_history,
+                                                                 &sig, NULL);
+
+        struct dbus_notification *n_dbus = dbus_notification_new();
+        n_dbus->app_name = "dunstteststack";
+        n_dbus->app_icon = "NONE";
+        n_dbus->summary = "test_history_signals";
+        n_dbus->body = "Text";
+
+        guint id;
+        ASSERT(dbus_notification_fire(n_dbus, &id));
+        guint history = queues_length_history();
+
+        GVariant *ret = dbus_invoke("CloseNotification", g_variant_new("(u)", id));
+        ASSERT(ret);
+        g_variant_unref(ret);
+
+        uint waiting = 0;
+        while ((sig.added != id || sig.history_length != history + 1) && waiting < 2000) {
+                usleep(500);
+                waiting++;
+        }
+        ASSERT_EQ(id, sig.added);
+        ASSERT_EQ(history + 1, sig.history_length);
+
+        ret = dbus_invoke_ifac("NotificationPopHistory", g_variant_new("(u)", id), DUNST_IFAC);
+        ASSERT(ret);
+        g_variant_unref(ret);
+
+        waiting = 0;
+        while ((sig.removed != id || sig.history_length != history) && waiting < 2000) {
+                usleep(500);
+                waiting++;
+        }
+        ASSERT_EQ(id, sig.removed);
+        ASSERT_EQ(history, sig.history_length);
+
+        // Clean up the redisplayed notification
+        ret = dbus_invoke("CloseNotification", g_variant_new("(u)", id));
+        g_variant_unref(ret);
+
+        g_dbus_connection_signal_unsubscribe(sig.conn, sig.subscription_id);
+        g_object_unref(sig.conn);
+        dbus_notification_free(n_dbus);
+        PASS();
+}
+
+TEST test_get_stats(void)
+{
+        struct dbus_notification *n_dbus = dbus_notification_new();
+        n_dbus->app_name = "dunstteststack";
+        n_dbus->app_icon = "NONE";
+        n_dbus->summary = "test_get_stats";
+        n_dbus->body = "Text";
+
+        guint inserted = stats_counter_get(STATS_INSERTED);
+        guint id;
+        ASSERT(dbus_notification_fire(n_dbus, &id));
+
+        GVariant *reply = dbus_invoke_ifac("GetStats", NULL, DUNST_IFAC);
+        ASSERT(reply);
+
+        GVariant *stats = g_variant_get_child_value(reply, 0);
+        GVariantDict dict;
+        g_variant_dict_init(&dict, stats);
+
+        guint32 count;
+        ASSERT(g_variant_dict_lookup(&dict, "inserted", "u", &count));
+        ASSERT_EQ(inserted + 1, count);
+        ASSERT(g_variant_dict_lookup(&dict, "closed_user", "u", &count));
+
+        for (int h = 0; h < STATS_HISTOGRAM_COUNT; h++) {
+                GVariant *histogram = g_variant_dict_lookup_value(&dict, stats_histogram_name(h),
+                                                                  G_VARIANT_TYPE_VARDICT);
+                ASSERT(histogram);
+                guint64 total;
+                GVariant *buckets;
+                ASSERT(g_variant_lookup(histogram, "count", "t", &total));
+                ASSERT(g_variant_lookup(histogram, "buckets", "@a(tu)", &buckets));
+                g_variant_unref(buckets);
+                g_variant_unref(histogram);
+        }
+
+        GVariant *decode = g_variant_dict_lookup_value(&dict, "decode", G_VARIANT_TYPE_VARDICT);
+        guint64 decoded;
+        ASSERT(g_variant_lookup(decode, "count", "t", &decoded));
+        ASSERT(decoded > 0);
+
+        queues_notification_close_id(id, REASON_UNDEF);
+
+        g_variant_unref(decode);
+        g_variant_dict_clear(&dict);
+        g_variant_unref(stats);
+        g_variant_unref(reply);
+        dbus_notification_free(n_dbus);
+        PASS();
+}
+
+TEST test_peer_notify(void)
+{
+        char *path = g_strdup_printf("%s/dunst-test-peer-%d", g_get_tmp_dir(), getpid());
+        ASSERT(dbus_peer_start(path));
+
+        char *address = g_strconcat("unix:path=", path, NULL);
+        GDBusConnection *conn = g_dbus_connection_new_for_address_sync(
+                                        address,
+                                        G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                        NULL, NULL, NULL);
+        ASSERT(conn);
+
+        struct signal_closed sig = {0, REASON_MIN-1, -1};
+        guint subscription = g_dbus_connection_signal_subscribe(
+                                        conn,
+                                        NULL,
+                                        FDN_IFAC,
+                                        "NotificationClosed",
+                                        FDN_PATH,
+                                        NULL,
+                                        G_DBUS_SIGNAL_FLAGS_NONE,
+                                        dbus_signal_cb_closed,
+                                        &sig,
+                                        NULL);
+
+        struct dbus_notification *n_dbus = dbus_notification_new();
+        n_dbus->app_name = "dunstteststack";
+        n_dbus->app_icon = "NONE";
+        n_dbus->summary = "test_peer_notify";
+        n_dbus->body = "Text";
+
+        GVariant *reply = g_dbus_connection_call_sync(conn, NULL, FDN_PATH, FDN_IFAC,
+                                                      "Notify",
+                                                      dbus_notification_to_variant(n_dbus),
+                                                      G_VARIANT_TYPE("(u)"),
+                                                      G_DBUS_CALL_FLAGS_NONE,
+                                                      -1, NULL, NULL);
+        ASSERT(reply);
+        g_variant_get(reply, "(u)", &sig.id);
+        g_variant_unref(reply);
+
+        struct notification *n = queues_debug_find_notification_by_id(sig.id);
+        ASSERT(n);
+        ASSERT_STR_EQ("test_peer_notify", n->summary);
+        ASSERT(g_str_has_prefix(n->dbus_client, PEER_PREFIX));
+
+        // The signal has to arrive on the peer connection
+        reply = g_dbus_connection_call_sync(conn, NULL, FDN_PATH, FDN_IFAC,
+                                            "CloseNotification",
+                                            g_variant_new("(u)", sig.id),
+                                            NULL,
+                                            G_DBUS_CALL_FLAGS_NONE,
+                                            -1, NULL, NULL);
+        ASSERT(reply);
+        g_variant_unref(reply);
+
+        uint waiting = 0;
+        while (sig.reason == REASON_MIN-1 && waiting < 2000) {
+                usleep(500);
+                waiting++;
+        }
+        ASSERT_EQ(REASON_SIG, sig.reason);
+
+        g_dbus_connection_signal_unsubscribe(conn, subscription);
+        dbus_peer_stop();
+        g_object_unref(conn);
+        dbus_notification_free(n_dbus);
+        ASSERT_FALSE(g_file_test(path, G_FILE_TEST_EXISTS));
+        g_free(address);
+        g_free(path);
+        PASS();
+}
+
+static struct shm_ring_producer *dbus_open_ring_on(GDBusConnection *conn)
+{
+        GUnixFDList *fds = NULL;
+        GVariant *reply = g_dbus_connection_call_with_unix_fd_list_sync(
+                                conn,
+                                FDN_NAME,
+                                FDN_PATH,
+                                DUNST_IFAC,
+                                "OpenRing",
+                                NULL,
+                                G_VARIANT_TYPE("(hh)"),
+                                G_DBUS_CALL_FLAGS_NONE,
+                                -1,
+                                NULL,
+                                &fds,
+                                NULL,
+                                NULL);
+        if (!reply)
+                return NULL;
+
+        gint ring, doorbell;
+        g_variant_get(reply, "(hh)", &ring, &doorbell);
+        struct shm_ring_producer *p = shm_ring_producer_new(g_unix_fd_list_get(fds, ring, NULL),
+                                                            g_unix_fd_list_get(fds, doorbell, NULL));
+        g_variant_unref(reply);
+        g_object_unref(fds);
+        return p;
+}
+
+static struct shm_ring_producer *dbus_open_ring(void)
+{
+        GDBusConnection *conn = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+        struct shm_ring_producer *p = dbus_open_ring_on(conn);
+        g_object_unref(conn);
+        return p;
+}
+
+/* A connection to the session bus of its own, so it is another client */
+static GDBusConnection *dbus_new_client(void)
+{
+        char *address = g_dbus_address_get_for_bus_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+        GDBusConnection *conn = g_dbus_connection_new_for_address_sync(
+                                        address,
+                                        G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT
+                                        | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                        NULL, NULL, NULL);
+        g_free(address);
+        return conn;
+}
+
+/* Push a message, waiting for dunst to make room if the ring is full */
+static void dbus_ring_push(struct shm_ring_producer *p, GVariant *message)
+{
+        while (!shm_ring_producer_push(p, message))
+                g_usleep(50);
+}
+
+static bool wait_for_waiting(guint expected)
+{
+        for (int waiting = 0; waiting < 20000; waiting++) {
+                if (queues_length_waiting() >= expected)
+                        return true;
+                usleep(500);
+        }
+        return false;
+}
+
+TEST test_open_ring(void)
+{
+        settings.shm_rings = 16;
+        struct shm_ring_producer *p = dbus_open_ring();
+        ASSERT(p);
+
+        struct dbus_notification *n_dbus = dbus_notification_new();
+        n_dbus->app_name = "dunstteststack";
+        n_dbus->app_icon = "NONE";
+        n_dbus->summary = "test_open_ring";
+
+        // The body of the last one doesn't fit into a slot
+        char *long_body = g_strnfill(4 * RING_SLOT_SIZE, 'x');
+        const char *bodies[] = { "first", "second", long_body };
+        guint len = queues_length_waiting();
+        for (int i = 0; i < G_N_ELEMENTS(bodies); i++) {
+                n_dbus->body = bodies[i];
+                GVariant *message = g_variant_ref_sink(dbus_notification_to_variant(n_dbus));
+                ASSERT(shm_ring_producer_push(p, message));
+                g_variant_unref(message);
+        }
+        ASSERT(wait_for_waiting(len + G_N_ELEMENTS(bodies)));
+
+        // The ids got assigned in order, so the ones from the ring are
+        // right before the next one
+        n_dbus->body = "after the ring";
+        guint after;
+        ASSERT(dbus_notification_fire(n_dbus, &after));
+
+        GVariantBuilder close_ids;
+        g_variant_builder_init(&close_ids, G_VARIANT_TYPE("(au)"));
+        g_variant_builder_open(&close_ids, G_VARIANT_TYPE("au"));
+        for (int i = 0; i < G_N_ELEMENTS(bodies); i++) {
+                guint id = after - G_N_ELEMENTS(bodies) + i;
+                struct notification *n = queues_debug_find_notification_by_id(id);
+                ASSERT(n);
+                ASSERT_STR_EQ(bodies[i], n->body);
+                g_variant_builder_add(&close_ids, "u", id);
+        }
+        g_variant_builder_add(&close_ids, "u", after);
+        g_variant_builder_close(&close_ids);
+
+        GVariant *ret = dbus_invoke_ifac("CloseBatch", g_variant_builder_end(&close_ids), DUNST_IFAC);
+        ASSERT(ret);
+        ASSERT_EQ(len, queues_length_waiting());
+
+        g_variant_unref(ret);
+        g_free(long_body);
+        dbus_notification_free(n_dbus);
+        shm_ring_producer_free(p);
+        PASS();
+}
+
+TEST test_open_ring_limit(void)
+{
+        GDBusConnection *conn = dbus_new_client();
+        ASSERT(conn);
+        int shm_rings = settings.shm_rings;
+
+        settings.shm_rings = 0;
+        ASSERT_FALSE(dbus_open_ring_on(conn));
+
+        // A producer with several threads opens a ring for each of them,
+        // only the total is limited
+        struct shm_ring_producer *producers[3];
+        settings.shm_rings = g_slist_length(rings) + G_N_ELEMENTS(producers);
+        for (int i = 0; i < G_N_ELEMENTS(producers); i++) {
+                producers[i] = dbus_open_ring_on(conn);
+                ASSERT(producers[i]);
+        }
+        ASSERT_FALSE(dbus_open_ring_on(conn));
+
+        for (int i = 0; i < G_N_ELEMENTS(producers); i++)
+                shm_ring_producer_free(producers[i]);
+        // The rings get closed, once the client disconnects
+        g_dbus_connection_close_sync(conn, NULL, NULL);
+        g_object_unref(conn);
+        settings.shm_rings = shm_rings;
+        PASS();
+}
+
+TEST test_bench_ring(void)
+{
+        int rounds = 10000;
+        struct dbus_notification *n_dbus = dbus_notification_new();
+        n_dbus->app_name = "dunstteststack";
+        n_dbus->app_icon = "NONE";
+        n_dbus->body = "A body of a usual length, which fits into a slot";
+
+        // Unique summaries, so nothing gets stacked
+        GVariant **messages = g_malloc(2 * rounds * sizeof(GVariant *));
+        for (int i = 0; i < 2 * rounds; i++) {
+                char *summary = g_strdup_printf("test_bench_ring %d", i);
+                n_dbus->summary = summary;
+                messages[i] = g_variant_ref_sink(dbus_notification_to_variant(n_dbus));
+                g_free(summary);
+        }
+
+        guint expected = queues_length_waiting() + rounds;
+        gint64 start = g_get_monotonic_time();
+        for (int i = 0; i < rounds; i++)
+                g_variant_unref(dbus_invoke("Notify", messages[i]));
+        ASSERT(wait_for_waiting(expected));
+        double elapsed = (g_get_monotonic_time() - start) / 1e6;
+        printf("Notify over D-Bus: %f seconds for %d notifications\n", elapsed, rounds);
+
+        struct shm_ring_producer *p = dbus_open_ring();
+        ASSERT(p);
+        expected += rounds;
+        start = g_get_monotonic_time();
+        for (int i = rounds; i < 2 * rounds; i++)
+                dbus_ring_push(p, messages[i]);
+        ASSERT(wait_for_waiting(expected));
+        elapsed = (g_get_monotonic_time() - start) / 1e6;
+        printf("Shared memory ring: %f seconds for %d notifications\n", elapsed, rounds);
+
+        for (int i = 0; i < 2 * rounds; i++)
+                g_variant_unref(messages[i]);
+        g_free(messages);
+        shm_ring_producer_free(p);
+        dbus_notification_free(n_dbus);
+        PASS();
+}
+
 TEST test_get_fdn_daemon_info(void)
 {
         unsigned int pid_is;
@@ -798,6 +1465,135 @@ TEST test_get_fdn_daemon_info(void)
         PASS();
 }
 
+TEST test_hint_table_perfect(void)
+{
+        int known = 0;
+        for (int i = 0; i < G_N_ELEMENTS(hint_table); i++) {
+                if (!hint_table[i].name)
+                        continue;
+
+                ASSERT_EQ_FMT(i, (int) hint_hash(hint_table[i].name), "%d");
+                ASSERT_EQ(hint_table[i].key, hint_lookup(hint_table[i].name));
+                if (hint_table[i].key != HINT_IGNORED)
+                        known++;
+        }
+
+        // Every hint can be found
+        ASSERT_EQ(HINT_COUNT, known);
+        for (int i = 0; i < G_N_ELEMENTS(stack_tag_hints); i++)
+                ASSERT_EQ(HINT_STACK_TAG + i, hint_lookup(stack_tag_hints[i]));
+
+        ASSERT_EQ(-1, hint_lookup("x-unknown"));
+        ASSERT_EQ(-1, hint_lookup(""));
+        PASS();
+}
+
+TEST test_dbus_hints_decode(void)
+{
+        GVariantBuilder b;
+        g_variant_builder_init(&b, G_VARIANT_TYPE("a{sv}"));
+        g_variant_builder_add(&b, "{sv}", "x-unknown", g_variant_new_string("ignored"));
+        g_variant_builder_add(&b, "{sv}", "sender-pid", g_variant_new_int64(1234));
+        g_variant_builder_add(&b, "{sv}", "category", g_variant_new_string("first"));
+        g_variant_builder_add(&b, "{sv}", "category", g_variant_new_string("second"));
+        g_variant_builder_add(&b, "{sv}", "urgency", g_variant_new_string("wrong type"));
+        g_variant_builder_add(&b, "{sv}", "value", g_variant_new_uint32(42));
+        GVariant *hints = g_variant_ref_sink(g_variant_builder_end(&b));
+
+        struct dbus_hints decoded;
+        dbus_hints_decode(hints, &decoded);
+
+        // Only the first value counts, like with g_variant_lookup_value()
+        char *category = dbus_hints_dup_string(&decoded, HINT_CATEGORY);
+        ASSERT_STR_EQ("first", category);
+        ASSERT_FALSE(dbus_hints_get(&decoded, HINT_URGENCY, G_VARIANT_TYPE_BYTE));
+        ASSERT_FALSE(dbus_hints_dup_string(&decoded, HINT_DESKTOP_ENTRY));
+        ASSERT_EQ(42, dbus_hints_get_progress(&decoded));
+
+        g_free(category);
+        dbus_hints_clear(&decoded);
+        for (int i = 0; i < HINT_COUNT; i++)
+                ASSERT_FALSE(decoded.values[i]);
+        g_variant_unref(hints);
+        PASS();
+}
+
+/**
+ * The hints a typical notification comes with: those notify-send and
+ * libnotify add, a progress bar, a raw image and some vendor hints.
+ */
+static GVariant *bench_hints(void)
+{
+        int size = 48;
+        guchar *pixels = g_malloc0(size * size * 4);
+        GVariant *image = g_variant_new("(iiibii@ay)", size, size, size * 4, TRUE, 8, 4,
+                                        g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
+                                                                  pixels, size * size * 4, 1));
+        g_free(pixels);
+
+        GVariantBuilder b;
+        g_variant_builder_init(&b, G_VARIANT_TYPE("a{sv}"));
+        g_variant_builder_add(&b, "{sv}", "urgency", g_variant_new_byte(1));
+        g_variant_builder_add(&b, "{sv}", "sender-pid", g_variant_new_int64(4242));
+        g_variant_builder_add(&b, "{sv}", "desktop-entry", g_variant_new_string("org.example.Files"));
+        g_variant_builder_add(&b, "{sv}", "category", g_variant_new_string("transfer"));
+        g_variant_builder_add(&b, "{sv}", "x-kde-appname", g_variant_new_string("files"));
+        g_variant_builder_add(&b, "{sv}", "x-kde-origin-name", g_variant_new_string("example"));
+        g_variant_builder_add(&b, "{sv}", "x-dunst-stack-tag", g_variant_new_string("copy"));
+        g_variant_builder_add(&b, "{sv}", "value", g_variant_new_int32(42));
+        g_variant_builder_add(&b, "{sv}", "transient", g_variant_new_boolean(TRUE));
+        g_variant_builder_add(&b, "{sv}", "image-data", image);
+        return g_variant_ref_sink(g_variant_builder_end(&b));
+}
+
+/* All the lookups dbus_message_to_notification() did before */
+static int bench_hints_lookup(GVariant *hints)
+{
+        static const char *lookups[] = {
+                "urgency", "category", "desktop-entry", "value", "value",
+                "synchronous", "private-synchronous", "x-canonical-private-synchronous",
+                "x-dunst-stack-tag", "transient", "transient", "transient", "image-path",
+                "image-data", "image_data", "icon_data",
+                "fgcolor", "bgcolor", "frcolor", "hlcolor",
+        };
+        int found = 0;
+        for (int i = 0; i < G_N_ELEMENTS(lookups); i++) {
+                GVariant *value = g_variant_lookup_value(hints, lookups[i], NULL);
+                if (value) {
+                        found++;
+                        g_variant_unref(value);
+                }
+        }
+        return found;
+}
+
+TEST test_bench_hints_decode(void)
+{
+        GVariant *hints = bench_hints();
+        int rounds = 100000;
+        int found = 0;
+
+        clock_t start_time = clock();
+        for (int i = 0; i < rounds; i++)
+                found += bench_hints_lookup(hints);
+        double elapsed_time = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+        printf("Looking up every hint: %f seconds (%d)\n", elapsed_time, found);
+
+        found = 0;
+        start_time = clock();
+        for (int i = 0; i < rounds; i++) {
+                struct dbus_hints decoded;
+                dbus_hints_decode(hints, &decoded);
+                found += !!decoded.values[HINT_VALUE];
+                dbus_hints_clear(&decoded);
+        }
+        elapsed_time = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+        printf("Decoding in a single pass: %f seconds (%d)\n", elapsed_time, found);
+
+        g_variant_unref(hints);
+        PASS();
+}
+
 TEST assert_methodlists_sorted(void)
 {
         for (size_t i = 0; i+1 < G_N_ELEMENTS(methods_fdn); i++) {
@@ -917,6 +1713,9 @@ gpointer run_threaded_tests(gpointer data)
         RUN_TEST(test_invalid_notification);
         RUN_TEST(test_hint_transient);
         RUN_TEST(test_hint_progress);
+        RUN_TEST(test_progress_update_in_place);
+        RUN_TEST(test_progress_update_rules_changed);
+        RUN_TEST(test_progress_update_raw_icon);
         RUN_TEST(test_hint_icons);
         RUN_TEST(test_hint_category);
         RUN_TEST(test_hint_desktop_entry);
@@ -927,6 +1726,14 @@ gpointer run_threaded_tests(gpointer data)
         RUN_TESTp(test_server_caps, MARKUP_STRIP);
         RUN_TESTp(test_server_caps, MARKUP_NO);
         RUN_TEST(test_close_and_signal);
+        RUN_TEST(test_notify_batch);
+        RUN_TEST(test_notify_order_per_sender);
+        RUN_TEST(test_close_after_pending_notify);
+        RUN_TEST(test_get_stats);
+        RUN_TEST(test_history_signals);
+        RUN_TEST(test_peer_notify);
+        RUN_TEST(test_open_ring);
+        RUN_TEST(test_open_ring_limit);
         RUN_TEST(test_signal_actioninvoked);
         RUN_TEST(test_timeout_overflow);
         RUN_TEST(test_override_dbus_timeout);
@@ -934,6 +1741,14 @@ gpointer run_threaded_tests(gpointer data)
         RUN_TEST(test_timeout);
 
         RUN_TEST(assert_methodlists_sorted);
+        RUN_TEST(test_hint_table_perfect);
+        RUN_TEST(test_dbus_hints_decode);
+
+        bool bench = false;
+        if (bench) {
+                RUN_TEST(test_bench_hints_decode);
+                RUN_TEST(test_bench_ring);
+        }
 
         RUN_TEST(test_dbus_teardown);
         g_main_loop_quit(loop);
@@ -3,8 +3,6 @@
 #include "helpers.h"
 #include <cairo.h>
 
-cairo_t *c;
-
 double get_dummy_scale() { return 1; }
 
 const struct screen_info* noop_screen(void) {
@@ -23,7 +21,6 @@ const struct output dummy_output = {
         x_win_hide,
 
         x_display_surface,
-        x_win_get_context,
 
         noop_screen,
 
@@ -33,16 +30,22 @@ const struct output dummy_output = {
         get_dummy_scale,
 };
 
+struct scene dummy_scene = { .scale = 1 };
+
 GSList *get_dummy_layouts(GSList *notifications)
 {
-        GSList *layouts = NULL;
-
         for (GSList *iter = notifications; iter; iter = iter->next) {
-                struct colored_layout *cl = layout_from_notification(c, iter->data);
-                layouts = g_slist_append(layouts, cl);
-
+                struct draw_item *item = draw_item_new(iter->data);
+                dummy_scene.items = g_slist_append(dummy_scene.items, item);
         }
-        return layouts;
+        return create_layouts(&dummy_scene);
+}
+
+void free_dummy_layouts(GSList *layouts)
+{
+        free_dummy_layouts(layouts);
+        g_slist_free_full(dummy_scene.items, draw_item_free);
+        dummy_scene.items = NULL;
 }
 
 int get_small_max_height()
@@ -94,9 +97,11 @@ TEST test_layout_from_notification(void)
         n->icon_position = ICON_LEFT;
         ASSERT(n->icon);
         n->text_to_render = g_strdup("");
-        struct colored_layout *cl = layout_from_notification(c, n);
+        struct draw_item *item = draw_item_new(n);
+        struct colored_layout *cl = layout_from_item(item, 0);
         ASSERT(cl->icon);
         free_colored_layout(cl);
+        draw_item_free(item);
         notification_unref(n);
         PASS();
 }
@@ -107,9 +112,11 @@ TEST test_layout_from_notification_icon_off(void)
         n->icon_position = ICON_OFF;
         ASSERT(n->icon);
         n->text_to_render = g_strdup("");
-        struct colored_layout *cl = layout_from_notification(c, n);
+        struct draw_item *item = draw_item_new(n);
+        struct colored_layout *cl = layout_from_item(item, 0);
         ASSERT_FALSE(cl->icon);
         free_colored_layout(cl);
+        draw_item_free(item);
         notification_unref(n);
         PASS();
 }
@@ -120,14 +127,90 @@ TEST test_layout_from_notification_no_icon(void)
         n->icon_position = ICON_LEFT;
         ASSERT_FALSE(n->icon);
         n->text_to_render = g_strdup("");
-        struct colored_layout *cl = layout_from_notification(c, n);
+        struct draw_item *item = draw_item_new(n);
+        struct colored_layout *cl = layout_from_item(item, 0);
+        ASSERT_FALSE(cl->icon);
+
+        free_colored_layout(cl);
+        draw_item_free(item);
+        notification_unref(n);
+        PASS();
+}
+
+TEST test_layout_reserves_icon_slot(void)
+{
+        struct notification *n = test_notification_with_icon("test", 10);
+        n->icon_position = ICON_LEFT;
+        n->text_to_render = g_strdup("");
+        struct draw_item *with_icon = draw_item_new(n);
+        struct colored_layout *expected = layout_from_item(with_icon, 0);
+
+        // the same notification, while its icon is still being loaded
+        struct draw_item *loading = draw_item_new(n);
+        cairo_surface_destroy(loading->icon);
+        loading->icon = NULL;
+        loading->icon_slot = get_icon_width(n->icon, 1);
+        struct colored_layout *cl = layout_from_item(loading, 0);
         ASSERT_FALSE(cl->icon);
 
+        struct dimensions dim = calculate_notification_dimensions(cl, 1);
+        struct dimensions dim_expected = calculate_notification_dimensions(expected, 1);
+        ASSERT_EQ(dim_expected.w, dim.w);
+        ASSERT_EQ(dim_expected.h, dim.h);
+        ASSERT_EQ(layout_get_height(expected, 1), layout_get_height(cl, 1));
+
         free_colored_layout(cl);
+        free_colored_layout(expected);
+        draw_item_free(loading);
+        draw_item_free(with_icon);
         notification_unref(n);
         PASS();
 }
 
+TEST test_draw_item_is_snapshot(void)
+{
+        struct notification *n = test_notification_with_icon("test", 10);
+        n->text_to_render = g_strdup("before");
+        struct draw_item *item = draw_item_new(n);
+
+        // the item must not be affected by later changes of the notification
+        g_free(n->text_to_render);
+        n->text_to_render = g_strdup("after");
+        ASSERT_STR_EQ("before", item->text);
+
+        // the icon is shared, but owned by both
+        ASSERT_EQ(n->icon, item->icon);
+        notification_unref(n);
+        ASSERT_EQ(1, cairo_surface_get_reference_count(item->icon));
+
+        draw_item_free(item);
+        PASS();
+}
+
+TEST test_slot_swap(void)
+{
+        gpointer slot = NULL;
+        int a, b;
+
+        ASSERT_EQ(NULL, slot_swap(&slot, &a));
+        ASSERT_EQ(&a, slot_swap(&slot, &b));
+        ASSERT_EQ(&b, slot_swap(&slot, NULL));
+        ASSERT_EQ(NULL, slot);
+        PASS();
+}
+
+TEST test_measure_context_cached(void)
+{
+        PangoContext *ctx = output_get_measure_context(96);
+        ASSERT(ctx);
+        ASSERT_EQ(ctx, output_get_measure_context(96));
+
+        // changing the dpi updates the context in place
+        ASSERT_EQ(ctx, output_get_measure_context(192));
+        ASSERT_EQ(pango_cairo_context_get_resolution(ctx), 192);
+        PASS();
+}
+
 TEST test_calculate_dimensions_height_no_gaps(void)
 {
         int original_height = settings.height;
@@ -144,28 +227,28 @@ TEST test_calculate_dimensions_height_no_gaps(void)
         layout_count = 1;
         notifications = get_dummy_notifications(layout_count);
         layouts = get_dummy_layouts(notifications);
-        dim = calculate_dimensions(layouts);
+        dim = calculate_dimensions(layouts, &dummy_scene);
         expected_height = get_expected_dimension_height(layout_count);
         ASSERT(dim.h == expected_height);
-        g_slist_free_full(layouts, free_colored_layout);
+        free_dummy_layouts(layouts);
         g_slist_free_full(notifications, free_dummy_notification);
 
         layout_count = 2;
         notifications = get_dummy_notifications(layout_count);
         layouts = get_dummy_layouts(notifications);
-        dim = calculate_dimensions(layouts);
+        dim = calculate_dimensions(layouts, &dummy_scene);
         expected_height = get_expected_dimension_height(layout_count);
         ASSERT(dim.h == expected_height);
-        g_slist_free_full(layouts, free_colored_layout);
+        free_dummy_layouts(layouts);
         g_slist_free_full(notifications, free_dummy_notification);
 
         layout_count = 3;
         notifications = get_dummy_notifications(layout_count);
         layouts = get_dummy_layouts(notifications);
-        dim = calculate_dimensions(layouts);
+        dim = calculate_dimensions(layouts, &dummy_scene);
         expected_height = get_expected_dimension_height(layout_count);
         ASSERT(dim.h == expected_height);
-        g_slist_free_full(layouts, free_colored_layout);
+        free_dummy_layouts(layouts);
         g_slist_free_full(notifications, free_dummy_notification);
 
         settings.gap_size = orginal_gap_size;
@@ -190,29 +273,29 @@ TEST test_calculate_dimensions_height_gaps(void)
         layout_count = 1;
         notifications = get_dummy_notifications(layout_count);
         layouts = get_dummy_layouts(notifications);
-        dim = calculate_dimensions(layouts);
+        dim = calculate_dimensions(layouts, &dummy_scene);
         expected_height = get_expected_dimension_height(layout_count);
         ASSERT(dim.h == expected_height);
-        g_slist_free_full(layouts, free_colored_layout);
+        free_dummy_layouts(layouts);
         g_slist_free_full(notifications, free_dummy_notification);
 
         layout_count = 2;
         notifications = get_dummy_notifications(layout_count);
         layouts = get_dummy_layouts(notifications);
-        dim = calculate_dimensions(layouts);
+        dim = calculate_dimensions(layouts, &dummy_scene);
         expected_height = get_expected_dimension_height(layout_count);
         ASSERT(dim.h == expected_height);
-        g_slist_free_full(layouts, free_colored_layout);
+        free_dummy_layouts(layouts);
         g_slist_free_full(notifications, free_dummy_notification);
 
         layout_count = 3;
         notifications = get_dummy_notifications(layout_count);
         layouts = get_dummy_layouts(notifications);
-        dim = calculate_dimensions(layouts);
+        dim = calculate_dimensions(layouts, &dummy_scene);
         expected_height = get_expected_dimension_height(layout_count);
         ASSERT(dim.h == expected_height);
 
-        g_slist_free_full(layouts, free_colored_layout);
+        free_dummy_layouts(layouts);
         g_slist_free_full(notifications, free_dummy_notification);
         settings.gap_size = orginal_gap_size;
         settings.height = original_height;
@@ -237,7 +320,7 @@ TEST test_layout_render_no_gaps(void)
         layout_count = 3;
         notifications = get_dummy_notifications(layout_count);
         layouts = get_dummy_layouts(notifications);
-        dim = calculate_dimensions(layouts);
+        dim = calculate_dimensions(layouts, &dummy_scene);
         image_surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
 
         bool first = true;
@@ -245,7 +328,7 @@ TEST test_layout_render_no_gaps(void)
                 struct colored_layout *cl_this = iter->data;
                 struct colored_layout *cl_next = iter->next ? iter->next->data : NULL;
 
-                dim = layout_render(image_surface, cl_this, cl_next, dim, first, !cl_next);
+                dim = layout_render(image_surface, cl_this, cl_next, dim, first, !cl_next, dummy_scene.scale);
 
                 first = false;
         }
@@ -253,7 +336,7 @@ TEST test_layout_render_no_gaps(void)
         expected_y = get_expected_dimension_y_offset(layout_count);
         ASSERT(dim.y == expected_y);
 
-        g_slist_free_full(layouts, free_colored_layout);
+        free_dummy_layouts(layouts);
         g_slist_free_full(notifications, free_dummy_notification);
         cairo_surface_destroy(image_surface);
         settings.gap_size = orginal_gap_size;
@@ -279,20 +362,20 @@ TEST test_layout_render_gaps(void)
         layout_count = 3;
         notifications = get_dummy_notifications(layout_count);
         layouts = get_dummy_layouts(notifications);
-        dim = calculate_dimensions(layouts);
+        dim = calculate_dimensions(layouts, &dummy_scene);
         image_surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
 
         for (GSList *iter = layouts; iter; iter = iter->next) {
                 struct colored_layout *cl_this = iter->data;
                 struct colored_layout *cl_next = iter->next ? iter->next->data : NULL;
 
-                dim = layout_render(image_surface, cl_this, cl_next, dim, true, true);
+                dim = layout_render(image_surface, cl_this, cl_next, dim, true, true, dummy_scene.scale);
         }
 
         expected_y = get_expected_dimension_y_offset(layout_count);
         ASSERT(dim.y == expected_y);
 
-        g_slist_free_full(layouts, free_colored_layout);
+        free_dummy_layouts(layouts);
         g_slist_free_full(notifications, free_dummy_notification);
         cairo_surface_destroy(image_surface);
         settings.gap_size = orginal_gap_size;
@@ -301,19 +384,264 @@ TEST test_layout_render_gaps(void)
         PASS();
 }
 
+static bool surfaces_equal(cairo_surface_t *a, cairo_surface_t *b)
+{
+        cairo_surface_flush(a);
+        cairo_surface_flush(b);
+
+        int height = cairo_image_surface_get_height(a);
+        int stride = cairo_image_surface_get_stride(a);
+        if (height != cairo_image_surface_get_height(b)
+            || cairo_image_surface_get_width(a) != cairo_image_surface_get_width(b)
+            || stride != cairo_image_surface_get_stride(b))
+                return false;
+
+        return memcmp(cairo_image_surface_get_data(a),
+                      cairo_image_surface_get_data(b),
+                      (size_t) height * stride) == 0;
+}
+
+TEST test_render_scene_parallel_matches_serial(void)
+{
+        bool orginal_gap_size = settings.gap_size;
+        gint64 original_item_cost = render_item_cost;
+        // Make sure the tiles get rendered on the worker pool
+        render_item_cost = PARALLEL_RENDER_MIN_COST;
+        struct scene scene = { .scale = 1, .screen_width = 1920 };
+        GSList *notifications = get_dummy_notifications(5);
+
+        for (GSList *iter = notifications; iter; iter = iter->next)
+                scene.items = g_slist_append(scene.items, draw_item_new(iter->data));
+
+        int gaps[] = { 0, 10 };
+        for (int i = 0; i < G_N_ELEMENTS(gaps); i++) {
+                settings.gap_size = gaps[i];
+
+                struct dimensions dim_serial, dim_parallel;
+                gint64 cost;
+                int rendered;
+                cairo_surface_t *serial = render_scene_serial(&scene, &dim_serial);
+                cairo_surface_t *parallel = render_scene_tiles(&scene, 5, &dim_parallel, &rendered, &cost);
+
+                ASSERT_EQ(5, rendered);
+
+                ASSERT_EQ(dim_serial.w, dim_parallel.w);
+                ASSERT_EQ(dim_serial.h, dim_parallel.h);
+                ASSERT_EQ(dim_serial.y, dim_parallel.y);
+                ASSERT(surfaces_equal(serial, parallel));
+
+                cairo_surface_destroy(serial);
+                cairo_surface_destroy(parallel);
+        }
+
+        render_scene_forget();
+        g_slist_free_full(scene.items, draw_item_free);
+        g_slist_free_full(notifications, free_dummy_notification);
+        settings.gap_size = orginal_gap_size;
+        render_item_cost = original_item_cost;
+        PASS();
+}
+
+static struct scene *scene_from_notifications(GSList *notifications)
+{
+        struct scene *scene = g_malloc0(sizeof(struct scene));
+        scene->ref = 1;
+        scene->scale = 1;
+        scene->screen_width = 1920;
+
+        for (GSList *iter = notifications; iter; iter = iter->next) {
+                struct notification *n = iter->data;
+                scene->items = g_slist_append(scene->items, draw_item_new(n));
+                n->dirty = DIRTY_NONE;
+        }
+        return scene;
+}
+
+TEST test_render_scene_progress_only(void)
+{
+        bool original_progress_bar = settings.progress_bar;
+        settings.progress_bar = true;
+        GSList *notifications = get_dummy_notifications(3);
+
+        for (GSList *iter = notifications; iter; iter = iter->next)
+                ((struct notification *) iter->data)->progress = 10;
+        frame_free(render_scene(scene_from_notifications(notifications)));
+
+        ((struct notification *) notifications->next->data)->progress = 60;
+        struct scene *scene = scene_from_notifications(notifications);
+        ASSERT(scene_progress_only(last_scene, scene));
+
+        struct frame *frame = render_scene(scene);
+        struct dimensions dim;
+        cairo_surface_t *full = render_scene_serial(scene, &dim);
+        ASSERT_EQ(dim.h, frame->dim.h);
+        ASSERT(surfaces_equal(full, frame->srf));
+
+        // A different text needs a new layout
+        struct notification *first = notifications->data;
+        g_free(first->text_to_render);
+        first->text_to_render = g_strdup("Something else");
+        first->dirty |= DIRTY_TEXT;
+        struct scene *changed = scene_from_notifications(notifications);
+        ASSERT_FALSE(scene_progress_only(last_scene, changed));
+
+        scene_unref(changed);
+        cairo_surface_destroy(full);
+        frame_free(frame);
+        render_scene_forget();
+        g_slist_free_full(notifications, free_dummy_notification);
+        settings.progress_bar = original_progress_bar;
+        PASS();
+}
+
+static cairo_surface_t *last_tile_of(const struct notification *n)
+{
+        struct render_tile *tile = g_hash_table_lookup(last_tiles, GINT_TO_POINTER(n->id));
+        return tile ? tile->srf : NULL;
+}
+
+TEST test_render_scene_changed_only(void)
+{
+        GSList *notifications = get_dummy_notifications(3);
+        struct notification *first = notifications->data;
+        struct notification *second = notifications->next->data;
+        struct notification *third = notifications->next->next->data;
+        first->id = 1;
+        second->id = 2;
+        third->id = 3;
+
+        frame_free(render_scene(scene_from_notifications(notifications)));
+        cairo_surface_t *first_tile = last_tile_of(first);
+        cairo_surface_t *second_tile = last_tile_of(second);
+        cairo_surface_t *third_tile = last_tile_of(third);
+        ASSERT(first_tile);
+        ASSERT(second_tile);
+        ASSERT(third_tile);
+
+        // The notification below moves by the added line, the width stays
+        g_free(second->text_to_render);
+        second->text_to_render = g_strdup("dummy\nlayout");
+        second->dirty |= DIRTY_TEXT;
+        struct scene *scene = scene_from_notifications(notifications);
+        ASSERT_FALSE(scene_progress_only(last_scene, scene));
+
+        struct frame *frame = render_scene(scene);
+        ASSERT_EQ(first_tile, last_tile_of(first));
+        ASSERT(second_tile != last_tile_of(second));
+        ASSERT_EQ(third_tile, last_tile_of(third));
+
+        struct dimensions dim;
+        cairo_surface_t *full = render_scene_serial(scene, &dim);
+        ASSERT_EQ(dim.h, frame->dim.h);
+        ASSERT(surfaces_equal(full, frame->srf));
+
+        cairo_surface_destroy(full);
+        frame_free(frame);
+        render_scene_forget();
+        g_slist_free_full(notifications, free_dummy_notification);
+        PASS();
+}
+
+TEST test_scene_merge_dirty(void)
+{
+        GSList *notifications = get_dummy_notifications(2);
+        struct notification *first = notifications->data;
+        struct notification *second = notifications->next->data;
+
+        first->dirty = DIRTY_ICON;
+        second->dirty = DIRTY_NONE;
+        struct scene *stale = scene_from_notifications(notifications);
+
+        first->dirty = DIRTY_PROGRESS;
+        second->dirty = DIRTY_TEXT;
+        struct scene *scene = scene_from_notifications(notifications);
+
+        scene_merge_dirty(scene, stale);
+        ASSERT_EQ(DIRTY_ICON | DIRTY_PROGRESS, ((struct draw_item *) scene->items->data)->dirty);
+        ASSERT_EQ(DIRTY_TEXT, ((struct draw_item *) scene->items->next->data)->dirty);
+
+        scene_unref(stale);
+        scene_unref(scene);
+        g_slist_free_full(notifications, free_dummy_notification);
+        PASS();
+}
+
+TEST test_frame_blit_matches_fill(void)
+{
+        struct color frame = { 0.2, 0.4, 0.6, 1 };
+        struct color bg = { 0.1, 0.1, 0.1, 0.8 };
+        struct frame_geometry shapes[] = {
+                { 300, 60, 10, 5, 3, 3, 3, 3, true, true },
+                { 300, 60, 10, 5, 3, 3, 3, 2, true, false },
+                { 300, 60, 10, 5, 3, 3, 0, 3, false, true },
+                { 300, 60, 0, 0, 2, 2, 0, 2, false, false },
+                { 451, 91, 15, 11, 5, 4, 5, 4, true, true },
+                { 301, 45, 4, 0, 6, 6, 6, 6, true, true },
+        };
+
+        frame_tiles_clear();
+
+        for (int i = 0; i < G_N_ELEMENTS(shapes); i++) {
+                const struct frame_geometry *g = &shapes[i];
+                cairo_surface_t *filled = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 480, 120);
+                cairo_surface_t *blitted = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 480, 120);
+
+                cairo_t *c = cairo_create(filled);
+                cairo_set_operator(c, CAIRO_OPERATOR_ADD);
+                frame_fill(c, g, 7, 13, frame, bg);
+                cairo_destroy(c);
+
+                c = cairo_create(blitted);
+                cairo_set_operator(c, CAIRO_OPERATOR_ADD);
+                ASSERT(frame_blit(c, g, 7, 13, frame, bg));
+                cairo_destroy(c);
+
+                ASSERTm("Sliced background differs", surfaces_equal(filled, blitted));
+
+                cairo_surface_destroy(filled);
+                cairo_surface_destroy(blitted);
+        }
+
+        // Same shape and colours share their slices
+        ASSERT_EQ(G_N_ELEMENTS(shapes), g_hash_table_size(frame_tiles));
+
+        // Too small to be sliced
+        struct frame_geometry tiny = { 12, 12, 10, 5, 3, 3, 3, 3, true, true };
+        cairo_surface_t *srf = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 12, 12);
+        cairo_t *c = cairo_create(srf);
+        ASSERT_FALSE(frame_blit(c, &tiny, 0, 0, frame, bg));
+        cairo_destroy(c);
+        cairo_surface_destroy(srf);
+
+        frame_tiles_clear();
+        PASS();
+}
+
 SUITE(suite_draw)
 {
         output = &dummy_output;
-        cairo_surface_t *s = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
-        c = cairo_create(s);
 
         SHUFFLE_TESTS(time(NULL), {
                         RUN_TEST(test_layout_from_notification);
                         RUN_TEST(test_layout_from_notification_icon_off);
                         RUN_TEST(test_layout_from_notification_no_icon);
+                        RUN_TEST(test_layout_reserves_icon_slot);
+                        RUN_TEST(test_draw_item_is_snapshot);
+                        RUN_TEST(test_slot_swap);
+                        RUN_TEST(test_measure_context_cached);
                         RUN_TEST(test_calculate_dimensions_height_no_gaps);
                         RUN_TEST(test_calculate_dimensions_height_gaps);
                         RUN_TEST(test_layout_render_no_gaps);
                         RUN_TEST(test_layout_render_gaps);
+                        RUN_TEST(test_render_scene_parallel_matches_serial);
+                        RUN_TEST(test_frame_blit_matches_fill);
+                        RUN_TEST(test_render_scene_progress_only);
+                        RUN_TEST(test_render_scene_changed_only);
+                        RUN_TEST(test_scene_merge_dirty);
         });
+
+        if (render_pool)
+                g_thread_pool_free(render_pool, FALSE, TRUE);
+        output_free_measure_context();
+        frame_tiles_clear();
 }
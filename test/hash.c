@@ -0,0 +1,47 @@
+#include "../src/hash.c"
+#include "greatest.h"
+
+TEST test_hash_data_reference(void)
+{
+        // Reference values of the XXH64 implementation
+        ASSERT_EQ(G_GUINT64_CONSTANT(0xef46db3751d8e999), hash_data("", 0, 0));
+        ASSERT_EQ(G_GUINT64_CONSTANT(0xd24ec4f1a98c6e5b), hash_data("a", 1, 0));
+        ASSERT_EQ(G_GUINT64_CONSTANT(0x44bc2cf5ad770999), hash_data("abc", 3, 0));
+
+        const char *long_input = "Nobody inspects the spammish repetition";
+        ASSERT_EQ(G_GUINT64_CONSTANT(0xfbcea83c8a378bf1), hash_data(long_input, strlen(long_input), 0));
+        PASS();
+}
+
+TEST test_hash_update_chunked(void)
+{
+        unsigned char data[1000];
+        for (int i = 0; i < sizeof(data); i++)
+                data[i] = i * 7;
+
+        guint64 expected = hash_data(data, sizeof(data), 42);
+
+        // The chunk size must not influence the result
+        for (int chunk = 1; chunk <= 70; chunk++) {
+                struct hash_state state;
+                hash_init(&state, 42);
+                for (int offset = 0; offset < sizeof(data); offset += chunk)
+                        hash_update(&state, data + offset, MIN(chunk, sizeof(data) - offset));
+                ASSERT_EQ(expected, hash_digest(&state));
+        }
+        PASS();
+}
+
+TEST test_hash_seed(void)
+{
+        ASSERT(hash_data("abc", 3, 0) != hash_data("abc", 3, 1));
+        PASS();
+}
+
+SUITE(suite_hash)
+{
+        RUN_TEST(test_hash_data_reference);
+        RUN_TEST(test_hash_update_chunked);
+        RUN_TEST(test_hash_seed);
+}
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
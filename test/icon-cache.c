@@ -0,0 +1,212 @@
+#include "../src/icon-cache.c"
+#include "greatest.h"
+
+extern const char *base;
+
+static cairo_surface_t *test_surface(int width, int height)
+{
+        return cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+}
+
+TEST test_icon_cache_shares_surfaces(void)
+{
+        cairo_surface_t *srf = test_surface(16, 16);
+        icon_cache_put("shared", srf, false);
+
+        cairo_surface_t *cached = icon_cache_get("shared");
+        ASSERT_EQ(srf, cached);
+        // ours, the cache's and the one we just got
+        ASSERT_EQ(3, cairo_surface_get_reference_count(srf));
+
+        cairo_surface_destroy(cached);
+        cairo_surface_destroy(srf);
+        ASSERT_EQ(NULL, icon_cache_get("not cached"));
+
+        icon_cache_clear();
+        PASS();
+}
+
+TEST test_icon_cache_evicts_least_recently_used(void)
+{
+        int original_size = settings.icon_cache_size;
+        // Fits two 32x32 ARGB surfaces
+        settings.icon_cache_size = 8;
+
+        const char *keys[] = { "first", "second", "third" };
+        for (int i = 0; i < 2; i++) {
+                cairo_surface_t *srf = test_surface(32, 32);
+                icon_cache_put(keys[i], srf, false);
+                cairo_surface_destroy(srf);
+        }
+
+        // Use the first one, so the second one is the oldest now
+        cairo_surface_destroy(icon_cache_get("first"));
+
+        cairo_surface_t *srf = test_surface(32, 32);
+        icon_cache_put("third", srf, false);
+        cairo_surface_destroy(srf);
+
+        cairo_surface_t *first = icon_cache_get("first");
+        cairo_surface_t *second = icon_cache_get("second");
+        cairo_surface_t *third = icon_cache_get("third");
+        ASSERT(first);
+        ASSERT_FALSE(second);
+        ASSERT(third);
+        ASSERT_EQ(8 * 1024, icon_cache_size());
+
+        cairo_surface_destroy(first);
+        cairo_surface_destroy(third);
+        icon_cache_clear();
+        settings.icon_cache_size = original_size;
+        PASS();
+}
+
+TEST test_icon_cache_keeps_pinned(void)
+{
+        int original_size = settings.icon_cache_size;
+        settings.icon_cache_size = 0;
+
+        cairo_surface_t *srf = test_surface(32, 32);
+        icon_cache_put("unpinned", srf, false);
+        icon_cache_put("pinned", srf, true);
+        cairo_surface_destroy(srf);
+
+        ASSERT_FALSE(icon_cache_get("unpinned"));
+        srf = icon_cache_get("pinned");
+        ASSERT(srf);
+        cairo_surface_destroy(srf);
+
+        icon_cache_clear();
+        ASSERT_EQ(0, icon_cache_size());
+        settings.icon_cache_size = original_size;
+        PASS();
+}
+
+TEST test_icon_cache_load_file(void)
+{
+        char *path = g_strconcat(base, "/data/icons/valid.png", NULL); // 4x4
+
+        cairo_surface_t *a = icon_cache_load_file(path, 16, 16, 1);
+        cairo_surface_t *b = icon_cache_load_file(path, 16, 16, 1);
+        cairo_surface_t *c = icon_cache_load_file(path, 32, 32, 1);
+        ASSERT(a);
+        ASSERT(c);
+        ASSERT_EQ(a, b);
+        ASSERT(a != c);
+        ASSERT_EQ(32, cairo_image_surface_get_width(c));
+
+        ASSERT_FALSE(icon_cache_load_file("/does/not/exist.png", 16, 16, 1));
+
+        cairo_surface_destroy(a);
+        cairo_surface_destroy(b);
+        cairo_surface_destroy(c);
+        icon_cache_clear();
+        g_free(path);
+        PASS();
+}
+
+struct async_result {
+        int loaded;
+        int destroyed;
+        cairo_surface_t *srf;
+};
+
+static void async_loaded(cairo_surface_t *srf, gpointer data)
+{
+        struct async_result *res = data;
+        res->loaded++;
+        res->srf = srf ? cairo_surface_reference(srf) : NULL;
+}
+
+static void async_destroy(gpointer data)
+{
+        struct async_result *res = data;
+        res->destroyed++;
+}
+
+TEST test_icon_cache_load_file_async(void)
+{
+        char *path = g_strconcat(base, "/data/icons/valid.png", NULL);
+        struct async_result res = { 0 };
+
+        // Without the loader, the caller has to load the icon itself
+        ASSERT_FALSE(icon_cache_load_file_async(path, 16, 16, 1, async_loaded, &res, async_destroy));
+        ASSERT_EQ(0, res.destroyed);
+
+        icon_cache_loader_start();
+        ASSERT(icon_cache_load_file_async(path, 16, 16, 1, async_loaded, &res, async_destroy));
+        // The result only arrives on the main loop
+        ASSERT_EQ(0, res.loaded);
+        while (!res.destroyed)
+                g_main_context_iteration(NULL, TRUE);
+
+        ASSERT_EQ(1, res.loaded);
+        ASSERT(res.srf);
+        ASSERT_EQ(16, cairo_image_surface_get_width(res.srf));
+        cairo_surface_destroy(res.srf);
+
+        icon_cache_loader_stop();
+        icon_cache_clear();
+        g_free(path);
+        PASS();
+}
+
+TEST test_icon_cache_request_cancel(void)
+{
+        char *path = g_strconcat(base, "/data/icons/valid.png", NULL);
+        struct async_result res = { 0 };
+
+        icon_cache_loader_start();
+        struct icon_request *req = icon_cache_load_file_async(path, 16, 16, 1,
+                                                              async_loaded, &res,
+                                                              async_destroy);
+        ASSERT(req);
+        icon_cache_request_cancel(req);
+        while (!res.destroyed)
+                g_main_context_iteration(NULL, TRUE);
+
+        ASSERT_EQ(0, res.loaded);
+        ASSERT_EQ(1, res.destroyed);
+
+        icon_cache_loader_stop();
+        icon_cache_clear();
+        g_free(path);
+        PASS();
+}
+
+TEST test_icon_cache_loader_stop_frees_requests(void)
+{
+        char *path = g_strconcat(base, "/data/icons/valid.png", NULL);
+        struct async_result res = { 0 };
+
+        // Some requests are still queued, some wait for the main loop
+        icon_cache_loader_start();
+        for (int i = 0; i < 32; i++)
+                ASSERT(icon_cache_load_file_async(path, 16, 16, 1, async_loaded,
+                                                  &res, async_destroy));
+        icon_cache_loader_stop();
+
+        ASSERT_EQ(0, res.loaded);
+        ASSERT_EQ(32, res.destroyed);
+
+        // Nothing is left to finish them
+        while (g_main_context_iteration(NULL, FALSE));
+        ASSERT_EQ(0, res.loaded);
+        ASSERT_EQ(32, res.destroyed);
+
+        icon_cache_clear();
+        g_free(path);
+        PASS();
+}
+
+SUITE(suite_icon_cache)
+{
+        RUN_TEST(test_icon_cache_shares_surfaces);
+        RUN_TEST(test_icon_cache_evicts_least_recently_used);
+        RUN_TEST(test_icon_cache_keeps_pinned);
+        RUN_TEST(test_icon_cache_load_file);
+        RUN_TEST(test_icon_cache_load_file_async);
+        RUN_TEST(test_icon_cache_request_cancel);
+        RUN_TEST(test_icon_cache_loader_stop_frees_requests);
+}
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
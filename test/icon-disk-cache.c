@@ -0,0 +1,169 @@
+#include "../src/icon-disk-cache.c"
+#include "greatest.h"
+
+static char *test_dir = NULL;
+
+static cairo_surface_t *test_surface(int width, int height, guint32 pixel)
+{
+        cairo_surface_t *srf = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+        cairo_surface_flush(srf);
+        unsigned char *data = cairo_image_surface_get_data(srf);
+        int stride = cairo_image_surface_get_stride(srf);
+        for (int y = 0; y < height; y++)
+                for (int x = 0; x < width; x++)
+                        ((guint32 *) (data + y * stride))[x] = pixel;
+        cairo_surface_mark_dirty(srf);
+        return srf;
+}
+
+static bool surface_has_pixel(cairo_surface_t *srf, guint32 pixel)
+{
+        unsigned char *data = cairo_image_surface_get_data(srf);
+        int stride = cairo_image_surface_get_stride(srf);
+        for (int y = 0; y < cairo_image_surface_get_height(srf); y++)
+                for (int x = 0; x < cairo_image_surface_get_width(srf); x++)
+                        if (((guint32 *) (data + y * stride))[x] != pixel)
+                                return false;
+        return true;
+}
+
+static void setup_pack(void)
+{
+        settings.icon_disk_cache = true;
+        test_dir = g_dir_make_tmp("dunst-icon-disk-cache-XXXXXX", NULL);
+        pack_path = g_build_filename(test_dir, "icons.pack", NULL);
+}
+
+static void teardown_pack(void)
+{
+        g_unlink(pack_path);
+        g_rmdir(test_dir);
+        g_clear_pointer(&test_dir, g_free);
+        icon_disk_cache_deinit();
+        settings.icon_disk_cache = false;
+}
+
+TEST test_icon_disk_cache_roundtrip(void)
+{
+        setup_pack();
+
+        cairo_surface_t *a = test_surface(5, 3, 0xff102030);
+        cairo_surface_t *b = test_surface(7, 7, 0x80400000);
+        icon_disk_cache_put("a", a);
+        ASSERT_FALSE(icon_disk_cache_get("a"));
+        icon_disk_cache_flush();
+
+        // A second write has to keep the icons of the first one
+        icon_disk_cache_put("b", b);
+        icon_disk_cache_flush();
+        cairo_surface_destroy(a);
+        cairo_surface_destroy(b);
+
+        a = icon_disk_cache_get("a");
+        b = icon_disk_cache_get("b");
+        ASSERT(a);
+        ASSERT(b);
+        ASSERT_FALSE(icon_disk_cache_get("c"));
+
+        ASSERT_EQ(5, cairo_image_surface_get_width(a));
+        ASSERT_EQ(3, cairo_image_surface_get_height(a));
+        ASSERT(surface_has_pixel(a, 0xff102030));
+        ASSERT(surface_has_pixel(b, 0x80400000));
+
+        // The pixels are used right from the mapping
+        unsigned char *data = cairo_image_surface_get_data(a);
+        ASSERT(data >= current->data && data < current->data + current->size);
+
+        cairo_surface_destroy(a);
+        cairo_surface_destroy(b);
+        teardown_pack();
+        PASS();
+}
+
+TEST test_icon_disk_cache_disabled(void)
+{
+        setup_pack();
+        settings.icon_disk_cache = false;
+
+        cairo_surface_t *srf = test_surface(4, 4, 0xffffffff);
+        icon_disk_cache_put("icon", srf);
+        icon_disk_cache_flush();
+        cairo_surface_destroy(srf);
+
+        ASSERT_FALSE(g_file_test(pack_path, G_FILE_TEST_EXISTS));
+        ASSERT_FALSE(icon_disk_cache_get("icon"));
+
+        teardown_pack();
+        PASS();
+}
+
+TEST test_icon_disk_cache_rejects_garbage(void)
+{
+        setup_pack();
+
+        cairo_surface_t *srf = test_surface(16, 16, 0xffffffff);
+        icon_disk_cache_put("icon", srf);
+        icon_disk_cache_flush();
+        cairo_surface_destroy(srf);
+
+        char *data;
+        gsize size;
+        ASSERT(g_file_get_contents(pack_path, &data, &size, NULL));
+
+        // Cut the pack off before the end of the pixels
+        ASSERT(g_file_set_contents(pack_path, data, size - 1, NULL));
+        ASSERT_FALSE(icon_disk_cache_get("icon"));
+
+        ASSERT(g_file_set_contents(pack_path, "DUNSTIC1", 8, NULL));
+        ASSERT_FALSE(icon_disk_cache_get("icon"));
+
+        g_free(data);
+        teardown_pack();
+        PASS();
+}
+
+TEST test_icon_disk_cache_rejects_zero_stride(void)
+{
+        setup_pack();
+
+        // An entry, whose width is too large for any stride
+        const char *key = "icon";
+        struct {
+                struct pack_header header;
+                struct pack_entry entry;
+                char key[16];
+        } file = {
+                .header = { .n_entries = 1 },
+                .entry = {
+                        .hash = hash_data(key, strlen(key), 0),
+                        .data_offset = 0,
+                        .key_offset = sizeof(struct pack_header) + sizeof(struct pack_entry),
+                        .key_len = strlen(key),
+                        .format = CAIRO_FORMAT_ARGB32,
+                        .width = G_MAXINT32,
+                        .height = 1,
+                        .stride = 0,
+                },
+        };
+        memcpy(file.header.magic, PACK_MAGIC, sizeof(file.header.magic));
+        strcpy(file.key, key);
+        ASSERT(g_file_set_contents(pack_path, (char *) &file, sizeof(file), NULL));
+
+        struct pack *pack = pack_open(pack_path);
+        ASSERT(pack);
+        ASSERT_FALSE(pack_entry_is_valid(pack, &pack->entries[0]));
+        ASSERT_FALSE(pack_lookup(pack, key));
+        pack_unref(pack);
+
+        teardown_pack();
+        PASS();
+}
+
+SUITE(suite_icon_disk_cache)
+{
+        RUN_TEST(test_icon_disk_cache_roundtrip);
+        RUN_TEST(test_icon_disk_cache_disabled);
+        RUN_TEST(test_icon_disk_cache_rejects_garbage);
+        RUN_TEST(test_icon_disk_cache_rejects_zero_stride);
+}
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -0,0 +1,177 @@
+#include "../src/icon-index.c"
+#include "greatest.h"
+
+#include <glib/gstdio.h>
+
+static void touch(const char *dir, const char *filename)
+{
+        char *path = g_build_filename(dir, filename, NULL);
+        g_file_set_contents(path, "", 0, NULL);
+        g_free(path);
+}
+
+static void remove_file(const char *dir, const char *filename)
+{
+        char *path = g_build_filename(dir, filename, NULL);
+        g_unlink(path);
+        g_free(path);
+}
+
+TEST test_icon_index_has_file(void)
+{
+        char *dir = g_dir_make_tmp("dunst-icon-index-XXXXXX", NULL);
+        ASSERT(dir);
+        touch(dir, "edit.png");
+
+        ASSERT(icon_index_has_file(dir, "edit.png"));
+        ASSERT_FALSE(icon_index_has_file(dir, "edit.svg"));
+
+        // Changes have to show up without clearing the index
+        touch(dir, "edit.svg");
+        remove_file(dir, "edit.png");
+        ASSERT(icon_index_has_file(dir, "edit.svg"));
+        ASSERT_FALSE(icon_index_has_file(dir, "edit.png"));
+
+        remove_file(dir, "edit.svg");
+        g_rmdir(dir);
+        g_free(dir);
+        icon_index_clear();
+        PASS();
+}
+
+TEST test_icon_index_missing_dir(void)
+{
+        char *parent = g_dir_make_tmp("dunst-icon-index-XXXXXX", NULL);
+        ASSERT(parent);
+        char *dir = g_build_filename(parent, "apps", NULL);
+
+        ASSERT_FALSE(icon_index_has_file(dir, "edit.png"));
+
+        g_mkdir(dir, 0700);
+        touch(dir, "edit.png");
+        ASSERT(icon_index_has_file(dir, "edit.png"));
+
+        remove_file(dir, "edit.png");
+        g_rmdir(dir);
+        g_rmdir(parent);
+        g_free(dir);
+        g_free(parent);
+        icon_index_clear();
+        PASS();
+}
+
+TEST test_icon_index_missing_invalidated(void)
+{
+#ifndef __linux__
+        SKIPm("Misses are only remembered with inotify");
+#endif
+        char *dir = g_dir_make_tmp("dunst-icon-index-XXXXXX", NULL);
+        ASSERT(dir);
+
+        ASSERT_FALSE(icon_index_has_file(dir, "edit.png"));
+        icon_index_remember_missing("edit");
+        ASSERT(icon_index_is_missing("edit"));
+        ASSERT_FALSE(icon_index_is_missing("other"));
+
+        // A new icon might satisfy any miss
+        touch(dir, "edit.png");
+        ASSERT_FALSE(icon_index_is_missing("edit"));
+
+        remove_file(dir, "edit.png");
+        g_rmdir(dir);
+        g_free(dir);
+        icon_index_clear();
+        PASS();
+}
+
+TEST test_icon_index_missing_bounded(void)
+{
+#ifndef __linux__
+        SKIPm("Misses are only remembered with inotify");
+#endif
+        for (int i = 0; i <= MISSING_MAX; i++) {
+                char *key = g_strdup_printf("icon-%d", i);
+                icon_index_remember_missing(key);
+                g_free(key);
+        }
+
+        ASSERT_EQ(MISSING_MAX, g_hash_table_size(missing));
+        ASSERT_FALSE(icon_index_is_missing("icon-0"));
+        ASSERT(icon_index_is_missing("icon-1"));
+        ASSERT(icon_index_is_missing("icon-512"));
+
+        icon_index_clear();
+        PASS();
+}
+
+TEST test_icon_index_missing_nested_dir(void)
+{
+#ifndef __linux__
+        SKIPm("Misses are only remembered with inotify");
+#endif
+        char *parent = g_dir_make_tmp("dunst-icon-index-XXXXXX", NULL);
+        ASSERT(parent);
+        char *theme = g_build_filename(parent, "gnome", NULL);
+        // Like the default icon_path, with a trailing slash
+        char *dir = g_build_filename(theme, "16x16", "status", "/", NULL);
+
+        ASSERT_FALSE(icon_index_is_missing("edit"));
+        ASSERT_FALSE(icon_index_has_file(dir, "edit.png"));
+        icon_index_remember_missing("edit");
+        ASSERT(icon_index_is_missing("edit"));
+
+        // The directory is remembered as missing, it's watched through
+        // the temporary directory
+        struct icon_dir *d = g_hash_table_lookup(dirs, dir);
+        ASSERT(d);
+        ASSERT(d->watched);
+        ASSERT_FALSE(d->files);
+
+        g_mkdir(theme, 0700);
+        ASSERT_FALSE(icon_index_is_missing("edit"));
+
+        g_rmdir(theme);
+        g_rmdir(parent);
+        g_free(dir);
+        g_free(theme);
+        g_free(parent);
+        icon_index_clear();
+        PASS();
+}
+
+TEST test_icon_index_unwatched_lookup(void)
+{
+#ifndef __linux__
+        SKIPm("Misses are only remembered with inotify");
+#endif
+        char *dir = g_dir_make_tmp("dunst-icon-index-XXXXXX", NULL);
+        ASSERT(dir);
+
+        // Nested names aren't indexed, so their miss isn't remembered
+        ASSERT_FALSE(icon_index_is_missing("nested"));
+        ASSERT_FALSE(icon_index_has_file(dir, "apps/edit.png"));
+        icon_index_remember_missing("nested");
+        ASSERT_FALSE(icon_index_is_missing("nested"));
+
+        // But other lookups are still remembered
+        ASSERT_FALSE(icon_index_is_missing("edit"));
+        ASSERT_FALSE(icon_index_has_file(dir, "edit.png"));
+        icon_index_remember_missing("edit");
+        ASSERT(icon_index_is_missing("edit"));
+
+        g_rmdir(dir);
+        g_free(dir);
+        icon_index_clear();
+        PASS();
+}
+
+SUITE(suite_icon_index)
+{
+        RUN_TEST(test_icon_index_has_file);
+        RUN_TEST(test_icon_index_missing_dir);
+        RUN_TEST(test_icon_index_missing_invalidated);
+        RUN_TEST(test_icon_index_missing_bounded);
+        RUN_TEST(test_icon_index_missing_nested_dir);
+        RUN_TEST(test_icon_index_unwatched_lookup);
+}
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
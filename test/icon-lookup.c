@@ -1,5 +1,8 @@
 #include "greatest.h"
 #include "../src/icon-lookup.c"
+
+#include <utime.h>
+
 #include "helpers.h"
 #include "../src/notification.h"
 #include "../src/settings_data.h"
@@ -55,6 +58,52 @@ TEST test_find_icon(void)
         PASS();
 }
 
+TEST test_find_icon_with_cache(void)
+{
+        // Make sure the cache isn't considered outdated
+        char *cache_path = g_build_filename(base, ICONPREFIX, "theme", "icon-theme.cache", NULL);
+        ASSERT_EQ(0, utime(cache_path, NULL));
+        g_free(cache_path);
+
+        int theme_index = setup_test_theme();
+        ASSERT(icon_themes[theme_index].cache);
+        find_icon_test("edit", 8, "16x16", "actions", "edit.png");
+        find_icon_test("edit", 49, "32x32", "actions", "edit.png");
+        find_icon_test("preferences", 32, "16x16", "apps", "preferences.png");
+        ASSERT_FALSE(find_icon_path("does-not-exist", 16));
+        free_all_themes();
+        PASS();
+}
+
+TEST test_register_theme_lazily(void)
+{
+        theme_path = g_ptr_array_new_full(1, g_free);
+        g_ptr_array_add(theme_path, g_build_filename(base, ICONPREFIX, NULL));
+
+        int theme_index = register_icon_theme("theme");
+        ASSERT_EQ(theme_index, register_icon_theme("theme"));
+        ASSERT_EQ(THEME_UNLOADED, icon_themes[theme_index].state);
+        add_default_theme(theme_index);
+
+        find_icon_test("edit", 16, "16x16", "actions", "edit.png");
+        ASSERT_EQ(THEME_LOADED, icon_themes[theme_index].state);
+        // The inherited themes weren't needed yet
+        ASSERT_FALSE(icon_themes[theme_index].inherits_index);
+
+        GArray *dirs = g_hash_table_lookup(icon_themes[theme_index].size_dirs, GINT_TO_POINTER(16));
+        ASSERT(dirs);
+        ASSERT_EQ(4, dirs->len);
+
+        ASSERT_FALSE(find_icon_path("does-not-exist", 16));
+        ASSERT(icon_themes[theme_index].inherits_index);
+        int hicolor = get_icon_theme("hicolor");
+        ASSERT(hicolor >= 0);
+        ASSERT_EQ(THEME_FAILED, icon_themes[hicolor].state);
+
+        free_all_themes();
+        PASS();
+}
+
 TEST test_find_path(void)
 {
         setup_test_theme();
@@ -167,6 +216,8 @@ SUITE (suite_icon_lookup)
 {
         RUN_TEST(test_load_theme_from_dir);
         RUN_TEST(test_find_icon);
+        RUN_TEST(test_find_icon_with_cache);
+        RUN_TEST(test_register_theme_lazily);
         RUN_TEST(test_find_path);
         RUN_TEST(test_new_icon_overrides_raw_icon);
         bool bench = false;
@@ -0,0 +1,82 @@
+#include "../src/icon-theme-cache.c"
+#include "greatest.h"
+
+#include <glib/gstdio.h>
+
+extern const char *base;
+
+static char *test_cache_path(void)
+{
+        return g_build_filename(base, "data", "icons", "theme", "icon-theme.cache", NULL);
+}
+
+static int find_dir(const struct icon_theme_cache *cache, const char *name)
+{
+        for (int i = 0; i < icon_theme_cache_dir_count(cache); i++)
+                if (STR_EQ(icon_theme_cache_dir_name(cache, i), name))
+                        return i;
+        return -1;
+}
+
+TEST test_icon_theme_cache_lookup(void)
+{
+        char *path = test_cache_path();
+        struct icon_theme_cache *cache = icon_theme_cache_open_file(path);
+        ASSERT(cache);
+        ASSERT_EQ(8, icon_theme_cache_dir_count(cache));
+        ASSERT_FALSE(icon_theme_cache_dir_name(cache, 8));
+
+        guint16 flags[8] = { 0 };
+        ASSERT(icon_theme_cache_lookup(cache, "edit", flags));
+        ASSERT_EQ(ICON_THEME_CACHE_PNG, flags[find_dir(cache, "16x16/actions")]);
+        ASSERT_EQ(ICON_THEME_CACHE_PNG, flags[find_dir(cache, "32x32@2x/actions")]);
+        ASSERT_EQ(0, flags[find_dir(cache, "16x16/apps")]);
+
+        memset(flags, 0, sizeof(flags));
+        ASSERT(icon_theme_cache_lookup(cache, "preferences", flags));
+        ASSERT_EQ(ICON_THEME_CACHE_PNG, flags[find_dir(cache, "32x32/apps")]);
+        ASSERT_EQ(0, flags[find_dir(cache, "32x32/actions")]);
+
+        ASSERT_FALSE(icon_theme_cache_lookup(cache, "does-not-exist", flags));
+
+        icon_theme_cache_close(cache);
+        g_free(path);
+        PASS();
+}
+
+TEST test_icon_theme_cache_truncated(void)
+{
+        char *path = test_cache_path();
+        char *data;
+        gsize size;
+        ASSERT(g_file_get_contents(path, &data, &size, NULL));
+
+        char *tmp = g_build_filename(g_get_tmp_dir(), "dunst-test-icon-theme.cache", NULL);
+
+        // Cut the cache off at every position, nothing may read past the end
+        for (gsize len = 0; len < size; len += 4) {
+                ASSERT(g_file_set_contents(tmp, data, len, NULL));
+                struct icon_theme_cache *cache = icon_theme_cache_open_file(tmp);
+                if (!cache)
+                        continue;
+
+                guint16 flags[8] = { 0 };
+                icon_theme_cache_lookup(cache, "edit", flags);
+                for (int i = 0; i < 8; i++)
+                        icon_theme_cache_dir_name(cache, i);
+                icon_theme_cache_close(cache);
+        }
+
+        g_unlink(tmp);
+        g_free(tmp);
+        g_free(data);
+        g_free(path);
+        PASS();
+}
+
+SUITE(suite_icon_theme_cache)
+{
+        RUN_TEST(test_icon_theme_cache_lookup);
+        RUN_TEST(test_icon_theme_cache_truncated);
+}
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -1,5 +1,6 @@
 #include "../src/icon.c"
 #include "greatest.h"
+#include "helpers.h"
 
 #define DATAPREFIX "/data"
 #define ICONPATH "/data/icons/theme"
@@ -82,6 +83,184 @@ TEST test_icon_size_clamp_too_small_then_too_big(int min_icon_size, int max_icon
         PASS();
 }
 
+TEST test_icon_hash_ignores_spacers(void)
+{
+        // 2x2 RGB image, once without and once with garbage at the row ends
+        const unsigned char tight[] = { 1, 2, 3, 4, 5, 6,
+                                        7, 8, 9, 10, 11, 12 };
+        const unsigned char padded[] = { 1, 2, 3, 4, 5, 6, 0xde, 0xad,
+                                         7, 8, 9, 10, 11, 12 };
+        const unsigned char other[] = { 1, 2, 3, 4, 5, 6, 0xbe, 0xef,
+                                        7, 8, 9, 10, 11, 13 };
+
+        guint64 hash_tight = icon_hash_raw_data(tight, 2, 2, 6, false, 8, 3, 3);
+        guint64 hash_padded = icon_hash_raw_data(padded, 2, 2, 8, false, 8, 3, 3);
+        guint64 hash_other = icon_hash_raw_data(other, 2, 2, 8, false, 8, 3, 3);
+        guint64 hash_shape = icon_hash_raw_data(tight, 4, 1, 12, false, 8, 3, 3);
+
+        ASSERT_EQ(hash_tight, hash_padded);
+        ASSERT(hash_tight != hash_other);
+        ASSERT(hash_tight != hash_shape);
+        PASS();
+}
+
+TEST test_icon_get_for_data_cached(void)
+{
+        char *path = g_strconcat(base, "/data/icons/valid.png", NULL); // 4x4
+        GVariant *raw = g_variant_ref_sink(notification_setup_raw_image(path));
+        char *id_a = NULL, *id_b = NULL, *id_c = NULL;
+
+        cairo_surface_t *a = icon_get_for_data(raw, &id_a, 1, 16, 16);
+        cairo_surface_t *b = icon_get_for_data(raw, &id_b, 1, 16, 16);
+        ASSERT(a);
+        ASSERT_EQ(a, b);
+        ASSERT_STR_EQ(id_a, id_b);
+        ASSERT_EQ(16, cairo_image_surface_get_width(a));
+
+        // Same image, but another size
+        cairo_surface_t *c = icon_get_for_data(raw, &id_c, 1, 32, 32);
+        ASSERT(c);
+        ASSERT(a != c);
+        ASSERT_STR_EQ(id_a, id_c);
+        ASSERT_EQ(32, cairo_image_surface_get_width(c));
+
+        cairo_surface_destroy(a);
+        cairo_surface_destroy(b);
+        cairo_surface_destroy(c);
+        g_free(id_a);
+        g_free(id_b);
+        g_free(id_c);
+        g_variant_unref(raw);
+        g_free(path);
+        icon_cache_clear();
+        PASS();
+}
+
+static guint32 surface_pixel(cairo_surface_t *srf, int x, int y)
+{
+        cairo_surface_flush(srf);
+        unsigned char *row = cairo_image_surface_get_data(srf)
+                             + y * cairo_image_surface_get_stride(srf);
+        return ((guint32 *) row)[x];
+}
+
+TEST test_icon_downscale_raw_data(void)
+{
+        // 4x2 RGBA with 4 bytes of garbage at the end of each row, which
+        // gets halved in both directions
+        const unsigned char data[] = {
+                255, 0, 0, 255,   255, 0, 0, 255,   0, 0, 0, 0,   0, 0, 0, 0,   1, 2, 3, 4,
+                255, 0, 0, 255,   255, 0, 0, 255,   0, 255, 0, 0, 0, 0, 255, 0,   1, 2, 3, 4,
+                0, 0, 255, 255,   0, 0, 255, 255,   0, 255, 0, 255, 0, 255, 0, 128,
+        };
+
+        cairo_surface_t *srf = icon_downscale_raw_data(data, 4, 3, 20, true, 4, 2, 1);
+        ASSERT(srf);
+        ASSERT_EQ(2, cairo_image_surface_get_width(srf));
+        ASSERT_EQ(1, cairo_image_surface_get_height(srf));
+
+        // The box covers all 3 rows: 4 red and 2 blue opaque pixels
+        ASSERT_EQ_FMT(0xffaa0055, surface_pixel(srf, 0, 0), "%08x");
+        // The colour of fully transparent pixels must not bleed into the
+        // result: one opaque and one half transparent green pixel
+        ASSERT_EQ_FMT(0x40004000, surface_pixel(srf, 1, 0), "%08x");
+
+        cairo_surface_destroy(srf);
+        PASS();
+}
+
+/* The conversion as it was done before the integer kernels, with
+ * floating point premultiplication */
+static void pixel_row_reference(const unsigned char *src, unsigned char *dst, int width, int n_channels)
+{
+        for (int w = 0; w < width; w++) {
+                double alpha_factor = n_channels == 4 ? src[3] / (double)0xff : 1;
+                dst[CAIRO_R] = (unsigned char)(src[0] * alpha_factor + .5);
+                dst[CAIRO_G] = (unsigned char)(src[1] * alpha_factor + .5);
+                dst[CAIRO_B] = (unsigned char)(src[2] * alpha_factor + .5);
+                dst[CAIRO_A] = n_channels == 4 ? src[3] : 0xff;
+                dst += 4;
+                src += n_channels;
+        }
+}
+
+TEST test_premultiply_exact(void)
+{
+        for (int a = 0; a <= 0xff; a++) {
+                for (int c = 0; c <= 0xff; c++) {
+                        unsigned char expected = (unsigned char)(c * (a / (double)0xff) + .5);
+                        ASSERT_EQ_FMT(expected, premultiply(c, a), "%d");
+                }
+        }
+        PASS();
+}
+
+TEST test_pixel_kernels_bit_exact(const struct pixel_kernels *kernels, int n_channels)
+{
+        if (kernels->supported && !kernels->supported())
+                SKIPm(kernels->name);
+
+        GRand *rand = g_rand_new_with_seed(n_channels);
+
+        // cover all remainders of the vectorised loops
+        for (int width = 1; width <= 67; width++) {
+                unsigned char *src = g_malloc(width * n_channels);
+                unsigned char *expected = g_malloc(width * 4);
+                unsigned char *actual = g_malloc(width * 4);
+
+                for (int i = 0; i < width * n_channels; i++)
+                        src[i] = g_rand_int_range(rand, 0, 0x100);
+
+                pixel_row_reference(src, expected, width, n_channels);
+                if (n_channels == 3)
+                        kernels->rgb(src, actual, width);
+                else
+                        kernels->rgba(src, actual, width);
+
+                ASSERT_MEM_EQm(kernels->name, expected, actual, width * 4);
+
+                g_free(src);
+                g_free(expected);
+                g_free(actual);
+        }
+
+        g_rand_free(rand);
+        PASS();
+}
+
+TEST test_bench_pixel_kernels(void)
+{
+        // A screenshot sized image
+        int width = 3840, height = 2160;
+        unsigned char *src = g_malloc((size_t) width * height * 4);
+        unsigned char *dst = g_malloc((size_t) width * height * 4);
+        memset(src, 0x7f, (size_t) width * height * 4);
+
+        for (int i = 0; i < G_N_ELEMENTS(pixel_kernels_all); i++) {
+                const struct pixel_kernels *kernels = pixel_kernels_all[i];
+                if (kernels->supported && !kernels->supported())
+                        continue;
+
+                for (int n_channels = 3; n_channels <= 4; n_channels++) {
+                        clock_t start_time = clock();
+                        for (int h = 0; h < height; h++) {
+                                const unsigned char *row_src = src + (size_t) h * width * n_channels;
+                                unsigned char *row_dst = dst + (size_t) h * width * 4;
+                                if (n_channels == 3)
+                                        kernels->rgb(row_src, row_dst, width);
+                                else
+                                        kernels->rgba(row_src, row_dst, width);
+                        }
+                        double elapsed_time = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+                        printf("%s, %d channels: %f seconds\n", kernels->name, n_channels, elapsed_time);
+                }
+        }
+
+        g_free(src);
+        g_free(dst);
+        PASS();
+}
+
 SUITE(suite_icon)
 {
         // set only valid icons in the path
@@ -103,6 +282,20 @@ SUITE(suite_icon)
         RUN_TESTp(test_icon_size_clamp_not_necessary, 0, 100);
         RUN_TESTp(test_icon_size_clamp_too_big, 0, 100);
 
+        RUN_TEST(test_icon_hash_ignores_spacers);
+        RUN_TEST(test_icon_get_for_data_cached);
+        RUN_TEST(test_icon_downscale_raw_data);
+
+        RUN_TEST(test_premultiply_exact);
+        for (int i = 0; i < G_N_ELEMENTS(pixel_kernels_all); i++) {
+                RUN_TESTp(test_pixel_kernels_bit_exact, pixel_kernels_all[i], 3);
+                RUN_TESTp(test_pixel_kernels_bit_exact, pixel_kernels_all[i], 4);
+        }
+
+        bool bench = false;
+        if (bench)
+                RUN_TEST(test_bench_pixel_kernels);
+
         g_clear_pointer(&icon_path, g_free);
 }
 /* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
@@ -196,6 +196,62 @@ TEST test_notification_icon_scaling_notneeded(void)
         PASS();
 }
 
+TEST test_notification_icon_update_scale_data(void)
+{
+        struct notification *n = notification_load_icon_with_scaling(20, 100);
+        ASSERT_EQ(20, cairo_image_surface_get_width(n->icon));
+        char *id = g_strdup(n->icon_id);
+
+        notification_icon_update_scale(n, 2);
+        ASSERT_EQ(40, cairo_image_surface_get_width(n->icon));
+        ASSERT_EQ(20, get_icon_width(n->icon, 2));
+        ASSERT_STR_EQ(id, n->icon_id);
+
+        notification_icon_update_scale(n, 1);
+        ASSERT_EQ(20, cairo_image_surface_get_width(n->icon));
+
+        g_free(id);
+        notification_unref(n);
+        PASS();
+}
+
+TEST test_notification_icon_update_scale_without_source(void)
+{
+        struct notification *n = notification_load_icon_with_scaling(20, 100);
+        // The raw data isn't kept, only the icon rasterised from it
+        ASSERT_EQ(n->icon, n->priv->icon_source);
+        ASSERT_EQ(16, n->priv->icon_source_width);
+
+        // Like in the history
+        notification_icon_release_source(n);
+        ASSERT_FALSE(n->priv->icon_source);
+
+        notification_icon_update_scale(n, 2);
+        ASSERT_EQ(20, cairo_image_surface_get_width(n->icon));
+
+        notification_unref(n);
+        PASS();
+}
+
+TEST test_notification_icon_update_scale_path(void)
+{
+        struct notification *n = notification_create();
+        char *path = g_strconcat(base, "/data/icons/valid.png", NULL); // 4x4
+
+        n->min_icon_size = 16;
+        n->max_icon_size = 16;
+        notification_icon_replace_path(n, path);
+        ASSERT_EQ(16, cairo_image_surface_get_width(n->icon));
+
+        notification_icon_update_scale(n, 2);
+        ASSERT_EQ(32, cairo_image_surface_get_width(n->icon));
+        ASSERT_EQ(16, get_icon_height(n->icon, 2));
+
+        g_free(path);
+        notification_unref(n);
+        PASS();
+}
+
 TEST test_notification_format_message(struct notification *n, const char *format, const char *exp)
 {
         n->format = format;
@@ -241,6 +297,9 @@ SUITE(suite_notification)
         RUN_TEST(test_notification_icon_scaling_toolarge);
         RUN_TEST(test_notification_icon_scaling_notconfigured);
         RUN_TEST(test_notification_icon_scaling_notneeded);
+        RUN_TEST(test_notification_icon_update_scale_data);
+        RUN_TEST(test_notification_icon_update_scale_without_source);
+        RUN_TEST(test_notification_icon_update_scale_path);
 
         // TEST notification_format_message
         struct notification *a = notification_create();
@@ -127,6 +127,97 @@ TEST test_queue_insert_id_replacement(void)
         PASS();
 }
 
+TEST test_queue_insert_id_replacement_keeps_unchanged(void)
+{
+        struct notification *a, *b, *c;
+        queues_init();
+
+        a = test_notification_with_icon("a", -1);
+        g_free(a->iconname);
+        a->iconname = g_strdup("icon");
+        queues_notification_insert(a);
+        queues_update(STATUS_NORMAL, time_monotonic_now());
+        QUEUE_LEN_ALL(0, 1, 0);
+
+        // Pretend it got drawn
+        cairo_surface_t *icon = a->icon;
+        a->text_to_render = g_strdup("drawn");
+        a->dirty = DIRTY_NONE;
+
+        b = test_notification("a", -1);
+        g_free(b->iconname);
+        b->iconname = g_strdup("icon");
+        b->progress = 50;
+        b->id = a->id;
+        notification_ref(b);
+        queues_notification_insert(b);
+        QUEUE_LEN_ALL(0, 1, 0);
+
+        ASSERT_EQ(icon, b->icon);
+        ASSERT_STR_EQ("drawn", b->text_to_render);
+        ASSERT_EQ(DIRTY_PROGRESS, b->dirty);
+
+        b->dirty = DIRTY_NONE;
+        c = test_notification("c", -1);
+        g_free(c->iconname);
+        c->iconname = g_strdup("icon");
+        c->progress = 50;
+        c->id = b->id;
+        notification_ref(c);
+        queues_notification_insert(c);
+        QUEUE_LEN_ALL(0, 1, 0);
+
+        ASSERT_EQ(icon, c->icon);
+        ASSERT_EQ(DIRTY_TEXT, c->dirty & DIRTY_TEXT);
+        ASSERT_FALSE(c->dirty & DIRTY_PROGRESS);
+        ASSERT_FALSE(c->dirty & DIRTY_ICON);
+
+        notification_unref(b);
+        notification_unref(c);
+        queues_teardown();
+        PASS();
+}
+
+TEST test_queue_insert_id_replacement_script_fields(void)
+{
+        struct notification *a, *b, *c;
+        queues_init();
+
+        // Keep them waiting, so the script doesn't run on replace
+        a = test_notification("a", -1);
+        queues_notification_insert(a);
+        QUEUE_LEN_ALL(1, 0, 0);
+        a->script_run = true;
+
+        b = test_notification("a", -1);
+        b->progress = 50;
+        b->id = a->id;
+        notification_ref(b);
+        queues_notification_insert(b);
+        QUEUE_LEN_ALL(1, 0, 0);
+
+        ASSERT(b->script_run);
+
+        // Only the script sees the category, nothing to draw
+        b->dirty = DIRTY_NONE;
+        c = test_notification("a", -1);
+        c->progress = 50;
+        g_free(c->category);
+        c->category = g_strdup("other");
+        c->id = b->id;
+        notification_ref(c);
+        queues_notification_insert(c);
+        QUEUE_LEN_ALL(1, 0, 0);
+
+        ASSERT_FALSE(c->script_run);
+        ASSERT_EQ(DIRTY_NONE, c->dirty);
+
+        notification_unref(b);
+        notification_unref(c);
+        queues_teardown();
+        PASS();
+}
+
 TEST test_queue_notification_close(void)
 {
         struct notification *n;
@@ -994,6 +1085,8 @@ SUITE(suite_queues)
         RUN_TEST(test_queue_init);
         RUN_TEST(test_queue_insert_id_invalid);
         RUN_TEST(test_queue_insert_id_replacement);
+        RUN_TEST(test_queue_insert_id_replacement_keeps_unchanged);
+        RUN_TEST(test_queue_insert_id_replacement_script_fields);
         RUN_TEST(test_queue_insert_id_valid_newid);
         RUN_TEST(test_queue_length);
         RUN_TEST(test_queue_notification_close);
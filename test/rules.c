@@ -2,6 +2,7 @@
 
 #include "greatest.h"
 #include <regex.h>
+#include <time.h>
 
 extern const char *base;
 
@@ -77,6 +78,138 @@ TEST test_pattern_match(void) {
         PASS();
 }
 
+TEST test_rule_snapshot(void)
+{
+        struct rule *r = rule_new("test_rule_snapshot");
+        r->summary = "test_rule_snapshot";
+        r->urgency = URG_CRIT;
+
+        struct rule_snapshot *enabled = rule_snapshot_new();
+        r->enabled = false;
+        struct rule_snapshot *disabled = rule_snapshot_new();
+
+        struct notification *n = notification_create();
+        n->summary = g_strdup("test_rule_snapshot");
+
+        // Disabling the rule doesn't change the snapshot taken before
+        rule_snapshot_apply(enabled, n);
+        ASSERT_EQ(URG_CRIT, n->urgency);
+
+        n->urgency = URG_LOW;
+        rule_snapshot_apply(disabled, n);
+        ASSERT_EQ(URG_LOW, n->urgency);
+
+        rule_snapshot_free(enabled);
+        rule_snapshot_free(disabled);
+        notification_unref(n);
+        PASS();
+}
+
+TEST test_rule_compile(void)
+{
+        bool store = settings.enable_regex;
+        struct rule r = empty_rule;
+        struct notification *n = notification_create();
+        n->appname = g_strdup("dunst");
+        n->summary = g_strdup("Low battery");
+
+        settings.enable_regex = true;
+        r.appname = "uns";
+        r.summary = "^Low";
+        rule_compile(&r);
+        ASSERT(r.patterns[FILTER_APPNAME].literal);
+        ASSERT(r.patterns[FILTER_SUMMARY].valid);
+        ASSERT(rule_filters_match(&r, n));
+
+        // Invalid ones never match
+        r.summary = "(";
+        rule_compile(&r);
+        ASSERT_FALSE(r.patterns[FILTER_SUMMARY].valid);
+        ASSERT_FALSE(rule_filters_match(&r, n));
+
+        // Filters changed after compiling are still matched
+        r.summary = "battery$";
+        ASSERT(rule_filters_match(&r, n));
+        settings.enable_regex = false;
+        ASSERT_FALSE(rule_filters_match(&r, n));
+
+        r.appname = "dunst";
+        r.summary = "Low*";
+        rule_compile(&r);
+        ASSERT(r.patterns[FILTER_APPNAME].literal);
+        ASSERT_FALSE(r.patterns[FILTER_SUMMARY].literal);
+        ASSERT(rule_filters_match(&r, n));
+        r.appname = "duns";
+        rule_compile(&r);
+        ASSERT_FALSE(rule_filters_match(&r, n));
+
+        rule_patterns_free(&r);
+        notification_unref(n);
+        settings.enable_regex = store;
+        PASS();
+}
+
+TEST test_bench_rule_matching(void)
+{
+        bool store = settings.enable_regex;
+        settings.enable_regex = true;
+
+        // Every rule gets checked up to the last filter, which doesn't match
+        int count = 150;
+        struct rule *bench_rules = g_new(struct rule, count);
+        char **tags = g_new(char *, count);
+        for (int i = 0; i < count; i++) {
+                tags[i] = g_strdup_printf("^tag-%d$", i);
+                bench_rules[i] = empty_rule;
+                bench_rules[i].appname = "^(dunst|notify-send)$";
+                bench_rules[i].desktop_entry = "^org\\.";
+                bench_rules[i].summary = "[Bb]attery";
+                bench_rules[i].body = ".*";
+                bench_rules[i].icon = "^battery-.*$";
+                bench_rules[i].category = "device";
+                bench_rules[i].stack_tag = tags[i];
+        }
+
+        struct notification *n = notification_create();
+        n->appname = g_strdup("dunst");
+        n->desktop_entry = g_strdup("org.example.Power");
+        n->summary = g_strdup("Low battery");
+        n->body = g_strdup("10% remaining");
+        n->iconname = g_strdup("battery-caution");
+        n->category = g_strdup("device.warning");
+        n->stack_tag = g_strdup("battery");
+
+        int rounds = 100;
+        int found = 0;
+        clock_t start_time = clock();
+        for (int i = 0; i < rounds; i++)
+                for (int j = 0; j < count; j++)
+                        found += rule_filters_match(&bench_rules[j], n);
+        double elapsed_time = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+        printf("Compiling the regexes for every notification: %f seconds (%d)\n", elapsed_time, found);
+
+        for (int j = 0; j < count; j++)
+                rule_compile(&bench_rules[j]);
+
+        found = 0;
+        start_time = clock();
+        for (int i = 0; i < rounds; i++)
+                for (int j = 0; j < count; j++)
+                        found += rule_filters_match(&bench_rules[j], n);
+        elapsed_time = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+        printf("Matching the compiled regexes: %f seconds (%d)\n", elapsed_time, found);
+
+        for (int j = 0; j < count; j++) {
+                rule_patterns_free(&bench_rules[j]);
+                g_free(tags[j]);
+        }
+        g_free(tags);
+        g_free(bench_rules);
+        notification_unref(n);
+        settings.enable_regex = store;
+        PASS();
+}
+
 SUITE(suite_rules) {
         bool store = settings.enable_regex;
 
@@ -87,4 +220,12 @@ SUITE(suite_rules) {
         RUN_TEST(test_pattern_match);
 
         settings.enable_regex = store;
+
+        RUN_TEST(test_rule_snapshot);
+        RUN_TEST(test_rule_compile);
+
+        bool bench = false;
+        if (bench) {
+                RUN_TEST(test_bench_rule_matching);
+        }
 }
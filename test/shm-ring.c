@@ -0,0 +1,171 @@
+#include "../src/shm-ring.c"
+#include "greatest.h"
+
+struct received {
+        int count;
+        char *summaries[16];
+};
+
+static void collect(GVariant *message, gpointer data)
+{
+        struct received *r = data;
+        const char *summary;
+
+        g_variant_get_child(message, 3, "&s", &summary);
+        r->summaries[r->count++] = g_strdup(summary);
+}
+
+static void received_clear(struct received *r)
+{
+        for (int i = 0; i < r->count; i++)
+                g_free(r->summaries[i]);
+        r->count = 0;
+}
+
+static GVariant *message_new(const char *summary, gsize body_length)
+{
+        char *body = g_strnfill(body_length, 'x');
+        GVariant *message = g_variant_new("(susssasa{sv}i)", "dunstteststack", 0, "",
+                                          summary, body, NULL, NULL, -1);
+        g_free(body);
+        return g_variant_ref_sink(message);
+}
+
+static struct shm_ring_producer *producer_for(struct shm_ring *ring)
+{
+        return shm_ring_producer_new(dup(shm_ring_get_fd(ring)),
+                                     dup(shm_ring_get_doorbell(ring)));
+}
+
+static bool doorbell_rung(struct shm_ring *ring)
+{
+        guint64 value;
+        return read(shm_ring_get_doorbell(ring), &value, sizeof(value)) == sizeof(value);
+}
+
+TEST test_shm_ring_invalid_layout(void)
+{
+        ASSERT_FALSE(shm_ring_new(3, 256, 1024));
+        ASSERT_FALSE(shm_ring_new(4, 8, 1024));
+        ASSERT_FALSE(shm_ring_new(4, 256, 1000));
+        ASSERT_FALSE(shm_ring_new(1 << 20, 1 << 10, 1024));
+        PASS();
+}
+
+TEST test_shm_ring_push_drain(void)
+{
+        struct shm_ring *ring = shm_ring_new(4, 256, 4096);
+        ASSERT(ring);
+        struct shm_ring_producer *p = producer_for(ring);
+        ASSERT(p);
+        struct received r = { 0 };
+
+        GVariant *small = message_new("inline", 10);
+        GVariant *big = message_new("spilled", 1000);
+        ASSERT(shm_ring_producer_push(p, small));
+        ASSERT(shm_ring_producer_push(p, big));
+        ASSERT(doorbell_rung(ring));
+
+        ASSERT_EQ(2, shm_ring_drain(ring, 16, collect, &r));
+        ASSERT_EQ(2, r.count);
+        ASSERT_STR_EQ("inline", r.summaries[0]);
+        ASSERT_STR_EQ("spilled", r.summaries[1]);
+        received_clear(&r);
+
+        // The ring is empty, so the doorbell rings again for the next one
+        ASSERT_FALSE(doorbell_rung(ring));
+        ASSERT(shm_ring_producer_push(p, small));
+        ASSERT(doorbell_rung(ring));
+        ASSERT_EQ(1, shm_ring_drain(ring, 16, collect, &r));
+        received_clear(&r);
+
+        g_variant_unref(small);
+        g_variant_unref(big);
+        shm_ring_producer_free(p);
+        shm_ring_free(ring);
+        PASS();
+}
+
+TEST test_shm_ring_full(void)
+{
+        struct shm_ring *ring = shm_ring_new(4, 256, 2048);
+        struct shm_ring_producer *p = producer_for(ring);
+        struct received r = { 0 };
+        GVariant *small = message_new("small", 10);
+        GVariant *big = message_new("big", 1000);
+        GVariant *huge = message_new("huge", 4000);
+
+        // Too big for the spill area at all
+        ASSERT_FALSE(shm_ring_producer_push(p, huge));
+
+        for (int i = 0; i < 4; i++)
+                ASSERT(shm_ring_producer_push(p, small));
+        ASSERT_FALSE(shm_ring_producer_push(p, small));
+
+        // Only one batch is taken, the doorbell rings for the rest
+        doorbell_rung(ring);
+        ASSERT_EQ(3, shm_ring_drain(ring, 3, collect, &r));
+        ASSERT(doorbell_rung(ring));
+        ASSERT_EQ(1, shm_ring_drain(ring, 3, collect, &r));
+        received_clear(&r);
+
+        // The spill area wraps around without splitting messages
+        for (int round = 0; round < 8; round++) {
+                ASSERT(shm_ring_producer_push(p, big));
+                ASSERT(shm_ring_producer_push(p, small));
+                ASSERT_EQ(2, shm_ring_drain(ring, 16, collect, &r));
+                ASSERT_STR_EQ("big", r.summaries[0]);
+                ASSERT_STR_EQ("small", r.summaries[1]);
+                received_clear(&r);
+        }
+
+        g_variant_unref(small);
+        g_variant_unref(big);
+        g_variant_unref(huge);
+        shm_ring_producer_free(p);
+        shm_ring_free(ring);
+        PASS();
+}
+
+TEST test_shm_ring_corrupt(void)
+{
+        struct shm_ring *ring = shm_ring_new(4, 256, 2048);
+        struct shm_ring_producer *p = producer_for(ring);
+        struct received r = { 0 };
+        GVariant *small = message_new("small", 10);
+
+        ASSERT(shm_ring_producer_push(p, small));
+        struct shm_ring_slot *slot = shm_ring_slot_at(p->slots, p->slot_size, 0);
+        slot->length = 4096;
+        ASSERT_EQ(-1, shm_ring_drain(ring, 16, collect, &r));
+
+        // A head too far ahead of the tail
+        slot->length = g_variant_get_size(small);
+        p->hdr->head += 100;
+        ASSERT_EQ(-1, shm_ring_drain(ring, 16, collect, &r));
+        ASSERT_EQ(0, r.count);
+
+        g_variant_unref(small);
+        shm_ring_producer_free(p);
+        shm_ring_free(ring);
+        PASS();
+}
+
+TEST test_shm_ring_producer_rejects_other_files(void)
+{
+        int fd = memfd_create("not-a-ring", MFD_CLOEXEC);
+        ASSERT(fd >= 0);
+        ASSERT_EQ(0, ftruncate(fd, 4096));
+        ASSERT_FALSE(shm_ring_producer_new(fd, eventfd(0, EFD_CLOEXEC)));
+        PASS();
+}
+
+SUITE(suite_shm_ring)
+{
+        RUN_TEST(test_shm_ring_invalid_layout);
+        RUN_TEST(test_shm_ring_push_drain);
+        RUN_TEST(test_shm_ring_full);
+        RUN_TEST(test_shm_ring_corrupt);
+        RUN_TEST(test_shm_ring_producer_rejects_other_files);
+}
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
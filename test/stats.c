@@ -0,0 +1,129 @@
+#include "../src/stats.c"
+#include "greatest.h"
+
+TEST test_stats_bucket_bounds(void)
+{
+        // Small values are exact
+        for (guint32 v = 0; v < STATS_SUB_COUNT; v++)
+                ASSERT_EQ(v, stats_bucket_upper(stats_bucket(v)));
+
+        ASSERT_EQ(16, stats_bucket_upper(stats_bucket(16)));
+        ASSERT_EQ(1023, stats_bucket_upper(stats_bucket(1000)));
+        ASSERT_EQ(STATS_BUCKETS - 1, stats_bucket(G_MAXUINT32));
+        ASSERT_EQ(G_MAXUINT32, stats_bucket_upper(STATS_BUCKETS - 1));
+
+        // Every value falls into a bucket, whose bounds are close to it
+        for (guint32 v = 1; v < G_MAXUINT32 / 3; v = v * 3 + 1) {
+                guint b = stats_bucket(v);
+                guint64 upper = stats_bucket_upper(b);
+                ASSERT(upper >= v);
+                ASSERT(b == 0 || stats_bucket_upper(b - 1) < v);
+                ASSERT(upper - v <= v / STATS_SUB_COUNT);
+        }
+        PASS();
+}
+
+TEST test_stats_summary(void)
+{
+        struct stats_summary s;
+        stats_reset();
+
+        stats_histogram_summary(STATS_DRAW, &s);
+        ASSERT_EQ(0, s.count);
+        ASSERT_EQ(0, s.max);
+
+        for (int i = 1; i <= 100; i++)
+                stats_record(STATS_DRAW, i);
+        stats_record(STATS_DRAW, -5);
+
+        stats_histogram_summary(STATS_DRAW, &s);
+        ASSERT_EQ(101, s.count);
+        ASSERT_EQ(51, s.p50);
+        ASSERT_EQ(91, s.p90);
+        ASSERT_EQ(99, s.p99);
+        ASSERT_EQ(103, s.max);
+
+        // The other histograms stay untouched
+        stats_histogram_summary(STATS_PRESENT, &s);
+        ASSERT_EQ(0, s.count);
+        PASS();
+}
+
+struct bucket_sum {
+        guint64 count;
+        guint64 last;
+        bool ascending;
+};
+
+static void sum_buckets(guint64 upper, guint count, gpointer data)
+{
+        struct bucket_sum *sum = data;
+        if (sum->count && upper <= sum->last)
+                sum->ascending = false;
+        sum->count += count;
+        sum->last = upper;
+}
+
+TEST test_stats_foreach(void)
+{
+        struct bucket_sum sum = { .ascending = true };
+        stats_reset();
+
+        stats_record(STATS_LATENCY, 5000);
+        stats_record(STATS_LATENCY, 10);
+        stats_record(STATS_LATENCY, 5001);
+        stats_record(STATS_LATENCY, G_MAXINT64);
+
+        stats_histogram_foreach(STATS_LATENCY, sum_buckets, &sum);
+        ASSERT_EQ(4, sum.count);
+        ASSERT_EQ(G_MAXUINT32, sum.last);
+        ASSERT(sum.ascending);
+        PASS();
+}
+
+TEST test_stats_counters(void)
+{
+        stats_reset();
+
+        stats_count(STATS_INSERTED);
+        stats_count(STATS_INSERTED);
+        stats_count_close(REASON_USER);
+        stats_count_close(REASON_TIME);
+        stats_count_close(REASON_SIG);
+        stats_count_close(42);
+
+        ASSERT_EQ(2, stats_counter_get(STATS_INSERTED));
+        ASSERT_EQ(1, stats_counter_get(STATS_CLOSED_USER));
+        ASSERT_EQ(1, stats_counter_get(STATS_CLOSED_TIME));
+        ASSERT_EQ(1, stats_counter_get(STATS_CLOSED_SIG));
+        ASSERT_EQ(1, stats_counter_get(STATS_CLOSED_UNDEF));
+        ASSERT_EQ(0, stats_counter_get(STATS_REDRAWS));
+
+        stats_reset();
+        ASSERT_EQ(0, stats_counter_get(STATS_INSERTED));
+        PASS();
+}
+
+TEST test_stats_names(void)
+{
+        for (int h = 0; h < STATS_HISTOGRAM_COUNT; h++)
+                ASSERT(stats_histogram_name(h));
+        for (int c = 0; c < STATS_COUNTER_COUNT; c++)
+                ASSERT(stats_counter_name(c));
+
+        ASSERT_STR_EQ("latency", stats_histogram_name(STATS_LATENCY));
+        ASSERT_STR_EQ("closed_user", stats_counter_name(STATS_CLOSED_USER));
+        PASS();
+}
+
+SUITE(suite_stats)
+{
+        RUN_TEST(test_stats_bucket_bounds);
+        RUN_TEST(test_stats_summary);
+        RUN_TEST(test_stats_foreach);
+        RUN_TEST(test_stats_counters);
+        RUN_TEST(test_stats_names);
+
+        stats_reset();
+}
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */
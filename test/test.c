@@ -18,6 +18,9 @@ SUITE_EXTERN(suite_notification);
 SUITE_EXTERN(suite_markup);
 SUITE_EXTERN(suite_misc);
 SUITE_EXTERN(suite_icon);
+SUITE_EXTERN(suite_icon_cache);
+SUITE_EXTERN(suite_icon_disk_cache);
+SUITE_EXTERN(suite_icon_index);
 SUITE_EXTERN(suite_queues);
 SUITE_EXTERN(suite_dunst);
 SUITE_EXTERN(suite_log);
@@ -26,9 +29,14 @@ SUITE_EXTERN(suite_dbus);
 SUITE_EXTERN(suite_setting);
 SUITE_EXTERN(suite_ini);
 SUITE_EXTERN(suite_icon_lookup);
+SUITE_EXTERN(suite_icon_theme_cache);
 SUITE_EXTERN(suite_draw);
 SUITE_EXTERN(suite_rules);
 SUITE_EXTERN(suite_input);
+SUITE_EXTERN(suite_hash);
+SUITE_EXTERN(suite_shm_ring);
+SUITE_EXTERN(suite_stats);
+SUITE_EXTERN(suite_trace);
 
 GREATEST_MAIN_DEFS();
 
@@ -58,6 +66,9 @@ int main(int argc, char *argv[]) {
         RUN_SUITE(suite_markup);
         RUN_SUITE(suite_misc);
         RUN_SUITE(suite_icon);
+        RUN_SUITE(suite_icon_cache);
+        RUN_SUITE(suite_icon_disk_cache);
+        RUN_SUITE(suite_icon_index);
         RUN_SUITE(suite_queues);
         RUN_SUITE(suite_dunst);
         RUN_SUITE(suite_log);
@@ -66,9 +77,14 @@ int main(int argc, char *argv[]) {
         RUN_SUITE(suite_dbus);
         RUN_SUITE(suite_setting);
         RUN_SUITE(suite_icon_lookup);
+        RUN_SUITE(suite_icon_theme_cache);
         RUN_SUITE(suite_draw);
         RUN_SUITE(suite_rules);
         RUN_SUITE(suite_input);
+        RUN_SUITE(suite_hash);
+        RUN_SUITE(suite_shm_ring);
+        RUN_SUITE(suite_stats);
+        RUN_SUITE(suite_trace);
 
         base = NULL;
         g_free(config_path);
@@ -0,0 +1,127 @@
+#include "../src/trace.c"
+#include "greatest.h"
+
+#include <glib/gstdio.h>
+
+static int count_substr(const char *haystack, const char *needle)
+{
+        int count = 0;
+        for (const char *p = strstr(haystack, needle); p; p = strstr(p + 1, needle))
+                count++;
+        return count;
+}
+
+TEST test_trace_inactive(void)
+{
+        trace_stop();
+        ASSERT_FALSE(trace_is_active());
+
+        TRACE_BEGIN("test_trace_inactive");
+        TRACE_END("test_trace_inactive");
+
+        char *json = trace_to_json();
+        ASSERT_EQ(0, count_substr(json, "test_trace_inactive"));
+        g_free(json);
+        PASS();
+}
+
+TEST test_trace_events(void)
+{
+        trace_start();
+        ASSERT(trace_is_active());
+
+        TRACE_BEGIN("test_trace_events");
+        TRACE_END("test_trace_events");
+        trace_stop();
+
+        char *json = trace_to_json();
+        ASSERT(g_str_has_prefix(json, "{\"traceEvents\":["));
+        ASSERT_EQ(2, count_substr(json, "\"name\":\"test_trace_events\""));
+        ASSERT_EQ(1, count_substr(json, "\"name\":\"test_trace_events\",\"ph\":\"B\""));
+        ASSERT_EQ(1, count_substr(json, "\"name\":\"test_trace_events\",\"ph\":\"E\""));
+        g_free(json);
+
+        // Starting again forgets the events
+        trace_start();
+        trace_stop();
+        json = trace_to_json();
+        ASSERT_EQ(0, count_substr(json, "test_trace_events"));
+        g_free(json);
+        PASS();
+}
+
+static gpointer record_in_thread(gpointer data)
+{
+        TRACE_BEGIN("record_in_thread");
+        TRACE_END("record_in_thread");
+        return NULL;
+}
+
+TEST test_trace_threads(void)
+{
+        trace_start();
+
+        TRACE_BEGIN("test_trace_threads");
+        // The second thread reuses the buffer of the first one
+        for (int i = 0; i < 2; i++)
+                g_thread_join(g_thread_new("dunst-trace", record_in_thread, NULL));
+        TRACE_END("test_trace_threads");
+        trace_stop();
+
+        char *json = trace_to_json();
+        ASSERT_EQ(2, count_substr(json, "\"name\":\"test_trace_threads\""));
+        ASSERT_EQ(4, count_substr(json, "\"name\":\"record_in_thread\""));
+        // The name of the first one got dropped with its buffer
+        ASSERT_EQ(1, count_substr(json, "\"args\":{\"name\":\"dunst-trace\"}"));
+        g_free(json);
+        PASS();
+}
+
+TEST test_trace_wraps_around(void)
+{
+        trace_start();
+        for (int i = 0; i < TRACE_BUFFER_SIZE; i++) {
+                TRACE_BEGIN("test_trace_wraps_around");
+                TRACE_END("test_trace_wraps_around");
+        }
+        trace_stop();
+
+        // Only the latest events are kept
+        char *json = trace_to_json();
+        int count = count_substr(json, "\"name\":\"test_trace_wraps_around\"");
+        ASSERT(count < TRACE_BUFFER_SIZE);
+        ASSERT(count >= TRACE_BUFFER_SIZE - 1);
+        g_free(json);
+        PASS();
+}
+
+TEST test_trace_dump(void)
+{
+        char *path = g_strdup_printf("%s/dunst-test-trace-%d.json", g_get_tmp_dir(), getpid());
+
+        trace_start();
+        TRACE_BEGIN("test_trace_dump");
+        TRACE_END("test_trace_dump");
+        trace_stop();
+
+        ASSERT(trace_dump(path));
+
+        char *json;
+        ASSERT(g_file_get_contents(path, &json, NULL, NULL));
+        ASSERT_EQ(2, count_substr(json, "\"name\":\"test_trace_dump\""));
+        g_free(json);
+
+        g_unlink(path);
+        g_free(path);
+        PASS();
+}
+
+SUITE(suite_trace)
+{
+        RUN_TEST(test_trace_inactive);
+        RUN_TEST(test_trace_events);
+        RUN_TEST(test_trace_threads);
+        RUN_TEST(test_trace_wraps_around);
+        RUN_TEST(test_trace_dump);
+}
+/* vim: set tabstop=8 shiftwidth=8 expandtab textwidth=0: */